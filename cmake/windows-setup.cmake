@@ -57,6 +57,7 @@ set(FLB_OUT_RETRY              No)
 set(FLB_OUT_SPLUNK            Yes)
 set(FLB_OUT_STACKDRIVER        No)
 set(FLB_OUT_STDOUT            Yes)
+set(FLB_OUT_TCP                No)
 set(FLB_OUT_LIB                No)
 set(FLB_OUT_NULL              Yes)
 set(FLB_OUT_FLOWCOUNTER       Yes)
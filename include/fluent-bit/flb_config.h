@@ -115,6 +115,9 @@ struct flb_config {
 
     struct mk_event_loop *evl;          /* the event loop (mk_core) */
 
+    /* DNS resolver and cache shared by the upstreams */
+    struct flb_net_dns *dns;
+
     /* Proxies */
     struct mk_list proxies;
 
@@ -163,6 +166,11 @@ struct flb_config {
     struct mk_list sqldb_list;
 #endif
 
+    /* OAuth2 tokens shared by output instances */
+#ifdef FLB_HAVE_TLS
+    struct mk_list oauth2_tokens;
+#endif
+
     /* LuaJIT environment's context */
 #ifdef FLB_HAVE_LUAJIT
     struct mk_list luajit_list;
@@ -0,0 +1,69 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2019      The Fluent Bit Authors
+ *  Copyright (C) 2015-2018 Treasure Data Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef FLB_INPUT_BATCH_H
+#define FLB_INPUT_BATCH_H
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_sds.h>
+#include <msgpack.h>
+
+/* Default flush threshold for a batch: 64KB (hint) */
+#define FLB_INPUT_BATCH_SIZE  65536
+
+/*
+ * An input batch is a msgpack buffer owned by a plugin instance where the
+ * plugin pack records one by one. Instead of calling
+ * flb_input_chunk_append_raw() per message (record counting, chunk lookup,
+ * filters and stream processor for every single record), the records are
+ * accumulated and appended at once when the buffer reach 'flush_size' or
+ * when the plugin calls flb_input_batch_flush() at the end of its event
+ * callback.
+ *
+ * The internal buffer is reused across flushes.
+ *
+ * A batch owned by a thread other than the engine one must set 'cb_flush',
+ * the callback receives the batch and is responsible to hand its content
+ * to the engine thread.
+ */
+struct flb_input_batch {
+    int records;                    /* number of records in the buffer */
+    size_t flush_size;              /* flush when buffer exceeds it    */
+    flb_sds_t tag;                  /* tag for the records (optional)  */
+    msgpack_sbuffer mp_sbuf;        /* msgpack buffer                  */
+    msgpack_packer mp_pck;          /* msgpack packer                  */
+    struct flb_input_instance *in;  /* parent input instance           */
+
+    /* Optional flush callback */
+    int (*cb_flush) (struct flb_input_batch *, void *);
+    void *cb_data;
+};
+
+int flb_input_batch_init(struct flb_input_batch *batch,
+                         struct flb_input_instance *in, size_t flush_size);
+int flb_input_batch_set_tag(struct flb_input_batch *batch,
+                            char *tag, int tag_len);
+int flb_input_batch_commit(struct flb_input_batch *batch, int records);
+int flb_input_batch_append_raw(struct flb_input_batch *batch, int records,
+                               char *buf, size_t size);
+int flb_input_batch_flush(struct flb_input_batch *batch);
+void flb_input_batch_destroy(struct flb_input_batch *batch);
+
+#endif
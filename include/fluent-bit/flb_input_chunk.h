@@ -50,6 +50,10 @@ int flb_input_chunk_append_obj(struct flb_input_instance *in,
 int flb_input_chunk_append_raw(struct flb_input_instance *in,
                                char *tag, size_t tag_len,
                                void *buf, size_t buf_size);
+int flb_input_chunk_append_records(struct flb_input_instance *in,
+                                   int records,
+                                   char *tag, size_t tag_len,
+                                   void *buf, size_t buf_size);
 void *flb_input_chunk_flush(struct flb_input_chunk *ic, size_t *size);
 int flb_input_chunk_release_lock(struct flb_input_chunk *ic);
 int flb_input_chunk_get_tag(struct flb_input_chunk *ic,
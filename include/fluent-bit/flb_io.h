@@ -40,6 +40,7 @@
 
 /* Other features */
 #define FLB_IO_IPV6       16  /* network I/O uses IPv6                  */
+#define FLB_IO_TCP_KA     32  /* keep connections open after release    */
 
 int flb_io_net_connect(struct flb_upstream_conn *u_conn,
                        struct flb_thread *th);
@@ -22,6 +22,7 @@
 #define FLB_IO_TLS_H
 
 #include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_metrics.h>
 
 #ifdef FLB_HAVE_TLS
 
@@ -45,17 +46,25 @@ struct flb_tls_context {
     mbedtls_dhm_context dhm;
     mbedtls_entropy_context entropy;
     mbedtls_ctr_drbg_context ctr_drbg;
+
+    /* SSL configuration shared (read-only) by all the sessions */
+    int conf_set;
+    mbedtls_ssl_config conf;
 };
 
 /* TLS connected session */
 struct flb_tls_session {
     struct mbedtls_ssl_context ssl;
-    struct mbedtls_ssl_config conf;
 };
 
 /* TLS instance, library context + active sessions */
 struct flb_tls {
     struct flb_tls_context *context;
+
+#ifdef FLB_HAVE_METRICS
+    /* metrics of the owner output instance: handshakes and their time */
+    struct flb_metrics *metrics;
+#endif
 };
 
 struct flb_tls_context *flb_tls_context_new();
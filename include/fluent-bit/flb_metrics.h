@@ -37,6 +37,11 @@
 #define FLB_METRIC_OUT_ERROR          12
 #define FLB_METRIC_OUT_RETRY          13
 #define FLB_METRIC_OUT_RETRY_FAILED   14
+#define FLB_METRIC_OUT_CORO_NEW       15
+#define FLB_METRIC_OUT_CORO_REUSED    16
+#define FLB_METRIC_OUT_TLS_HANDSHAKES 17
+#define FLB_METRIC_OUT_TLS_RESUMED    18
+#define FLB_METRIC_OUT_TLS_HS_USEC    19
 
 struct flb_metric {
     int id;
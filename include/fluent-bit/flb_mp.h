@@ -25,5 +25,6 @@
 
 int flb_mp_count(void *data, size_t bytes);
 int flb_mp_count_zone(void *data, size_t bytes, msgpack_zone *zone);
+int flb_mp_validate_records(const char *data, size_t bytes);
 
 #endif
@@ -0,0 +1,97 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2019      The Fluent Bit Authors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef FLB_NET_DNS_H
+#define FLB_NET_DNS_H
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_sds.h>
+#include <fluent-bit/flb_socket.h>
+#include <fluent-bit/flb_thread.h>
+#include <monkey/mk_core.h>
+
+#include <time.h>
+#include <pthread.h>
+
+#define FLB_NET_DNS_RESOLV_CONF     "/etc/resolv.conf"
+#define FLB_NET_DNS_HOSTS           "/etc/hosts"
+
+#define FLB_NET_DNS_PORT            53
+#define FLB_NET_DNS_MAX_SERVERS     3      /* same as glibc MAXNS        */
+#define FLB_NET_DNS_MAX_SEARCH      6
+#define FLB_NET_DNS_MAX_ADDRS       8      /* addresses kept per name    */
+
+/* resolv.conf defaults, see resolv.conf(5) */
+#define FLB_NET_DNS_TIMEOUT         5
+#define FLB_NET_DNS_ATTEMPTS        2
+#define FLB_NET_DNS_NDOTS           1
+
+/* TTL used for names resolved by the system (/etc/hosts) */
+#define FLB_NET_DNS_SYSTEM_TTL      60
+
+/* A name resolved to a set of addresses, rotated on every lookup */
+struct flb_net_dns_entry {
+    flb_sds_t host;
+    int family;
+    int n_addrs;
+    int next;
+    time_t expire;
+    struct sockaddr_storage addrs[FLB_NET_DNS_MAX_ADDRS];
+    struct mk_list _head;
+};
+
+struct flb_net_dns {
+    /* resolv.conf */
+    int n_servers;
+    struct sockaddr_storage servers[FLB_NET_DNS_MAX_SERVERS];
+    socklen_t servers_len[FLB_NET_DNS_MAX_SERVERS];
+    int n_search;
+    flb_sds_t search[FLB_NET_DNS_MAX_SEARCH];
+    int timeout;
+    int attempts;
+    int ndots;
+
+    /* names listed in /etc/hosts, resolved through getaddrinfo() */
+    struct mk_list hosts;
+
+    /* cache shared by all upstreams */
+    pthread_mutex_t lock;
+    struct mk_list entries;
+
+    /*
+     * Queries waiting on the event loop: a one second timer expires the
+     * ones that got no answer and releases the finished ones.
+     */
+    struct mk_event_loop *evl;
+    struct mk_event timer;
+    int timer_fd;
+    uint16_t query_id;
+    struct mk_list queries;
+};
+
+struct flb_net_dns *flb_net_dns_create(const char *resolv_conf,
+                                       const char *hosts);
+void flb_net_dns_destroy(struct flb_net_dns *dns);
+int flb_net_dns_server_add(struct flb_net_dns *dns, const char *addr, int port);
+int flb_net_dns_lookup(struct flb_net_dns *dns, const char *host, int port,
+                       int family, struct mk_event_loop *evl,
+                       struct flb_thread *th,
+                       struct sockaddr_storage *addr, socklen_t *addr_len);
+
+#endif
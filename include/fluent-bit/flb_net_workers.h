@@ -0,0 +1,138 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2019      The Fluent Bit Authors
+ *  Copyright (C) 2015-2018 Treasure Data Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef FLB_NET_WORKERS_H
+#define FLB_NET_WORKERS_H
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_input.h>
+#include <fluent-bit/flb_input_batch.h>
+#include <fluent-bit/flb_pipe.h>
+#include <fluent-bit/flb_socket.h>
+#include <monkey/mk_core.h>
+
+#include <pthread.h>
+
+/*
+ * Network workers
+ * ===============
+ * A set of threads accepting and reading the connections of a TCP input
+ * plugin, or reading the datagrams of an UDP one. Every worker owns a
+ * socket bound with SO_REUSEPORT (or shares a single one if the option is
+ * not available) and an event loop where the plugin registers its
+ * connections.
+ *
+ * The plugin handlers run in the worker thread and pack the records into
+ * the worker batch; complete batches are put in a bounded queue and the
+ * engine thread is woken up through a channel, it appends them to the
+ * input instance in flb_net_workers_collect().
+ *
+ * When the queue is full a worker waits for the engine to make room, and
+ * while the input instance is paused the workers stop reading from their
+ * sockets, so the backpressure reaches the clients (or the UDP socket
+ * receive buffer).
+ */
+
+/* Max number of batches waiting for the engine thread */
+#define FLB_NET_WORKERS_QUEUE_MAX   64
+
+/* Socket types */
+#define FLB_NET_WORKERS_TCP         0
+#define FLB_NET_WORKERS_UDP         1
+
+/* Worker control channel messages */
+#define FLB_NET_WORKER_EXIT         1
+#define FLB_NET_WORKER_PAUSE        2
+#define FLB_NET_WORKER_RESUME       3
+
+struct flb_net_workers;
+
+struct flb_net_worker {
+    int id;
+    flb_sockfd_t server_fd;            /* listening or UDP socket         */
+    pthread_t tid;                     /* thread ID                       */
+    struct mk_event server_event;      /* event for the listening socket  */
+    struct mk_event ch_event;          /* event for the control channel   */
+    int ch_ctl[2];                     /* control channel                 */
+    struct mk_event_loop *evl;         /* worker event loop               */
+    struct flb_input_batch batch;      /* records decoded by this worker  */
+    struct mk_list connections;        /* plugin connections              */
+    void *data;                        /* plugin data of this worker      */
+    struct flb_net_workers *parent;
+    struct mk_list _head;
+};
+
+struct flb_net_workers {
+    int type;                          /* FLB_NET_WORKERS_TCP or _UDP     */
+    int count;                         /* number of workers               */
+    flb_sockfd_t server_fd;            /* shared socket (no SO_REUSEPORT) */
+    flb_pipefd_t ch_batches[2];        /* workers -> engine wake up       */
+
+    /* Batches queue, see FLB_NET_WORKERS_QUEUE_MAX */
+    pthread_mutex_t lock;
+    pthread_cond_t cond;               /* signaled when a batch is taken  */
+    int exit;                          /* workers must not wait anymore   */
+    int queue_len;
+    struct mk_list queue;
+
+    /*
+     * Plugin callbacks: cb_accept() runs in the worker thread for every new
+     * TCP connection, it must register the connection into worker->evl and
+     * close the file descriptor on error. cb_read() runs in the worker
+     * thread when the UDP socket has datagrams. cb_init() is invoked when
+     * the worker socket is ready, before the thread starts, and cb_exit()
+     * once the worker thread finished to release the connections and the
+     * worker data.
+     */
+    int (*cb_accept) (flb_sockfd_t, struct flb_net_worker *, void *);
+    void (*cb_read) (struct flb_net_worker *, void *);
+    int (*cb_init) (struct flb_net_worker *, void *);
+    void (*cb_exit) (struct flb_net_worker *, void *);
+    void *data;
+
+    struct flb_input_instance *in;
+    struct mk_list workers;
+};
+
+struct flb_net_workers *flb_net_workers_create(struct flb_input_instance *in,
+                                               char *listen, char *port,
+                                               int count,
+                                               int (*cb_accept) (flb_sockfd_t,
+                                                                 struct flb_net_worker *,
+                                                                 void *),
+                                               void (*cb_exit) (struct flb_net_worker *,
+                                                                void *),
+                                               void *data);
+struct flb_net_workers *flb_net_workers_create_udp(struct flb_input_instance *in,
+                                                   char *listen, char *port,
+                                                   int count,
+                                                   int (*cb_init) (struct flb_net_worker *,
+                                                                   void *),
+                                                   void (*cb_read) (struct flb_net_worker *,
+                                                                    void *),
+                                                   void (*cb_exit) (struct flb_net_worker *,
+                                                                    void *),
+                                                   void *data);
+int flb_net_workers_collect(struct flb_net_workers *ws);
+void flb_net_workers_pause(struct flb_net_workers *ws);
+void flb_net_workers_resume(struct flb_net_workers *ws);
+void flb_net_workers_destroy(struct flb_net_workers *ws);
+
+#endif
@@ -43,6 +43,8 @@ int flb_net_host_set(char *plugin_name, struct flb_net_host *host, char *address
 
 /* TCP options */
 int flb_net_socket_reset(flb_sockfd_t fd);
+int flb_net_socket_reuseport(flb_sockfd_t fd);
+int flb_net_socket_rcvbuf(flb_sockfd_t fd, int size);
 int flb_net_socket_tcp_nodelay(flb_sockfd_t fd);
 int flb_net_socket_nonblocking(flb_sockfd_t fd);
 int flb_net_socket_tcp_fastopen(flb_sockfd_t sockfd);
@@ -54,7 +56,9 @@ flb_sockfd_t flb_net_tcp_connect(char *host, unsigned long port);
 flb_sockfd_t flb_net_udp_connect(char *host, unsigned long port);
 int flb_net_tcp_fd_connect(flb_sockfd_t fd, char *host, unsigned long port);
 flb_sockfd_t flb_net_server(char *port, char *listen_addr);
+flb_sockfd_t flb_net_server_reuseport(char *port, char *listen_addr);
 flb_sockfd_t flb_net_server_udp(char *port, char *listen_addr);
+flb_sockfd_t flb_net_server_udp_reuseport(char *port, char *listen_addr);
 int flb_net_bind(flb_sockfd_t fd, const struct sockaddr *addr,
                  socklen_t addrlen, int backlog);
 int flb_net_bind_udp(flb_sockfd_t fd, const struct sockaddr *addr,
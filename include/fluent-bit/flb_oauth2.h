@@ -23,10 +23,19 @@
 
 #include <fluent-bit/flb_info.h>
 #include <fluent-bit/flb_sds.h>
+#include <monkey/mk_core.h>
+
+#include <pthread.h>
 
 #define FLB_OAUTH2_PORT          "443"
 #define FLB_OAUTH2_HTTP_ENCODING "application/x-www-form-urlencoded"
 
+/* Shared tokens are refreshed this number of seconds before expiration */
+#define FLB_OAUTH2_REFRESH_MARGIN 300
+
+/* Retry interval (seconds) after a failed refresh, doubled up to the margin */
+#define FLB_OAUTH2_REFRESH_RETRY  5
+
 struct flb_oauth2 {
     flb_sds_t auth_url;
     flb_sds_t payload;
@@ -56,6 +65,39 @@ struct flb_oauth2 {
     struct flb_upstream *u;
 };
 
+/*
+ * Shared token
+ * ============
+ * An access token used by the instances configured with the same
+ * credentials (same key). A background thread obtains a new token before
+ * the current one expires, so flushes only read the cached value.
+ *
+ * The token is requested through the cb_token() callback of one of the
+ * registered users, it must return a new oauth2 context holding a valid
+ * access token (or NULL on error).
+ */
+struct flb_oauth2_shared_user {
+    struct flb_oauth2 *(*cb_token) (void *);
+    void *data;
+    struct mk_list _head;
+};
+
+struct flb_oauth2_shared {
+    flb_sds_t key;                    /* credentials identifier   */
+    flb_sds_t access_token;           /* current token            */
+    time_t expires;                   /* token expiration time    */
+
+    int stop;
+    pthread_t tid;                    /* refresher thread         */
+    pthread_mutex_t lock;             /* token and stop flag      */
+    pthread_mutex_t users_lock;       /* users list and refreshes */
+    pthread_cond_t cond;
+
+    struct mk_list users;
+    struct flb_config *config;
+    struct mk_list _head;             /* link to config->oauth2_tokens */
+};
+
 struct flb_oauth2 *flb_oauth2_create(struct flb_config *config,
                                      char *auth_url, int expire_sec);
 void flb_oauth2_destroy(struct flb_oauth2 *ctx);
@@ -69,4 +111,11 @@ int flb_oauth2_token_expired(struct flb_oauth2 *ctx);
 int flb_oauth2_parse_json_response(char *json_data, size_t json_size,
                         struct flb_oauth2 *ctx);
 
+struct flb_oauth2_shared *flb_oauth2_shared_get(struct flb_config *config,
+                                                char *key,
+                                                struct flb_oauth2 *(*cb_token) (void *),
+                                                void *data);
+void flb_oauth2_shared_release(struct flb_oauth2_shared *s, void *data);
+flb_sds_t flb_oauth2_shared_token(struct flb_oauth2_shared *s);
+
 #endif
@@ -175,6 +175,16 @@ struct flb_output_instance {
      */
     struct mk_list th_queue;
 
+    /*
+     * Co-routines of finished flushes kept for reuse, so a new flush does
+     * not allocate a stack. The pool holds up to the peak number of flushes
+     * that ran at the same time (th_peak).
+     */
+    struct mk_list th_pool;
+    int th_pool_size;
+    int th_active;
+    int th_peak;
+
 #ifdef FLB_HAVE_TLS
     struct flb_tls tls;
 #else
@@ -218,8 +228,13 @@ struct flb_output_thread *flb_output_thread_get(int id, struct flb_task *task)
     return NULL;
 }
 
+struct flb_thread *flb_output_thread_pool_get(struct flb_output_instance *ins);
+int flb_output_thread_pool_put(struct flb_output_instance *ins,
+                               struct flb_thread *th);
+
 static FLB_INLINE int flb_output_thread_destroy_id(int id, struct flb_task *task)
 {
+    int ret;
     struct flb_output_thread *out_th;
     struct flb_thread *thread;
 
@@ -231,7 +246,11 @@ static FLB_INLINE int flb_output_thread_destroy_id(int id, struct flb_task *task
     mk_list_del(&out_th->_head);
     thread = out_th->parent;
 
-    flb_thread_destroy(thread);
+    /* A finished flush leaves its co-routine to the pool */
+    ret = flb_output_thread_pool_put(out_th->o_ins, thread);
+    if (ret == -1) {
+        flb_thread_destroy(thread);
+    }
     task->users--;
 
     return 0;
@@ -295,25 +314,42 @@ static FLB_INLINE void output_params_set(struct flb_thread *th,
 
 static FLB_INLINE void output_pre_cb_flush(void)
 {
-    void *data   = libco_param.data;
-    size_t bytes = libco_param.bytes;
-    char *tag    = libco_param.tag;
-    int tag_len  = libco_param.tag_len;
-    struct flb_input_instance *i_ins = libco_param.i_ins;
-    struct flb_output_plugin *out_p  = libco_param.out_plugin;
-    void *out_context                = libco_param.out_context;
-    struct flb_config *config        = libco_param.config;
-    struct flb_thread *th            = libco_param.th;
+    void *data;
+    size_t bytes;
+    char *tag;
+    int tag_len;
+    struct flb_input_instance *i_ins;
+    struct flb_output_plugin *out_p;
+    void *out_context;
+    struct flb_config *config;
+    struct flb_thread *th;
 
     /*
-     * Until this point the th->callee already set the variables, so we
-     * wait until the core wanted to resume so we really trigger the
-     * output callback.
+     * A pooled co-routine is parked in the yield of FLB_OUTPUT_RETURN(),
+     * when it's taken for a new flush it gets resumed once: the flush
+     * callback returns and the loop picks the new parameters.
      */
-    co_switch(th->caller);
-
-    /* Continue, we will resume later */
-    out_p->cb_flush(data, bytes, tag, tag_len, i_ins, out_context, config);
+    while (1) {
+        data        = libco_param.data;
+        bytes       = libco_param.bytes;
+        tag         = libco_param.tag;
+        tag_len     = libco_param.tag_len;
+        i_ins       = libco_param.i_ins;
+        out_p       = libco_param.out_plugin;
+        out_context = libco_param.out_context;
+        config      = libco_param.config;
+        th          = libco_param.th;
+
+        /*
+         * Until this point the th->callee already set the variables, so we
+         * wait until the core wanted to resume so we really trigger the
+         * output callback.
+         */
+        co_switch(th->caller);
+
+        /* Continue, we will resume later */
+        out_p->cb_flush(data, bytes, tag, tag_len, i_ins, out_context, config);
+    }
 }
 
 static FLB_INLINE
@@ -328,19 +364,42 @@ struct flb_thread *flb_output_thread(struct flb_task *task,
     struct flb_output_thread *out_th;
     struct flb_thread *th;
 
-    /* Create a new thread */
-    th = flb_thread_new(sizeof(struct flb_output_thread),
-                        cb_output_thread_destroy);
+    /* Take a co-routine from the pool or create a new one */
+    th = flb_output_thread_pool_get(o_ins);
     if (!th) {
-        return NULL;
+        th = flb_thread_new(sizeof(struct flb_output_thread),
+                            cb_output_thread_destroy);
+        if (!th) {
+            return NULL;
+        }
+
+        th->callee = co_create(config->coro_stack_size,
+                               output_pre_cb_flush, &stack_size);
+        if (!th->callee) {
+            flb_free(th);
+            return NULL;
+        }
+
+#ifdef FLB_HAVE_VALGRIND
+        th->valgrind_stack_id = VALGRIND_STACK_REGISTER(th->callee,
+                                                        ((char *)th->callee) + stack_size);
+#endif
+        flb_thread_stack_guard(th, stack_size);
+
+#ifdef FLB_HAVE_METRICS
+        if (o_ins->metrics) {
+            flb_metrics_sum(FLB_METRIC_OUT_CORO_NEW, 1, o_ins->metrics);
+        }
+#endif
+    }
+
+    o_ins->th_active++;
+    if (o_ins->th_active > o_ins->th_peak) {
+        o_ins->th_peak = o_ins->th_active;
     }
 
     /* Custom output-thread info */
     out_th = (struct flb_output_thread *) FLB_THREAD_DATA(th);
-    if (!out_th) {
-        flb_errno();
-        return NULL;
-    }
 
     /*
      * Each 'Thread' receives an 'id'. This is assigned when this thread
@@ -355,13 +414,6 @@ struct flb_thread *flb_output_thread(struct flb_task *task,
     out_th->parent  = th;
 
     th->caller = co_active();
-    th->callee = co_create(config->coro_stack_size,
-                           output_pre_cb_flush, &stack_size);
-
-#ifdef FLB_HAVE_VALGRIND
-    th->valgrind_stack_id = VALGRIND_STACK_REGISTER(th->callee,
-                                                    ((char *)th->callee) + stack_size);
-#endif
 
     /* Workaround for makecontext() */
     output_params_set(th,
@@ -42,6 +42,18 @@ struct flb_pack_state {
     jsmn_parser parser;   /* parser state            */
 };
 
+/* Resumable parser for a stream of JSON values */
+struct flb_pack_json_stream {
+    int ndjson;           /* newline delimited mode  */
+    int started;          /* value start was found   */
+    int depth;            /* nesting level           */
+    int in_string;        /* inside a string         */
+    int escape;           /* previous byte was '\'   */
+    size_t start;         /* current value start     */
+    size_t offset;        /* next byte to scan       */
+    struct flb_pack_state state;
+};
+
 int flb_json_tokenise(char *js, size_t len, struct flb_pack_state *state);
 int flb_pack_json(char *js, size_t len, char **buffer, size_t *size,
                   int *root_type);
@@ -53,6 +65,23 @@ int flb_pack_json_state(char *js, size_t len,
                         struct flb_pack_state *state);
 int flb_pack_json_valid(char *json, size_t len);
 
+int flb_pack_json_stream_init(struct flb_pack_json_stream *s, int ndjson);
+void flb_pack_json_stream_reset(struct flb_pack_json_stream *s);
+void flb_pack_json_stream_destroy(struct flb_pack_json_stream *s);
+int flb_pack_json_stream_next(struct flb_pack_json_stream *s,
+                              char *js, size_t len,
+                              char **value, size_t *value_len,
+                              int *root_type);
+size_t flb_pack_json_stream_processed(struct flb_pack_json_stream *s);
+void flb_pack_json_stream_consume(struct flb_pack_json_stream *s,
+                                  size_t bytes);
+int flb_pack_json_stream_pack(struct flb_pack_json_stream *s,
+                              char *value, size_t value_len,
+                              msgpack_packer *pck);
+int flb_pack_json_stream_record(struct flb_pack_json_stream *s,
+                                char *value, size_t value_len, int type,
+                                msgpack_packer *pck);
+
 void flb_pack_print(char *data, size_t bytes);
 int flb_msgpack_to_json(char *json_str, size_t str_len,
                         msgpack_object *obj);
@@ -61,6 +90,61 @@ int flb_msgpack_raw_to_json_str(char *buf, size_t buf_size,
                                 char **out_buf, size_t *out_size);
 flb_sds_t flb_msgpack_raw_to_json_sds(void *in_buf, size_t in_size);
 
+/* JSON encoder: layout of the records of a chunk */
+#define FLB_PACK_JSON_FORMAT_JSON    0   /* [{...}, {...}]   */
+#define FLB_PACK_JSON_FORMAT_STREAM  1   /* {...} {...}      */
+#define FLB_PACK_JSON_FORMAT_LINES   2   /* {...}\n{...}\n   */
+
+/* JSON encoder: format of the record date */
+#define FLB_PACK_JSON_DATE_DOUBLE    0   /* 1546300800.123456             */
+#define FLB_PACK_JSON_DATE_ISO8601   1   /* "2019-01-01T00:00:00.123456Z" */
+#define FLB_PACK_JSON_DATE_EPOCH     2   /* 1546300800                    */
+
+#define FLB_PACK_JSON_DATE_ISO8601_FMT "%Y-%m-%dT%H:%M:%S"
+
+/*
+ * Streaming JSON encoder: records are appended straight into a sds buffer.
+ * The context is owned by the caller (usually an output plugin instance)
+ * and keeps the settings and the date formatted for the last second.
+ */
+struct flb_pack_json_enc {
+    int format;                 /* FLB_PACK_JSON_FORMAT_*                */
+    int date_format;            /* FLB_PACK_JSON_DATE_*                  */
+    flb_sds_t date_key;         /* escaped "key": or NULL for no date    */
+
+    /* ISO8601: strftime() format of the seconds and fractional digits */
+    char *date_strftime;
+    int date_frac;
+
+    /* ISO8601: seconds part formatted for 'date_sec' */
+    time_t date_sec;
+    int date_cache_len;
+    char date_cache[64];
+
+    /*
+     * Optional hook to add fields to every record after the date. It must
+     * append "key":value pairs separated by ", " and return the number of
+     * pairs written or -1 on error.
+     */
+    int (*cb_fields) (flb_sds_t *buf, struct flb_time *tm,
+                      msgpack_object *map, void *data);
+    void *cb_data;
+};
+
+int flb_pack_json_enc_init(struct flb_pack_json_enc *enc, int format,
+                           int date_format, char *date_key);
+void flb_pack_json_enc_destroy(struct flb_pack_json_enc *enc);
+int flb_pack_json_enc_str(flb_sds_t *buf, char *str, size_t len);
+int flb_pack_json_enc_object(flb_sds_t *buf, msgpack_object *obj);
+int flb_pack_json_enc_date(struct flb_pack_json_enc *enc, flb_sds_t *buf,
+                           struct flb_time *tm);
+int flb_pack_json_enc_record(struct flb_pack_json_enc *enc, flb_sds_t *buf,
+                             struct flb_time *tm, msgpack_object *map);
+int flb_pack_json_enc_chunk(struct flb_pack_json_enc *enc, flb_sds_t *buf,
+                            void *data, size_t bytes);
+int flb_pack_to_json_format_type(char *str);
+int flb_pack_to_json_date_type(char *str);
+
 int flb_pack_time_now(msgpack_packer *pck);
 int flb_msgpack_expand_map(char *map_data, size_t map_size,
                            msgpack_object_kv **obj_arr, int obj_arr_len,
@@ -32,6 +32,7 @@
 #define FLB_PARSER_JSON  2
 #define FLB_PARSER_LTSV  3
 #define FLB_PARSER_LOGFMT 4
+#define FLB_PARSER_SYSLOG 5
 
 struct flb_parser_types {
     char *key;
@@ -39,6 +40,21 @@ struct flb_parser_types {
     int type;
 };
 
+/*
+ * A regex named group resolved when the parser is created: the capture
+ * is packed without looking up its name against the time key or the
+ * types list on every record.
+ */
+struct flb_parser_slot {
+    int group;            /* regex group number */
+    int type;             /* FLB_PARSER_TYPE_*, 0 if it's not casted */
+    int time_key;         /* the group holds the record time */
+    char *name;           /* group name (NULL terminated) */
+    int name_len;
+    char *key;            /* group name packed as a msgpack string */
+    int key_len;
+};
+
 struct flb_parser {
     /* configuration */
     int type;             /* parser type */
@@ -60,6 +76,8 @@ struct flb_parser {
     char *time_fmt_year;
     int time_with_tz;     /* do time_fmt consider a timezone ?  */
     struct flb_regex *regex;
+    struct flb_parser_slot *slots; /* regex named groups */
+    int slots_len;
     struct mk_list _head;
 };
 
@@ -100,6 +118,8 @@ void flb_parser_destroy(struct flb_parser *parser);
 struct flb_parser *flb_parser_get(char *name, struct flb_config *config);
 int flb_parser_do(struct flb_parser *parser, char *buf, size_t length,
                   void **out_buf, size_t *out_size, struct flb_time *out_time);
+int flb_parser_do_pack(struct flb_parser *parser, char *buf, size_t length,
+                       msgpack_packer *pck, struct flb_time *out_time);
 
 void flb_parser_exit(struct flb_config *config);
 int flb_parser_tzone_offset(char *str, int len, int *tmdiff);
@@ -112,4 +132,7 @@ int flb_parser_typecast(char *key, int key_len,
                         msgpack_packer *pck,
                         struct flb_parser_types *types,
                         int types_len);
+void flb_parser_typecast_value(char *key, int key_len,
+                               char *val, int val_len, int type,
+                               msgpack_packer *pck);
 #endif
@@ -56,6 +56,14 @@ int flb_regex_parse(struct flb_regex *r, struct flb_regex_search *result,
                                       unsigned char *, size_t,  /* value */
                                       void *),                  /* caller data */
                     void *data);
+int flb_regex_groups(struct flb_regex *r,
+                     int (*cb_group) (unsigned char *, size_t,  /* name  */
+                                      int,                      /* group */
+                                      void *),                  /* caller data */
+                     void *data);
+ssize_t flb_regex_group_get(struct flb_regex_search *result, int group,
+                            unsigned char **value, size_t *len);
+void flb_regex_search_release(struct flb_regex_search *result);
 int flb_regex_destroy(struct flb_regex *r);
 void flb_regex_exit();
 
@@ -0,0 +1,127 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2019      The Fluent Bit Authors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef FLB_SIMD_H
+#define FLB_SIMD_H
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/*
+ * A byte is 'clean' when it can be copied as it is inside a JSON string:
+ * printable ASCII except the double quote and the backslash. Control
+ * characters, DEL and the bytes of multibyte UTF-8 sequences take the
+ * slow path.
+ */
+static inline int flb_simd_json_clean(unsigned char c)
+{
+    return (c >= 0x20 && c < 0x7f && c != '"' && c != '\\');
+}
+
+/*
+ * Return the length of the leading run of clean bytes of 'str'. Logs are
+ * mostly plain ASCII, so callers copy the run in bulk and only inspect
+ * byte by byte what comes after it.
+ */
+static inline size_t flb_simd_json_clean_len(const char *str, size_t len)
+{
+    size_t i = 0;
+    uint64_t w;
+    uint64_t bad;
+    const uint64_t ones = 0x0101010101010101ULL;
+    const uint64_t high = 0x8080808080808080ULL;
+
+#if defined(__AVX2__)
+    uint32_t mask;
+    __m256i v;
+    __m256i bad32;
+    const __m256i ctl = _mm256_set1_epi8(0x20);
+    const __m256i del = _mm256_set1_epi8(0x7f);
+    const __m256i quote = _mm256_set1_epi8('"');
+    const __m256i bslash = _mm256_set1_epi8('\\');
+
+    for (; i + 32 <= len; i += 32) {
+        v = _mm256_loadu_si256((const __m256i *) (str + i));
+
+        /* signed compare: catches control chars and bytes >= 0x80 */
+        bad32 = _mm256_cmpgt_epi8(ctl, v);
+        bad32 = _mm256_or_si256(bad32, _mm256_cmpeq_epi8(v, del));
+        bad32 = _mm256_or_si256(bad32, _mm256_cmpeq_epi8(v, quote));
+        bad32 = _mm256_or_si256(bad32, _mm256_cmpeq_epi8(v, bslash));
+        mask = (uint32_t) _mm256_movemask_epi8(bad32);
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+#elif defined(__SSE2__)
+    uint32_t mask;
+    __m128i v;
+    __m128i bad16;
+    const __m128i ctl = _mm_set1_epi8(0x20);
+    const __m128i del = _mm_set1_epi8(0x7f);
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i bslash = _mm_set1_epi8('\\');
+
+    for (; i + 16 <= len; i += 16) {
+        v = _mm_loadu_si128((const __m128i *) (str + i));
+
+        /* signed compare: catches control chars and bytes >= 0x80 */
+        bad16 = _mm_cmplt_epi8(v, ctl);
+        bad16 = _mm_or_si128(bad16, _mm_cmpeq_epi8(v, del));
+        bad16 = _mm_or_si128(bad16, _mm_cmpeq_epi8(v, quote));
+        bad16 = _mm_or_si128(bad16, _mm_cmpeq_epi8(v, bslash));
+        mask = (uint32_t) _mm_movemask_epi8(bad16);
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+#endif
+
+    /*
+     * Portable path (and the tail of the vector ones): test 8 bytes at
+     * once, a word with any byte to escape is resolved byte by byte.
+     */
+    for (; i + 8 <= len; i += 8) {
+        memcpy(&w, str + i, 8);
+
+        /* bytes >= 0x80 or < 0x20 */
+        bad = w | ((w - ones * 0x20) & ~w);
+        /* bytes equal to '"', '\\' or DEL */
+        bad |= ((w ^ (ones * '"')) - ones) & ~(w ^ (ones * '"'));
+        bad |= ((w ^ (ones * '\\')) - ones) & ~(w ^ (ones * '\\'));
+        bad |= ((w ^ (ones * 0x7f)) - ones) & ~(w ^ (ones * 0x7f));
+        if (bad & high) {
+            break;
+        }
+    }
+
+    while (i < len && flb_simd_json_clean((unsigned char) str[i])) {
+        i++;
+    }
+
+    return i;
+}
+
+#endif
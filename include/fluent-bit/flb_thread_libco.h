@@ -36,12 +36,23 @@
 #include <valgrind/valgrind.h>
 #endif
 
+#ifdef FLB_HAVE_CORO_GUARD
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
 struct flb_thread {
 
 #ifdef FLB_HAVE_VALGRIND
     unsigned int valgrind_stack_id;
 #endif
 
+#ifdef FLB_HAVE_CORO_GUARD
+    /* protected page at the bottom of the stack, see flb_thread_stack_guard */
+    void *guard;
+#endif
+
     /* libco 'contexts' */
     cothread_t caller;
     cothread_t callee;
@@ -75,6 +86,33 @@ static FLB_INLINE void flb_thread_yield(struct flb_thread *th, int ended)
     co_switch(th->caller);
 }
 
+/*
+ * Debug builds with FLB_CORO_GUARD protect the lowest page of the co-routine
+ * stack (above the libco context storage), so an overflow faults right away
+ * instead of corrupting the heap.
+ */
+static FLB_INLINE void flb_thread_stack_guard(struct flb_thread *th,
+                                              size_t stack_size)
+{
+#ifdef FLB_HAVE_CORO_GUARD
+    size_t page;
+    uintptr_t addr;
+
+    page = sysconf(_SC_PAGESIZE);
+    addr = ((uintptr_t) th->callee + 512 + page - 1) & ~(page - 1);
+    if (addr + (2 * page) > (uintptr_t) th->callee + stack_size) {
+        return;
+    }
+
+    if (mprotect((void *) addr, page, PROT_NONE) == 0) {
+        th->guard = (void *) addr;
+    }
+#else
+    (void) th;
+    (void) stack_size;
+#endif
+}
+
 static FLB_INLINE void flb_thread_destroy(struct flb_thread *th)
 {
     if (th->cb_destroy) {
@@ -86,6 +124,12 @@ static FLB_INLINE void flb_thread_destroy(struct flb_thread *th)
     VALGRIND_STACK_DEREGISTER(th->valgrind_stack_id);
 #endif
 
+#ifdef FLB_HAVE_CORO_GUARD
+    if (th->guard) {
+        mprotect(th->guard, sysconf(_SC_PAGESIZE), PROT_READ | PROT_WRITE);
+    }
+#endif
+
     co_delete(th->callee);
     flb_free(th);
 }
@@ -126,6 +170,9 @@ static FLB_INLINE struct flb_thread *flb_thread_new(size_t data_size,
 
     th = (struct flb_thread *) p;
     th->cb_destroy = NULL;
+#ifdef FLB_HAVE_CORO_GUARD
+    th->guard = NULL;
+#endif
 
     flb_trace("[thread %p] created (custom data at %p, size=%lu",
               th, FLB_THREAD_DATA(th), data_size);
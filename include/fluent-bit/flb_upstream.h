@@ -29,6 +29,7 @@
 
 #ifdef FLB_HAVE_TLS
 #include <mbedtls/net.h>
+#include <mbedtls/ssl.h>
 #endif
 /*
  * Upstream creation FLAGS set by Fluent Bit sub-components
@@ -50,6 +51,9 @@ struct flb_upstream {
     int tcp_port;
     char *tcp_host;
 
+    /* resolver of 'tcp_host', shared through the config context */
+    struct flb_net_dns *dns;
+
     int n_connections;
 
     /*
@@ -84,6 +88,13 @@ struct flb_upstream {
 #ifdef FLB_HAVE_TLS
     /* context with mbedTLS data to handle certificates and keys */
     struct flb_tls *tls;
+
+    /*
+     * Last TLS session negotiated with the host (session ID or ticket),
+     * new connections offer it to get an abbreviated handshake.
+     */
+    int tls_resume_set;
+    mbedtls_ssl_session tls_resume;
 #endif
 };
 
@@ -95,6 +106,9 @@ struct flb_upstream_conn {
     flb_sockfd_t fd;
     int connect_count;
 
+    /* Number of times a keepalive connection has been reused */
+    int ka_count;
+
     /* Upstream parent */
     struct flb_upstream *u;
 
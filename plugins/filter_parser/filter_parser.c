@@ -27,6 +27,7 @@
 #include <msgpack.h>
 
 #include <string.h>
+#include <ctype.h>
 #include <fluent-bit.h>
 
 #include "filter_parser.h"
@@ -68,10 +69,174 @@ static int add_parser(char *parser, struct filter_parser_ctx *ctx,
     }
 
     fp->parser = p;
+    fp->hits = 0;
     mk_list_add(&fp->_head, &ctx->parsers);
     return 0;
 }
 
+/*
+ * Set the leading bytes a parser can accept. Native formats know their
+ * first byte, regex parsers are restricted when the pattern is anchored
+ * and starts with a literal. Anything else accepts every byte.
+ */
+static void parser_first_bytes(struct filter_parser *fp)
+{
+    int len;
+    char *re;
+    struct flb_parser *p = fp->parser;
+
+    memset(fp->first_byte, FLB_TRUE, sizeof(fp->first_byte));
+    fp->first_line = FLB_FALSE;
+
+    if (p->type == FLB_PARSER_JSON) {
+        memset(fp->first_byte, FLB_FALSE, sizeof(fp->first_byte));
+        fp->first_byte['{'] = FLB_TRUE;
+        fp->first_byte[' '] = FLB_TRUE;
+        fp->first_byte['\t'] = FLB_TRUE;
+        fp->first_byte['\r'] = FLB_TRUE;
+        fp->first_byte['\n'] = FLB_TRUE;
+        return;
+    }
+    else if (p->type == FLB_PARSER_SYSLOG) {
+        memset(fp->first_byte, FLB_FALSE, sizeof(fp->first_byte));
+        fp->first_byte['<'] = FLB_TRUE;
+        return;
+    }
+    else if (p->type != FLB_PARSER_REGEX) {
+        return;
+    }
+
+    re = p->p_regex;
+    len = strlen(re);
+    if (len > 1 && re[0] == '/' && re[len - 1] == '/') {
+        re++;
+        len -= 2;
+    }
+
+    /* an alternation may not be anchored */
+    if (len < 2 || re[0] != '^' || memchr(re, '|', len)) {
+        return;
+    }
+    re++;
+    len--;
+
+    if (re[0] == '\\' && len > 1 && ispunct((unsigned char) re[1])) {
+        re++;
+        len--;
+    }
+    else if (re[0] == '\\' || strchr("[](){}.*+?^$|", re[0])) {
+        return;
+    }
+
+    /* the literal must not be optional */
+    if (len > 1 && strchr("?*{", re[1])) {
+        return;
+    }
+
+    /* '^' also matches after a line break, see dispatch_do() */
+    memset(fp->first_byte, FLB_FALSE, sizeof(fp->first_byte));
+    fp->first_byte[(unsigned char) re[0]] = FLB_TRUE;
+    fp->first_line = FLB_TRUE;
+}
+
+static int dispatch_create(struct filter_parser_ctx *ctx)
+{
+    int i = 0;
+    struct mk_list *head;
+    struct filter_parser *fp;
+
+    ctx->dispatch_len = mk_list_size(&ctx->parsers);
+    ctx->dispatch_list = flb_malloc(sizeof(struct filter_parser *) *
+                                    ctx->dispatch_len);
+    if (!ctx->dispatch_list) {
+        flb_errno();
+        return -1;
+    }
+
+    mk_list_foreach(head, &ctx->parsers) {
+        fp = mk_list_entry(head, struct filter_parser, _head);
+        parser_first_bytes(fp);
+        ctx->dispatch_list[i++] = fp;
+    }
+
+    return 0;
+}
+
+/*
+ * Sort the candidates by hits, most frequent first. The sort is stable so
+ * the configuration order breaks ties, and the counters are halved so the
+ * order follows changes in the traffic.
+ */
+static void dispatch_reorder(struct filter_parser_ctx *ctx)
+{
+    int i;
+    int j;
+    struct filter_parser *fp;
+    struct filter_parser *first = ctx->dispatch_list[0];
+
+    for (i = 1; i < ctx->dispatch_len; i++) {
+        fp = ctx->dispatch_list[i];
+        for (j = i; j > 0 && ctx->dispatch_list[j - 1]->hits < fp->hits; j--) {
+            ctx->dispatch_list[j] = ctx->dispatch_list[j - 1];
+        }
+        ctx->dispatch_list[j] = fp;
+    }
+
+    for (i = 0; i < ctx->dispatch_len; i++) {
+        ctx->dispatch_list[i]->hits /= 2;
+    }
+
+    if (ctx->dispatch_list[0] != first) {
+        flb_debug("[filter_parser] dispatch: '%s' is now tried first",
+                  ctx->dispatch_list[0]->parser->name);
+    }
+}
+
+/* Dispatch mode: parse a value with the first candidate that accepts it */
+static int dispatch_do(struct filter_parser_ctx *ctx,
+                       char *val_str, int val_len,
+                       char **out_buf, size_t *out_size,
+                       struct flb_time *parsed_time)
+{
+    int i;
+    int ret = -1;
+    int lines = -1;
+    unsigned char c = 0;
+    struct filter_parser *fp;
+
+    if (val_len > 0) {
+        c = (unsigned char) val_str[0];
+    }
+
+    for (i = 0; i < ctx->dispatch_len; i++) {
+        fp = ctx->dispatch_list[i];
+        if (val_len > 0 && fp->first_byte[c] == FLB_FALSE) {
+            /* an anchored regex can still match a line after the first */
+            if (fp->first_line == FLB_TRUE && lines == -1) {
+                lines = (memchr(val_str, '\n', val_len) != NULL);
+            }
+            if (fp->first_line == FLB_FALSE || lines == 0) {
+                continue;
+            }
+        }
+
+        flb_time_zero(parsed_time);
+        ret = flb_parser_do(fp->parser, val_str, val_len,
+                            (void **) out_buf, out_size, parsed_time);
+        if (ret >= 0) {
+            fp->hits++;
+            break;
+        }
+    }
+
+    ctx->dispatch_records++;
+    if (ctx->dispatch_records % FILTER_PARSER_DISPATCH_REORDER == 0) {
+        dispatch_reorder(ctx);
+    }
+
+    return ret;
+}
+
 static int delete_parsers(struct filter_parser_ctx *ctx)
 {
     int c = 0;
@@ -101,6 +266,10 @@ static int configure(struct filter_parser_ctx *ctx,
     ctx->key_name = NULL;
     ctx->reserve_data = FLB_FALSE;
     ctx->preserve_key = FLB_FALSE;
+    ctx->dispatch = FLB_FALSE;
+    ctx->dispatch_len = 0;
+    ctx->dispatch_records = 0;
+    ctx->dispatch_list = NULL;
     mk_list_init(&ctx->parsers);
 
     /* Key name */
@@ -144,6 +313,18 @@ static int configure(struct filter_parser_ctx *ctx,
         ctx->preserve_key = flb_utils_bool(tmp);
     }
 
+    /* Dispatch */
+    tmp = flb_filter_get_property("dispatch", f_ins);
+    if (tmp) {
+        ctx->dispatch = flb_utils_bool(tmp);
+    }
+
+    if (ctx->dispatch == FLB_TRUE) {
+        if (dispatch_create(ctx) == -1) {
+            return -1;
+        }
+    }
+
     return 0;
 }
 
@@ -259,6 +440,29 @@ static int cb_parser_filter(void *data, size_t bytes,
                         continue;
                     }
 
+                    if (ctx->dispatch == FLB_TRUE) {
+                        parse_ret = dispatch_do(ctx, val_str, val_len,
+                                                &out_buf, &out_size,
+                                                &parsed_time);
+                        if (parse_ret >= 0) {
+                            if (flb_time_to_double(&parsed_time) != 0.0) {
+                                flb_time_copy(&tm, &parsed_time);
+                            }
+
+                            if (ctx->reserve_data) {
+                                if (!ctx->preserve_key) {
+                                    append_arr_i--;
+                                    append_arr_len--;
+                                    append_arr[append_arr_i] = NULL;
+                                }
+                            }
+                            else {
+                                continue_parsing = FLB_FALSE;
+                            }
+                        }
+                        continue;
+                    }
+
                     /* Lookup parser */
                     mk_list_foreach(head, &ctx->parsers) {
                         fp = mk_list_entry(head, struct filter_parser, _head);
@@ -358,6 +562,7 @@ static int cb_parser_exit(void *data, struct flb_config *config)
     }
 
     delete_parsers(ctx);
+    flb_free(ctx->dispatch_list);
     flb_free(ctx->key_name);
     flb_free(ctx);
     return 0;
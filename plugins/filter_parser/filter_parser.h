@@ -23,8 +23,19 @@
 
 #include <fluent-bit/flb_parser.h>
 
+#include <stdint.h>
+
+/* Dispatch mode: candidates are re-sorted by hits every N records */
+#define FILTER_PARSER_DISPATCH_REORDER  1024
+
 struct filter_parser {
     struct flb_parser *parser;
+
+    /* Dispatch mode */
+    uint64_t hits;                /* records parsed (decayed on re-sort) */
+    char first_byte[256];         /* leading bytes the parser can accept */
+    int first_line;               /* ..only at the beginning of a line    */
+
     struct mk_list _head;
 };
 
@@ -35,6 +46,15 @@ struct filter_parser_ctx {
     int    preserve_key;
 
     struct mk_list parsers;
+
+    /*
+     * Dispatch mode: a value is only handed to the parsers that accept its
+     * first byte, in order of how many records each one parsed.
+     */
+    int    dispatch;
+    int    dispatch_len;
+    uint64_t dispatch_records;
+    struct filter_parser **dispatch_list;
 };
 
 #endif /* FLB_FILTER_PARSER_H */
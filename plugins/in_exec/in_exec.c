@@ -25,103 +25,278 @@
 #include <fluent-bit/flb_utils.h>
 #include <fluent-bit/flb_pack.h>
 #include <fluent-bit/flb_parser.h>
+
+#include <fluent-bit/flb_engine.h>
 #include <msgpack.h>
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <unistd.h>
+#include <sys/wait.h>
 
 #include "in_exec.h"
 
-/* cb_collect callback */
-static int in_exec_collect(struct flb_input_instance *i_ins,
-                           struct flb_config *config, void *in_context)
+extern char **environ;
+
+/* Pack a line of the command output into the batch */
+static void process_line(struct flb_in_exec_config *ctx, char *line,
+                         size_t len)
 {
-    int ret = -1;
-    size_t str_len = 0;
-    FILE *cmdp = NULL;
-    struct flb_in_exec_config *exec_config = in_context;
-    msgpack_packer mp_pck;
-    msgpack_sbuffer mp_sbuf;
-
-    /* variables for parser */
-    int parser_ret = -1;
+    int ret;
     void *out_buf = NULL;
     size_t out_size = 0;
     struct flb_time out_time;
+    msgpack_packer *mp_pck = &ctx->batch.mp_pck;
+
+    if (ctx->parser) {
+        flb_time_get(&out_time);
+        ret = flb_parser_do(ctx->parser, line, len,
+                            &out_buf, &out_size, &out_time);
+        if (ret < 0) {
+            flb_trace("[in_exec] tried to parse '%.*s'", (int) len, line);
+            flb_trace("[in_exec] buf_size %zu", ctx->buf_size);
+            flb_error("[in_exec] parser returned an error");
+            return;
+        }
 
-    cmdp = popen(exec_config->cmd, "r");
-    if (cmdp == NULL) {
-        flb_debug("[in_exec] %s failed", exec_config->cmd);
-        goto collect_end;
+        if (flb_time_to_double(&out_time) == 0.0) {
+            flb_time_get(&out_time);
+        }
+
+        msgpack_pack_array(mp_pck, 2);
+        flb_time_append_to_msgpack(&out_time, mp_pck, 0);
+        msgpack_sbuffer_write(&ctx->batch.mp_sbuf, out_buf, out_size);
+        flb_free(out_buf);
+    }
+    else {
+        msgpack_pack_array(mp_pck, 2);
+        flb_pack_time_now(mp_pck);
+        msgpack_pack_map(mp_pck, 1);
+
+        msgpack_pack_str(mp_pck, 4);
+        msgpack_pack_str_body(mp_pck, "exec", 4);
+        msgpack_pack_str(mp_pck, len);
+        msgpack_pack_str_body(mp_pck, line, len);
     }
 
-    if (exec_config->parser) {
-        while (fgets(exec_config->buf, exec_config->buf_size, cmdp) != NULL) {
-            str_len = strnlen(exec_config->buf, exec_config->buf_size);
-            exec_config->buf[str_len - 1] = '\0'; /* chomp */
+    flb_input_batch_commit(&ctx->batch, 1);
+}
 
-            flb_time_get(&out_time);
-            parser_ret = flb_parser_do(exec_config->parser, exec_config->buf, str_len - 1,
-                                       &out_buf, &out_size, &out_time);
-            if (parser_ret >= 0) {
-                if (flb_time_to_double(&out_time) == 0.0) {
-                    flb_time_get(&out_time);
-                }
-
-                /* Initialize local msgpack buffer */
-                msgpack_sbuffer_init(&mp_sbuf);
-                msgpack_packer_init(&mp_pck, &mp_sbuf, msgpack_sbuffer_write);
-
-                msgpack_pack_array(&mp_pck, 2);
-                flb_time_append_to_msgpack(&out_time, &mp_pck, 0);
-                msgpack_sbuffer_write(&mp_sbuf, out_buf, out_size);
-
-                flb_input_chunk_append_raw(i_ins, NULL, 0,
-                                           mp_sbuf.data, mp_sbuf.size);
-                msgpack_sbuffer_destroy(&mp_sbuf);
-                flb_free(out_buf);
-            }
-            else {
-                flb_trace("[in_exec] tried to parse '%s'", exec_config->buf);
-                flb_trace("[in_exec] buf_size %zu", exec_config->buf_size);
-                flb_error("[in_exec] parser returned an error");
-            }
+/*
+ * Process the complete lines of the buffer. If 'flush' is set the remaining
+ * data is processed as a line too (the output of the command ended or the
+ * line does not fit in the buffer).
+ */
+static void process_buffer(struct flb_in_exec_config *ctx, int flush)
+{
+    size_t len;
+    char *p = ctx->buf;
+    char *end = ctx->buf + ctx->buf_len;
+    char *eol;
+
+    while (p < end) {
+        eol = memchr(p, '\n', end - p);
+        if (!eol) {
+            break;
         }
+        len = eol - p;
+        if (len > 0 && p[len - 1] == '\r') {
+            len--;
+        }
+        process_line(ctx, p, len);
+        p = eol + 1;
     }
-    else {
-        while (fgets(exec_config->buf, exec_config->buf_size, cmdp) != NULL) {
-            str_len = strnlen(exec_config->buf, exec_config->buf_size);
-            exec_config->buf[str_len - 1] = '\0'; /* chomp */
-
-            /* Initialize local msgpack buffer */
-            msgpack_sbuffer_init(&mp_sbuf);
-            msgpack_packer_init(&mp_pck, &mp_sbuf, msgpack_sbuffer_write);
-
-            msgpack_pack_array(&mp_pck, 2);
-            flb_pack_time_now(&mp_pck);
-            msgpack_pack_map(&mp_pck, 1);
-
-            msgpack_pack_str(&mp_pck, 4);
-            msgpack_pack_str_body(&mp_pck, "exec", 4);
-            msgpack_pack_str(&mp_pck, str_len - 1);
-            msgpack_pack_str_body(&mp_pck,
-                                  exec_config->buf, str_len - 1);
-
-            flb_input_chunk_append_raw(i_ins, NULL, 0,
-                                       mp_sbuf.data, mp_sbuf.size);
-            msgpack_sbuffer_destroy(&mp_sbuf);
+
+    if (flush == FLB_TRUE && p < end) {
+        process_line(ctx, p, end - p);
+        p = end;
+    }
+
+    /* Keep the incomplete line */
+    ctx->buf_len = end - p;
+    if (ctx->buf_len > 0 && p != ctx->buf) {
+        memmove(ctx->buf, p, ctx->buf_len);
+    }
+}
+
+/* Reap the child process if it finished */
+static void child_wait(struct flb_in_exec_config *ctx, int options)
+{
+    int ret;
+    int status;
+
+    if (ctx->pid == -1) {
+        return;
+    }
+
+    ret = waitpid(ctx->pid, &status, options);
+    if (ret == 0) {
+        /* Still running */
+        return;
+    }
+
+    if (ret == ctx->pid) {
+        if (WIFEXITED(status)) {
+            ctx->exit_status = WEXITSTATUS(status);
+        }
+        else {
+            ctx->exit_status = 128 + WTERMSIG(status);
         }
+        flb_debug("[in_exec] '%s' exited, status=%i",
+                  ctx->cmd, ctx->exit_status);
+    }
+    ctx->pid = -1;
+}
+
+static void child_output_close(struct flb_in_exec_config *ctx)
+{
+    if (ctx->fd == -1) {
+        return;
+    }
+
+    mk_event_del(ctx->evl, &ctx->event);
+    close(ctx->fd);
+    ctx->fd = -1;
+    ctx->buf_len = 0;
+}
+
+/* Event handler: output of the child process available */
+static int in_exec_child_event(void *data)
+{
+    ssize_t bytes;
+    struct flb_in_exec_config *ctx = data;
+
+    if (ctx->event.mask & MK_EVENT_READ) {
+        /* A line longer than the buffer is split */
+        if (ctx->buf_len == ctx->buf_size) {
+            process_buffer(ctx, FLB_TRUE);
+        }
+
+        bytes = read(ctx->fd, ctx->buf + ctx->buf_len,
+                     ctx->buf_size - ctx->buf_len);
+        if (bytes > 0) {
+            ctx->buf_len += bytes;
+            process_buffer(ctx, FLB_FALSE);
+            flb_input_batch_flush(&ctx->batch);
+            return 0;
+        }
+        else if (bytes == -1 && (errno == EAGAIN || errno == EINTR)) {
+            return 0;
+        }
+    }
+
+    /* End of the output: the command finished or closed its stdout */
+    process_buffer(ctx, FLB_TRUE);
+    flb_input_batch_flush(&ctx->batch);
+    child_output_close(ctx);
+    child_wait(ctx, WNOHANG);
+
+    return 0;
+}
+
+/* Spawn the command, its standard output is read from the event loop */
+static int child_spawn(struct flb_in_exec_config *ctx)
+{
+    int ret;
+    int fds[2];
+    char *argv[] = {"/bin/sh", "-c", ctx->cmd, NULL};
+    posix_spawn_file_actions_t actions;
+
+    if (pipe(fds) == -1) {
+        flb_errno();
+        return -1;
     }
 
-    ret = 0; /* success */
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addclose(&actions, fds[0]);
+    posix_spawn_file_actions_adddup2(&actions, fds[1], STDOUT_FILENO);
+    posix_spawn_file_actions_addclose(&actions, fds[1]);
 
- collect_end:
-    if(cmdp != NULL){
-        pclose(cmdp);
+    ret = posix_spawn(&ctx->pid, argv[0], &actions, NULL, argv, environ);
+    posix_spawn_file_actions_destroy(&actions);
+    close(fds[1]);
+
+    if (ret != 0) {
+        flb_error("[in_exec] could not run '%s': %s", ctx->cmd, strerror(ret));
+        close(fds[0]);
+        ctx->pid = -1;
+        return -1;
     }
 
-    return ret;
+    fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+    fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    ctx->fd = fds[0];
+    ctx->buf_len = 0;
+
+    MK_EVENT_NEW(&ctx->event);
+    ctx->event.fd = ctx->fd;
+    ctx->event.type = FLB_ENGINE_EV_CUSTOM;
+    ctx->event.handler = in_exec_child_event;
+
+    /* The instance was paused meanwhile, the output is read on resume */
+    if (ctx->paused == FLB_TRUE) {
+        ret = 0;
+    }
+    else {
+        ret = mk_event_add(ctx->evl, ctx->fd, FLB_ENGINE_EV_CUSTOM,
+                           MK_EVENT_READ, &ctx->event);
+    }
+    if (ret == -1) {
+        flb_error("[in_exec] could not register command output");
+        close(ctx->fd);
+        ctx->fd = -1;
+        kill(ctx->pid, SIGTERM);
+        child_wait(ctx, 0);
+        return -1;
+    }
+
+    ctx->runs++;
+    flb_debug("[in_exec] '%s' started, pid=%i", ctx->cmd, (int) ctx->pid);
+
+    return 0;
+}
+
+/*
+ * cb_collect callback (interval timer): the command runs in background, if
+ * it finished it is started again according to the restart policy.
+ */
+static int in_exec_collect(struct flb_input_instance *i_ins,
+                           struct flb_config *config, void *in_context)
+{
+    struct flb_in_exec_config *ctx = in_context;
+    (void) i_ins;
+    (void) config;
+
+    /* The output was closed but the process might be still running */
+    if (ctx->fd == -1) {
+        child_wait(ctx, WNOHANG);
+    }
+
+    if (ctx->pid != -1 || ctx->fd != -1) {
+        return 0;
+    }
+
+    /* Don't run the command while the instance can't take records */
+    if (ctx->paused == FLB_TRUE) {
+        return 0;
+    }
+
+    if (ctx->runs > 0) {
+        if (ctx->restart == FLB_EXEC_RESTART_NEVER) {
+            return 0;
+        }
+        if (ctx->restart == FLB_EXEC_RESTART_ON_FAILURE &&
+            ctx->exit_status == 0) {
+            return 0;
+        }
+    }
+
+    return child_spawn(ctx);
 }
 
 /* read config file and*/
@@ -164,6 +339,22 @@ static int in_exec_config_read(struct flb_in_exec_config *exec_config,
         exec_config->buf_size = DEFAULT_BUF_SIZE;
     }
 
+    /* restart policy */
+    pval = flb_input_get_property("restart", in);
+    if (pval == NULL || strcasecmp(pval, "always") == 0) {
+        exec_config->restart = FLB_EXEC_RESTART_ALWAYS;
+    }
+    else if (strcasecmp(pval, "on_failure") == 0) {
+        exec_config->restart = FLB_EXEC_RESTART_ON_FAILURE;
+    }
+    else if (strcasecmp(pval, "never") == 0) {
+        exec_config->restart = FLB_EXEC_RESTART_NEVER;
+    }
+    else {
+        flb_error("[in_exec] invalid restart policy '%s'", pval);
+        return -1;
+    }
+
     /* interval settings */
     pval = flb_input_get_property("interval_sec", in);
     if (pval != NULL && atoi(pval) >= 0) {
@@ -196,6 +387,14 @@ static int in_exec_config_read(struct flb_in_exec_config *exec_config,
 static void delete_exec_config(struct flb_in_exec_config *exec_config)
 {
     if (exec_config) {
+        /* stop the command if it's still running */
+        child_output_close(exec_config);
+        if (exec_config->pid != -1) {
+            kill(exec_config->pid, SIGTERM);
+            child_wait(exec_config, 0);
+        }
+        flb_input_batch_destroy(&exec_config->batch);
+
         /* release buffer */
         if (exec_config->buf != NULL) {
             flb_free(exec_config->buf);
@@ -214,11 +413,17 @@ static int in_exec_init(struct flb_input_instance *in,
     int interval_nsec = 0;
 
     /* Allocate space for the configuration */
-    exec_config = flb_malloc(sizeof(struct flb_in_exec_config));
+    exec_config = flb_calloc(1, sizeof(struct flb_in_exec_config));
     if (exec_config == NULL) {
         return -1;
     }
     exec_config->parser = NULL;
+    exec_config->pid = -1;
+    exec_config->fd = -1;
+    exec_config->exit_status = -1;
+    exec_config->evl = config->evl;
+    exec_config->ins = in;
+    flb_input_batch_init(&exec_config->batch, in, 0);
 
     /* Initialize exec config */
     ret = in_exec_config_read(exec_config, in, config, &interval_sec, &interval_nsec);
@@ -251,6 +456,37 @@ static int in_exec_init(struct flb_input_instance *in,
     return -1;
 }
 
+/*
+ * Paused instance (mem_buf_limit reached): stop reading the command output,
+ * the command blocks once the pipe is full.
+ */
+static void in_exec_pause(void *data, struct flb_config *config)
+{
+    struct flb_in_exec_config *ctx = data;
+    (void) config;
+
+    ctx->paused = FLB_TRUE;
+    if (ctx->fd != -1) {
+        mk_event_del(ctx->evl, &ctx->event);
+    }
+}
+
+static void in_exec_resume(void *data, struct flb_config *config)
+{
+    int ret;
+    struct flb_in_exec_config *ctx = data;
+    (void) config;
+
+    ctx->paused = FLB_FALSE;
+    if (ctx->fd != -1) {
+        ret = mk_event_add(ctx->evl, ctx->fd, FLB_ENGINE_EV_CUSTOM,
+                           MK_EVENT_READ, &ctx->event);
+        if (ret == -1) {
+            flb_error("[in_exec] could not register command output");
+        }
+    }
+}
+
 static int in_exec_exit(void *data, struct flb_config *config)
 {
     (void) *config;
@@ -268,5 +504,7 @@ struct flb_input_plugin in_exec_plugin = {
     .cb_pre_run   = NULL,
     .cb_collect   = in_exec_collect,
     .cb_flush_buf = NULL,
+    .cb_pause     = in_exec_pause,
+    .cb_resume    = in_exec_resume,
     .cb_exit      = in_exec_exit
 };
@@ -24,18 +24,48 @@
 #include <fluent-bit/flb_input.h>
 #include <fluent-bit/flb_utils.h>
 #include <fluent-bit/flb_parser.h>
+#include <fluent-bit/flb_input_batch.h>
 
 #include <msgpack.h>
+#include <sys/types.h>
 
 #define DEFAULT_BUF_SIZE      4096
 #define DEFAULT_INTERVAL_SEC  1
 #define DEFAULT_INTERVAL_NSEC 0
 
+/*
+ * Restart policy, checked on every interval when the command is not
+ * running: 'always' runs it again (the default, a short-lived command runs
+ * once per interval), 'on_failure' only if it exited with an error and
+ * 'never' runs it only once.
+ */
+enum {
+    FLB_EXEC_RESTART_ALWAYS = 0,
+    FLB_EXEC_RESTART_ON_FAILURE,
+    FLB_EXEC_RESTART_NEVER
+};
+
 struct flb_in_exec_config {
+    /* Event for the child output, registered in the engine event loop */
+    struct mk_event event;
+
     char  *cmd;
     struct flb_parser  *parser;
     char *buf;
     size_t buf_size;
+    size_t buf_len;
+
+    /* Child process */
+    int restart;                      /* restart policy               */
+    int runs;                         /* number of times spawned      */
+    int exit_status;                  /* last exit status (-1: none)  */
+    pid_t pid;                        /* child PID, -1 if not running */
+    int fd;                           /* child stdout, -1 if closed   */
+    int paused;                       /* output event removed         */
+
+    struct mk_event_loop *evl;
+    struct flb_input_batch batch;
+    struct flb_input_instance *ins;
 };
 
 extern struct flb_input_plugin in_exec_plugin;
@@ -89,13 +89,51 @@ static int in_fw_collect(struct flb_input_instance *i_ins,
     }
 
     flb_trace("[in_fw] new TCP connection arrived FD=%i", fd);
-    conn = fw_conn_add(fd, ctx);
+    conn = fw_conn_add(fd, ctx, NULL);
     if (!conn) {
         return -1;
     }
     return 0;
 }
 
+/* Worker threads: new connection accepted */
+static int in_fw_worker_accept(flb_sockfd_t fd,
+                               struct flb_net_worker *worker, void *data)
+{
+    struct fw_conn *conn;
+
+    conn = fw_conn_add(fd, data, worker);
+    if (!conn) {
+        return -1;
+    }
+    return 0;
+}
+
+/* Worker threads: release the connections once the thread finished */
+static void in_fw_worker_exit(struct flb_net_worker *worker, void *data)
+{
+    struct mk_list *tmp;
+    struct mk_list *head;
+    struct fw_conn *conn;
+    (void) data;
+
+    mk_list_foreach_safe(head, tmp, &worker->connections) {
+        conn = mk_list_entry(head, struct fw_conn, _head);
+        fw_conn_del(conn);
+    }
+}
+
+/* Records decoded by the worker threads */
+static int in_fw_collect_workers(struct flb_input_instance *i_ins,
+                                 struct flb_config *config, void *in_context)
+{
+    struct flb_in_fw_config *ctx = in_context;
+    (void) i_ins;
+    (void) config;
+
+    return flb_net_workers_collect(ctx->net_workers);
+}
+
 /* Initialize plugin */
 static int in_fw_init(struct flb_input_instance *in,
                       struct flb_config *config, void *data)
@@ -114,6 +152,35 @@ static int in_fw_init(struct flb_input_instance *in,
 
     /* Set the context */
     flb_input_set_context(in, ctx);
+    ctx->evl = config->evl;
+
+    /* Accept and read the connections in worker threads */
+    if (ctx->workers > 0) {
+        ctx->net_workers = flb_net_workers_create(in,
+                                                  ctx->listen, ctx->tcp_port,
+                                                  ctx->workers,
+                                                  in_fw_worker_accept,
+                                                  in_fw_worker_exit,
+                                                  ctx);
+        if (!ctx->net_workers) {
+            flb_error("[in_fw] could not start workers on %s:%s",
+                      ctx->listen, ctx->tcp_port);
+            fw_config_destroy(ctx);
+            return -1;
+        }
+
+        ret = flb_input_set_collector_event(in,
+                                            in_fw_collect_workers,
+                                            ctx->net_workers->ch_batches[0],
+                                            config);
+        if (ret == -1) {
+            flb_error("Could not set collector for IN_FW input plugin");
+            flb_net_workers_destroy(ctx->net_workers);
+            fw_config_destroy(ctx);
+            return -1;
+        }
+        return 0;
+    }
 
     /* Unix Socket mode */
     if (ctx->unix_path) {
@@ -148,8 +215,6 @@ static int in_fw_init(struct flb_input_instance *in,
     }
     flb_net_socket_nonblocking(ctx->server_fd);
 
-    ctx->evl = config->evl;
-
     /* Collect upon data available on the standard input */
     ret = flb_input_set_collector_socket(in,
                                          in_fw_collect,
@@ -164,6 +229,27 @@ static int in_fw_init(struct flb_input_instance *in,
     return 0;
 }
 
+/* Paused instance: the worker threads stop reading their connections */
+static void in_fw_pause(void *data, struct flb_config *config)
+{
+    struct flb_in_fw_config *ctx = data;
+    (void) config;
+
+    if (ctx->net_workers) {
+        flb_net_workers_pause(ctx->net_workers);
+    }
+}
+
+static void in_fw_resume(void *data, struct flb_config *config)
+{
+    struct flb_in_fw_config *ctx = data;
+    (void) config;
+
+    if (ctx->net_workers) {
+        flb_net_workers_resume(ctx->net_workers);
+    }
+}
+
 int in_fw_exit(void *data, struct flb_config *config)
 {
     struct mk_list *tmp;
@@ -172,6 +258,10 @@ int in_fw_exit(void *data, struct flb_config *config)
     struct flb_in_fw_config *ctx = data;
     struct fw_conn *conn;
 
+    if (ctx->net_workers) {
+        flb_net_workers_destroy(ctx->net_workers);
+    }
+
     mk_list_foreach_safe(head, tmp, &ctx->connections) {
         conn = mk_list_entry(head, struct fw_conn, _head);
         fw_conn_del(conn);
@@ -189,6 +279,8 @@ struct flb_input_plugin in_forward_plugin = {
     .cb_pre_run   = NULL,
     .cb_collect   = in_fw_collect,
     .cb_flush_buf = NULL,
+    .cb_pause     = in_fw_pause,
+    .cb_resume    = in_fw_resume,
     .cb_exit      = in_fw_exit,
     .flags        = FLB_INPUT_NET
 };
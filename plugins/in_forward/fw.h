@@ -23,6 +23,8 @@
 
 #include <msgpack.h>
 #include <fluent-bit/flb_input.h>
+#include <fluent-bit/flb_input_batch.h>
+#include <fluent-bit/flb_net_workers.h>
 
 struct flb_in_fw_config {
     int server_fd;               /* TCP server file descriptor  */
@@ -36,6 +38,11 @@ struct flb_in_fw_config {
     /* Unix Socket (TCP only) */
     char *unix_path;             /* Unix path for socket        */
 
+    /* Worker threads to accept and read connections (TCP only) */
+    int workers;
+    struct flb_net_workers *net_workers;
+
+    struct flb_input_batch batch;  /* Records pending to append  */
     struct mk_list connections;    /* List of active connections */
     struct mk_event_loop *evl;     /* Event loop file descriptor */
     struct flb_input_instance *in; /* Input plugin instace       */
@@ -31,6 +31,7 @@ struct flb_in_fw_config *fw_config_init(struct flb_input_instance *i_ins)
     char *listen;
     char *buffer_size;
     char *chunk_size;
+    char *workers;
     char *p;
     struct flb_in_fw_config *config;
 
@@ -89,6 +90,21 @@ struct flb_in_fw_config *fw_config_init(struct flb_input_instance *i_ins)
         config->buffer_max_size  = flb_utils_size_to_bytes(buffer_size);
     }
 
+    /* Worker threads (0: connections are handled by the engine thread) */
+    workers = flb_input_get_property("workers", i_ins);
+    if (workers) {
+        config->workers = atoi(workers);
+        if (config->workers < 0) {
+            config->workers = 0;
+        }
+        if (config->workers > 0 && config->unix_path) {
+            flb_warn("[in_fw] 'workers' is not supported with unix_path");
+            config->workers = 0;
+        }
+    }
+
+    flb_input_batch_init(&config->batch, i_ins, FLB_INPUT_BATCH_SIZE);
+
     if (!config->unix_path) {
         flb_debug("[in_fw] Listen='%s' TCP_Port=%s",
                   config->listen, config->tcp_port);
@@ -106,6 +122,7 @@ int fw_config_destroy(struct flb_in_fw_config *config)
         flb_free(config->listen);
         flb_free(config->tcp_port);
     }
+    flb_input_batch_destroy(&config->batch);
     flb_free(config);
 
     return 0;
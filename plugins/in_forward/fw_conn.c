@@ -31,48 +31,47 @@ int fw_conn_event(void *data)
 {
     int ret;
     int bytes;
-    int available;
-    int size;
-    char *tmp;
+    size_t pending;
+    size_t available;
     struct mk_event *event;
     struct fw_conn *conn = data;
     struct flb_in_fw_config *ctx = conn->ctx;
 
     event = &conn->event;
     if (event->mask & MK_EVENT_READ) {
-        available = (conn->buf_size - conn->buf_len);
-        if (available < 1) {
-            if (conn->buf_size + ctx->buffer_chunk_size > ctx->buffer_max_size) {
+        /*
+         * The unpacker keeps the bytes of an incomplete message, make sure
+         * it does not exceed the limit before growing its buffer.
+         */
+        available = msgpack_unpacker_buffer_capacity(conn->unp);
+        if (available < ctx->buffer_chunk_size) {
+            pending = msgpack_unpacker_message_size(conn->unp);
+            if (pending + ctx->buffer_chunk_size > ctx->buffer_max_size) {
                 flb_warn("[in_fw] fd=%i incoming data exceed limit (%i bytes)",
                          event->fd, (ctx->buffer_max_size));
                 fw_conn_del(conn);
                 return -1;
             }
 
-            size = conn->buf_size + ctx->buffer_chunk_size;
-            tmp = flb_realloc(conn->buf, size);
-            if (!tmp) {
+            if (!msgpack_unpacker_reserve_buffer(conn->unp,
+                                                 ctx->buffer_chunk_size)) {
                 flb_errno();
+                fw_conn_del(conn);
                 return -1;
             }
-            flb_trace("[in_fw] fd=%i buffer realloc %i -> %i",
-                      event->fd, conn->buf_size, size);
-
-            conn->buf = tmp;
-            conn->buf_size = size;
-            available = (conn->buf_size - conn->buf_len);
+            available = msgpack_unpacker_buffer_capacity(conn->unp);
         }
 
-        bytes = read(conn->fd,
-                     conn->buf + conn->buf_len, available);
-
+        bytes = read(conn->fd, msgpack_unpacker_buffer(conn->unp), available);
         if (bytes > 0) {
-            flb_trace("[in_fw] read()=%i pre_len=%i now_len=%i",
-                      bytes, conn->buf_len, conn->buf_len + bytes);
-            conn->buf_len += bytes;
+            flb_trace("[in_fw] read()=%i pending=%lu",
+                      bytes, msgpack_unpacker_message_size(conn->unp));
+            msgpack_unpacker_buffer_consumed(conn->unp, bytes);
 
             ret = fw_prot_process(conn);
+            flb_input_batch_flush(conn->batch);
             if (ret == -1) {
+                fw_conn_del(conn);
                 return -1;
             }
             return bytes;
@@ -92,8 +91,12 @@ int fw_conn_event(void *data)
     return 0;
 }
 
-/* Create a new mqtt request instance */
-struct fw_conn *fw_conn_add(int fd, struct flb_in_fw_config *ctx)
+/*
+ * Create a new connection. If 'worker' is set the connection is handled by
+ * that worker thread, otherwise by the engine thread.
+ */
+struct fw_conn *fw_conn_add(int fd, struct flb_in_fw_config *ctx,
+                            struct flb_net_worker *worker)
 {
     int ret;
     struct fw_conn *conn;
@@ -114,32 +117,44 @@ struct fw_conn *fw_conn_add(int fd, struct flb_in_fw_config *ctx)
     /* Connection info */
     conn->fd      = fd;
     conn->ctx     = ctx;
-    conn->buf_len = 0;
-    conn->rest    = 0;
     conn->status  = FW_NEW;
 
-    /* Allocate read buffer */
-    conn->buf = flb_malloc(ctx->buffer_chunk_size);
-    if (!conn->buf) {
+    /* Streaming unpacker, it owns the read buffer */
+    conn->unp = msgpack_unpacker_new(ctx->buffer_chunk_size);
+    if (!conn->unp) {
         flb_errno();
         close(fd);
         flb_free(conn);
         return NULL;
     }
-    conn->buf_size = ctx->buffer_chunk_size;
     conn->in       = ctx->in;
+    conn->worker   = worker;
+
+    if (worker) {
+        conn->evl = worker->evl;
+        conn->batch = &worker->batch;
+    }
+    else {
+        conn->evl = ctx->evl;
+        conn->batch = &ctx->batch;
+    }
 
     /* Register instance into the event loop */
-    ret = mk_event_add(ctx->evl, fd, FLB_ENGINE_EV_CUSTOM, MK_EVENT_READ, conn);
+    ret = mk_event_add(conn->evl, fd, FLB_ENGINE_EV_CUSTOM, MK_EVENT_READ, conn);
     if (ret == -1) {
         flb_error("[in_fw] could not register new connection");
         close(fd);
-        flb_free(conn->buf);
+        msgpack_unpacker_free(conn->unp);
         flb_free(conn);
         return NULL;
     }
 
-    mk_list_add(&conn->_head, &ctx->connections);
+    if (worker) {
+        mk_list_add(&conn->_head, &worker->connections);
+    }
+    else {
+        mk_list_add(&conn->_head, &ctx->connections);
+    }
 
     return conn;
 }
@@ -147,12 +162,12 @@ struct fw_conn *fw_conn_add(int fd, struct flb_in_fw_config *ctx)
 int fw_conn_del(struct fw_conn *conn)
 {
     /* Unregister the file descriptior from the event-loop */
-    mk_event_del(conn->ctx->evl, &conn->event);
+    mk_event_del(conn->evl, &conn->event);
 
     /* Release resources */
     mk_list_del(&conn->_head);
     close(conn->fd);
-    flb_free(conn->buf);
+    msgpack_unpacker_free(conn->unp);
     flb_free(conn);
 
     return 0;
@@ -21,6 +21,10 @@
 #ifndef FLB_IN_FW_CONN_H
 #define FLB_IN_FW_CONN_H
 
+#include <fluent-bit/flb_input_batch.h>
+#include <fluent-bit/flb_net_workers.h>
+#include <msgpack.h>
+
 #define FLB_IN_FW_CHUNK 32768
 
 enum {
@@ -39,19 +43,20 @@ struct fw_conn {
     int fd;                          /* Socket file descriptor            */
     int status;                      /* Connection status                 */
 
-    /* Buffer */
-    char *buf;                       /* Buffer data                       */
-    int  buf_len;                    /* Data length                       */
-    int  buf_size;                   /* Buffer size                       */
-    size_t rest;                     /* Unpacking offset                  */
+    /* Incoming data is read directly into the unpacker buffer */
+    msgpack_unpacker *unp;           /* Streaming unpacker                */
 
+    struct mk_event_loop *evl;       /* Event loop of the owner thread    */
+    struct flb_input_batch *batch;   /* Batch of the owner thread         */
+    struct flb_net_worker *worker;   /* Owner worker (if any)             */
     struct flb_input_instance *in;   /* Parent plugin instance            */
     struct flb_in_fw_config *ctx;    /* Plugin configuration context      */
 
     struct mk_list _head;
 };
 
-struct fw_conn *fw_conn_add(int fd, struct flb_in_fw_config *ctx);
+struct fw_conn *fw_conn_add(int fd, struct flb_in_fw_config *ctx,
+                            struct flb_net_worker *worker);
 int fw_conn_del(struct fw_conn *conn);
 
 #endif
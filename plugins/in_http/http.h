@@ -0,0 +1,49 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2019      The Fluent Bit Authors
+ *  Copyright (C) 2015-2018 Treasure Data Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef FLB_IN_HTTP_H
+#define FLB_IN_HTTP_H
+
+#include <fluent-bit/flb_input.h>
+#include <fluent-bit/flb_input_batch.h>
+#include <msgpack.h>
+#include <zlib.h>
+
+struct flb_in_http_config {
+    int server_fd;                 /* TCP server file descriptor      */
+    size_t buffer_max_size;        /* Max size of a request           */
+    size_t buffer_chunk_size;      /* Connection buffer increments    */
+    char *listen;                  /* Listen interface                */
+    char *tcp_port;                /* TCP Port                        */
+    struct mk_list connections;    /* List of active connections      */
+    struct mk_event_loop *evl;     /* Event loop file descriptor      */
+    struct flb_input_batch batch;  /* Records pending to append       */
+
+    /* gzip bodies: the inflate context and its output buffer are reused */
+    z_stream zstream;
+    char *zbuf;
+    size_t zbuf_size;
+
+    struct flb_input_instance *in; /* Input plugin instace            */
+};
+
+extern struct flb_input_plugin in_http_plugin;
+
+#endif
@@ -0,0 +1,129 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2019      The Fluent Bit Authors
+ *  Copyright (C) 2015-2018 Treasure Data Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <fluent-bit/flb_utils.h>
+
+#include "http.h"
+#include "http_conn.h"
+#include "http_config.h"
+
+struct flb_in_http_config *http_config_init(struct flb_input_instance *i_ins)
+{
+    int ret;
+    int64_t size;
+    char tmp[16];
+    char *listen;
+    char *buffer_size;
+    char *chunk_size;
+    struct flb_in_http_config *config;
+
+    config = flb_calloc(1, sizeof(struct flb_in_http_config));
+    if (!config) {
+        flb_errno();
+        return NULL;
+    }
+    flb_input_batch_init(&config->batch, i_ins, 0);
+
+    /* Listen interface (if not set, defaults to 0.0.0.0) */
+    if (!i_ins->host.listen) {
+        listen = flb_input_get_property("listen", i_ins);
+        if (listen) {
+            config->listen = flb_strdup(listen);
+        }
+        else {
+            config->listen = flb_strdup("0.0.0.0");
+        }
+    }
+    else {
+        config->listen = flb_strdup(i_ins->host.listen);
+    }
+
+    /* Listener TCP Port */
+    if (i_ins->host.port == 0) {
+        config->tcp_port = flb_strdup("9880");
+    }
+    else {
+        snprintf(tmp, sizeof(tmp) - 1, "%d", i_ins->host.port);
+        config->tcp_port = flb_strdup(tmp);
+    }
+
+    /* Chunk size */
+    chunk_size = flb_input_get_property("buffer_chunk_size", i_ins);
+    if (!chunk_size) {
+        config->buffer_chunk_size = FLB_IN_HTTP_CHUNK; /* 32KB */
+    }
+    else {
+        size = flb_utils_size_to_bytes(chunk_size);
+        config->buffer_chunk_size = size > 0 ? size : 0;
+    }
+
+    /* Buffer size: max size of a request */
+    buffer_size = flb_input_get_property("buffer_max_size", i_ins);
+    if (!buffer_size) {
+        config->buffer_max_size = FLB_IN_HTTP_MAX_SIZE; /* 4MB */
+    }
+    else {
+        size = flb_utils_size_to_bytes(buffer_size);
+        config->buffer_max_size = size > 0 ? size : 0;
+    }
+
+    if (config->buffer_chunk_size == 0 ||
+        config->buffer_max_size < config->buffer_chunk_size) {
+        flb_error("[in_http] invalid buffer_chunk_size or buffer_max_size");
+        http_config_destroy(config);
+        return NULL;
+    }
+
+    /* gzip decoder (16: gzip header and trailer) */
+    ret = inflateInit2(&config->zstream, 16 + MAX_WBITS);
+    if (ret != Z_OK) {
+        flb_error("[in_http] could not initialize zlib inflate");
+        http_config_destroy(config);
+        return NULL;
+    }
+    config->zbuf = flb_malloc(config->buffer_chunk_size);
+    if (!config->zbuf) {
+        flb_errno();
+        inflateEnd(&config->zstream);
+        http_config_destroy(config);
+        return NULL;
+    }
+    config->zbuf_size = config->buffer_chunk_size;
+
+    flb_debug("[in_http] Listen='%s' TCP_Port=%s",
+              config->listen, config->tcp_port);
+
+    return config;
+}
+
+int http_config_destroy(struct flb_in_http_config *config)
+{
+    if (config->zbuf) {
+        inflateEnd(&config->zstream);
+        flb_free(config->zbuf);
+    }
+    flb_input_batch_destroy(&config->batch);
+    flb_free(config->listen);
+    flb_free(config->tcp_port);
+    flb_free(config);
+
+    return 0;
+}
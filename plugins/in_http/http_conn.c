@@ -0,0 +1,278 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2019      The Fluent Bit Authors
+ *  Copyright (C) 2015-2018 Treasure Data Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <errno.h>
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_engine.h>
+#include <fluent-bit/flb_network.h>
+
+#include "http.h"
+#include "http_conn.h"
+#include "http_prot.h"
+
+/* Write the pending responses, returns the number of bytes left or -1 */
+static ssize_t conn_out_flush(struct http_conn *conn)
+{
+    ssize_t bytes;
+    size_t sent = 0;
+
+    while (sent < conn->out_len) {
+        bytes = write(conn->fd, conn->out_data + sent, conn->out_len - sent);
+        if (bytes == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
+            flb_errno();
+            return -1;
+        }
+        sent += bytes;
+    }
+
+    if (sent > 0 && sent < conn->out_len) {
+        memmove(conn->out_data, conn->out_data + sent, conn->out_len - sent);
+    }
+    conn->out_len -= sent;
+
+    return conn->out_len;
+}
+
+/* Wait for the socket to be writable (MK_EVENT_WRITE) or readable */
+static int conn_event_switch(struct http_conn *conn, int mask)
+{
+    int ret;
+    struct mk_event *event = &conn->event;
+
+    if (event->mask == (uint32_t) mask) {
+        return 0;
+    }
+
+    ret = mk_event_add(conn->ctx->evl, conn->fd, FLB_ENGINE_EV_CUSTOM,
+                       mask, event);
+    if (ret == -1) {
+        flb_error("[in_http] fd=%i error changing mask to %i",
+                  conn->fd, mask);
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Send 'len' bytes to the client. What can't be written now is queued and
+ * sent when the socket is writable, the connection stops reading meanwhile.
+ */
+int http_conn_write(struct http_conn *conn, char *buf, size_t len)
+{
+    char *tmp;
+    size_t size;
+
+    if (conn->out_len + len > conn->out_size) {
+        size = conn->out_len + len;
+        tmp = flb_realloc(conn->out_data, size);
+        if (!tmp) {
+            flb_errno();
+            return -1;
+        }
+        conn->out_data = tmp;
+        conn->out_size = size;
+    }
+    memcpy(conn->out_data + conn->out_len, buf, len);
+    conn->out_len += len;
+
+    /* Responses are sent in order, wait for the pending ones */
+    if (conn->out_len > len) {
+        return 0;
+    }
+
+    if (conn_out_flush(conn) > 0) {
+        return conn_event_switch(conn, MK_EVENT_WRITE);
+    }
+
+    return 0;
+}
+
+/* Callback invoked every time an event is triggered for a connection */
+int http_conn_event(void *data)
+{
+    int ret;
+    int bytes;
+    size_t size;
+    size_t available;
+    char *tmp;
+    struct mk_event *event;
+    struct http_conn *conn = data;
+    struct flb_in_http_config *ctx = conn->ctx;
+
+    event = &conn->event;
+    if (event->mask & MK_EVENT_WRITE) {
+        ret = conn_out_flush(conn);
+        if (ret == -1 || (ret == 0 && conn->out_close == FLB_TRUE)) {
+            http_conn_del(conn);
+            return -1;
+        }
+        if (ret == 0 && conn_event_switch(conn, MK_EVENT_READ) == -1) {
+            http_conn_del(conn);
+            return -1;
+        }
+        return 0;
+    }
+
+    if (event->mask & MK_EVENT_READ) {
+        available = conn->buf_size - conn->buf_len;
+        if (available < 1) {
+            if (conn->buf_size >= ctx->buffer_max_size) {
+                flb_warn("[in_http] fd=%i request exceed limit (%lu bytes)",
+                         event->fd, ctx->buffer_max_size);
+                http_conn_del(conn);
+                return -1;
+            }
+
+            size = conn->buf_size + ctx->buffer_chunk_size;
+            if (size > ctx->buffer_max_size) {
+                size = ctx->buffer_max_size;
+            }
+            tmp = flb_realloc(conn->buf_data, size);
+            if (!tmp) {
+                flb_errno();
+                http_conn_del(conn);
+                return -1;
+            }
+            flb_trace("[in_http] fd=%i buffer realloc %lu -> %lu",
+                      event->fd, conn->buf_size, size);
+
+            conn->buf_data = tmp;
+            conn->buf_size = size;
+            available = conn->buf_size - conn->buf_len;
+        }
+
+        /* Read data */
+        bytes = read(conn->fd, conn->buf_data + conn->buf_len, available);
+        if (bytes <= 0) {
+            flb_trace("[in_http] fd=%i closed connection", event->fd);
+            http_conn_del(conn);
+            return -1;
+        }
+
+        flb_trace("[in_http] read()=%i pre_len=%lu now_len=%lu",
+                  bytes, conn->buf_len, conn->buf_len + bytes);
+        conn->buf_len += bytes;
+
+        ret = http_prot_process(conn);
+        flb_input_batch_flush(&ctx->batch);
+        if (ret == -1) {
+            /* The last response is still queued, close once it's sent */
+            if (conn->out_len > 0) {
+                conn->out_close = FLB_TRUE;
+                return bytes;
+            }
+            http_conn_del(conn);
+            return -1;
+        }
+        return bytes;
+    }
+
+    if (event->mask & MK_EVENT_CLOSE) {
+        flb_trace("[in_http] fd=%i hangup", event->fd);
+        http_conn_del(conn);
+        return -1;
+    }
+    return 0;
+}
+
+void http_conn_request_reset(struct http_conn *conn)
+{
+    memset(&conn->req, '\0', sizeof(struct http_request));
+    conn->req.state = HTTP_REQ_HEADERS;
+    conn->req.content_length = -1;
+}
+
+struct http_conn *http_conn_add(int fd, struct flb_in_http_config *ctx)
+{
+    int ret;
+    struct http_conn *conn;
+    struct mk_event *event;
+
+    conn = flb_malloc(sizeof(struct http_conn));
+    if (!conn) {
+        flb_errno();
+        close(fd);
+        return NULL;
+    }
+
+    /* Set data for the event-loop */
+    event = &conn->event;
+    MK_EVENT_NEW(event);
+    event->fd           = fd;
+    event->type         = FLB_ENGINE_EV_CUSTOM;
+    event->handler      = http_conn_event;
+
+    /* Connection info */
+    conn->fd      = fd;
+    conn->ctx     = ctx;
+    conn->in      = ctx->in;
+    conn->buf_len = 0;
+    conn->out_data = NULL;
+    conn->out_len = 0;
+    conn->out_size = 0;
+    conn->out_close = FLB_FALSE;
+    http_conn_request_reset(conn);
+
+    conn->buf_data = flb_malloc(ctx->buffer_chunk_size);
+    if (!conn->buf_data) {
+        flb_errno();
+        close(fd);
+        flb_error("[in_http] could not allocate new connection");
+        flb_free(conn);
+        return NULL;
+    }
+    conn->buf_size = ctx->buffer_chunk_size;
+
+    /* Register instance into the event loop */
+    ret = mk_event_add(ctx->evl, fd, FLB_ENGINE_EV_CUSTOM, MK_EVENT_READ, conn);
+    if (ret == -1) {
+        flb_error("[in_http] could not register new connection");
+        close(fd);
+        flb_free(conn->buf_data);
+        flb_free(conn);
+        return NULL;
+    }
+
+    mk_list_add(&conn->_head, &ctx->connections);
+    return conn;
+}
+
+int http_conn_del(struct http_conn *conn)
+{
+    /* Unregister the file descriptior from the event-loop */
+    mk_event_del(conn->ctx->evl, &conn->event);
+
+    /* Release resources */
+    mk_list_del(&conn->_head);
+    close(conn->fd);
+    flb_free(conn->buf_data);
+    flb_free(conn->out_data);
+    flb_free(conn);
+
+    return 0;
+}
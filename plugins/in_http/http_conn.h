@@ -0,0 +1,103 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2019      The Fluent Bit Authors
+ *  Copyright (C) 2015-2018 Treasure Data Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef FLB_IN_HTTP_CONN_H
+#define FLB_IN_HTTP_CONN_H
+
+#include <fluent-bit/flb_input.h>
+
+#include "http.h"
+
+#define FLB_IN_HTTP_CHUNK      32768    /* 32KB */
+#define FLB_IN_HTTP_MAX_SIZE   4194304  /* 4MB  */
+
+/* Request parser states */
+enum {
+    HTTP_REQ_HEADERS = 0,    /* waiting for the end of the headers    */
+    HTTP_REQ_BODY,           /* Content-Length body                   */
+    HTTP_REQ_CHUNK_SIZE,     /* chunked body: size line               */
+    HTTP_REQ_CHUNK_DATA,     /* chunked body: data                    */
+    HTTP_REQ_CHUNK_CRLF,     /* chunked body: CRLF after data         */
+    HTTP_REQ_CHUNK_TRAILER,  /* chunked body: trailer headers         */
+    HTTP_REQ_DONE            /* request complete                      */
+};
+
+enum {
+    HTTP_METHOD_OTHER = 0,
+    HTTP_METHOD_POST,
+    HTTP_METHOD_PUT
+};
+
+/*
+ * Request being received. Offsets are relative to the connection buffer
+ * since it can be reallocated while the request arrives. A chunked body is
+ * decoded in place: the data of every chunk is moved right after the
+ * previously decoded one, so the body always starts at 'headers_len'.
+ */
+struct http_request {
+    int state;                  /* parser state                        */
+    int method;                 /* HTTP_METHOD_*                       */
+    int keepalive;              /* keep the connection open            */
+    int chunked;                /* Transfer-Encoding: chunked          */
+    int gzip;                   /* Content-Encoding: gzip              */
+    int ndjson;                 /* Content-Type: application/x-ndjson  */
+    int expect_continue;        /* Expect: 100-continue                */
+    size_t uri_off;             /* request URI                         */
+    size_t uri_len;
+    size_t scan;                /* headers end lookup position         */
+    size_t headers_len;         /* headers length, body offset         */
+    long content_length;        /* Content-Length value or -1          */
+    size_t body_len;            /* (decoded) body length               */
+    size_t raw_pos;             /* raw data parsing position           */
+    size_t chunk_left;          /* pending bytes of the current chunk  */
+};
+
+/* Respresents a connection */
+struct http_conn {
+    struct mk_event event;            /* Built-in event data for mk_events */
+    int fd;                           /* Socket file descriptor            */
+
+    /* Buffer */
+    char *buf_data;                   /* Buffer data                       */
+    size_t buf_len;                   /* Data length                       */
+    size_t buf_size;                  /* Buffer size                       */
+
+    /*
+     * Responses not written yet: the socket is non-blocking, the
+     * connection waits for MK_EVENT_WRITE until they are sent.
+     */
+    char *out_data;
+    size_t out_len;
+    size_t out_size;
+    int out_close;                    /* close once they are written       */
+
+    struct http_request req;          /* Request in progress               */
+    struct flb_input_instance *in;    /* Parent plugin instance            */
+    struct flb_in_http_config *ctx;   /* Plugin configuration context      */
+
+    struct mk_list _head;
+};
+
+struct http_conn *http_conn_add(int fd, struct flb_in_http_config *ctx);
+int http_conn_del(struct http_conn *conn);
+void http_conn_request_reset(struct http_conn *conn);
+int http_conn_write(struct http_conn *conn, char *buf, size_t len);
+
+#endif
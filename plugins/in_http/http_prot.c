@@ -0,0 +1,625 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2019      The Fluent Bit Authors
+ *  Copyright (C) 2015-2018 Treasure Data Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#define _GNU_SOURCE
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_input.h>
+#include <fluent-bit/flb_pack.h>
+#include <fluent-bit/flb_error.h>
+
+#include "http.h"
+#include "http_conn.h"
+#include "http_prot.h"
+
+static char *http_status_reason(int status)
+{
+    switch (status) {
+    case 100:
+        return "Continue";
+    case 201:
+        return "Created";
+    case 400:
+        return "Bad Request";
+    case 405:
+        return "Method Not Allowed";
+    case 413:
+        return "Payload Too Large";
+    case 415:
+        return "Unsupported Media Type";
+    case 429:
+        return "Too Many Requests";
+    case 501:
+        return "Not Implemented";
+    }
+    return "Internal Server Error";
+}
+
+static int send_response(struct http_conn *conn, int status, int keepalive)
+{
+    int len;
+    char buf[160];
+
+    if (status == 100) {
+        len = snprintf(buf, sizeof(buf), "HTTP/1.1 100 Continue\r\n\r\n");
+    }
+    else {
+        len = snprintf(buf, sizeof(buf),
+                       "HTTP/1.1 %i %s\r\n"
+                       "Content-Length: 0\r\n"
+                       "%s"
+                       "\r\n",
+                       status, http_status_reason(status),
+                       keepalive ? "" : "Connection: close\r\n");
+    }
+
+    return http_conn_write(conn, buf, len);
+}
+
+static inline int header_is(char *key, size_t key_len, char *name)
+{
+    size_t len = strlen(name);
+
+    return (key_len == len && strncasecmp(key, name, len) == 0);
+}
+
+/*
+ * Parse the request line and the headers, the complete header block is in
+ * the buffer. Returns 0 or the HTTP status code of the error.
+ */
+static int parse_headers(struct http_conn *conn)
+{
+    char *p;
+    char *end;
+    char *eol;
+    char *sep;
+    char *key;
+    char *val;
+    char *tmp;
+    size_t key_len;
+    size_t val_len;
+    struct http_request *req = &conn->req;
+
+    p = conn->buf_data;
+    end = conn->buf_data + req->headers_len - 2;
+
+    /* Request line: METHOD SP URI SP VERSION */
+    eol = memmem(p, end - p, "\r\n", 2);
+    if (!eol) {
+        return 400;
+    }
+
+    sep = memchr(p, ' ', eol - p);
+    if (!sep) {
+        return 400;
+    }
+    if (header_is(p, sep - p, "POST")) {
+        req->method = HTTP_METHOD_POST;
+    }
+    else if (header_is(p, sep - p, "PUT")) {
+        req->method = HTTP_METHOD_PUT;
+    }
+    else {
+        req->method = HTTP_METHOD_OTHER;
+    }
+
+    p = sep + 1;
+    sep = memchr(p, ' ', eol - p);
+    if (!sep || sep == p) {
+        return 400;
+    }
+    req->uri_off = p - conn->buf_data;
+    req->uri_len = sep - p;
+
+    p = sep + 1;
+    if (header_is(p, eol - p, "HTTP/1.1")) {
+        req->keepalive = FLB_TRUE;
+    }
+    else if (header_is(p, eol - p, "HTTP/1.0")) {
+        req->keepalive = FLB_FALSE;
+    }
+    else {
+        return 400;
+    }
+
+    /* Headers */
+    p = eol + 2;
+    while (p < end) {
+        eol = memmem(p, end - p + 2, "\r\n", 2);
+        if (!eol) {
+            return 400;
+        }
+
+        sep = memchr(p, ':', eol - p);
+        if (!sep) {
+            return 400;
+        }
+        key = p;
+        key_len = sep - p;
+
+        val = sep + 1;
+        while (val < eol && (*val == ' ' || *val == '\t')) {
+            val++;
+        }
+        val_len = eol - val;
+        while (val_len > 0 && (val[val_len - 1] == ' ' ||
+                               val[val_len - 1] == '\t')) {
+            val_len--;
+        }
+        p = eol + 2;
+
+        if (header_is(key, key_len, "Content-Length")) {
+            errno = 0;
+            req->content_length = strtol(val, &tmp, 10);
+            if (errno != 0 || tmp != val + val_len ||
+                req->content_length < 0) {
+                return 400;
+            }
+        }
+        else if (header_is(key, key_len, "Transfer-Encoding")) {
+            if (!header_is(val, val_len, "chunked")) {
+                return 501;
+            }
+            req->chunked = FLB_TRUE;
+        }
+        else if (header_is(key, key_len, "Content-Encoding")) {
+            if (header_is(val, val_len, "gzip") ||
+                header_is(val, val_len, "x-gzip")) {
+                req->gzip = FLB_TRUE;
+            }
+            else if (!header_is(val, val_len, "identity")) {
+                return 415;
+            }
+        }
+        else if (header_is(key, key_len, "Content-Type")) {
+            if (val_len >= 20 &&
+                strncasecmp(val, "application/x-ndjson", 20) == 0) {
+                req->ndjson = FLB_TRUE;
+            }
+        }
+        else if (header_is(key, key_len, "Connection")) {
+            if (header_is(val, val_len, "close")) {
+                req->keepalive = FLB_FALSE;
+            }
+            else if (header_is(val, val_len, "keep-alive")) {
+                req->keepalive = FLB_TRUE;
+            }
+        }
+        else if (header_is(key, key_len, "Expect")) {
+            if (header_is(val, val_len, "100-continue")) {
+                req->expect_continue = FLB_TRUE;
+            }
+        }
+    }
+
+    /* A chunked body has no length */
+    if (req->chunked == FLB_TRUE) {
+        req->content_length = -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Inflate a gzip body into the context buffer. Returns 0 on success, -1 if
+ * the data is invalid and -2 if it exceeds buffer_max_size once decoded.
+ */
+static int http_gunzip(struct flb_in_http_config *ctx,
+                       char *data, size_t size,
+                       char **out_buf, size_t *out_size)
+{
+    int ret;
+    size_t new_size;
+    char *tmp;
+    z_stream *strm = &ctx->zstream;
+
+    inflateReset(strm);
+    strm->next_in = (Bytef *) data;
+    strm->avail_in = size;
+
+    while (1) {
+        if (strm->total_out == ctx->zbuf_size) {
+            if (ctx->zbuf_size >= ctx->buffer_max_size) {
+                return -2;
+            }
+            new_size = ctx->zbuf_size * 2;
+            if (new_size > ctx->buffer_max_size) {
+                new_size = ctx->buffer_max_size;
+            }
+            tmp = flb_realloc(ctx->zbuf, new_size);
+            if (!tmp) {
+                flb_errno();
+                return -1;
+            }
+            ctx->zbuf = tmp;
+            ctx->zbuf_size = new_size;
+        }
+
+        strm->next_out = (Bytef *) ctx->zbuf + strm->total_out;
+        strm->avail_out = ctx->zbuf_size - strm->total_out;
+
+        ret = inflate(strm, Z_NO_FLUSH);
+        if (ret == Z_STREAM_END) {
+            break;
+        }
+        if (ret != Z_OK && !(ret == Z_BUF_ERROR && strm->avail_out == 0)) {
+            return -1;
+        }
+        if (strm->avail_in == 0 && strm->avail_out > 0) {
+            /* Truncated stream */
+            return -1;
+        }
+    }
+
+    *out_buf = ctx->zbuf;
+    *out_size = strm->total_out;
+    return 0;
+}
+
+static inline int is_space(char c)
+{
+    return (c == ' ' || c == '\t' || c == '\r' || c == '\n');
+}
+
+/*
+ * Convert the JSON values of the body into records packed in the batch. A
+ * JSON body can be a single value, a sequence of values or an array whose
+ * elements are the records; a NDJSON body contains a value per line.
+ *
+ * The records are committed at once, so an invalid request does not leave
+ * part of its records in the batch. Returns the number of records or -1.
+ */
+static int process_json(struct flb_input_batch *batch,
+                        char *buf, size_t size, int ndjson)
+{
+    int ret;
+    int type;
+    int array = FLB_FALSE;
+    int records = 0;
+    char *p = buf;
+    char *end = buf + size;
+    char *value;
+    size_t off;
+    size_t value_len;
+    struct flb_pack_json_stream stream;
+
+    ret = flb_pack_json_stream_init(&stream, ndjson);
+    if (ret == -1) {
+        return -1;
+    }
+
+    while (p < end && is_space(*p)) {
+        p++;
+    }
+    if (ndjson == FLB_FALSE && p < end && *p == '[') {
+        array = FLB_TRUE;
+        p++;
+    }
+
+    off = batch->mp_sbuf.size;
+    while (1) {
+        /* Array elements separator and end */
+        while (array == FLB_TRUE && p < end && (is_space(*p) || *p == ',')) {
+            p++;
+        }
+        if (array == FLB_TRUE && p < end && *p == ']') {
+            array = FLB_FALSE;
+            p++;
+            continue;
+        }
+
+        flb_pack_json_stream_reset(&stream);
+        ret = flb_pack_json_stream_next(&stream, p, end - p,
+                                        &value, &value_len, &type);
+        if (ret == FLB_ERR_JSON_PART) {
+            /*
+             * The body is complete: the remaining bytes can only be a last
+             * line or a top level primitive without a delimiter.
+             */
+            while (p < end && is_space(*p)) {
+                p++;
+            }
+            while (end > p && is_space(*(end - 1))) {
+                end--;
+            }
+            if (p == end) {
+                ret = 0;
+                break;
+            }
+
+            value = p;
+            value_len = end - p;
+            type = FLB_PACK_JSON_PRIMITIVE;
+            if (ndjson == FLB_TRUE) {
+                type = (*p == '{') ? FLB_PACK_JSON_OBJECT : type;
+            }
+            else if (*p == '{' || *p == '[' || *p == '"') {
+                ret = -1;
+                break;
+            }
+        }
+        else if (ret != 0) {
+            ret = -1;
+            break;
+        }
+
+        ret = flb_pack_json_stream_record(&stream, value, value_len, type,
+                                          &batch->mp_pck);
+        if (ret != 0) {
+            ret = -1;
+            break;
+        }
+        records++;
+        p = value + value_len;
+    }
+    flb_pack_json_stream_destroy(&stream);
+
+    /* Unterminated array */
+    if (ret == 0 && array == FLB_TRUE) {
+        ret = -1;
+    }
+
+    if (ret == -1) {
+        batch->mp_sbuf.size = off;
+        return -1;
+    }
+
+    flb_input_batch_commit(batch, records);
+    return records;
+}
+
+/* Ingest a complete request, returns the HTTP status of the response */
+static int process_request(struct http_conn *conn)
+{
+    int ret;
+    int tag_len = 0;
+    char *tag = NULL;
+    char *body;
+    char *uri;
+    char *qs;
+    size_t size;
+    struct http_request *req = &conn->req;
+    struct flb_in_http_config *ctx = conn->ctx;
+
+    if (req->method != HTTP_METHOD_POST && req->method != HTTP_METHOD_PUT) {
+        return 405;
+    }
+
+    /* Backpressure: the client is expected to retry later */
+    if (flb_input_buf_paused(ctx->in) == FLB_TRUE) {
+        flb_trace("[in_http] fd=%i input paused, request rejected", conn->fd);
+        return 429;
+    }
+
+    body = conn->buf_data + req->headers_len;
+    size = req->body_len;
+    if (size == 0) {
+        return 400;
+    }
+
+    if (req->gzip == FLB_TRUE) {
+        ret = http_gunzip(ctx, body, size, &body, &size);
+        if (ret == -2) {
+            return 413;
+        }
+        else if (ret == -1) {
+            flb_warn("[in_http] fd=%i invalid gzip body", conn->fd);
+            return 400;
+        }
+    }
+
+    /* The URI path (if any) sets the tag of the records */
+    uri = conn->buf_data + req->uri_off;
+    qs = memchr(uri, '?', req->uri_len);
+    tag_len = qs ? qs - uri : req->uri_len;
+    if (tag_len > 1 && uri[0] == '/') {
+        tag = uri + 1;
+        tag_len--;
+    }
+    else {
+        tag_len = 0;
+    }
+    flb_input_batch_set_tag(&ctx->batch, tag, tag_len);
+
+    ret = process_json(&ctx->batch, body, size, req->ndjson);
+    if (ret == -1) {
+        flb_warn("[in_http] fd=%i invalid JSON body", conn->fd);
+        return 400;
+    }
+
+    return 201;
+}
+
+/* Release the bytes of the completed request, pipelined data is kept */
+static void request_consume(struct http_conn *conn)
+{
+    size_t bytes = conn->req.raw_pos;
+
+    if (bytes < conn->buf_len) {
+        memmove(conn->buf_data, conn->buf_data + bytes,
+                conn->buf_len - bytes);
+    }
+    conn->buf_len -= bytes;
+    http_conn_request_reset(conn);
+}
+
+/*
+ * Process the data available in the connection buffer: parse and ingest the
+ * complete requests and keep the state of the incomplete one. Returns -1 if
+ * the connection must be closed.
+ */
+int http_prot_process(struct http_conn *conn)
+{
+    int ret;
+    int keepalive;
+    char *p;
+    char *eol;
+    char *tmp;
+    size_t n;
+    size_t size;
+    struct http_request *req = &conn->req;
+    struct flb_in_http_config *ctx = conn->ctx;
+
+    while (1) {
+        switch (req->state) {
+        case HTTP_REQ_HEADERS:
+            p = memmem(conn->buf_data + req->scan, conn->buf_len - req->scan,
+                       "\r\n\r\n", 4);
+            if (!p) {
+                req->scan = conn->buf_len > 3 ? conn->buf_len - 3 : 0;
+                return 0;
+            }
+            req->headers_len = (p + 4) - conn->buf_data;
+
+            ret = parse_headers(conn);
+            if (ret != 0) {
+                send_response(conn, ret, FLB_FALSE);
+                return -1;
+            }
+
+            if (req->content_length > 0 &&
+                (req->headers_len > ctx->buffer_max_size ||
+                 (size_t) req->content_length >
+                 ctx->buffer_max_size - req->headers_len)) {
+                send_response(conn, 413, FLB_FALSE);
+                return -1;
+            }
+
+            if (req->expect_continue == FLB_TRUE) {
+                send_response(conn, 100, FLB_TRUE);
+            }
+
+            req->raw_pos = req->headers_len;
+            if (req->chunked == FLB_TRUE) {
+                req->state = HTTP_REQ_CHUNK_SIZE;
+            }
+            else {
+                req->state = HTTP_REQ_BODY;
+            }
+            break;
+        case HTTP_REQ_BODY:
+            size = req->content_length > 0 ? req->content_length : 0;
+            if (conn->buf_len - req->headers_len < size) {
+                return 0;
+            }
+            req->body_len = size;
+            req->raw_pos = req->headers_len + size;
+            req->state = HTTP_REQ_DONE;
+            break;
+        case HTTP_REQ_CHUNK_SIZE:
+            p = conn->buf_data + req->raw_pos;
+            eol = memmem(p, conn->buf_len - req->raw_pos, "\r\n", 2);
+            if (!eol) {
+                return 0;
+            }
+
+            /* Size in hex, chunk extensions are ignored */
+            errno = 0;
+            size = strtoul(p, &tmp, 16);
+            if (errno != 0 || tmp == p || (tmp != eol && *tmp != ';')) {
+                send_response(conn, 400, FLB_FALSE);
+                return -1;
+            }
+            req->raw_pos = (eol + 2) - conn->buf_data;
+
+            if (size == 0) {
+                req->state = HTTP_REQ_CHUNK_TRAILER;
+            }
+            else if (req->headers_len + req->body_len >
+                     ctx->buffer_max_size ||
+                     size > ctx->buffer_max_size -
+                     (req->headers_len + req->body_len)) {
+                send_response(conn, 413, FLB_FALSE);
+                return -1;
+            }
+            else {
+                req->chunk_left = size;
+                req->state = HTTP_REQ_CHUNK_DATA;
+            }
+            break;
+        case HTTP_REQ_CHUNK_DATA:
+            n = conn->buf_len - req->raw_pos;
+            if (n == 0) {
+                return 0;
+            }
+            if (n > req->chunk_left) {
+                n = req->chunk_left;
+            }
+
+            /* Decode in place: the data goes right after the body */
+            memmove(conn->buf_data + req->headers_len + req->body_len,
+                    conn->buf_data + req->raw_pos, n);
+            req->body_len += n;
+            req->raw_pos += n;
+            req->chunk_left -= n;
+            if (req->chunk_left == 0) {
+                req->state = HTTP_REQ_CHUNK_CRLF;
+            }
+            break;
+        case HTTP_REQ_CHUNK_CRLF:
+            if (conn->buf_len - req->raw_pos < 2) {
+                return 0;
+            }
+            p = conn->buf_data + req->raw_pos;
+            if (p[0] != '\r' || p[1] != '\n') {
+                send_response(conn, 400, FLB_FALSE);
+                return -1;
+            }
+            req->raw_pos += 2;
+            req->state = HTTP_REQ_CHUNK_SIZE;
+            break;
+        case HTTP_REQ_CHUNK_TRAILER:
+            p = conn->buf_data + req->raw_pos;
+            eol = memmem(p, conn->buf_len - req->raw_pos, "\r\n", 2);
+            if (!eol) {
+                return 0;
+            }
+            req->raw_pos = (eol + 2) - conn->buf_data;
+
+            /* Trailer headers are skipped, an empty line ends the body */
+            if (eol == p) {
+                req->state = HTTP_REQ_DONE;
+            }
+            break;
+        case HTTP_REQ_DONE:
+            ret = process_request(conn);
+            keepalive = req->keepalive;
+
+            ret = send_response(conn, ret, keepalive);
+            request_consume(conn);
+            if (ret == -1) {
+                return -1;
+            }
+
+            if (keepalive == FLB_FALSE) {
+                return -1;
+            }
+            if (conn->buf_len == 0) {
+                return 0;
+            }
+            break;
+        }
+    }
+
+    return 0;
+}
@@ -20,7 +20,6 @@
 
 #include <fluent-bit/flb_info.h>
 #include <fluent-bit/flb_input.h>
-#include <fluent-bit/flb_engine.h>
 #include <fluent-bit/flb_time.h>
 
 #include <msgpack.h>
@@ -38,6 +37,7 @@
 #include <inttypes.h>
 
 #include "in_kmsg.h"
+#include "in_kmsg_db.h"
 
 struct flb_input_plugin in_kmsg_plugin;
 
@@ -106,193 +106,258 @@ static int boot_time(struct timeval *boot_time)
     return 0;
 }
 
-static inline int process_line(char *line,
-                               struct flb_input_instance *i_ins,
+/* Read the current boot ID, sequence numbers are only valid within a boot */
+static void boot_id_read(struct flb_in_kmsg_config *ctx)
+{
+    int fd;
+    int bytes;
+
+    ctx->boot_id[0] = '\0';
+
+    fd = open(FLB_KMSG_BOOT_ID, O_RDONLY);
+    if (fd == -1) {
+        return;
+    }
+
+    bytes = read(fd, ctx->boot_id, sizeof(ctx->boot_id) - 1);
+    close(fd);
+    if (bytes <= 0) {
+        ctx->boot_id[0] = '\0';
+        return;
+    }
+
+    /* Remove the trailing new line */
+    while (bytes > 0 && isspace(ctx->boot_id[bytes - 1])) {
+        bytes--;
+    }
+    ctx->boot_id[bytes] = '\0';
+}
+
+/* Parse an unsigned number followed by 'delim' */
+static inline int parse_uint(char **p, char *end, char delim, uint64_t *val)
+{
+    char *c = *p;
+    uint64_t v = 0;
+
+    if (c >= end || !isdigit(*c)) {
+        return -1;
+    }
+
+    while (c < end && isdigit(*c)) {
+        v = (v * 10) + (*c - '0');
+        c++;
+    }
+
+    /* skip the remaining fields until the delimiter */
+    while (c < end && *c != delim) {
+        c++;
+    }
+    if (c >= end) {
+        return -1;
+    }
+
+    *p = c + 1;
+    *val = v;
+    return 0;
+}
+
+/*
+ * Parse a record: 'priority,sequence,timestamp,flags;message\n', optionally
+ * followed by continuation lines with key/value pairs (ignored). The record
+ * is packed into the batch.
+ */
+static inline int process_line(char *line, size_t size,
                                struct flb_in_kmsg_config *ctx)
 {
     char priority;           /* log priority                */
     uint64_t sequence;       /* sequence number             */
-    struct timeval tv;       /* time value                  */
-    int line_len;
+    uint64_t usec;           /* timestamp since boot        */
     uint64_t val;
+    size_t msg_len;
     char *p = line;
-    char *end = NULL;
-    msgpack_packer mp_pck;
-    msgpack_sbuffer mp_sbuf;
+    char *end = line + size;
+    char *msg;
+    char *eol;
+    struct timeval tv;       /* time value                  */
     struct flb_time ts;
-
-    /* Increase buffer position */
-    ctx->buffer_id++;
-
-    errno = 0;
-    val = strtol(p, &end, 10);
-    if ((errno == ERANGE && (val == INT_MAX || val == INT_MIN))
-        || (errno != 0 && val == 0)) {
-        goto fail;
-    }
+    msgpack_packer *mp_pck = &ctx->batch.mp_pck;
 
     /* Priority */
+    if (parse_uint(&p, end, ',', &val) == -1) {
+        return -1;
+    }
     priority = FLB_KLOG_PRI(val);
 
     /* Sequence */
-    p = strchr(p, ',');
-    if (!p) {
-        goto fail;
+    if (parse_uint(&p, end, ',', &sequence) == -1) {
+        return -1;
     }
-    p++;
 
-    val = strtol(p, &end, 10);
-    if ((errno == ERANGE && (val == INT_MAX || val == INT_MIN))
-        || (errno != 0 && val == 0)) {
-        goto fail;
+    /* Records already ingested before a restart */
+    if (ctx->seq_skip == FLB_TRUE) {
+        if (sequence <= ctx->seq_saved) {
+            return 0;
+        }
+        ctx->seq_skip = FLB_FALSE;
     }
 
-    sequence = val;
-    p = ++end;
-
     /* Timestamp */
-    val = strtol(p, &end, 10);
-    if ((errno == ERANGE && (val == INT_MAX || val == INT_MIN))
-        || (errno != 0 && val == 0)) {
-        goto fail;
+    if (parse_uint(&p, end, ';', &usec) == -1) {
+        return -1;
     }
+    tv.tv_sec  = usec / KMSG_USEC_PER_SEC;
+    tv.tv_usec = usec % KMSG_USEC_PER_SEC;
 
-    tv.tv_sec  = val/1000000;
-    tv.tv_usec = val - (tv.tv_sec * 1000000);
-
-    flb_time_set(&ts, ctx->boot_time.tv_sec + tv.tv_sec, tv.tv_usec * 1000);
+    /* The boot time is cached, the conversion is a single addition */
+    usec += ctx->boot_usec;
+    flb_time_set(&ts, usec / KMSG_USEC_PER_SEC,
+                 (usec % KMSG_USEC_PER_SEC) * 1000);
 
     /* Now process the human readable message */
-    p = strchr(p, ';');
-    if (!p) {
-        goto fail;
-    }
-    p++;
-
-    line_len = strlen(p);
-
-    /* Initialize local msgpack buffer */
-    msgpack_sbuffer_init(&mp_sbuf);
-    msgpack_packer_init(&mp_pck, &mp_sbuf, msgpack_sbuffer_write);
+    msg = p;
+    eol = memchr(msg, '\n', end - msg);
+    msg_len = eol ? (size_t) (eol - msg) : (size_t) (end - msg);
 
     /*
      * Store the new data into the MessagePack buffer,
      * we handle this as a list of maps.
      */
-    msgpack_pack_array(&mp_pck, 2);
-    flb_time_append_to_msgpack(&ts, &mp_pck, 0);
+    msgpack_pack_array(mp_pck, 2);
+    flb_time_append_to_msgpack(&ts, mp_pck, 0);
 
-    msgpack_pack_map(&mp_pck, 5);
-    msgpack_pack_str(&mp_pck, 8);
-    msgpack_pack_str_body(&mp_pck, "priority", 8);
-    msgpack_pack_char(&mp_pck, priority);
+    msgpack_pack_map(mp_pck, 5);
+    msgpack_pack_str(mp_pck, 8);
+    msgpack_pack_str_body(mp_pck, "priority", 8);
+    msgpack_pack_char(mp_pck, priority);
 
-    msgpack_pack_str(&mp_pck, 8);
-    msgpack_pack_str_body(&mp_pck, "sequence", 8);
-    msgpack_pack_uint64(&mp_pck, sequence);
+    msgpack_pack_str(mp_pck, 8);
+    msgpack_pack_str_body(mp_pck, "sequence", 8);
+    msgpack_pack_uint64(mp_pck, sequence);
 
-    msgpack_pack_str(&mp_pck, 3);
-    msgpack_pack_str_body(&mp_pck, "sec", 3);
-    msgpack_pack_uint64(&mp_pck, tv.tv_sec);
+    msgpack_pack_str(mp_pck, 3);
+    msgpack_pack_str_body(mp_pck, "sec", 3);
+    msgpack_pack_uint64(mp_pck, tv.tv_sec);
 
-    msgpack_pack_str(&mp_pck, 4);
-    msgpack_pack_str_body(&mp_pck, "usec", 4);
-    msgpack_pack_uint64(&mp_pck, tv.tv_usec);
+    msgpack_pack_str(mp_pck, 4);
+    msgpack_pack_str_body(mp_pck, "usec", 4);
+    msgpack_pack_uint64(mp_pck, tv.tv_usec);
 
-    msgpack_pack_str(&mp_pck, 3);
-    msgpack_pack_str_body(&mp_pck, "msg", 3);
-    msgpack_pack_str(&mp_pck, line_len - 1);
-    msgpack_pack_str_body(&mp_pck, p, line_len - 1);
+    msgpack_pack_str(mp_pck, 3);
+    msgpack_pack_str_body(mp_pck, "msg", 3);
+    msgpack_pack_str(mp_pck, msg_len);
+    msgpack_pack_str_body(mp_pck, msg, msg_len);
 
-    flb_input_chunk_append_raw(i_ins, NULL, 0, mp_sbuf.data, mp_sbuf.size);
-    msgpack_sbuffer_destroy(&mp_sbuf);
+    flb_input_batch_commit(&ctx->batch, 1);
+    ctx->seq_last = sequence;
 
-    flb_trace("[in_kmsg] pri=%i seq=%" PRIu64 " ts=%ld sec=%ld usec=%ld '%s'",
+    flb_trace("[in_kmsg] pri=%i seq=%" PRIu64 " sec=%ld usec=%ld '%.*s'",
               priority,
               sequence,
-              ts,
               (long int) tv.tv_sec,
               (long int) tv.tv_usec,
-              (const char *) p);
+              (int) msg_len, msg);
 
     return 0;
-
- fail:
-    ctx->buffer_id--;
-    return -1;
 }
 
-/* Callback triggered when some Kernel Log buffer msgs are available */
+/*
+ * Callback triggered when some Kernel Log buffer msgs are available. Every
+ * read() returns a single record, all the available ones are read until
+ * EAGAIN and ingested at once.
+ */
 static int in_kmsg_collect(struct flb_input_instance *i_ins,
                            struct flb_config *config, void *in_context)
 {
-    int ret;
     int bytes;
+    uint64_t seq;
     struct flb_in_kmsg_config *ctx = in_context;
-
-    bytes = read(ctx->fd, ctx->buf_data, ctx->buf_size - 1);
-    if (bytes == -1) {
-        if (errno == -EPIPE) {
-            return -1;
+    (void) i_ins;
+    (void) config;
+
+    seq = ctx->seq_last;
+
+    while (1) {
+        bytes = read(ctx->fd, ctx->buf_data, ctx->buf_size - 1);
+        if (bytes == -1) {
+            if (errno == EPIPE) {
+                /* Records were overwritten, continue with the next one */
+                flb_debug("[in_kmsg] kernel ring buffer overrun");
+                continue;
+            }
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                flb_errno();
+            }
+            break;
         }
-        return 0;
-    }
-    else if (bytes == 0) {
-        flb_errno();
-        return 0;
+        else if (bytes == 0) {
+            break;
+        }
+        ctx->buf_data[bytes] = '\0';
+        ctx->buf_len = bytes;
+
+        /* Process and enqueue the received record */
+        process_line(ctx->buf_data, bytes, ctx);
     }
-    ctx->buf_len += bytes;
+    ctx->buf_len = 0;
 
-    /* Always set a delimiter to avoid buffer trash */
-    ctx->buf_data[ctx->buf_len] = '\0';
+    flb_input_batch_flush(&ctx->batch);
 
-    /* Check if our buffer is full */
-    if (ctx->buffer_id + 1 == KMSG_BUFFER_SIZE) {
-        ret = flb_engine_flush(config, &in_kmsg_plugin);
-        if (ret == -1) {
-            ctx->buffer_id = 0;
-        }
+    /* Save the last sequence number ingested */
+    if (ctx->db && ctx->seq_last != seq) {
+        in_kmsg_db_set_seq(ctx, ctx->seq_last);
     }
 
-    /* Process and enqueue the received line */
-    process_line(ctx->buf_data, i_ins, ctx);
-    ctx->buf_len = 0;
-
     return 0;
 }
 
+static void in_kmsg_config_destroy(struct flb_in_kmsg_config *ctx)
+{
+    if (ctx->fd >= 0) {
+        close(ctx->fd);
+    }
+
+    in_kmsg_db_close(ctx);
+    flb_input_batch_destroy(&ctx->batch);
+    flb_free(ctx->buf_data);
+    flb_free(ctx);
+}
+
 /* Init kmsg input */
 int in_kmsg_init(struct flb_input_instance *in,
                  struct flb_config *config, void *data)
 {
     int fd;
     int ret;
+    char *tmp;
     struct flb_in_kmsg_config *ctx;
     (void) data;
 
     ctx = flb_calloc(1, sizeof(struct flb_in_kmsg_config));
     if (!ctx) {
-        perror("calloc");
+        flb_errno();
         return -1;
     }
+    ctx->fd = -1;
+    ctx->i_ins = in;
+    flb_input_batch_init(&ctx->batch, in, 0);
 
     ctx->buf_data = flb_malloc(FLB_KMSG_BUF_SIZE);
     if (!ctx->buf_data) {
         flb_errno();
-        flb_free(ctx);
+        in_kmsg_config_destroy(ctx);
         return -1;
     }
     ctx->buf_len = 0;
     ctx->buf_size = FLB_KMSG_BUF_SIZE;
 
-    /* set context */
-    flb_input_set_context(in, ctx);
-
     /* open device */
-    fd = open(FLB_KMSG_DEV, O_RDONLY);
+    fd = open(FLB_KMSG_DEV, O_RDONLY | O_NONBLOCK);
     if (fd == -1) {
         flb_errno();
-        flb_free(ctx);
+        in_kmsg_config_destroy(ctx);
         return -1;
     }
     ctx->fd = fd;
@@ -301,9 +366,32 @@ int in_kmsg_init(struct flb_input_instance *in,
     ret = boot_time(&ctx->boot_time);
     if (ret == -1) {
         flb_error("Could not get system boot time for kmsg input plugin");
-        flb_free(ctx);
+        in_kmsg_config_destroy(ctx);
         return -1;
     }
+    ctx->boot_usec = ((uint64_t) ctx->boot_time.tv_sec * KMSG_USEC_PER_SEC) +
+        ctx->boot_time.tv_usec;
+
+    /* Database: start after the last record ingested in this boot */
+    tmp = flb_input_get_property("db", in);
+    if (tmp) {
+        boot_id_read(ctx);
+        if (ctx->boot_id[0] == '\0') {
+            flb_warn("[in_kmsg] could not read the boot ID, 'db' is ignored");
+        }
+        else if (in_kmsg_db_open(ctx, tmp, config) == -1) {
+            flb_error("[in_kmsg] could not open/create database");
+        }
+        else if (in_kmsg_db_get_seq(ctx, &ctx->seq_saved) == 0) {
+            flb_info("[in_kmsg] skipping records up to sequence %" PRIu64,
+                     ctx->seq_saved);
+            ctx->seq_skip = FLB_TRUE;
+            ctx->seq_last = ctx->seq_saved;
+        }
+    }
+
+    /* set context */
+    flb_input_set_context(in, ctx);
 
     /* Set our collector based on a file descriptor event */
     ret = flb_input_set_collector_event(in,
@@ -312,7 +400,7 @@ int in_kmsg_init(struct flb_input_instance *in,
                                         config);
     if (ret == -1) {
         flb_error("Could not set collector for kmsg input plugin");
-        flb_free(ctx);
+        in_kmsg_config_destroy(ctx);
         return -1;
     }
 
@@ -324,12 +412,7 @@ static int in_kmsg_exit(void *data, struct flb_config *config)
     (void)*config;
     struct flb_in_kmsg_config *ctx = data;
 
-    if (ctx->fd >= 0) {
-        close(ctx->fd);
-    }
-
-    flb_free(ctx->buf_data);
-    flb_free(ctx);
+    in_kmsg_config_destroy(ctx);
     return 0;
 }
 
@@ -21,10 +21,16 @@
 #ifndef FLB_IN_KMSG
 #define FLB_IN_KMSG
 
+#include <fluent-bit/flb_input.h>
+#include <fluent-bit/flb_input_batch.h>
+#include <fluent-bit/flb_sqldb.h>
+
 #include <stdint.h>
+#include <sys/time.h>
 
 #define FLB_KMSG_DEV        "/dev/kmsg"
-#define FLB_KMSG_BUF_SIZE   4096
+#define FLB_KMSG_BOOT_ID    "/proc/sys/kernel/random/boot_id"
+#define FLB_KMSG_BUF_SIZE   8192
 
 /* Alert levels, taken from util-linux sources */
 #define FLB_KLOG_EMERG      0
@@ -39,20 +45,30 @@
 #define FLB_KLOG_PRIMASK    0x07
 #define FLB_KLOG_PRI(p)     ((p) & FLB_KLOG_PRIMASK)
 
-#define KMSG_BUFFER_SIZE   256
 #define KMSG_USEC_PER_SEC  1000000
 
 struct flb_in_kmsg_config {
     int fd;                    /* descriptor -> FLB_KMSG_DEV */
     struct timeval boot_time;  /* System boot time           */
+    uint64_t boot_usec;        /* boot time in microseconds  */
+    char boot_id[40];          /* boot ID (empty if unknown) */
 
-    /* Line processing */
-    int buffer_id;
+    /* Sequence numbers */
+    int seq_skip;              /* skip records up to seq_saved */
+    uint64_t seq_saved;        /* last sequence in database    */
+    uint64_t seq_last;         /* last sequence ingested       */
 
     /* Buffer */
     char *buf_data;
     size_t buf_len;
     size_t buf_size;
+
+    /* Database */
+    struct flb_sqldb *db;
+    sqlite3_stmt *stmt_set_seq;
+
+    struct flb_input_batch batch;
+    struct flb_input_instance *i_ins;
 };
 
 int in_kmsg_start();
@@ -0,0 +1,139 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2019      The Fluent Bit Authors
+ *  Copyright (C) 2015-2018 Treasure Data Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_input.h>
+#include <fluent-bit/flb_sqldb.h>
+
+#include <stdlib.h>
+#include <time.h>
+
+#include "in_kmsg.h"
+#include "in_kmsg_db.h"
+
+struct query_status {
+    int rows;
+    char *boot_id;
+    uint64_t seq;
+};
+
+static int cb_seq_check(void *data, int argc, char **argv, char **cols)
+{
+    struct query_status *qs = data;
+
+    if (argc < 2 || !argv[0] || !argv[1]) {
+        return 0;
+    }
+
+    qs->boot_id = flb_strdup(argv[0]);          /* boot ID         */
+    qs->seq = strtoull(argv[1], NULL, 10);      /* sequence number */
+    qs->rows++;
+
+    return 0;
+}
+
+int in_kmsg_db_open(struct flb_in_kmsg_config *ctx, char *path,
+                    struct flb_config *config)
+{
+    int ret;
+    struct flb_sqldb *db;
+
+    /* Open/create the database */
+    db = flb_sqldb_open(path, ctx->i_ins->name, config);
+    if (!db) {
+        return -1;
+    }
+    ctx->db = db;
+
+    /* Create table schema if it don't exists */
+    ret = flb_sqldb_query(db, SQL_CREATE_SEQ, NULL, NULL);
+    if (ret != FLB_OK) {
+        flb_error("[in_kmsg:db] could not create 'seq' table");
+        in_kmsg_db_close(ctx);
+        return -1;
+    }
+
+    ret = sqlite3_prepare_v2(db->handler, SQL_SET_SEQ, -1,
+                             &ctx->stmt_set_seq, NULL);
+    if (ret != SQLITE_OK) {
+        flb_error("[in_kmsg:db] error preparing sequence statement");
+        in_kmsg_db_close(ctx);
+        return -1;
+    }
+
+    return 0;
+}
+
+void in_kmsg_db_close(struct flb_in_kmsg_config *ctx)
+{
+    if (ctx->stmt_set_seq) {
+        sqlite3_finalize(ctx->stmt_set_seq);
+        ctx->stmt_set_seq = NULL;
+    }
+    if (ctx->db) {
+        flb_sqldb_close(ctx->db);
+        ctx->db = NULL;
+    }
+}
+
+/*
+ * Get the last sequence number saved for the current boot. Returns 0 if
+ * found, -1 if there is none or it belongs to another boot.
+ */
+int in_kmsg_db_get_seq(struct flb_in_kmsg_config *ctx, uint64_t *seq)
+{
+    int ret;
+    struct query_status qs;
+
+    memset(&qs, '\0', sizeof(qs));
+    ret = flb_sqldb_query(ctx->db, SQL_GET_SEQ, cb_seq_check, &qs);
+    if (ret != FLB_OK || qs.rows == 0) {
+        return -1;
+    }
+
+    ret = -1;
+    if (strcmp(qs.boot_id, ctx->boot_id) == 0) {
+        *seq = qs.seq;
+        ret = 0;
+    }
+    flb_free(qs.boot_id);
+
+    return ret;
+}
+
+int in_kmsg_db_set_seq(struct flb_in_kmsg_config *ctx, uint64_t seq)
+{
+    int ret;
+    sqlite3_stmt *stmt = ctx->stmt_set_seq;
+
+    sqlite3_bind_text(stmt, 1, ctx->boot_id, -1, SQLITE_STATIC);
+    sqlite3_bind_int64(stmt, 2, seq);
+    sqlite3_bind_int64(stmt, 3, time(NULL));
+    ret = sqlite3_step(stmt);
+    sqlite3_clear_bindings(stmt);
+    sqlite3_reset(stmt);
+
+    if (ret != SQLITE_DONE) {
+        flb_error("[in_kmsg:db] could not save sequence, ret=%i", ret);
+        return -1;
+    }
+
+    return 0;
+}
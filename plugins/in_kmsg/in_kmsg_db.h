@@ -0,0 +1,56 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2019      The Fluent Bit Authors
+ *  Copyright (C) 2015-2018 Treasure Data Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef FLB_IN_KMSG_DB_H
+#define FLB_IN_KMSG_DB_H
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_input.h>
+#include <fluent-bit/flb_config.h>
+
+#include "in_kmsg.h"
+
+/*
+ * A single row keeps the sequence number of the last record ingested and
+ * the ID of the boot it belongs to: sequence numbers restart on every boot.
+ */
+#define SQL_CREATE_SEQ                                                  \
+    "CREATE TABLE IF NOT EXISTS in_kmsg_seq ("                          \
+    "  id      INTEGER PRIMARY KEY,"                                    \
+    "  boot_id TEXT NOT NULL,"                                          \
+    "  seq     INTEGER NOT NULL,"                                       \
+    "  updated INTEGER"                                                 \
+    ");"
+
+#define SQL_GET_SEQ \
+    "SELECT boot_id, seq FROM in_kmsg_seq WHERE id=0;"
+
+/* Prepared statement: @boot_id, @seq, @updated */
+#define SQL_SET_SEQ                                                     \
+    "INSERT OR REPLACE INTO in_kmsg_seq (id, boot_id, seq, updated)"    \
+    "  VALUES (0, @boot_id, @seq, @updated);"
+
+int in_kmsg_db_open(struct flb_in_kmsg_config *ctx, char *path,
+                    struct flb_config *config);
+void in_kmsg_db_close(struct flb_in_kmsg_config *ctx);
+int in_kmsg_db_get_seq(struct flb_in_kmsg_config *ctx, uint64_t *seq);
+int in_kmsg_db_set_seq(struct flb_in_kmsg_config *ctx, uint64_t seq);
+
+#endif
@@ -20,6 +20,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
@@ -35,12 +36,15 @@ static int in_lib_collect(struct flb_input_instance *i_ins,
                           struct flb_config *config, void *in_context)
 {
     int ret;
+    int type;
     int bytes;
-    int out_size;
     int capacity;
     int size;
+    size_t off;
+    size_t processed;
+    size_t value_len;
     char *ptr;
-    char *pack;
+    char *value;
     struct flb_in_lib_config *ctx = in_context;
 
     capacity = (ctx->buf_size - ctx->buf_len);
@@ -71,28 +75,47 @@ static int in_lib_collect(struct flb_input_instance *i_ins,
     }
     ctx->buf_len += bytes;
 
-    /* initially we should support json input */
-    ret = flb_pack_json_state(ctx->buf_data, ctx->buf_len,
-                              &pack, &out_size, &ctx->state);
-    if (ret == FLB_ERR_JSON_PART) {
-        flb_warn("lib data incomplete, waiting for more data...");
-        return 0;
+    /*
+     * Initially we should support json input. Every complete JSON message
+     * is packed as a record, an incomplete one is resumed on next read.
+     */
+    while (1) {
+        ret = flb_pack_json_stream_next(&ctx->stream,
+                                        ctx->buf_data, ctx->buf_len,
+                                        &value, &value_len, &type);
+        if (ret != 0) {
+            break;
+        }
+
+        off = ctx->batch.mp_sbuf.size;
+        ret = flb_pack_json_stream_pack(&ctx->stream, value, value_len,
+                                        &ctx->batch.mp_pck);
+        if (ret != 0) {
+            flb_warn("lib data invalid, skipping message");
+            ctx->batch.mp_sbuf.size = off;
+            continue;
+        }
+        flb_input_batch_commit(&ctx->batch, 1);
     }
-    else if (ret == FLB_ERR_JSON_INVAL) {
+    flb_input_batch_flush(&ctx->batch);
+
+    if (ret == FLB_ERR_JSON_INVAL) {
         flb_warn("lib data invalid");
-        flb_pack_state_reset(&ctx->state);
-        flb_pack_state_init(&ctx->state);
+        flb_pack_json_stream_reset(&ctx->stream);
+        ctx->buf_len = 0;
         return -1;
     }
-    ctx->buf_len = 0;
 
-    /* Pack data */
-    flb_input_chunk_append_raw(ctx->i_ins, NULL, 0, pack, out_size);
-    flb_free(pack);
-    flb_pack_state_reset(&ctx->state);
-    flb_pack_state_init(&ctx->state);
+    /* Release processed bytes */
+    processed = flb_pack_json_stream_processed(&ctx->stream);
+    if (processed > 0) {
+        memmove(ctx->buf_data, ctx->buf_data + processed,
+                ctx->buf_len - processed);
+        ctx->buf_len -= processed;
+        flb_pack_json_stream_consume(&ctx->stream, processed);
+    }
 
-    return ret;
+    return 0;
 }
 
 /* Initialize plugin */
@@ -121,6 +144,14 @@ int in_lib_init(struct flb_input_instance *in,
         return -1;
     }
 
+    ret = flb_pack_json_stream_init(&ctx->stream, FLB_FALSE);
+    if (ret == -1) {
+        flb_free(ctx->buf_data);
+        flb_free(ctx);
+        return -1;
+    }
+    flb_input_batch_init(&ctx->batch, in, 0);
+
     /* Init communication channel */
     flb_input_channel_init(in);
     ctx->fd = in->channel[0];
@@ -135,12 +166,13 @@ int in_lib_init(struct flb_input_instance *in,
                                         config);
     if (ret == -1) {
         flb_error("Could not set collector for LIB input plugin");
+        flb_pack_json_stream_destroy(&ctx->stream);
+        flb_input_batch_destroy(&ctx->batch);
         flb_free(ctx->buf_data);
         flb_free(ctx);
         return -1;
     }
 
-    flb_pack_state_init(&ctx->state);
     return 0;
 }
 
@@ -148,16 +180,13 @@ static int in_lib_exit(void *data, struct flb_config *config)
 {
     (void) config;
     struct flb_in_lib_config *ctx = data;
-    struct flb_pack_state *s;
 
     if (ctx->buf_data) {
         flb_free(ctx->buf_data);
     }
 
-    s = &ctx->state;
-    if (s->tokens) {
-        flb_free(s->tokens);
-    }
+    flb_pack_json_stream_destroy(&ctx->stream);
+    flb_input_batch_destroy(&ctx->batch);
 
     flb_free(ctx);
     return 0;
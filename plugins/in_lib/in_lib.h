@@ -24,6 +24,7 @@
 #include <fluent-bit/flb_config.h>
 #include <fluent-bit/flb_input.h>
 #include <fluent-bit/flb_pack.h>
+#include <fluent-bit/flb_input_batch.h>
 
 #define LIB_BUF_CHUNK   65536
 
@@ -34,7 +35,8 @@ struct flb_in_lib_config {
     int buf_len;                /* read buffer length      */
     char *buf_data;             /* the real buffer         */
 
-    struct flb_pack_state state;
+    struct flb_pack_json_stream stream;
+    struct flb_input_batch batch;
     struct flb_input_instance *i_ins;
 };
 
@@ -26,6 +26,44 @@
 #include "mqtt_conn.h"
 #include "mqtt_config.h"
 
+/* Worker threads: new connection accepted */
+static int in_mqtt_worker_accept(flb_sockfd_t fd,
+                                 struct flb_net_worker *worker, void *data)
+{
+    struct mqtt_conn *conn;
+
+    conn = mqtt_conn_add(fd, data, worker);
+    if (!conn) {
+        return -1;
+    }
+    return 0;
+}
+
+/* Worker threads: release the connections once the thread finished */
+static void in_mqtt_worker_exit(struct flb_net_worker *worker, void *data)
+{
+    struct mk_list *tmp;
+    struct mk_list *head;
+    struct mqtt_conn *conn;
+    (void) data;
+
+    mk_list_foreach_safe(head, tmp, &worker->connections) {
+        conn = mk_list_entry(head, struct mqtt_conn, _head);
+        mqtt_conn_del(conn);
+    }
+}
+
+/* Records decoded by the worker threads */
+static int in_mqtt_collect_workers(struct flb_input_instance *i_ins,
+                                   struct flb_config *config, void *in_context)
+{
+    struct flb_in_mqtt_config *ctx = in_context;
+    (void) i_ins;
+    (void) config;
+
+    return flb_net_workers_collect(ctx->net_workers);
+}
+
 /* Initialize plugin */
 static int in_mqtt_init(struct flb_input_instance *in,
                         struct flb_config *config, void *data)
@@ -40,10 +78,40 @@ static int in_mqtt_init(struct flb_input_instance *in,
         return -1;
     }
     ctx->msgp_len = 0;
+    ctx->evl = config->evl;
+    ctx->i_ins = in;
 
     /* Set the context */
     flb_input_set_context(in, ctx);
 
+    /* Accept and read the connections in worker threads */
+    if (ctx->workers > 0) {
+        ctx->net_workers = flb_net_workers_create(in,
+                                                  ctx->listen, ctx->tcp_port,
+                                                  ctx->workers,
+                                                  in_mqtt_worker_accept,
+                                                  in_mqtt_worker_exit,
+                                                  ctx);
+        if (!ctx->net_workers) {
+            flb_error("[in_mqtt] could not start workers on %s:%s",
+                      ctx->listen, ctx->tcp_port);
+            mqtt_config_free(ctx);
+            return -1;
+        }
+
+        ret = flb_input_set_collector_event(in,
+                                            in_mqtt_collect_workers,
+                                            ctx->net_workers->ch_batches[0],
+                                            config);
+        if (ret == -1) {
+            flb_error("[in_mqtt] Could not set collector for MQTT input plugin");
+            flb_net_workers_destroy(ctx->net_workers);
+            mqtt_config_free(ctx);
+            return -1;
+        }
+        return 0;
+    }
+
     /* Create TCP server */
     ctx->server_fd = flb_net_server(ctx->tcp_port, ctx->listen);
     if (ctx->server_fd > 0) {
@@ -55,8 +123,6 @@ static int in_mqtt_init(struct flb_input_instance *in,
         mqtt_config_free(ctx);
         return -1;
     }
-    ctx->evl = config->evl;
-    ctx->i_ins = in;
 
     /* Collect upon data available on the standard input */
     ret = flb_input_set_collector_event(in,
@@ -92,18 +158,42 @@ int in_mqtt_collect(struct flb_input_instance *i_ins,
     }
 
     flb_trace("[in_mqtt] [fd=%i] new TCP connection", fd);
-    conn = mqtt_conn_add(fd, ctx);
+    conn = mqtt_conn_add(fd, ctx, NULL);
     if (!conn) {
         return -1;
     }
     return 0;
 }
 
+/* Paused instance: the worker threads stop reading their connections */
+static void in_mqtt_pause(void *data, struct flb_config *config)
+{
+    struct flb_in_mqtt_config *ctx = data;
+    (void) config;
+
+    if (ctx->net_workers) {
+        flb_net_workers_pause(ctx->net_workers);
+    }
+}
+
+static void in_mqtt_resume(void *data, struct flb_config *config)
+{
+    struct flb_in_mqtt_config *ctx = data;
+    (void) config;
+
+    if (ctx->net_workers) {
+        flb_net_workers_resume(ctx->net_workers);
+    }
+}
+
 static int in_mqtt_exit(void *data, struct flb_config *config)
 {
     (void) *config;
     struct flb_in_mqtt_config *ctx = data;
 
+    if (ctx->net_workers) {
+        flb_net_workers_destroy(ctx->net_workers);
+    }
     mqtt_conn_destroy_all(ctx);
     mqtt_config_free(ctx);
 
@@ -118,6 +208,8 @@ struct flb_input_plugin in_mqtt_plugin = {
     .cb_pre_run   = NULL,
     .cb_collect   = in_mqtt_collect,
     .cb_flush_buf = NULL,
+    .cb_pause     = in_mqtt_pause,
+    .cb_resume    = in_mqtt_resume,
     .cb_exit      = in_mqtt_exit,
     .flags        = FLB_INPUT_NET,
 };
@@ -21,19 +21,25 @@
 #ifndef FLB_IN_MQTT_H
 #define FLB_IN_MQTT_H
 
+#include <fluent-bit/flb_input_batch.h>
+#include <fluent-bit/flb_net_workers.h>
+
 #define MQTT_MSGP_BUF_SIZE 8192
 
 struct flb_in_mqtt_config {
     int server_fd;                     /* TCP server file descriptor  */
+    int workers;                       /* number of worker threads    */
 
     char *listen;                      /* Listen interface            */
     char *tcp_port;                    /* TCP Port                    */
 
     int msgp_len;                      /* msgpack data length         */
     char msgp[MQTT_MSGP_BUF_SIZE];     /* msgpack static buffer       */
+    struct flb_input_batch batch;      /* records pending to append   */
     struct flb_input_instance *i_ins;  /* plugin input instance       */
     struct mk_event_loop *evl;         /* Event loop file descriptor  */
     struct mk_list conns;              /* Active connections          */
+    struct flb_net_workers *net_workers; /* Listener threads          */
 };
 
 int in_mqtt_collect(struct flb_input_instance *i_ins,
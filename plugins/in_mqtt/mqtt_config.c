@@ -29,6 +29,7 @@ struct flb_in_mqtt_config *mqtt_config_init(struct flb_input_instance *i_ins)
 {
     char tmp[16];
     char *listen;
+    char *workers;
     struct flb_in_mqtt_config *config;
 
     config = flb_calloc(1, sizeof(struct flb_in_mqtt_config));
@@ -60,10 +61,20 @@ struct flb_in_mqtt_config *mqtt_config_init(struct flb_input_instance *i_ins)
         config->tcp_port = flb_strdup(tmp);
     }
 
+    /* Worker threads (0: connections are handled by the engine thread) */
+    workers = flb_input_get_property("workers", i_ins);
+    if (workers) {
+        config->workers = atoi(workers);
+        if (config->workers < 0) {
+            config->workers = 0;
+        }
+    }
+
     flb_debug("[in_mqtt] Listen='%s' TCP_Port=%s",
               config->listen, config->tcp_port);
 
     mk_list_init(&config->conns);
+    flb_input_batch_init(&config->batch, i_ins, FLB_INPUT_BATCH_SIZE);
     return config;
 }
 
@@ -74,5 +85,6 @@ void mqtt_config_free(struct flb_in_mqtt_config *config)
     }
     flb_free(config->listen);
     flb_free(config->tcp_port);
+    flb_input_batch_destroy(&config->batch);
     flb_free(config);
 }
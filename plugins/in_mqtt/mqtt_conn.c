@@ -46,6 +46,7 @@ int mqtt_conn_event(void *data)
             flb_trace("[in_mqtt] [fd=%i] read()=%i bytes",
                       conn->event.fd, bytes);
             ret = mqtt_prot_parser(conn);
+            flb_input_batch_flush(conn->batch);
             if (ret < 0) {
                 mqtt_conn_del(conn);
                 return -1;
@@ -63,8 +64,12 @@ int mqtt_conn_event(void *data)
     return 0;
 }
 
-/* Create a new mqtt request instance */
-struct mqtt_conn *mqtt_conn_add(int fd, struct flb_in_mqtt_config *ctx)
+/*
+ * Create a new mqtt request instance. If 'worker' is set the connection is
+ * handled by that worker thread, otherwise by the engine thread.
+ */
+struct mqtt_conn *mqtt_conn_add(int fd, struct flb_in_mqtt_config *ctx,
+                                struct flb_net_worker *worker)
 {
     int ret;
     struct mqtt_conn *conn;
@@ -92,8 +97,17 @@ struct mqtt_conn *mqtt_conn_add(int fd, struct flb_in_mqtt_config *ctx)
     conn->buf_frame_end = 0;
     conn->status  = MQTT_NEW;
 
+    if (worker) {
+        conn->evl = worker->evl;
+        conn->batch = &worker->batch;
+    }
+    else {
+        conn->evl = ctx->evl;
+        conn->batch = &ctx->batch;
+    }
+
     /* Register instance into the event loop */
-    ret = mk_event_add(ctx->evl, fd, FLB_ENGINE_EV_CUSTOM, MK_EVENT_READ, conn);
+    ret = mk_event_add(conn->evl, fd, FLB_ENGINE_EV_CUSTOM, MK_EVENT_READ, conn);
     if (ret == -1) {
         flb_error("[mqtt] could not register new connection");
         close(fd);
@@ -101,14 +115,19 @@ struct mqtt_conn *mqtt_conn_add(int fd, struct flb_in_mqtt_config *ctx)
         return NULL;
     }
 
-    mk_list_add(&conn->_head, &ctx->conns);
+    if (worker) {
+        mk_list_add(&conn->_head, &worker->connections);
+    }
+    else {
+        mk_list_add(&conn->_head, &ctx->conns);
+    }
     return conn;
 }
 
 int mqtt_conn_del(struct mqtt_conn *conn)
 {
     /* Unregister the file descriptior from the event-loop */
-    mk_event_del(conn->ctx->evl, &conn->event);
+    mk_event_del(conn->evl, &conn->event);
 
     /* Release resources */
     close(conn->fd);
@@ -21,6 +21,9 @@
 #ifndef FLB_MQTT_CONN_H
 #define FLB_MQTT_CONN_H
 
+#include <fluent-bit/flb_input_batch.h>
+#include <fluent-bit/flb_net_workers.h>
+
 enum {
     MQTT_NEW        = 1,  /* it's a new connection                */
     MQTT_CONNECTED  = 2,  /* MQTT connection per protocol spec OK */
@@ -38,11 +41,14 @@ struct mqtt_conn {
     int  buf_pos;                    /* Index position                    */
     int  buf_len;                    /* Buffer content length             */
     unsigned char buf[1024];         /* Buffer data                       */
+    struct mk_event_loop *evl;       /* Event loop of the owner thread    */
+    struct flb_input_batch *batch;   /* Batch of the owner thread         */
     struct flb_in_mqtt_config *ctx;  /* Plugin configuration context      */
     struct mk_list _head;            /* Link to flb_in_mqtt_config->conns */
 };
 
-struct mqtt_conn *mqtt_conn_add(int fd, struct flb_in_mqtt_config *ctx);
+struct mqtt_conn *mqtt_conn_add(int fd, struct flb_in_mqtt_config *ctx,
+                                struct flb_net_worker *worker);
 int mqtt_conn_del(struct mqtt_conn *conn);
 int mqtt_conn_destroy_all(struct flb_in_mqtt_config *ctx);
 
@@ -28,6 +28,7 @@
 
 
 #include "mqtt.h"
+#include "mqtt_conn.h"
 #include "mqtt_prot.h"
 
 #define BUFC()          conn->buf[conn->buf_pos]
@@ -119,7 +120,7 @@ static inline int mqtt_packet_header(int type, int length, char *buf)
 /* Collect a buffer of JSON data and convert it to Fluent Bit format */
 static int mqtt_data_append(char *topic, size_t topic_len,
                             char *msg, int msg_len,
-                            void *in_context)
+                            struct flb_input_batch *batch)
 {
     int i;
     int ret;
@@ -130,9 +131,7 @@ static int mqtt_data_append(char *topic, size_t topic_len,
     char *pack;
     msgpack_object root;
     msgpack_unpacked result;
-    msgpack_packer mp_pck;
-    msgpack_sbuffer mp_sbuf;
-    struct flb_in_mqtt_config *ctx = in_context;
+    msgpack_packer *mp_pck;
 
     /* Convert our incoming JSON to MsgPack */
     ret = flb_pack_json(msg, msg_len, &pack, &out, &root_type);
@@ -154,30 +153,26 @@ static int mqtt_data_append(char *topic, size_t topic_len,
     }
     root = result.data;
 
-    /* Initialize local msgpack buffer */
-    msgpack_sbuffer_init(&mp_sbuf);
-    msgpack_packer_init(&mp_pck, &mp_sbuf, msgpack_sbuffer_write);
-
-    /* Pack data */
-    msgpack_pack_array(&mp_pck, 2);
-    flb_pack_time_now(&mp_pck);
+    /* Pack data into the connection batch */
+    mp_pck = &batch->mp_pck;
+    msgpack_pack_array(mp_pck, 2);
+    flb_pack_time_now(mp_pck);
 
     n_size = root.via.map.size;
-    msgpack_pack_map(&mp_pck, n_size + 1);
-    msgpack_pack_str(&mp_pck, 5);
-    msgpack_pack_str_body(&mp_pck, "topic", 5);
-    msgpack_pack_str(&mp_pck, topic_len);
-    msgpack_pack_str_body(&mp_pck, topic, topic_len);
+    msgpack_pack_map(mp_pck, n_size + 1);
+    msgpack_pack_str(mp_pck, 5);
+    msgpack_pack_str_body(mp_pck, "topic", 5);
+    msgpack_pack_str(mp_pck, topic_len);
+    msgpack_pack_str_body(mp_pck, topic, topic_len);
 
     /* Re-pack original KVs */
     for (i = 0; i < n_size; i++) {
-        msgpack_pack_object(&mp_pck, root.via.map.ptr[i].key);
-        msgpack_pack_object(&mp_pck, root.via.map.ptr[i].val);
+        msgpack_pack_object(mp_pck, root.via.map.ptr[i].key);
+        msgpack_pack_object(mp_pck, root.via.map.ptr[i].val);
     }
 
-
-    flb_input_chunk_append_raw(ctx->i_ins, NULL, 0, mp_sbuf.data, mp_sbuf.size);
-    msgpack_sbuffer_destroy(&mp_sbuf);
+    /* The batch is flushed once the connection event is processed */
+    flb_input_batch_commit(batch, 1);
 
     msgpack_unpacked_destroy(&result);
     flb_free(pack);
@@ -263,7 +258,7 @@ static int mqtt_handle_publish(struct mqtt_conn *conn)
     mqtt_data_append((char *) (conn->buf + topic), topic_len,
                      (char *) (conn->buf + conn->buf_pos),
                      conn->buf_frame_end - conn->buf_pos + 1,
-                     conn->ctx);
+                     conn->batch);
 
     flb_trace("[in_mqtt] [fd=%i] CMD PUBLISH",
               conn->event.fd);
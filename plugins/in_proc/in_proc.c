@@ -238,8 +238,7 @@ static int generate_record_linux(struct flb_input_instance *i_ins,
     int i;
     int map_num = 3;    /* 3 = alive, proc_name, pid */
     struct flb_in_proc_config *ctx = in_context;
-    msgpack_packer mp_pck;
-    msgpack_sbuffer mp_sbuf;
+    msgpack_packer *mp_pck = &ctx->batch.mp_pck;
 
     if (ctx->alive == FLB_TRUE && ctx->alert == FLB_TRUE) {
         return 0;
@@ -256,38 +255,34 @@ static int generate_record_linux(struct flb_input_instance *i_ins,
      * Store the new data into the MessagePack buffer,
      */
 
-    /* Initialize local msgpack buffer */
-    msgpack_sbuffer_init(&mp_sbuf);
-    msgpack_packer_init(&mp_pck, &mp_sbuf, msgpack_sbuffer_write);
-
     /* Pack data */
-    msgpack_pack_array(&mp_pck, 2);
-    flb_pack_time_now(&mp_pck);
+    msgpack_pack_array(mp_pck, 2);
+    flb_pack_time_now(mp_pck);
 
     /* 3 = alive, proc_name, pid */
-    msgpack_pack_map(&mp_pck, map_num);
+    msgpack_pack_map(mp_pck, map_num);
 
     /* Status */
-    msgpack_pack_str(&mp_pck, 5);
-    msgpack_pack_str_body(&mp_pck, "alive", 5);
+    msgpack_pack_str(mp_pck, 5);
+    msgpack_pack_str_body(mp_pck, "alive", 5);
 
     if (ctx->alive) {
-        msgpack_pack_true(&mp_pck);
+        msgpack_pack_true(mp_pck);
     }
     else {
-        msgpack_pack_false(&mp_pck);
+        msgpack_pack_false(mp_pck);
     }
 
     /* proc name */
-    msgpack_pack_str(&mp_pck, strlen("proc_name"));
-    msgpack_pack_str_body(&mp_pck, "proc_name", strlen("proc_name"));
-    msgpack_pack_str(&mp_pck, ctx->len_proc_name);
-    msgpack_pack_str_body(&mp_pck, ctx->proc_name, ctx->len_proc_name);
+    msgpack_pack_str(mp_pck, strlen("proc_name"));
+    msgpack_pack_str_body(mp_pck, "proc_name", strlen("proc_name"));
+    msgpack_pack_str(mp_pck, ctx->len_proc_name);
+    msgpack_pack_str_body(mp_pck, ctx->proc_name, ctx->len_proc_name);
 
     /* pid */
-    msgpack_pack_str(&mp_pck, strlen("pid"));
-    msgpack_pack_str_body(&mp_pck, "pid", strlen("pid"));
-    msgpack_pack_int64(&mp_pck, ctx->pid);
+    msgpack_pack_str(mp_pck, strlen("pid"));
+    msgpack_pack_str_body(mp_pck, "pid", strlen("pid"));
+    msgpack_pack_int64(mp_pck, ctx->pid);
 
     /* memory */
     if (ctx->mem == FLB_TRUE) {
@@ -296,21 +291,20 @@ static int generate_record_linux(struct flb_input_instance *i_ins,
         for (i = 0; mem_linux[i].key != NULL; i++) {
             str = mem_linux[i].msgpack_key;
             val = (uint64_t*)((char*)mem_stat + mem_linux[i].offset);
-            msgpack_pack_str(&mp_pck, strlen(str));
-            msgpack_pack_str_body(&mp_pck, str, strlen(str));
-            msgpack_pack_uint64(&mp_pck, *val);
+            msgpack_pack_str(mp_pck, strlen(str));
+            msgpack_pack_str_body(mp_pck, str, strlen(str));
+            msgpack_pack_uint64(mp_pck, *val);
         }
     }
 
     /* file descriptor */
     if (ctx->fds == FLB_TRUE) {
-        msgpack_pack_str(&mp_pck, strlen("fd"));
-        msgpack_pack_str_body(&mp_pck, "fd", strlen("fd"));
-        msgpack_pack_uint64(&mp_pck, fds);
+        msgpack_pack_str(mp_pck, strlen("fd"));
+        msgpack_pack_str_body(mp_pck, "fd", strlen("fd"));
+        msgpack_pack_uint64(mp_pck, fds);
     }
 
-    flb_input_chunk_append_raw(i_ins, NULL, 0, mp_sbuf.data, mp_sbuf.size);
-    msgpack_sbuffer_destroy(&mp_sbuf);
+    flb_input_batch_commit(&ctx->batch, 1);
 
     return 0;
 }
@@ -448,6 +442,7 @@ static int in_proc_collect_linux(struct flb_input_instance *i_ins,
             update_fds_linux(ctx, &fds);
         }
         generate_record_linux(i_ins, config, in_context, &mem, fds);
+        flb_input_batch_flush(&ctx->batch);
     }
 
     return 0;
@@ -478,6 +473,7 @@ static int in_proc_init(struct flb_input_instance *in,
     ctx->fds   = FLB_TRUE;
     ctx->proc_name = NULL;
     ctx->pid = -1;
+    flb_input_batch_init(&ctx->batch, in, FLB_INPUT_BATCH_SIZE);
 
     configure(ctx, in);
 
@@ -511,6 +507,7 @@ static int in_proc_exit(void *data, struct flb_config *config)
     struct flb_in_proc_config *ctx = data;
 
     /* Destroy context */
+    flb_input_batch_destroy(&ctx->batch);
     flb_free(ctx->proc_name);
     flb_free(ctx);
 
@@ -24,6 +24,7 @@
 #include <stdint.h>
 #include <unistd.h>
 #include <fluent-bit/flb_input.h>
+#include <fluent-bit/flb_input_batch.h>
 #include <msgpack.h>
 
 #define DEFAULT_INTERVAL_SEC  1
@@ -70,6 +71,9 @@ struct flb_in_proc_config {
 
     /* File descriptor */
     uint8_t fds;
+
+    /* Records buffer, reused on every collection */
+    struct flb_input_batch batch;
 };
 
 extern struct flb_input_plugin in_proc_plugin;
@@ -35,6 +35,7 @@
 #include "syslog_server.h"
 #include "syslog_conn.h"
 #include "syslog_prot.h"
+#include "syslog_udp.h"
 
 /* cb_collect callback */
 static int in_syslog_collect_tcp(struct flb_input_instance *i_ins,
@@ -53,7 +54,7 @@ static int in_syslog_collect_tcp(struct flb_input_instance *i_ins,
     }
 
     flb_trace("[in_syslog] new Unix connection arrived FD=%i", fd);
-    conn = syslog_conn_add(fd, ctx);
+    conn = syslog_conn_add(fd, ctx, NULL);
     if (!conn) {
         return -1;
     }
@@ -62,31 +63,35 @@ static int in_syslog_collect_tcp(struct flb_input_instance *i_ins,
 }
 
 /*
- * Collect a datagram, per Syslog specification a datagram contains only
- * one syslog message and it should not exceed 1KB.
+ * Collect datagrams, per Syslog specification a datagram contains only
+ * one syslog message and it should not exceed 1KB. Many datagrams are
+ * read at once with recvmmsg(2) when available.
  */
 static int in_syslog_collect_udp(struct flb_input_instance *i_ins,
                                  struct flb_config *config,
                                  void *in_context)
 {
-    int bytes;
     struct flb_syslog *ctx = in_context;
     (void) i_ins;
+    (void) config;
 
-    bytes = recvfrom(ctx->server_fd,
-                     ctx->buffer_data, ctx->buffer_size - 1, 0,
-                     NULL, NULL);
-    if (bytes > 0) {
-        ctx->buffer_data[bytes] = '\0';
-        ctx->buffer_len = bytes;
-        syslog_prot_process_udp(ctx->buffer_data, ctx->buffer_len, ctx);
-    }
-    else {
-        flb_errno();
+    return syslog_udp_collect(ctx);
+}
+
+/* Records read by the worker threads: TCP connections or UDP datagrams */
+static int in_syslog_collect_workers(struct flb_input_instance *i_ins,
+                                     struct flb_config *config,
+                                     void *in_context)
+{
+    struct flb_syslog *ctx = in_context;
+    (void) i_ins;
+    (void) config;
+
+    if (ctx->mode == FLB_SYSLOG_UDP) {
+        return syslog_udp_collect_workers(ctx);
     }
-    ctx->buffer_len = 0;
 
-    return 0;
+    return flb_net_workers_collect(ctx->net_workers);
 }
 
 /* Initialize plugin */
@@ -121,8 +126,14 @@ static int in_syslog_init(struct flb_input_instance *in,
     flb_input_set_context(in, ctx);
 
     /* Collect events for every opened connection to our socket */
-    if (ctx->mode == FLB_SYSLOG_UNIX_TCP ||
-        ctx->mode == FLB_SYSLOG_TCP) {
+    if (ctx->net_workers) {
+        ret = flb_input_set_collector_event(in,
+                                            in_syslog_collect_workers,
+                                            ctx->net_workers->ch_batches[0],
+                                            config);
+    }
+    else if (ctx->mode == FLB_SYSLOG_UNIX_TCP ||
+             ctx->mode == FLB_SYSLOG_TCP) {
         ret = flb_input_set_collector_socket(in,
                                              in_syslog_collect_tcp,
                                              ctx->server_fd,
@@ -138,11 +149,33 @@ static int in_syslog_init(struct flb_input_instance *in,
     if (ret == -1) {
         flb_error("[in_syslog] Could not set collector");
         syslog_conf_destroy(ctx);
+        return -1;
     }
 
     return 0;
 }
 
+/* Paused instance: the worker threads stop reading their input */
+static void in_syslog_pause(void *data, struct flb_config *config)
+{
+    struct flb_syslog *ctx = data;
+    (void) config;
+
+    if (ctx->net_workers) {
+        flb_net_workers_pause(ctx->net_workers);
+    }
+}
+
+static void in_syslog_resume(void *data, struct flb_config *config)
+{
+    struct flb_syslog *ctx = data;
+    (void) config;
+
+    if (ctx->net_workers) {
+        flb_net_workers_resume(ctx->net_workers);
+    }
+}
+
 static int in_syslog_exit(void *data, struct flb_config *config)
 {
     struct flb_syslog *ctx = data;
@@ -162,6 +195,8 @@ struct flb_input_plugin in_syslog_plugin = {
     .cb_pre_run   = NULL,
     .cb_collect   = NULL,
     .cb_flush_buf = NULL,
+    .cb_pause     = in_syslog_pause,
+    .cb_resume    = in_syslog_resume,
     .cb_exit      = in_syslog_exit,
     .flags        = FLB_INPUT_NET
 };
@@ -23,6 +23,10 @@
 
 #include <fluent-bit/flb_info.h>
 #include <fluent-bit/flb_input.h>
+#include <fluent-bit/flb_input_batch.h>
+#include <fluent-bit/flb_net_workers.h>
+
+#include <stdint.h>
 
 /* Syslog modes */
 #define FLB_SYSLOG_UNIX_TCP  1
@@ -33,6 +37,11 @@
 /* 32KB chunk size */
 #define FLB_SYSLOG_CHUNK   32768
 
+/* Number of datagrams read per recvmmsg(2) call */
+#define FLB_SYSLOG_UDP_BATCH  16
+
+struct syslog_udp_rx;
+
 /* Context / Config*/
 struct flb_syslog {
     /* Listening mode: unix udp, unix tcp or normal tcp */
@@ -46,10 +55,15 @@ struct flb_syslog {
     int server_fd;
     char *unix_path;
 
-    /* UDP buffer, data length and buffer size */
-    char *buffer_data;
-    size_t buffer_len;
-    size_t buffer_size;
+    /* UDP: datagrams per read, Kernel buffer size and receiver threads */
+    int udp_batch;
+    int receive_buffer_size;
+    int workers;                       /* UDP receivers or TCP workers     */
+    struct syslog_udp_rx *rx;          /* receiver for the engine thread   */
+    uint32_t udp_drops;                /* Kernel drops seen by receivers   */
+
+    /* Sockets read by worker threads: TCP connections or UDP datagrams */
+    struct flb_net_workers *net_workers;
 
     /* Buffers setup */
     size_t buffer_max_size;
@@ -58,6 +72,9 @@ struct flb_syslog {
     /* Configuration */
     struct flb_parser *parser;
 
+    /* Records batch, flushed at the end of every event callback */
+    struct flb_input_batch batch;
+
     /* List for connections and event loop */
     struct mk_list connections;
     struct mk_event_loop *evl;
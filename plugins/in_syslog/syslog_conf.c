@@ -44,8 +44,9 @@ struct flb_syslog *syslog_conf_create(struct flb_input_instance *i_ins,
     }
     ctx->evl = config->evl;
     ctx->i_ins = i_ins;
-    ctx->buffer_data = NULL;
+    ctx->server_fd = -1;
     mk_list_init(&ctx->connections);
+    flb_input_batch_init(&ctx->batch, i_ins, FLB_INPUT_BATCH_SIZE);
 
     /* Syslog mode: unix_udp, unix_tcp, tcp or udp */
     tmp = flb_input_get_property("mode", i_ins);
@@ -124,6 +125,36 @@ struct flb_syslog *syslog_conf_create(struct flb_input_instance *i_ins,
         ctx->buffer_max_size  = flb_utils_size_to_bytes(tmp);
     }
 
+    /* Datagrams read per call */
+    tmp = flb_input_get_property("udp_batch", i_ins);
+    if (tmp) {
+        ctx->udp_batch = atoi(tmp);
+    }
+    if (ctx->udp_batch <= 0) {
+        ctx->udp_batch = FLB_SYSLOG_UDP_BATCH;
+    }
+
+    /* Kernel receive buffer (SO_RCVBUF) */
+    tmp = flb_input_get_property("receive_buffer_size", i_ins);
+    if (tmp) {
+        ctx->receive_buffer_size = flb_utils_size_to_bytes(tmp);
+    }
+
+    /* UDP receiver threads or TCP workers */
+    tmp = flb_input_get_property("workers", i_ins);
+    if (tmp) {
+        ctx->workers = atoi(tmp);
+        if (ctx->workers < 0) {
+            ctx->workers = 0;
+        }
+        if (ctx->workers > 0 && ctx->mode != FLB_SYSLOG_UDP &&
+            ctx->mode != FLB_SYSLOG_TCP) {
+            flb_warn("[in_syslog] 'workers' is only supported in udp and "
+                     "tcp modes");
+            ctx->workers = 0;
+        }
+    }
+
     /* Parser */
     tmp = flb_input_get_property("parser", i_ins);
     if (tmp) {
@@ -149,11 +180,8 @@ struct flb_syslog *syslog_conf_create(struct flb_input_instance *i_ins,
 
 int syslog_conf_destroy(struct flb_syslog *ctx)
 {
-    if (ctx->buffer_data) {
-        flb_free(ctx->buffer_data);
-        ctx->buffer_data = NULL;
-    }
     syslog_server_destroy(ctx);
+    flb_input_batch_destroy(&ctx->batch);
     flb_free(ctx);
 
     return 0;
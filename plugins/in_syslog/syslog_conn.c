@@ -73,6 +73,7 @@ int syslog_conn_event(void *data)
             conn->buf_len += bytes;
             conn->buf_data[conn->buf_len] = '\0';
             ret = syslog_prot_process(conn);
+            flb_input_batch_flush(conn->batch);
             if (ret == -1) {
                 return -1;
             }
@@ -93,8 +94,12 @@ int syslog_conn_event(void *data)
     return 0;
 }
 
-/* Create a new mqtt request instance */
-struct syslog_conn *syslog_conn_add(int fd, struct flb_syslog *ctx)
+/*
+ * Create a new connection. If 'worker' is set the connection is handled by
+ * that worker thread, otherwise by the engine thread.
+ */
+struct syslog_conn *syslog_conn_add(int fd, struct flb_syslog *ctx,
+                                    struct flb_net_worker *worker)
 {
     int ret;
     struct syslog_conn *conn;
@@ -119,6 +124,15 @@ struct syslog_conn *syslog_conn_add(int fd, struct flb_syslog *ctx)
     conn->buf_parsed = 0;
     conn->in      = ctx->i_ins;
 
+    if (worker) {
+        conn->evl = worker->evl;
+        conn->batch = &worker->batch;
+    }
+    else {
+        conn->evl = ctx->evl;
+        conn->batch = &ctx->batch;
+    }
+
     /* Allocate read buffer */
     conn->buf_data = flb_malloc(ctx->buffer_chunk_size);
     if (!conn->buf_data) {
@@ -130,7 +144,7 @@ struct syslog_conn *syslog_conn_add(int fd, struct flb_syslog *ctx)
     conn->buf_size = ctx->buffer_chunk_size;
 
     /* Register instance into the event loop */
-    ret = mk_event_add(ctx->evl, fd, FLB_ENGINE_EV_CUSTOM, MK_EVENT_READ, conn);
+    ret = mk_event_add(conn->evl, fd, FLB_ENGINE_EV_CUSTOM, MK_EVENT_READ, conn);
     if (ret == -1) {
         flb_error("[in_fw] could not register new connection");
         close(fd);
@@ -139,7 +153,12 @@ struct syslog_conn *syslog_conn_add(int fd, struct flb_syslog *ctx)
         return NULL;
     }
 
-    mk_list_add(&conn->_head, &ctx->connections);
+    if (worker) {
+        mk_list_add(&conn->_head, &worker->connections);
+    }
+    else {
+        mk_list_add(&conn->_head, &ctx->connections);
+    }
 
     return conn;
 }
@@ -147,7 +166,7 @@ struct syslog_conn *syslog_conn_add(int fd, struct flb_syslog *ctx)
 int syslog_conn_del(struct syslog_conn *conn)
 {
     /* Unregister the file descriptior from the event-loop */
-    mk_event_del(conn->ctx->evl, &conn->event);
+    mk_event_del(conn->evl, &conn->event);
 
     /* Release resources */
     mk_list_del(&conn->_head);
@@ -171,3 +190,30 @@ int syslog_conn_exit(struct flb_syslog *ctx)
 
     return 0;
 }
+
+/* Worker threads (TCP mode): new connection accepted */
+int syslog_conn_worker_accept(flb_sockfd_t fd, struct flb_net_worker *worker,
+                              void *data)
+{
+    struct syslog_conn *conn;
+
+    conn = syslog_conn_add(fd, data, worker);
+    if (!conn) {
+        return -1;
+    }
+    return 0;
+}
+
+/* Worker threads (TCP mode): release connections once the thread finished */
+void syslog_conn_worker_exit(struct flb_net_worker *worker, void *data)
+{
+    struct mk_list *tmp;
+    struct mk_list *head;
+    struct syslog_conn *conn;
+    (void) data;
+
+    mk_list_foreach_safe(head, tmp, &worker->connections) {
+        conn = mk_list_entry(head, struct syslog_conn, _head);
+        syslog_conn_del(conn);
+    }
+}
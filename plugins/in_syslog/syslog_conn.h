@@ -37,6 +37,8 @@ struct syslog_conn {
     size_t buf_size;                 /* Buffer size                       */
     size_t buf_len;                  /* Buffer length                     */
     size_t buf_parsed;               /* Parsed buffer (offset)            */
+    struct mk_event_loop *evl;       /* Event loop of the owner thread    */
+    struct flb_input_batch *batch;   /* Batch of the owner thread         */
     struct flb_input_instance *in;   /* Parent plugin instance            */
     struct flb_syslog *ctx;          /* Plugin configuration context      */
 
@@ -44,8 +46,13 @@ struct syslog_conn {
 };
 
 int syslog_conn_event(void *data);
-struct syslog_conn *syslog_conn_add(int fd, struct flb_syslog *ctx);
+struct syslog_conn *syslog_conn_add(int fd, struct flb_syslog *ctx,
+                                    struct flb_net_worker *worker);
 int syslog_conn_del(struct syslog_conn *conn);
 int syslog_conn_exit(struct flb_syslog *ctx);
 
+int syslog_conn_worker_accept(flb_sockfd_t fd, struct flb_net_worker *worker,
+                              void *data);
+void syslog_conn_worker_exit(struct flb_net_worker *worker, void *data);
+
 #endif
@@ -23,6 +23,7 @@
 #include <fluent-bit/flb_info.h>
 #include <fluent-bit/flb_parser.h>
 #include <fluent-bit/flb_time.h>
+#include <fluent-bit/flb_input_batch.h>
 
 #include "syslog.h"
 #include "syslog_conn.h"
@@ -32,96 +33,137 @@ static inline void consume_bytes(char *buf, int bytes, int length)
     memmove(buf, buf + bytes, length - bytes);
 }
 
-static inline int pack_line(struct flb_syslog *ctx,
+/*
+ * Pack the record into the given packer, it's expected to write into a
+ * msgpack_sbuffer (the instance batch or a receiver thread buffer).
+ */
+static inline int pack_line(msgpack_packer *mp_pck,
                             struct flb_time *time, char *data, size_t data_size)
 {
-    msgpack_packer mp_pck;
-    msgpack_sbuffer mp_sbuf;
-
-    /* Initialize local msgpack buffer */
-    msgpack_sbuffer_init(&mp_sbuf);
-    msgpack_packer_init(&mp_pck, &mp_sbuf, msgpack_sbuffer_write);
+    msgpack_pack_array(mp_pck, 2);
+    flb_time_append_to_msgpack(time, mp_pck, 0);
+    msgpack_sbuffer_write(mp_pck->data, data, data_size);
 
-    msgpack_pack_array(&mp_pck, 2);
-    flb_time_append_to_msgpack(time, &mp_pck, 0);
-    msgpack_sbuffer_write(&mp_sbuf, data, data_size);
+    return 0;
+}
 
-    flb_input_chunk_append_raw(ctx->i_ins, NULL, 0, mp_sbuf.data, mp_sbuf.size);
-    msgpack_sbuffer_destroy(&mp_sbuf);
+static inline void process_message(struct syslog_conn *conn,
+                                   char *buf, int len)
+{
+    int ret;
+    void *out_buf;
+    size_t out_size;
+    struct flb_time out_time = {0};
 
-    return 0;
+    ret = flb_parser_do(conn->ctx->parser, buf, len,
+                        &out_buf, &out_size, &out_time);
+    if (ret >= 0) {
+        /* The batch is flushed at the end of the connection event */
+        pack_line(&conn->batch->mp_pck, &out_time, out_buf, out_size);
+        flb_input_batch_commit(conn->batch, 1);
+        flb_free(out_buf);
+    }
+    else {
+        flb_warn("[in_syslog] error parsing log message");
+    }
 }
 
+/*
+ * Process the messages available in the connection buffer. Two framing
+ * methods are supported (RFC6587):
+ *
+ * - Octet counting: 'MSG-LEN SP SYSLOG-MSG', detected because the frame
+ *   starts with a digit while a syslog message starts with '<'.
+ * - Non-transparent framing: messages delimited by a new line.
+ */
 int syslog_prot_process(struct syslog_conn *conn)
 {
     int len;
-    int ret;
+    int digits;
     char *p;
-    char *eof;
+    char *q;
+    char *eol;
     char *end;
-    void *out_buf;
-    size_t out_size;
-    struct flb_time out_time;
     struct flb_syslog *ctx = conn->ctx;
 
-    eof = p = conn->buf_data;
+    p = conn->buf_data;
     end = conn->buf_data + conn->buf_len;
 
-    /* Always parse while some remaining bytes exists */
-    while (eof < end) {
-
-        /* Lookup the ending byte */
-        eof = conn->buf_data + conn->buf_parsed;
-        while (*eof != '\n' && *eof != '\0' && eof < end) {
-            eof++;
+    while (p < end) {
+        /* Skip empty lines between frames */
+        if (*p == '\n' || *p == '\0') {
+            p++;
+            continue;
         }
 
-        /* Incomplete message */
-        if (eof == end || (*eof != '\n' && *eof != '\0')) {
-            return 0;
-        }
+        /* Octet counting */
+        if (*p >= '0' && *p <= '9') {
+            len = 0;
+            digits = 0;
+            q = p;
+            while (q < end && *q >= '0' && *q <= '9' && digits < 10) {
+                len = (len * 10) + (*q - '0');
+                digits++;
+                q++;
+            }
 
-        /* No data ? */
-        len = (eof - p);
-        if (len == 0) {
-            consume_bytes(conn->buf_data, 1, conn->buf_len);
-            conn->buf_len--;
-            conn->buf_parsed = 0;
-            conn->buf_data[conn->buf_len] = '\0';
-            end = conn->buf_data + conn->buf_len;
-
-            if (conn->buf_len == 0) {
-                return 0;
+            if (q == end) {
+                /* Incomplete frame length */
+                break;
             }
 
-            continue;
+            if (*q == ' ') {
+                if (len > ctx->buffer_max_size) {
+                    flb_warn("[in_syslog] fd=%i frame of %i bytes exceed "
+                             "buffer_max_size", conn->fd, len);
+                    return -1;
+                }
+
+                q++;
+                if (end - q < len) {
+                    /* Incomplete message */
+                    break;
+                }
+
+                process_message(conn, q, len);
+                p = q + len;
+                continue;
+            }
         }
 
-        /* Process the string */
-        ret = flb_parser_do(ctx->parser, p, len,
-                            &out_buf, &out_size, &out_time);
-        if (ret >= 0) {
-            pack_line(ctx, &out_time, out_buf, out_size);
-            flb_free(out_buf);
+        /* Lookup the ending byte */
+        eol = p;
+        while (eol < end && *eol != '\n' && *eol != '\0') {
+            eol++;
         }
-        else {
-            flb_warn("[in_syslog] error parsing log message");
+
+        /* Incomplete message */
+        if (eol == end) {
+            break;
         }
 
-        conn->buf_parsed += len + 1;
-        end = conn->buf_data + conn->buf_len;
-        eof = p = conn->buf_data + conn->buf_parsed;
+        process_message(conn, p, eol - p);
+        p = eol + 1;
     }
 
-    consume_bytes(conn->buf_data, conn->buf_parsed, conn->buf_len);
-    conn->buf_len -= conn->buf_parsed;
+    len = p - conn->buf_data;
+    if (len > 0) {
+        consume_bytes(conn->buf_data, len, conn->buf_len);
+        conn->buf_len -= len;
+    }
     conn->buf_parsed = 0;
     conn->buf_data[conn->buf_len] = '\0';
 
     return 0;
 }
 
-int syslog_prot_process_udp(char *buf, size_t size, struct flb_syslog *ctx)
+/*
+ * Parse a datagram and pack the record into 'mp_pck'. This function can be
+ * invoked from the UDP receiver threads so it must not touch the instance
+ * batch.
+ */
+int syslog_prot_process_udp(char *buf, size_t size,
+                            msgpack_packer *mp_pck, struct flb_syslog *ctx)
 {
     int ret;
     void *out_buf;
@@ -134,7 +176,7 @@ int syslog_prot_process_udp(char *buf, size_t size, struct flb_syslog *ctx)
         if (flb_time_to_double(&out_time) == 0) {
             flb_time_get(&out_time);
         }
-        pack_line(ctx, &out_time, out_buf, out_size);
+        pack_line(mp_pck, &out_time, out_buf, out_size);
         flb_free(out_buf);
     }
     else {
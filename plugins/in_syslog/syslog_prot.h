@@ -22,10 +22,12 @@
 #define FLB_IN_SYSLOG_PROT_H
 
 #include <fluent-bit/flb_info.h>
+#include <msgpack.h>
 
 #include "syslog.h"
 
 int syslog_prot_process(struct syslog_conn *conn);
-int syslog_prot_process_udp(char *buf, size_t size, struct flb_syslog *ctx);
+int syslog_prot_process_udp(char *buf, size_t size,
+                            msgpack_packer *mp_pck, struct flb_syslog *ctx);
 
 #endif
@@ -30,6 +30,8 @@
 #include <sys/un.h>
 
 #include "syslog.h"
+#include "syslog_conn.h"
+#include "syslog_udp.h"
 
 static int syslog_server_unix_create(struct flb_syslog *ctx)
 {
@@ -104,16 +106,35 @@ int syslog_server_create(struct flb_syslog *ctx)
 {
     int ret;
 
+    /* UDP datagrams read by receiver threads */
+    if (ctx->mode == FLB_SYSLOG_UDP && ctx->workers > 0) {
+        return syslog_udp_workers_create(ctx);
+    }
+
+    /* TCP connections accepted and read by worker threads */
+    if (ctx->mode == FLB_SYSLOG_TCP && ctx->workers > 0) {
+        ctx->net_workers = flb_net_workers_create(ctx->i_ins,
+                                                  ctx->listen, ctx->port,
+                                                  ctx->workers,
+                                                  syslog_conn_worker_accept,
+                                                  syslog_conn_worker_exit,
+                                                  ctx);
+        if (!ctx->net_workers) {
+            return -1;
+        }
+        return 0;
+    }
+
     if (ctx->mode == FLB_SYSLOG_UDP || ctx->mode == FLB_SYSLOG_UNIX_UDP) {
-        /* Create UDP buffer */
-        ctx->buffer_data = flb_calloc(1, ctx->buffer_chunk_size);
-        if (!ctx->buffer_data) {
-            flb_errno();
+        /* Create UDP buffers */
+        ctx->rx = syslog_udp_rx_create(ctx->udp_batch,
+                                       ctx->buffer_chunk_size);
+        if (!ctx->rx) {
             return -1;
         }
-        ctx->buffer_size = ctx->buffer_chunk_size;
-        flb_info("[in_syslog] UDP buffer size set to %lu bytes",
-                 ctx->buffer_size);
+        flb_info("[in_syslog] UDP buffer size set to %lu bytes "
+                 "(%i datagrams per read)",
+                 ctx->buffer_chunk_size, ctx->udp_batch);
     }
 
     if (ctx->mode == FLB_SYSLOG_TCP || ctx->mode == FLB_SYSLOG_UDP) {
@@ -128,6 +149,10 @@ int syslog_server_create(struct flb_syslog *ctx)
         return -1;
     }
 
+    if (ctx->rx) {
+        syslog_udp_socket_setup(ctx, ctx->server_fd);
+    }
+
     return 0;
 }
 
@@ -140,11 +165,22 @@ int syslog_server_destroy(struct flb_syslog *ctx)
         }
     }
     else {
+        if (ctx->net_workers) {
+            flb_net_workers_destroy(ctx->net_workers);
+            ctx->net_workers = NULL;
+        }
         flb_free(ctx->listen);
         flb_free(ctx->port);
     }
 
-    close(ctx->server_fd);
+    if (ctx->rx) {
+        syslog_udp_rx_destroy(ctx->rx);
+        ctx->rx = NULL;
+    }
+
+    if (ctx->server_fd != -1) {
+        close(ctx->server_fd);
+    }
 
     return 0;
 }
@@ -0,0 +1,340 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2019      The Fluent Bit Authors
+ *  Copyright (C) 2015-2018 Treasure Data Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#define _GNU_SOURCE
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_mem.h>
+#include <fluent-bit/flb_log.h>
+#include <fluent-bit/flb_network.h>
+#include <fluent-bit/flb_input.h>
+#include <fluent-bit/flb_input_batch.h>
+#include <fluent-bit/flb_net_workers.h>
+#ifdef FLB_HAVE_METRICS
+#include <fluent-bit/flb_metrics.h>
+#endif
+
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include "syslog.h"
+#include "syslog_conn.h"
+#include "syslog_prot.h"
+#include "syslog_udp.h"
+
+/* Max number of reads per socket event */
+#define SYSLOG_UDP_ROUNDS  8
+
+struct syslog_udp_rx *syslog_udp_rx_create(int count, size_t msg_size)
+{
+    int i;
+    struct msghdr *hdr;
+    struct syslog_udp_rx *rx;
+
+    rx = flb_calloc(1, sizeof(struct syslog_udp_rx));
+    if (!rx) {
+        flb_errno();
+        return NULL;
+    }
+    rx->count = count;
+    rx->msg_size = msg_size;
+#ifdef SO_RXQ_OVFL
+    rx->cmsg_size = CMSG_SPACE(sizeof(uint32_t));
+#endif
+
+    /* Every datagram gets one extra byte for the NULL terminator */
+    rx->data = flb_malloc(count * (msg_size + 1));
+    rx->iov  = flb_calloc(count, sizeof(struct iovec));
+    rx->msgs = flb_calloc(count, sizeof(struct mmsghdr));
+    if (rx->cmsg_size > 0) {
+        rx->cmsg = flb_calloc(count, rx->cmsg_size);
+    }
+
+    if (!rx->data || !rx->iov || !rx->msgs ||
+        (rx->cmsg_size > 0 && !rx->cmsg)) {
+        flb_errno();
+        syslog_udp_rx_destroy(rx);
+        return NULL;
+    }
+
+    for (i = 0; i < count; i++) {
+        rx->iov[i].iov_base = rx->data + (i * (msg_size + 1));
+        rx->iov[i].iov_len  = msg_size;
+
+        hdr = &rx->msgs[i].msg_hdr;
+        hdr->msg_iov = &rx->iov[i];
+        hdr->msg_iovlen = 1;
+    }
+
+    return rx;
+}
+
+void syslog_udp_rx_destroy(struct syslog_udp_rx *rx)
+{
+    flb_free(rx->data);
+    flb_free(rx->cmsg);
+    flb_free(rx->iov);
+    flb_free(rx->msgs);
+    flb_free(rx);
+}
+
+/* Apply the receive buffer size and request the Kernel drops counter */
+int syslog_udp_socket_setup(struct flb_syslog *ctx, flb_sockfd_t fd)
+{
+#ifdef SO_RXQ_OVFL
+    int on = 1;
+#endif
+
+    if (ctx->receive_buffer_size > 0) {
+        if (flb_net_socket_rcvbuf(fd, ctx->receive_buffer_size) == -1) {
+            flb_warn("[in_syslog] could not set receive buffer size to %i",
+                     ctx->receive_buffer_size);
+        }
+    }
+
+#ifdef SO_RXQ_OVFL
+    if (setsockopt(fd, SOL_SOCKET, SO_RXQ_OVFL, &on, sizeof(on)) == -1) {
+        flb_debug("[in_syslog] SO_RXQ_OVFL not available, drops not reported");
+    }
+#endif
+
+    return 0;
+}
+
+/* Read up to rx->count datagrams already available on the socket */
+static int udp_rx_read(struct syslog_udp_rx *rx, flb_sockfd_t fd)
+{
+    int i;
+    int ret;
+    struct msghdr *hdr;
+
+    for (i = 0; i < rx->count; i++) {
+        hdr = &rx->msgs[i].msg_hdr;
+        if (rx->cmsg_size > 0) {
+            hdr->msg_control = rx->cmsg + (i * rx->cmsg_size);
+            hdr->msg_controllen = rx->cmsg_size;
+        }
+        rx->msgs[i].msg_len = 0;
+    }
+
+#ifdef FLB_HAVE_RECVMMSG
+    ret = recvmmsg(fd, rx->msgs, rx->count, MSG_DONTWAIT, NULL);
+#else
+    for (i = 0; i < rx->count; i++) {
+        ret = recvmsg(fd, &rx->msgs[i].msg_hdr, MSG_DONTWAIT);
+        if (ret == -1) {
+            break;
+        }
+        rx->msgs[i].msg_len = ret;
+    }
+    ret = (i > 0) ? i : -1;
+#endif
+
+    if (ret == -1) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+            flb_errno();
+            return -1;
+        }
+        return 0;
+    }
+
+    return ret;
+}
+
+/* Returns the number of datagrams dropped by the Kernel since last check */
+static uint32_t udp_rx_drops(struct syslog_udp_rx *rx, int n)
+{
+#ifdef SO_RXQ_OVFL
+    int i;
+    uint32_t val;
+    uint32_t diff = 0;
+    struct cmsghdr *cmsg;
+
+    /* The counter is cumulative, the last datagram has the newest value */
+    for (i = n - 1; i >= 0; i--) {
+        cmsg = CMSG_FIRSTHDR(&rx->msgs[i].msg_hdr);
+        for (; cmsg; cmsg = CMSG_NXTHDR(&rx->msgs[i].msg_hdr, cmsg)) {
+            if (cmsg->cmsg_level == SOL_SOCKET &&
+                cmsg->cmsg_type == SO_RXQ_OVFL) {
+                memcpy(&val, CMSG_DATA(cmsg), sizeof(uint32_t));
+                diff = val - rx->drops;
+                rx->drops = val;
+                return diff;
+            }
+        }
+    }
+#endif
+    (void) rx;
+    (void) n;
+
+    return 0;
+}
+
+/* Parse 'n' received datagrams, returns the number of records packed */
+static int udp_rx_process(struct flb_syslog *ctx, struct syslog_udp_rx *rx,
+                          int n, msgpack_packer *mp_pck)
+{
+    int i;
+    int ret;
+    int records = 0;
+    char *buf;
+    size_t len;
+
+    for (i = 0; i < n; i++) {
+        len = rx->msgs[i].msg_len;
+        if (len == 0) {
+            continue;
+        }
+        buf = rx->iov[i].iov_base;
+        buf[len] = '\0';
+
+        ret = syslog_prot_process_udp(buf, len, mp_pck, ctx);
+        if (ret == 0) {
+            records++;
+        }
+    }
+
+    return records;
+}
+
+static void udp_report_drops(struct flb_syslog *ctx, uint32_t drops)
+{
+    if (drops == 0) {
+        return;
+    }
+
+    flb_warn("[in_syslog] %u datagrams dropped by the Kernel, consider "
+             "increasing receive_buffer_size", drops);
+#ifdef FLB_HAVE_METRICS
+    flb_metrics_sum(FLB_METRIC_N_DROPPED, drops, ctx->i_ins->metrics);
+#endif
+}
+
+/*
+ * Drain the socket in rounds of 'udp_batch' datagrams, the records are
+ * packed in 'batch'. Returns the number of datagrams dropped by the Kernel.
+ */
+static uint32_t udp_read(struct flb_syslog *ctx, struct syslog_udp_rx *rx,
+                         flb_sockfd_t fd, struct flb_input_batch *batch)
+{
+    int n;
+    int rounds = 0;
+    int records;
+    uint32_t drops = 0;
+
+    do {
+        n = udp_rx_read(rx, fd);
+        if (n <= 0) {
+            break;
+        }
+        drops += udp_rx_drops(rx, n);
+        records = udp_rx_process(ctx, rx, n, &batch->mp_pck);
+        flb_input_batch_commit(batch, records);
+        rounds++;
+    } while (n == rx->count && rounds < SYSLOG_UDP_ROUNDS);
+
+    return drops;
+}
+
+/* Collect datagrams on the engine thread */
+int syslog_udp_collect(struct flb_syslog *ctx)
+{
+    uint32_t drops;
+
+    drops = udp_read(ctx, ctx->rx, ctx->server_fd, &ctx->batch);
+    flb_input_batch_flush(&ctx->batch);
+    udp_report_drops(ctx, drops);
+
+    return 0;
+}
+
+/*
+ * Receiver thread: the worker batch is handed to the engine thread once
+ * the socket is drained. The drops are accounted by the engine thread in
+ * syslog_udp_collect_workers().
+ */
+static void udp_worker_read(struct flb_net_worker *worker, void *data)
+{
+    uint32_t drops;
+    struct flb_syslog *ctx = data;
+
+    drops = udp_read(ctx, worker->data, worker->server_fd, &worker->batch);
+    if (drops > 0) {
+        __sync_fetch_and_add(&ctx->udp_drops, drops);
+    }
+}
+
+/* Every receiver thread has its own datagrams buffers */
+static int udp_worker_init(struct flb_net_worker *worker, void *data)
+{
+    struct flb_syslog *ctx = data;
+
+    worker->data = syslog_udp_rx_create(ctx->udp_batch,
+                                        ctx->buffer_chunk_size);
+    if (!worker->data) {
+        return -1;
+    }
+    syslog_udp_socket_setup(ctx, worker->server_fd);
+
+    return 0;
+}
+
+static void udp_worker_exit(struct flb_net_worker *worker, void *data)
+{
+    (void) data;
+
+    if (worker->data) {
+        syslog_udp_rx_destroy(worker->data);
+        worker->data = NULL;
+    }
+}
+
+/*
+ * Create 'workers' receiver threads, each one owns a socket bound to the
+ * same address with SO_REUSEPORT, so the Kernel distribute the datagrams
+ * across them.
+ */
+int syslog_udp_workers_create(struct flb_syslog *ctx)
+{
+    ctx->net_workers = flb_net_workers_create_udp(ctx->i_ins,
+                                                  ctx->listen, ctx->port,
+                                                  ctx->workers,
+                                                  udp_worker_init,
+                                                  udp_worker_read,
+                                                  udp_worker_exit,
+                                                  ctx);
+    if (!ctx->net_workers) {
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Engine thread: append the records packed by the receiver threads */
+int syslog_udp_collect_workers(struct flb_syslog *ctx)
+{
+    uint32_t drops;
+
+    drops = __sync_lock_test_and_set(&ctx->udp_drops, 0);
+    udp_report_drops(ctx, drops);
+
+    return flb_net_workers_collect(ctx->net_workers);
+}
@@ -0,0 +1,60 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2019      The Fluent Bit Authors
+ *  Copyright (C) 2015-2018 Treasure Data Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef FLB_IN_SYSLOG_UDP_H
+#define FLB_IN_SYSLOG_UDP_H
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_socket.h>
+
+#include <stdint.h>
+#include <sys/socket.h>
+
+#include "syslog.h"
+
+#ifndef FLB_HAVE_RECVMMSG
+/* Systems without recvmmsg(2) read the datagrams one by one */
+struct mmsghdr {
+    struct msghdr msg_hdr;
+    unsigned int msg_len;
+};
+#endif
+
+/* Batch receiver: a set of buffers to read many datagrams at once */
+struct syslog_udp_rx {
+    int count;                  /* max number of datagrams per read */
+    size_t msg_size;            /* max size of each datagram        */
+    size_t cmsg_size;           /* control data size per datagram   */
+    char *data;                 /* datagrams buffers                */
+    char *cmsg;                 /* control data buffers             */
+    struct iovec *iov;
+    struct mmsghdr *msgs;
+    uint32_t drops;             /* last Kernel drops counter seen   */
+};
+
+struct syslog_udp_rx *syslog_udp_rx_create(int count, size_t msg_size);
+void syslog_udp_rx_destroy(struct syslog_udp_rx *rx);
+int syslog_udp_socket_setup(struct flb_syslog *ctx, flb_sockfd_t fd);
+
+int syslog_udp_collect(struct flb_syslog *ctx);
+int syslog_udp_collect_workers(struct flb_syslog *ctx);
+int syslog_udp_workers_create(struct flb_syslog *ctx);
+
+#endif
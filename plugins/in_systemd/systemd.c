@@ -22,6 +22,7 @@
 #include <fluent-bit/flb_input.h>
 #include <fluent-bit/flb_config.h>
 #include <fluent-bit/flb_time.h>
+#include <fluent-bit/flb_pipe.h>
 
 #include "systemd_config.h"
 #include "systemd_db.h"
@@ -69,12 +70,61 @@ static int tag_compose(char *tag, char *unit_name,
     return 0;
 }
 
+/* Pack a 'KEY=value' field of the journal entry */
+static inline int field_pack(struct flb_systemd_config *ctx,
+                             msgpack_packer *mp_pck,
+                             const void *data, size_t length)
+{
+    int len;
+    char *key = (char *) data;
+    char *sep;
+
+    sep = memchr(key, '=', length);
+    if (!sep) {
+        return -1;
+    }
+
+    if (ctx->strip_underscores == FLB_TRUE && key[0] == '_') {
+        key++;
+        length--;
+    }
+
+    len = (sep - key);
+    msgpack_pack_str(mp_pck, len);
+    msgpack_pack_str_body(mp_pck, key, len);
+
+    len = length - (sep - key) - 1;
+    msgpack_pack_str(mp_pck, len);
+    msgpack_pack_str_body(mp_pck, sep + 1, len);
+
+    return 0;
+}
+
+/*
+ * The number of entries per round is limited, when the limit is reached the
+ * collector yields: instead of waiting for the pending records timer, it is
+ * notified through a channel so the engine can process its other events
+ * before reading the next round.
+ */
+static void pending_signal(struct flb_systemd_config *ctx)
+{
+    uint64_t val = 0xc003;
+
+    if (ctx->pending_signal == FLB_TRUE || ctx->coll_fd_more == -1) {
+        return;
+    }
+
+    if (flb_pipe_w(ctx->ch_pending[1], &val, sizeof(val)) == sizeof(val)) {
+        ctx->pending_signal = FLB_TRUE;
+    }
+}
+
 static int in_systemd_collect(struct flb_input_instance *i_ins,
                               struct flb_config *config, void *in_context)
 {
+    int i;
     int ret;
     int ret_j;
-    int len;
     int entries = 0;
     int rows = 0;
     time_t sec;
@@ -82,31 +132,22 @@ static int in_systemd_collect(struct flb_input_instance *i_ins,
     uint8_t h;
     uint64_t usec;
     size_t length;
-    char *sep;
-    char *key;
-    char *val;
+    size_t bytes = 0;
     char *tmp;
-    char *cursor = NULL;
-    char *tag;
+    char *tag = NULL;
     char new_tag[PATH_MAX];
-    char last_tag[PATH_MAX];
-    size_t tag_len;
-    size_t last_tag_len = 0;
+    size_t tag_len = 0;
     off_t off;
     const void *data;
     struct flb_systemd_config *ctx = in_context;
+    struct flb_input_batch *batch = &ctx->batch;
     struct flb_time tm;
-    msgpack_sbuffer mp_sbuf;
-    msgpack_packer mp_pck;
 
     /* Restricted by mem_buf_limit */
     if (flb_input_buf_paused(i_ins) == FLB_TRUE) {
         return FLB_SYSTEMD_BUSY;
     }
 
-    msgpack_sbuffer_init(&mp_sbuf);
-    msgpack_packer_init(&mp_pck, &mp_sbuf, msgpack_sbuffer_write);
-
     /*
      * if there are not pending records from a previous round, likely we got
      * some changes in the journal, otherwise go ahead and continue reading
@@ -126,27 +167,17 @@ static int in_systemd_collect(struct flb_input_instance *i_ins,
         /* If the tag is composed dynamically, gather the Systemd Unit name */
         if (ctx->dynamic_tag) {
             ret = sd_journal_get_data(ctx->j, "_SYSTEMD_UNIT", &data, &length);
+            tag = new_tag;
             if (ret == 0) {
-                tag = new_tag;
                 tag_compose(ctx->i_ins->tag, (char *) data + 14, length - 14,
                             &tag, &tag_len);
             }
             else {
-                tag = new_tag;
                 tag_compose(ctx->i_ins->tag,
                             FLB_SYSTEMD_UNKNOWN, sizeof(FLB_SYSTEMD_UNKNOWN) - 1,
                             &tag, &tag_len);
             }
         }
-        else {
-            tag = ctx->i_ins->tag;
-            tag_len = ctx->i_ins->tag_len;
-        }
-
-        if (last_tag_len == 0) {
-            strncpy(last_tag, tag, tag_len);
-            last_tag_len = tag_len;
-        }
 
         /* Set time */
         ret = sd_journal_get_realtime_usec(ctx->j, &usec);
@@ -161,71 +192,65 @@ static int in_systemd_collect(struct flb_input_instance *i_ins,
         flb_time_set(&tm, sec, nsec);
 
         /*
-         * The new incoming record can have a different tag than previous one,
-         * so a new msgpack buffer is required. We ingest the data and prepare
-         * a new buffer.
+         * The new incoming record can have a different tag than previous
+         * one, the batch ingests the records of the previous tag first.
          */
-        if (mp_sbuf.size > 0 &&
-            ((last_tag_len != tag_len) || (strncmp(last_tag, tag, tag_len) != 0))) {
-            flb_input_chunk_append_raw(ctx->i_ins,
-                                       last_tag, last_tag_len,
-                                       mp_sbuf.data,
-                                       mp_sbuf.size);
-            msgpack_sbuffer_destroy(&mp_sbuf);
-            msgpack_sbuffer_init(&mp_sbuf);
-
-            strncpy(last_tag, tag, tag_len);
-            last_tag_len = tag_len;
-        }
+        flb_input_batch_set_tag(batch, tag, tag_len);
 
         /* Prepare buffer and write map content */
-        msgpack_pack_array(&mp_pck, 2);
-        flb_time_append_to_msgpack(&tm, &mp_pck, 0);
+        msgpack_pack_array(&batch->mp_pck, 2);
+        flb_time_append_to_msgpack(&tm, &batch->mp_pck, 0);
 
         /*
          * Save the current size/position of the buffer since this is
          * where the Map header will be stored.
          */
-        off = mp_sbuf.size;
+        off = batch->mp_sbuf.size;
 
         /*
          * Register the maximum fields allowed per entry in the map. With
          * this approach we can ingest all the fields and then just adjust
          * the map size if required.
          */
-        msgpack_pack_map(&mp_pck, ctx->max_fields);
+        msgpack_pack_map(&batch->mp_pck, ctx->max_fields);
 
-        /* Pack every field in the entry */
         entries = 0;
-        while (sd_journal_enumerate_data(ctx->j, &data, &length) > 0 &&
-               entries < ctx->max_fields) {
-            key = (char *) data;
-            if (ctx->strip_underscores == FLB_TRUE && key[0] == '_') {
-                key++;
-                length--;
+        if (ctx->fields_count > 0) {
+            /*
+             * Allow-list: lookup only the fields needed, the other ones are
+             * not read (nor decompressed) from the journal.
+             */
+            for (i = 0; i < ctx->fields_count && entries < ctx->max_fields;
+                 i++) {
+                ret = sd_journal_get_data(ctx->j, ctx->fields[i],
+                                          &data, &length);
+                if (ret != 0) {
+                    continue;
+                }
+                if (field_pack(ctx, &batch->mp_pck, data, length) == 0) {
+                    entries++;
+                }
             }
-            sep = strchr(key, '=');
-            len = (sep - key);
-            msgpack_pack_str(&mp_pck, len);
-            msgpack_pack_str_body(&mp_pck, key, len);
-
-            val = sep + 1;
-            len = length - (sep - key) - 1;
-            msgpack_pack_str(&mp_pck, len);
-            msgpack_pack_str_body(&mp_pck, val, len);
-
-            entries++;
         }
-        rows++;
-        if (entries == ctx->max_fields) {
-            flb_debug("[in_systemd] max number of fields is reached: %i; all other fields are discarded", ctx->max_fields);
+        else {
+            /* Pack every field in the entry */
+            while (sd_journal_enumerate_data(ctx->j, &data, &length) > 0 &&
+                   entries < ctx->max_fields) {
+                if (field_pack(ctx, &batch->mp_pck, data, length) == 0) {
+                    entries++;
+                }
+            }
+            if (entries == ctx->max_fields) {
+                flb_debug("[in_systemd] max number of fields is reached: %i; all other fields are discarded", ctx->max_fields);
+            }
         }
+        rows++;
 
         /*
          * The fields were packed, now we need to adjust the msgpack map size
          * to set the proper number of fields appended to the record.
          */
-        tmp = mp_sbuf.data + off;
+        tmp = batch->mp_sbuf.data + off;
         h = tmp[0];
         if (h >> 4 == 0x8) {
             *tmp = (uint8_t) 0x8 << 4 | ((uint8_t) entries);
@@ -239,19 +264,14 @@ static int in_systemd_collect(struct flb_input_instance *i_ins,
             pack_uint32(tmp, entries);
         }
 
+        bytes += batch->mp_sbuf.size - off;
+        flb_input_batch_commit(batch, 1);
+
         /*
          * Some journals can have too much data, pause if we have processed
          * more than 1MB. Journal will resume later.
          */
-        if (mp_sbuf.size > 1024000) {
-            flb_input_chunk_append_raw(ctx->i_ins,
-                                       tag, tag_len,
-                                       mp_sbuf.data,
-                                       mp_sbuf.size);
-            msgpack_sbuffer_destroy(&mp_sbuf);
-            msgpack_sbuffer_init(&mp_sbuf);
-            strncpy(last_tag, tag, tag_len);
-            last_tag_len = tag_len;
+        if (bytes > 1024000) {
             break;
         }
 
@@ -260,23 +280,13 @@ static int in_systemd_collect(struct flb_input_instance *i_ins,
         }
     }
 
-    /* Save cursor */
-    if (ctx->db) {
-        sd_journal_get_cursor(ctx->j, &cursor);
-        if (cursor) {
-            flb_systemd_db_set_cursor(ctx, cursor);
-            flb_free(cursor);
-        }
+    /* The cursor is saved by the checkpoint timer */
+    if (rows > 0) {
+        ctx->cursor_dirty = FLB_TRUE;
     }
 
     /* Write any pending data into the buffer */
-    if (mp_sbuf.size > 0) {
-        flb_input_chunk_append_raw(ctx->i_ins,
-                                   tag, tag_len,
-                                   mp_sbuf.data,
-                                   mp_sbuf.size);
-    }
-    msgpack_sbuffer_destroy(&mp_sbuf);
+    flb_input_batch_flush(batch);
 
     /* the journal is empty, no more records */
     if (ret_j == 0) {
@@ -290,6 +300,7 @@ static int in_systemd_collect(struct flb_input_instance *i_ins,
         * process on this call. Assume there are pending records.
         */
         ctx->pending_records = FLB_TRUE;
+        pending_signal(ctx);
         return FLB_SYSTEMD_MORE;
     }
     else {
@@ -306,6 +317,59 @@ static int in_systemd_collect(struct flb_input_instance *i_ins,
     }
 }
 
+/* Pending records notified by a previous round */
+static int in_systemd_collect_more(struct flb_input_instance *i_ins,
+                                   struct flb_config *config, void *in_context)
+{
+    uint64_t val;
+    struct flb_systemd_config *ctx = in_context;
+
+    flb_pipe_r(ctx->ch_pending[0], &val, sizeof(val));
+    ctx->pending_signal = FLB_FALSE;
+
+    if (ctx->pending_records == FLB_FALSE) {
+        return 0;
+    }
+
+    in_systemd_collect(i_ins, config, in_context);
+    return 0;
+}
+
+/* Save the cursor of the last entry read, if it changed */
+static int systemd_checkpoint(struct flb_systemd_config *ctx)
+{
+    int ret;
+    char *cursor = NULL;
+
+    if (!ctx->db || ctx->cursor_dirty == FLB_FALSE) {
+        return 0;
+    }
+
+    ret = sd_journal_get_cursor(ctx->j, &cursor);
+    if (ret != 0 || !cursor) {
+        return -1;
+    }
+
+    ret = flb_systemd_db_set_cursor(ctx, cursor);
+    flb_free(cursor);
+    if (ret == 0) {
+        ctx->cursor_dirty = FLB_FALSE;
+    }
+
+    return ret;
+}
+
+static int in_systemd_collect_checkpoint(struct flb_input_instance *i_ins,
+                                         struct flb_config *config,
+                                         void *in_context)
+{
+    (void) i_ins;
+    (void) config;
+
+    systemd_checkpoint(in_context);
+    return 0;
+}
+
 static int in_systemd_collect_archive(struct flb_input_instance *i_ins,
                                       struct flb_config *config, void *in_context)
 {
@@ -349,6 +413,20 @@ static int in_systemd_collect_archive(struct flb_input_instance *i_ins,
         ctx->coll_fd_pending = ret;
         flb_input_collector_start(ctx->coll_fd_pending, i_ins);
 
+        /* Events collector: pending records, yielded by a full round */
+        ret = flb_input_set_collector_event(i_ins,
+                                            in_systemd_collect_more,
+                                            ctx->ch_pending[0],
+                                            config);
+        if (ret == -1) {
+            flb_error("[in_systemd] error setting up collector "
+                      "for pending records");
+            flb_systemd_config_destroy(ctx);
+            return -1;
+        }
+        ctx->coll_fd_more = ret;
+        flb_input_collector_start(ctx->coll_fd_more, i_ins);
+
         return 0;
     }
 
@@ -372,6 +450,7 @@ static int in_systemd_init(struct flb_input_instance *in,
 
     /* Set the context */
     flb_input_set_context(in, ctx);
+    ctx->coll_fd_more = -1;
 
     /* Events collector: archive */
     ret = flb_input_set_collector_event(in, in_systemd_collect_archive,
@@ -382,6 +461,20 @@ static int in_systemd_init(struct flb_input_instance *in,
     }
     ctx->coll_fd_archive = ret;
 
+    /* Timer to save the cursor in the database */
+    if (ctx->db) {
+        ret = flb_input_set_collector_time(in,
+                                           in_systemd_collect_checkpoint,
+                                           ctx->checkpoint_interval, 0,
+                                           config);
+        if (ret == -1) {
+            flb_error("[in_systemd] error setting up checkpoint timer");
+            flb_systemd_config_destroy(ctx);
+            return -1;
+        }
+        ctx->coll_fd_checkpoint = ret;
+    }
+
     return 0;
 }
 
@@ -416,6 +509,7 @@ static void in_systemd_pause(void *data, struct flb_config *config)
     if (ret == FLB_TRUE) {
         flb_input_collector_pause(ctx->coll_fd_journal, ctx->i_ins);
         flb_input_collector_pause(ctx->coll_fd_pending, ctx->i_ins);
+        flb_input_collector_pause(ctx->coll_fd_more, ctx->i_ins);
     }
 }
 
@@ -431,6 +525,7 @@ static void in_systemd_resume(void *data, struct flb_config *config)
     if (ret == FLB_FALSE) {
         flb_input_collector_resume(ctx->coll_fd_journal, ctx->i_ins);
         flb_input_collector_resume(ctx->coll_fd_pending, ctx->i_ins);
+        flb_input_collector_resume(ctx->coll_fd_more, ctx->i_ins);
     }
 }
 
@@ -439,6 +534,9 @@ static int in_systemd_exit(void *data, struct flb_config *config)
     (void) *config;
     struct flb_systemd_config *ctx = data;
 
+    /* Last checkpoint */
+    systemd_checkpoint(ctx);
+
     flb_systemd_config_destroy(ctx);
     return 0;
 }
@@ -22,6 +22,7 @@
 #include <fluent-bit/flb_config.h>
 #include <fluent-bit/flb_input.h>
 #include <fluent-bit/flb_utils.h>
+#include <fluent-bit/flb_pipe.h>
 
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -30,6 +31,66 @@
 #include "systemd_db.h"
 #include "systemd_config.h"
 
+/* Load the comma separated list of fields to read from the entries */
+static int fields_create(struct flb_systemd_config *ctx, char *list)
+{
+    int i = 0;
+    int len;
+    char *p;
+    struct mk_list *head;
+    struct mk_list *split;
+    struct flb_split_entry *entry;
+
+    split = flb_utils_split(list, ',', -1);
+    if (!split) {
+        return -1;
+    }
+
+    ctx->fields = flb_calloc(mk_list_size(split), sizeof(char *));
+    if (!ctx->fields) {
+        flb_errno();
+        flb_utils_split_free(split);
+        return -1;
+    }
+
+    mk_list_foreach(head, split) {
+        entry = mk_list_entry(head, struct flb_split_entry, _head);
+
+        /* Trim spaces */
+        p = entry->value;
+        len = entry->len;
+        while (len > 0 && *p == ' ') {
+            p++;
+            len--;
+        }
+        while (len > 0 && p[len - 1] == ' ') {
+            len--;
+        }
+        if (len == 0) {
+            continue;
+        }
+
+        ctx->fields[i] = flb_strndup(p, len);
+        if (!ctx->fields[i]) {
+            flb_errno();
+            ctx->fields_count = i;
+            flb_utils_split_free(split);
+            return -1;
+        }
+        flb_debug("[in_systemd] field: %s", ctx->fields[i]);
+        i++;
+    }
+    ctx->fields_count = i;
+    flb_utils_split_free(split);
+
+    if (i == 0) {
+        flb_error("[in_systemd] invalid 'fields' value: %s", list);
+        return -1;
+    }
+
+    return 0;
+}
+
 struct flb_systemd_config *flb_systemd_config_create(struct flb_input_instance *i_ins,
                                                      struct flb_config *config)
 {
@@ -57,6 +118,19 @@ struct flb_systemd_config *flb_systemd_config_create(struct flb_input_instance *
         return NULL;
     }
 
+    /* Pending records notification channel */
+    ret = pipe(ctx->ch_pending);
+    if (ret == -1) {
+        flb_errno();
+        close(ctx->ch_manager[0]);
+        close(ctx->ch_manager[1]);
+        flb_free(ctx);
+        return NULL;
+    }
+    flb_pipe_set_nonblocking(ctx->ch_pending[0]);
+    flb_pipe_set_nonblocking(ctx->ch_pending[1]);
+    flb_input_batch_init(&ctx->batch, i_ins, 0);
+
     /* Config: path */
     tmp = flb_input_get_property("path", i_ins);
     if (tmp) {
@@ -108,12 +182,31 @@ struct flb_systemd_config *flb_systemd_config_create(struct flb_input_instance *
     /* Database file */
     tmp = flb_input_get_property("db", i_ins);
     if (tmp) {
-        ctx->db = flb_systemd_db_open(tmp, i_ins, config);
-        if (!ctx->db) {
+        ret = flb_systemd_db_open(ctx, tmp, config);
+        if (ret == -1) {
             flb_error("[in_systemd] could not open/create database");
         }
     }
 
+    /* Seconds between cursor checkpoints in the database */
+    tmp = flb_input_get_property("db.checkpoint_interval", i_ins);
+    if (tmp) {
+        ctx->checkpoint_interval = atoi(tmp);
+    }
+    if (ctx->checkpoint_interval <= 0) {
+        ctx->checkpoint_interval = FLB_SYSTEMD_CHECKPOINT;
+    }
+
+    /* Fields allow-list */
+    tmp = flb_input_get_property("fields", i_ins);
+    if (tmp) {
+        ret = fields_create(ctx, tmp);
+        if (ret == -1) {
+            flb_systemd_config_destroy(ctx);
+            return NULL;
+        }
+    }
+
     /* Max number of fields per record/entry */
     tmp = flb_input_get_property("max_fields", i_ins);
     if (tmp) {
@@ -218,6 +311,8 @@ struct flb_systemd_config *flb_systemd_config_create(struct flb_input_instance *
 
 int flb_systemd_config_destroy(struct flb_systemd_config *ctx)
 {
+    int i;
+
     /* Close context */
     if (ctx->j) {
         sd_journal_close(ctx->j);
@@ -227,12 +322,21 @@ int flb_systemd_config_destroy(struct flb_systemd_config *ctx)
         flb_free(ctx->path);
     }
 
-    if (ctx->db) {
-        flb_systemd_db_close(ctx->db);
+    flb_systemd_db_close(ctx);
+
+    if (ctx->fields) {
+        for (i = 0; i < ctx->fields_count; i++) {
+            flb_free(ctx->fields[i]);
+        }
+        flb_free(ctx->fields);
     }
 
+    flb_input_batch_destroy(&ctx->batch);
+
     close(ctx->ch_manager[0]);
     close(ctx->ch_manager[1]);
+    close(ctx->ch_pending[0]);
+    close(ctx->ch_pending[1]);
 
     flb_free(ctx);
     return 0;
@@ -24,6 +24,8 @@
 #include <fluent-bit/flb_info.h>
 #include <fluent-bit/flb_input.h>
 #include <fluent-bit/flb_config.h>
+#include <fluent-bit/flb_input_batch.h>
+#include <fluent-bit/flb_sqldb.h>
 
 #include <systemd/sd-journal.h>
 
@@ -39,6 +41,7 @@
 #define FLB_SYSTEMD_UNKNOWN  "unknown"
 #define FLB_SYSTEMD_MAX_FIELDS   8000
 #define FLB_SYSTEMD_MAX_ENTRIES  5000
+#define FLB_SYSTEMD_CHECKPOINT   5     /* seconds between cursor checkpoints */
 
 /* Input configuration & context */
 struct flb_systemd_config {
@@ -52,14 +55,31 @@ struct flb_systemd_config {
 
     /* Internal */
     int ch_manager[2];         /* pipe: channel manager    */
+    int ch_pending[2];         /* pipe: pending records    */
     int coll_fd_archive;       /* archive collector        */
     int coll_fd_journal;       /* journal, events mode     */
     int coll_fd_pending;       /* pending records          */
+    int coll_fd_more;          /* pending records, yielded */
+    int coll_fd_checkpoint;    /* cursor checkpoints       */
+    int pending_signal;        /* ch_pending was notified  */
     int dynamic_tag;
     int max_fields;            /* max number of fields per record */
     int max_entries;           /* max number of records per iteration */
     int strip_underscores;
+
+    /* Fields allow-list: only these fields are read from the entries */
+    char **fields;
+    int fields_count;
+
+    /* Database: the cursor is saved by a timer if it changed */
+    int checkpoint_interval;
+    int cursor_dirty;
+    int db_cursor_exists;
+    sqlite3_stmt *stmt_insert_cursor;
+    sqlite3_stmt *stmt_update_cursor;
     struct flb_sqldb *db;
+
+    struct flb_input_batch batch;
     struct flb_input_instance *i_ins;
 };
 
@@ -42,69 +42,95 @@ static int cb_cursor_check(void *data, int argc, char **argv, char **cols)
     return 0;
 }
 
-struct flb_sqldb *flb_systemd_db_open(char *path, struct flb_input_instance *in,
-                                      struct flb_config *config)
+int flb_systemd_db_open(struct flb_systemd_config *ctx, char *path,
+                        struct flb_config *config)
 {
     int ret;
+    char *cursor;
     struct flb_sqldb *db;
 
     /* Open/create the database */
-    db = flb_sqldb_open(path, in->name, config);
+    db = flb_sqldb_open(path, ctx->i_ins->name, config);
     if (!db) {
-        return NULL;
+        return -1;
     }
+    ctx->db = db;
 
     /* Create table schema if it don't exists */
     ret = flb_sqldb_query(db, SQL_CREATE_CURSOR, NULL, NULL);
     if (ret != FLB_OK) {
         flb_error("[in_systemd:db] could not create 'cursor' table");
-        flb_sqldb_close(db);
-        return NULL;
+        flb_systemd_db_close(ctx);
+        return -1;
+    }
+
+    /* Statements used by the cursor checkpoints */
+    ret = sqlite3_prepare_v2(db->handler, SQL_INSERT_CURSOR, -1,
+                             &ctx->stmt_insert_cursor, NULL);
+    if (ret != SQLITE_OK) {
+        flb_error("[in_systemd:db] error preparing cursor insert statement");
+        flb_systemd_db_close(ctx);
+        return -1;
+    }
+
+    ret = sqlite3_prepare_v2(db->handler, SQL_UPDATE_CURSOR, -1,
+                             &ctx->stmt_update_cursor, NULL);
+    if (ret != SQLITE_OK) {
+        flb_error("[in_systemd:db] error preparing cursor update statement");
+        flb_systemd_db_close(ctx);
+        return -1;
     }
 
-    return db;
+    /* The row is created once, further checkpoints just update it */
+    cursor = flb_systemd_db_get_cursor(ctx);
+    if (cursor) {
+        ctx->db_cursor_exists = FLB_TRUE;
+        flb_free(cursor);
+    }
+
+    return 0;
 }
 
-int flb_systemd_db_close(struct flb_sqldb *db)
+void flb_systemd_db_close(struct flb_systemd_config *ctx)
 {
-    flb_sqldb_close(db);
-    return 0;
+    if (ctx->stmt_insert_cursor) {
+        sqlite3_finalize(ctx->stmt_insert_cursor);
+        ctx->stmt_insert_cursor = NULL;
+    }
+    if (ctx->stmt_update_cursor) {
+        sqlite3_finalize(ctx->stmt_update_cursor);
+        ctx->stmt_update_cursor = NULL;
+    }
+    if (ctx->db) {
+        flb_sqldb_close(ctx->db);
+        ctx->db = NULL;
+    }
 }
 
 int flb_systemd_db_set_cursor(struct flb_systemd_config *ctx, char *cursor)
 {
     int ret;
-    char query[PATH_MAX];
-    struct query_status qs = {0};
+    sqlite3_stmt *stmt;
 
-    /* Check if the file exists */
-    memset(&qs, '\0', sizeof(qs));
-    ret = flb_sqldb_query(ctx->db,
-                          SQL_GET_CURSOR, cb_cursor_check, &qs);
-
-    if (qs.rows == 0) {
-        /* Register the cursor */
-        snprintf(query, sizeof(query) - 1,
-                 SQL_INSERT_CURSOR,
-                 cursor, time(NULL));
-        ret = flb_sqldb_query(ctx->db,
-                              query, NULL, NULL);
-        if (ret == FLB_ERROR) {
-            return -1;
-        }
-        return 0;
+    if (ctx->db_cursor_exists == FLB_TRUE) {
+        stmt = ctx->stmt_update_cursor;
+    }
+    else {
+        stmt = ctx->stmt_insert_cursor;
     }
 
-    /* Register the cursor */
-    flb_free(qs.cursor);
-    snprintf(query, sizeof(query) - 1,
-             SQL_UPDATE_CURSOR,
-             cursor, time(NULL));
-    ret = flb_sqldb_query(ctx->db,
-                          query, NULL, NULL);
-    if (ret == FLB_ERROR) {
+    sqlite3_bind_text(stmt, 1, cursor, -1, SQLITE_STATIC);
+    sqlite3_bind_int64(stmt, 2, time(NULL));
+    ret = sqlite3_step(stmt);
+    sqlite3_clear_bindings(stmt);
+    sqlite3_reset(stmt);
+
+    if (ret != SQLITE_DONE) {
+        flb_error("[in_systemd:db] could not save cursor, ret=%i", ret);
         return -1;
     }
+
+    ctx->db_cursor_exists = FLB_TRUE;
     return 0;
 }
 
@@ -36,16 +36,17 @@
 #define SQL_GET_CURSOR \
     "SELECT * FROM in_systemd_cursor;"
 
+/* Prepared statements: @cursor, @updated */
 #define SQL_INSERT_CURSOR                               \
     "INSERT INTO in_systemd_cursor (cursor, updated)"   \
-    "  VALUES ('%s', %lu);"
+    "  VALUES (@cursor, @updated);"
 
 #define SQL_UPDATE_CURSOR \
-    "UPDATE in_systemd_cursor SET cursor='%s', updated=%lu;"
+    "UPDATE in_systemd_cursor SET cursor=@cursor, updated=@updated;"
 
-struct flb_sqldb *flb_systemd_db_open(char *path, struct flb_input_instance *in,
-                                      struct flb_config *config);
-int flb_systemd_db_close(struct flb_sqldb *db);
+int flb_systemd_db_open(struct flb_systemd_config *ctx, char *path,
+                        struct flb_config *config);
+void flb_systemd_db_close(struct flb_systemd_config *ctx);
 int flb_systemd_db_set_cursor(struct flb_systemd_config *ctx, char *cursor);
 char *flb_systemd_db_get_cursor(struct flb_systemd_config *ctx);
 
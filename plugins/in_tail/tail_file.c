@@ -116,67 +116,53 @@ static int unpack_and_pack(msgpack_packer *pck, msgpack_object *root,
     return 0;
 }
 
-static int append_record_to_map(char **data, size_t *data_size,
+/* Pack a parsed record adding a new k/v pair at the beginning */
+static int append_record_to_map(msgpack_packer *pck,
+                                char *data, size_t data_size,
                                 char *key,  size_t key_len,
                                 char *val,  size_t val_len)
 {
     int ret;
     msgpack_unpacked result;
     msgpack_object   root;
-    msgpack_sbuffer sbuf;
-    msgpack_packer  pck;
     size_t off = 0;
 
-    msgpack_sbuffer_init(&sbuf);
-    msgpack_packer_init(&pck, &sbuf, msgpack_sbuffer_write);
     msgpack_unpacked_init(&result);
 
-    ret = msgpack_unpack_next(&result, *data, *data_size, &off);
+    ret = msgpack_unpack_next(&result, data, data_size, &off);
     if (ret != MSGPACK_UNPACK_SUCCESS) {
         msgpack_unpacked_destroy(&result);
-        msgpack_sbuffer_destroy(&sbuf);
         return -1;
     }
 
     root = result.data;
-    ret = unpack_and_pack(&pck, &root,
+    ret = unpack_and_pack(pck, &root,
                           key, key_len, val, val_len);
-    if (ret < 0) {
-        /* fail! */
-        msgpack_unpacked_destroy(&result);
-        msgpack_sbuffer_destroy(&sbuf);
-        return -1;
-    }
-    else {
-        /* success !*/
-        flb_free(*data);
-        *data      = sbuf.data;
-        *data_size = sbuf.size;
-    }
 
     msgpack_unpacked_destroy(&result);
-    return 0;
+    return ret;
 }
 
 int flb_tail_pack_line_map(msgpack_sbuffer *mp_sbuf, msgpack_packer *mp_pck,
                            struct flb_time *time, char **data,
                            size_t *data_size, struct flb_tail_file *file)
 {
-    int map_num = 1;
+    int ret;
 
-    if (file->config->path_key != NULL) {
-        map_num++; /* to append path_key */
-    }
+    msgpack_pack_array(mp_pck, 2);
+    flb_time_append_to_msgpack(time, mp_pck, 0);
 
     if (file->config->path_key != NULL) {
-        append_record_to_map(data, data_size,
-                             file->config->path_key,
-                             file->config->path_key_len,
-                             file->name, file->name_len);
+        /* append path_key */
+        ret = append_record_to_map(mp_pck, *data, *data_size,
+                                   file->config->path_key,
+                                   file->config->path_key_len,
+                                   file->name, file->name_len);
+        if (ret == 0) {
+            return 0;
+        }
     }
 
-    msgpack_pack_array(mp_pck, 2);
-    flb_time_append_to_msgpack(time, mp_pck, 0);
     msgpack_sbuffer_write(mp_sbuf, *data, *data_size);
 
     return 0;
@@ -235,11 +221,18 @@ static int process_content(struct flb_tail_file *file, off_t *bytes)
     msgpack_packer mp_pck;
     msgpack_sbuffer *out_sbuf;
     msgpack_packer *out_pck;
+    msgpack_sbuffer parser_sbuf;
+    msgpack_packer parser_pck;
     struct flb_tail_config *ctx = file->config;
 
     /* Create a temporal msgpack buffer */
     msgpack_sbuffer_init(&mp_sbuf);
     msgpack_packer_init(&mp_pck, &mp_sbuf, msgpack_sbuffer_write);
+
+    /* Parsed records buffer, reused for every line */
+    msgpack_sbuffer_init(&parser_sbuf);
+    msgpack_packer_init(&parser_pck, &parser_sbuf, msgpack_sbuffer_write);
+
     out_sbuf = &mp_sbuf;
     out_pck  = &mp_pck;
 
@@ -302,8 +295,9 @@ static int process_content(struct flb_tail_file *file, off_t *bytes)
 #ifdef FLB_HAVE_PARSER
         if (ctx->parser) {
             /* Common parser (non-multiline) */
-            ret = flb_parser_do(ctx->parser, line, line_len,
-                                &out_buf, &out_size, &out_time);
+            msgpack_sbuffer_clear(&parser_sbuf);
+            ret = flb_parser_do_pack(ctx->parser, line, line_len,
+                                     &parser_pck, &out_time);
             if (ret >= 0) {
                 if (flb_time_to_double(&out_time) == 0) {
                     flb_time_get(&out_time);
@@ -311,7 +305,6 @@ static int process_content(struct flb_tail_file *file, off_t *bytes)
 
                 if (ctx->ignore_older > 0) {
                     if ((now - ctx->ignore_older) > out_time.tm.tv_sec) {
-                        flb_free(out_buf);
                         goto go_next;
                     }
                 }
@@ -321,9 +314,10 @@ static int process_content(struct flb_tail_file *file, off_t *bytes)
                     flb_tail_mult_flush(out_sbuf, out_pck, file, ctx);
                 }
 
+                out_buf = parser_sbuf.data;
+                out_size = parser_sbuf.size;
                 flb_tail_pack_line_map(out_sbuf, out_pck, &out_time,
                                        (char**) &out_buf, &out_size, file);
-                flb_free(out_buf);
             }
             else {
                 /* Parser failed, pack raw text */
@@ -384,6 +378,7 @@ static int process_content(struct flb_tail_file *file, off_t *bytes)
                                out_sbuf->size);
 
     msgpack_sbuffer_destroy(out_sbuf);
+    msgpack_sbuffer_destroy(&parser_sbuf);
     return lines;
 }
 
@@ -46,13 +46,79 @@ static int in_tcp_collect(struct flb_input_instance *in,
     }
 
     flb_trace("[in_tcp] new TCP connection arrived FD=%i", fd);
-    conn = tcp_conn_add(fd, ctx);
+    conn = tcp_conn_add(fd, ctx, NULL);
     if (!conn) {
         return -1;
     }
     return 0;
 }
 
+/* Worker threads: new connection accepted */
+static int in_tcp_worker_accept(flb_sockfd_t fd,
+                                struct flb_net_worker *worker, void *data)
+{
+    struct tcp_conn *conn;
+
+    conn = tcp_conn_add(fd, data, worker);
+    if (!conn) {
+        return -1;
+    }
+    return 0;
+}
+
+/* Worker threads: release the connections once the thread finished */
+static void in_tcp_worker_exit(struct flb_net_worker *worker, void *data)
+{
+    struct mk_list *tmp;
+    struct mk_list *head;
+    struct tcp_conn *conn;
+    (void) data;
+
+    mk_list_foreach_safe(head, tmp, &worker->connections) {
+        conn = mk_list_entry(head, struct tcp_conn, _head);
+        tcp_conn_del(conn);
+    }
+}
+
+/* Records decoded by the worker threads */
+static int in_tcp_collect_workers(struct flb_input_instance *in,
+                                  struct flb_config *config, void *in_context)
+{
+    struct flb_in_tcp_config *ctx = in_context;
+    (void) in;
+    (void) config;
+
+    return flb_net_workers_collect(ctx->net_workers);
+}
+
+static int in_tcp_workers_init(struct flb_in_tcp_config *ctx,
+                               struct flb_config *config)
+{
+    int ret;
+
+    ctx->net_workers = flb_net_workers_create(ctx->in,
+                                              ctx->listen, ctx->tcp_port,
+                                              ctx->workers,
+                                              in_tcp_worker_accept,
+                                              in_tcp_worker_exit,
+                                              ctx);
+    if (!ctx->net_workers) {
+        return -1;
+    }
+
+    ret = flb_input_set_collector_event(ctx->in,
+                                        in_tcp_collect_workers,
+                                        ctx->net_workers->ch_batches[0],
+                                        config);
+    if (ret == -1) {
+        flb_net_workers_destroy(ctx->net_workers);
+        ctx->net_workers = NULL;
+        return -1;
+    }
+
+    return 0;
+}
+
 /* Initialize plugin */
 static int in_tcp_init(struct flb_input_instance *in,
                       struct flb_config *config, void *data)
@@ -71,6 +137,19 @@ static int in_tcp_init(struct flb_input_instance *in,
 
     /* Set the context */
     flb_input_set_context(in, ctx);
+    ctx->evl = config->evl;
+
+    /* Accept and read the connections in worker threads */
+    if (ctx->workers > 0) {
+        ret = in_tcp_workers_init(ctx, config);
+        if (ret == -1) {
+            flb_error("[in_tcp] could not start workers on %s:%s",
+                      ctx->listen, ctx->tcp_port);
+            tcp_config_destroy(ctx);
+            return -1;
+        }
+        return 0;
+    }
 
     /* Create TCP server */
     ctx->server_fd = flb_net_server(ctx->tcp_port, ctx->listen);
@@ -85,8 +164,6 @@ static int in_tcp_init(struct flb_input_instance *in,
     }
     flb_net_socket_nonblocking(ctx->server_fd);
 
-    ctx->evl = config->evl;
-
     /* Collect upon data available on the standard input */
     ret = flb_input_set_collector_socket(in,
                                         in_tcp_collect,
@@ -101,6 +178,27 @@ static int in_tcp_init(struct flb_input_instance *in,
     return 0;
 }
 
+/* Paused instance: the worker threads stop reading their connections */
+static void in_tcp_pause(void *data, struct flb_config *config)
+{
+    struct flb_in_tcp_config *ctx = data;
+    (void) config;
+
+    if (ctx->net_workers) {
+        flb_net_workers_pause(ctx->net_workers);
+    }
+}
+
+static void in_tcp_resume(void *data, struct flb_config *config)
+{
+    struct flb_in_tcp_config *ctx = data;
+    (void) config;
+
+    if (ctx->net_workers) {
+        flb_net_workers_resume(ctx->net_workers);
+    }
+}
+
 static int in_tcp_exit(void *data, struct flb_config *config)
 {
     struct mk_list *tmp;
@@ -109,6 +207,10 @@ static int in_tcp_exit(void *data, struct flb_config *config)
     struct flb_in_tcp_config *ctx = data;
     struct tcp_conn *conn;
 
+    if (ctx->net_workers) {
+        flb_net_workers_destroy(ctx->net_workers);
+    }
+
     mk_list_foreach_safe(head, tmp, &ctx->connections) {
         conn = mk_list_entry(head, struct tcp_conn, _head);
         tcp_conn_del(conn);
@@ -126,6 +228,8 @@ struct flb_input_plugin in_tcp_plugin = {
     .cb_pre_run   = NULL,
     .cb_collect   = in_tcp_collect,
     .cb_flush_buf = NULL,
+    .cb_pause     = in_tcp_pause,
+    .cb_resume    = in_tcp_resume,
     .cb_exit      = in_tcp_exit,
     .flags        = FLB_INPUT_NET,
 };
@@ -23,15 +23,21 @@
 
 #include <msgpack.h>
 #include <fluent-bit/flb_input.h>
+#include <fluent-bit/flb_input_batch.h>
+#include <fluent-bit/flb_net_workers.h>
 
 struct flb_in_tcp_config {
     int server_fd;                 /* TCP server file descriptor  */
+    int ndjson;                    /* newline delimited JSON      */
+    int workers;                   /* number of worker threads    */
     size_t buffer_size;            /* Buffer size for each reader */
     size_t chunk_size;             /* Chunk allocation size       */
     char *listen;                  /* Listen interface            */
     char *tcp_port;                /* TCP Port                    */
     struct mk_list connections;    /* List of active connections  */
     struct mk_event_loop *evl;     /* Event loop file descriptor  */
+    struct flb_input_batch batch;  /* Records pending to append   */
+    struct flb_net_workers *net_workers; /* Listener threads      */
     struct flb_input_instance *in; /* Input plugin instace        */
 };
 
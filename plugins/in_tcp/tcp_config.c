@@ -31,6 +31,8 @@ struct flb_in_tcp_config *tcp_config_init(struct flb_input_instance *i_ins)
     char *listen;
     char *buffer_size;
     char *chunk_size;
+    char *format;
+    char *workers;
     struct flb_in_tcp_config *config;
 
     config = flb_malloc(sizeof(struct flb_in_tcp_config));
@@ -79,6 +81,26 @@ struct flb_in_tcp_config *tcp_config_init(struct flb_input_instance *i_ins)
         config->buffer_size  = (atoi(buffer_size) * 1024);
     }
 
+    /* Format: 'json' (default) or 'ndjson' (one JSON message per line) */
+    format = flb_input_get_property("format", i_ins);
+    if (format && strcasecmp(format, "ndjson") == 0) {
+        config->ndjson = FLB_TRUE;
+    }
+    else if (format && strcasecmp(format, "json") != 0) {
+        flb_warn("[in_tcp] unknown format '%s', using 'json'", format);
+    }
+
+    /* Worker threads to accept and read connections (0: engine thread) */
+    workers = flb_input_get_property("workers", i_ins);
+    if (workers) {
+        config->workers = atoi(workers);
+        if (config->workers < 0) {
+            config->workers = 0;
+        }
+    }
+
+    flb_input_batch_init(&config->batch, i_ins, 0);
+
     flb_debug("[in_tcp] Listen='%s' TCP_Port=%s",
               config->listen, config->tcp_port);
 
@@ -87,6 +109,7 @@ struct flb_in_tcp_config *tcp_config_init(struct flb_input_instance *i_ins)
 
 int tcp_config_destroy(struct flb_in_tcp_config *config)
 {
+    flb_input_batch_destroy(&config->batch);
     flb_free(config->listen);
     flb_free(config->tcp_port);
     flb_free(config);
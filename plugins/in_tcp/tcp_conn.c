@@ -33,42 +33,62 @@ static inline void consume_bytes(char *buf, int bytes, int length)
     memmove(buf, buf + bytes, length - bytes);
 }
 
-static inline int process_pack(struct tcp_conn *conn,
-                               char *pack, size_t size)
+/*
+ * Process the complete JSON messages available in the connection buffer.
+ * The stream parser keeps its position between calls, so the bytes of an
+ * incomplete message are only scanned once no matter how many reads are
+ * needed to receive it. Invalid messages are skipped alone, the stream
+ * resyncs on the next value.
+ */
+static int process_stream(struct tcp_conn *conn)
 {
-    size_t off = 0;
-    msgpack_unpacked result;
-    msgpack_object entry;
-    msgpack_packer mp_pck;
-    msgpack_sbuffer mp_sbuf;
-
-    /* Initialize local msgpack buffer */
-    msgpack_sbuffer_init(&mp_sbuf);
-    msgpack_packer_init(&mp_pck, &mp_sbuf, msgpack_sbuffer_write);
-
-    /* First pack the results, iterate concatenated messages */
-    msgpack_unpacked_init(&result);
-    while (msgpack_unpack_next(&result, pack, size, &off) == MSGPACK_UNPACK_SUCCESS) {
-        entry = result.data;
-
-        msgpack_pack_array(&mp_pck, 2);
-        flb_pack_time_now(&mp_pck);
-
-        if (entry.type == MSGPACK_OBJECT_MAP) {
-            msgpack_pack_object(&mp_pck, entry);
+    int ret;
+    int type;
+    int invalid = 0;
+    size_t off;
+    size_t processed;
+    size_t value_len;
+    char *value;
+    struct flb_input_batch *batch = conn->batch;
+
+    while (1) {
+        ret = flb_pack_json_stream_next(&conn->stream,
+                                        conn->buf_data, conn->buf_len,
+                                        &value, &value_len, &type);
+        if (ret == FLB_ERR_JSON_INVAL) {
+            invalid++;
+            continue;
         }
-        else {
-            msgpack_pack_map(&mp_pck, 1);
-            msgpack_pack_str(&mp_pck, 3);
-            msgpack_pack_str_body(&mp_pck, "msg", 3);
-            msgpack_pack_object(&mp_pck, entry);
+        else if (ret != 0) {
+            break;
         }
+
+        /* Keep the batch consistent if the message cannot be packed */
+        off = batch->mp_sbuf.size;
+        ret = flb_pack_json_stream_record(&conn->stream, value, value_len,
+                                          type, &batch->mp_pck);
+        if (ret != 0) {
+            invalid++;
+            batch->mp_sbuf.size = off;
+            continue;
+        }
+        flb_input_batch_commit(batch, 1);
     }
 
-    msgpack_unpacked_destroy(&result);
+    flb_input_batch_flush(batch);
 
-    flb_input_chunk_append_raw(conn->in, NULL, 0, mp_sbuf.data, mp_sbuf.size);
-    msgpack_sbuffer_destroy(&mp_sbuf);
+    if (invalid > 0) {
+        flb_warn("[in_tcp] fd=%i invalid JSON message, skipping", conn->fd);
+    }
+
+    /* Release the bytes of the messages already processed */
+    processed = flb_pack_json_stream_processed(&conn->stream);
+    if (processed > 0) {
+        consume_bytes(conn->buf_data, processed, conn->buf_len);
+        conn->buf_len -= processed;
+        conn->buf_data[conn->buf_len] = '\0';
+        flb_pack_json_stream_consume(&conn->stream, processed);
+    }
 
     return 0;
 }
@@ -76,7 +96,6 @@ static inline int process_pack(struct tcp_conn *conn,
 /* Callback invoked every time an event is triggered for a connection */
 int tcp_conn_event(void *data)
 {
-    int ret;
     int bytes;
     int available;
     int size;
@@ -87,7 +106,7 @@ int tcp_conn_event(void *data)
 
     event = &conn->event;
     if (event->mask & MK_EVENT_READ) {
-        available = (conn->buf_size - conn->buf_len);
+        available = (conn->buf_size - conn->buf_len) - 1;
         if (available < 1) {
             if (conn->buf_size + ctx->chunk_size > ctx->buffer_size) {
                 flb_trace("[in_tcp] fd=%i incoming data exceed limit (%i KB)",
@@ -107,7 +126,7 @@ int tcp_conn_event(void *data)
 
             conn->buf_data = tmp;
             conn->buf_size = size;
-            available = (conn->buf_size - conn->buf_len);
+            available = (conn->buf_size - conn->buf_len) - 1;
         }
 
         /* Read data */
@@ -124,48 +143,7 @@ int tcp_conn_event(void *data)
         conn->buf_len += bytes;
         conn->buf_data[conn->buf_len] = '\0';
 
-        /* Strip CR or LF if found at first byte */
-        if (conn->buf_data[0] == '\r' || conn->buf_data[0] == '\n') {
-            /* Skip message with one byte with CR or LF */
-            flb_trace("[in_tcp] skip one byte message with ASCII code=%i",
-                      conn->buf_data[0]);
-            consume_bytes(conn->buf_data, 1, conn->buf_len);
-            conn->buf_len--;
-        }
-
-        /* JSON Format handler */
-        char *pack;
-        int out_size;
-        ret = flb_pack_json_state(conn->buf_data, conn->buf_len,
-                                  &pack, &out_size, &conn->pack_state);
-        if (ret == FLB_ERR_JSON_PART) {
-            flb_debug("[in_tcp] JSON incomplete, waiting for more data...");
-            return 0;
-        }
-        else if (ret == FLB_ERR_JSON_INVAL) {
-            flb_warn("[in_tcp] invalid JSON message, skipping");
-            flb_pack_state_reset(&conn->pack_state);
-            flb_pack_state_init(&conn->pack_state);
-            conn->buf_len = 0;
-            conn->pack_state.multiple = FLB_TRUE;
-            return -1;
-        }
-
-        /*
-         * Given the Tokens used for the packaged message, append
-         * the records and then adjust buffer.
-         */
-        process_pack(conn, pack, out_size);
-
-        consume_bytes(conn->buf_data, conn->pack_state.last_byte, conn->buf_len);
-        conn->buf_len -= conn->pack_state.last_byte;
-        conn->buf_data[conn->buf_len] = '\0';
-
-        flb_pack_state_reset(&conn->pack_state);
-        flb_pack_state_init(&conn->pack_state);
-        conn->pack_state.multiple = FLB_TRUE;
-
-        flb_free(pack);
+        process_stream(conn);
         return bytes;
     }
 
@@ -177,8 +155,12 @@ int tcp_conn_event(void *data)
     return 0;
 }
 
-/* Create a new mqtt request instance */
-struct tcp_conn *tcp_conn_add(int fd, struct flb_in_tcp_config *ctx)
+/*
+ * Create a new connection. If 'worker' is set the connection is handled by
+ * that worker thread, otherwise by the engine thread.
+ */
+struct tcp_conn *tcp_conn_add(int fd, struct flb_in_tcp_config *ctx,
+                              struct flb_net_worker *worker)
 {
     int ret;
     struct tcp_conn *conn;
@@ -215,35 +197,51 @@ struct tcp_conn *tcp_conn_add(int fd, struct flb_in_tcp_config *ctx)
     conn->buf_size = ctx->chunk_size;
     conn->in       = ctx->in;
 
+    if (worker) {
+        conn->evl = worker->evl;
+        conn->batch = &worker->batch;
+    }
+    else {
+        conn->evl = ctx->evl;
+        conn->batch = &ctx->batch;
+    }
+
     /* Initialize JSON parser */
-    flb_pack_state_init(&conn->pack_state);
-    conn->pack_state.multiple = FLB_TRUE;
+    ret = flb_pack_json_stream_init(&conn->stream, ctx->ndjson);
+    if (ret == -1) {
+        close(fd);
+        flb_free(conn->buf_data);
+        flb_free(conn);
+        return NULL;
+    }
 
     /* Register instance into the event loop */
-    ret = mk_event_add(ctx->evl, fd, FLB_ENGINE_EV_CUSTOM, MK_EVENT_READ, conn);
+    ret = mk_event_add(conn->evl, fd, FLB_ENGINE_EV_CUSTOM, MK_EVENT_READ, conn);
     if (ret == -1) {
         flb_error("[in_tcp] could not register new connection");
         close(fd);
+        flb_pack_json_stream_destroy(&conn->stream);
         flb_free(conn->buf_data);
         flb_free(conn);
         return NULL;
     }
 
-    mk_list_add(&conn->_head, &ctx->connections);
+    if (worker) {
+        mk_list_add(&conn->_head, &worker->connections);
+    }
+    else {
+        mk_list_add(&conn->_head, &ctx->connections);
+    }
 
     return conn;
 }
 
 int tcp_conn_del(struct tcp_conn *conn)
 {
-    struct flb_in_tcp_config *ctx;
-
-    ctx = conn->ctx;
-
-    flb_pack_state_reset(&conn->pack_state);
+    flb_pack_json_stream_destroy(&conn->stream);
 
     /* Unregister the file descriptior from the event-loop */
-    mk_event_del(ctx->evl, &conn->event);
+    mk_event_del(conn->evl, &conn->event);
 
     /* Release resources */
     mk_list_del(&conn->_head);
@@ -22,6 +22,8 @@
 #define FLB_IN_TCP_CONN_H
 
 #include <fluent-bit/flb_pack.h>
+#include <fluent-bit/flb_input_batch.h>
+#include <fluent-bit/flb_net_workers.h>
 
 #define FLB_IN_TCP_CHUNK 32768
 
@@ -47,14 +49,17 @@ struct tcp_conn {
     int  buf_size;                    /* Buffer size                       */
     size_t rest;                      /* Unpacking offset                  */
 
+    struct mk_event_loop *evl;        /* Event loop of the owner thread    */
+    struct flb_input_batch *batch;    /* Batch of the owner thread         */
     struct flb_input_instance *in;    /* Parent plugin instance            */
     struct flb_in_tcp_config *ctx;    /* Plugin configuration context      */
-    struct flb_pack_state pack_state; /* Internal JSON parser              */
+    struct flb_pack_json_stream stream; /* Internal JSON parser            */
 
     struct mk_list _head;
 };
 
-struct tcp_conn *tcp_conn_add(int fd, struct flb_in_tcp_config *ctx);
+struct tcp_conn *tcp_conn_add(int fd, struct flb_in_tcp_config *ctx,
+                              struct flb_net_worker *worker);
 int tcp_conn_del(struct tcp_conn *conn);
 
 #endif
@@ -49,83 +49,20 @@ int azure_format(void *in_buf, size_t in_bytes,
                   char **out_buf, size_t *out_size,
                   struct flb_azure *ctx)
 {
-    int i;
-    int array_size = 0;
-    int map_size;
-    size_t off = 0;
-    double t;
-    struct flb_time tm;
-    msgpack_unpacked result;
-    msgpack_object root;
-    msgpack_object *obj;
-    msgpack_object map;
-    msgpack_object k;
-    msgpack_object v;
-    msgpack_sbuffer mp_sbuf;
-    msgpack_packer mp_pck;
-    msgpack_sbuffer tmp_sbuf;
-    msgpack_packer tmp_pck;
+    int ret;
     flb_sds_t record;
 
-    /* Count number of items */
-    msgpack_unpacked_init(&result);
-    while (msgpack_unpack_next(&result, in_buf, in_bytes, &off) == MSGPACK_UNPACK_SUCCESS) {
-        array_size++;
-    }
-    msgpack_unpacked_destroy(&result);
-    msgpack_unpacked_init(&result);
-
-    /* Create temporal msgpack buffer */
-    msgpack_sbuffer_init(&mp_sbuf);
-    msgpack_packer_init(&mp_pck, &mp_sbuf, msgpack_sbuffer_write);
-    msgpack_pack_array(&mp_pck, array_size);
-
-    off = 0;
-    while (msgpack_unpack_next(&result, in_buf, in_bytes, &off) == MSGPACK_UNPACK_SUCCESS) {
-        root = result.data;
-
-        /* Get timestamp */
-        flb_time_pop_from_msgpack(&tm, &result, &obj);
-        t = flb_time_to_double(&tm);
-
-        /* Create temporal msgpack buffer */
-        msgpack_sbuffer_init(&tmp_sbuf);
-        msgpack_packer_init(&tmp_pck, &tmp_sbuf, msgpack_sbuffer_write);
-
-        map = root.via.array.ptr[1];
-        map_size = map.via.map.size;
-
-        msgpack_pack_map(&mp_pck, map_size + 1);
-
-        /* Append the time key */
-        msgpack_pack_str(&mp_pck, flb_sds_len(ctx->time_key));
-        msgpack_pack_str_body(&mp_pck,
-                              ctx->time_key,
-                              flb_sds_len(ctx->time_key));
-        msgpack_pack_double(&mp_pck, t);
-
-        /* Append original map k/v */
-        for (i = 0; i < map_size; i++) {
-            k = map.via.map.ptr[i].key;
-            v = map.via.map.ptr[i].val;
-
-            msgpack_pack_object(&tmp_pck, k);
-            msgpack_pack_object(&tmp_pck, v);
-        }
-        msgpack_sbuffer_write(&mp_sbuf, tmp_sbuf.data, tmp_sbuf.size);
-        msgpack_sbuffer_destroy(&tmp_sbuf);
-    }
-
-    record = flb_msgpack_raw_to_json_sds(mp_sbuf.data, mp_sbuf.size);
+    record = flb_sds_create_size(in_bytes * 1.5);
     if (!record) {
         flb_errno();
-        msgpack_sbuffer_destroy(&mp_sbuf);
-        msgpack_unpacked_destroy(&result);
         return -1;
     }
 
-    msgpack_sbuffer_destroy(&mp_sbuf);
-    msgpack_unpacked_destroy(&result);
+    ret = flb_pack_json_enc_chunk(&ctx->json_enc, &record, in_buf, in_bytes);
+    if (ret == -1) {
+        flb_sds_destroy(record);
+        return -1;
+    }
 
     *out_buf = record;
     *out_size = flb_sds_len(record);
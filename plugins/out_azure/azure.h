@@ -31,6 +31,7 @@
 #include <fluent-bit/flb_info.h>
 #include <fluent-bit/flb_output.h>
 #include <fluent-bit/flb_sds.h>
+#include <fluent-bit/flb_pack.h>
 
 struct flb_azure {
     /* account setup */
@@ -46,6 +47,7 @@ struct flb_azure {
 
     /* records */
     flb_sds_t time_key;
+    struct flb_pack_json_enc json_enc;
 
     /* Upstream connection to the backend server */
     struct flb_upstream *u;
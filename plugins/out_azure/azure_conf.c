@@ -108,6 +108,14 @@ struct flb_azure *flb_azure_conf_create(struct flb_output_instance *ins,
         return NULL;
     }
 
+    /* Records are sent as a JSON array, the time key goes first */
+    ret = flb_pack_json_enc_init(&ctx->json_enc, FLB_PACK_JSON_FORMAT_JSON,
+                                 FLB_PACK_JSON_DATE_DOUBLE, ctx->time_key);
+    if (ret == -1) {
+        flb_azure_conf_destroy(ctx);
+        return NULL;
+    }
+
     /* Validate hostname given by command line or 'Host' property */
     if (!ins->host.name && !cid) {
         flb_error("[out_azure] property 'customer_id' is not defined");
@@ -217,6 +225,7 @@ int flb_azure_conf_destroy(struct flb_azure *ctx)
     if (ctx->log_type) {
         flb_sds_destroy(ctx->log_type);
     }
+    flb_pack_json_enc_destroy(&ctx->json_enc);
     if (ctx->time_key) {
         flb_sds_destroy(ctx->time_key);
     }
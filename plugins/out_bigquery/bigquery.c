@@ -187,8 +187,11 @@ static int bigquery_jwt_encode(char *payload, char *secret,
     return 0;
 }
 
-/* Create a new oauth2 context and get a oauth2 token */
-static int bigquery_get_oauth2_token(struct flb_bigquery *ctx)
+/*
+ * Create a new oauth2 context and get a oauth2 token, invoked by the
+ * background refresh of the shared token.
+ */
+static struct flb_oauth2 *bigquery_oauth2_token_create(void *data)
 {
     int ret;
     char *token;
@@ -197,6 +200,8 @@ static int bigquery_get_oauth2_token(struct flb_bigquery *ctx)
     time_t issued;
     time_t expires;
     char payload[1024];
+    struct flb_oauth2 *o;
+    struct flb_bigquery *ctx = data;
 
     /* JWT encode for oauth2 */
     issued = time(NULL);
@@ -213,76 +218,80 @@ static int bigquery_get_oauth2_token(struct flb_bigquery *ctx)
     ret = bigquery_jwt_encode(payload, ctx->oauth_credentials->private_key, &sig_data, &sig_size);
     if (ret != 0) {
         flb_error("[out_bigquery] JWT signature generation failed");
-        return -1;
+        return NULL;
     }
 
     flb_debug("[out_bigquery] JWT signature:\n%s", sig_data);
 
     /* Create oauth2 context */
-    ctx->o = flb_oauth2_create(ctx->config, FLB_BIGQUERY_AUTH_URL, 3000);
-    if (!ctx->o) {
+    o = flb_oauth2_create(ctx->config, FLB_BIGQUERY_AUTH_URL, 3000);
+    if (!o) {
         flb_sds_destroy(sig_data);
         flb_error("[out_bigquery] cannot create oauth2 context");
-        return -1;
+        return NULL;
     }
 
-    ret = flb_oauth2_payload_append(ctx->o,
+    ret = flb_oauth2_payload_append(o,
                                     "grant_type", -1,
                                     "urn:ietf:params:oauth:"
                                     "grant-type:jwt-bearer", -1);
     if (ret == -1) {
         flb_error("[out_bigquery] error appending oauth2 params");
         flb_sds_destroy(sig_data);
-        return -1;
+        flb_oauth2_destroy(o);
+        return NULL;
     }
 
-    ret = flb_oauth2_payload_append(ctx->o,
+    ret = flb_oauth2_payload_append(o,
                                     "assertion", -1,
                                     sig_data, sig_size);
     if (ret == -1) {
         flb_error("[out_bigquery] error appending oauth2 params");
         flb_sds_destroy(sig_data);
-        return -1;
+        flb_oauth2_destroy(o);
+        return NULL;
     }
     flb_sds_destroy(sig_data);
 
     /* Retrieve access token */
-    token = flb_oauth2_token_get(ctx->o);
+    token = flb_oauth2_token_get(o);
     if (!token) {
         flb_error("[out_bigquery] error retrieving oauth2 access token");
-        return -1;
+        flb_oauth2_destroy(o);
+        return NULL;
     }
 
-    return 0;
+    return o;
 }
 
-static char *get_google_token(struct flb_bigquery *ctx)
+/* Use the token shared by the instances with the same service account */
+static int bigquery_oauth2_token_register(struct flb_bigquery *ctx)
 {
-    flb_trace("[bigquery] getting google token");
-    int ret = 0;
+    flb_sds_t key;
 
-    if (!ctx->o) {
-        flb_trace("[bigquery] acquiring new token");
-        ret = bigquery_get_oauth2_token(ctx);
-    }
-    else if (flb_oauth2_token_expired(ctx->o) == FLB_TRUE) {
-        flb_trace("[bigquery] replacing expired token");
-        flb_oauth2_destroy(ctx->o);
-        ret = bigquery_get_oauth2_token(ctx);
+    key = flb_sds_create_size(256);
+    if (!key) {
+        flb_errno();
+        return -1;
     }
+    flb_sds_printf(&key, "jwt %s %s", FLB_BIGQUERY_SCOPE,
+                   ctx->oauth_credentials->client_email);
 
-    if (ret != 0) {
-        return NULL;
+    ctx->oauth2 = flb_oauth2_shared_get(ctx->config, key,
+                                        bigquery_oauth2_token_create, ctx);
+    flb_sds_destroy(key);
+    if (!ctx->oauth2) {
+        return -1;
     }
 
-    return ctx->o->access_token;
+    return 0;
 }
 
-
 static int cb_bigquery_init(struct flb_output_instance *ins,
                             struct flb_config *config, void *data)
 {
-    char *token;
+    int ret;
+    flb_sds_t token;
     struct flb_bigquery *ctx;
 
     /* Create config context */
@@ -301,11 +310,18 @@ static int cb_bigquery_init(struct flb_output_instance *ins,
         return -1;
     }
 
-    /* Retrief oauth2 token */
-    token = get_google_token(ctx);
+    /* Retrieve oauth2 token, it's refreshed in background */
+    ret = bigquery_oauth2_token_register(ctx);
+    if (ret == -1) {
+        flb_error("[out_bigquery] cannot register oauth2 token");
+        return -1;
+    }
+
+    token = flb_oauth2_shared_token(ctx->oauth2);
     if (!token) {
         flb_warn("[out_bigquery] token retrieval failed");
     }
+    flb_sds_destroy(token);
 
     return 0;
 }
@@ -316,55 +332,40 @@ static int bigquery_format(void *data, size_t bytes,
                            struct flb_bigquery *ctx)
 {
     int ret;
-    int array_size = 0;
+    int rows = 0;
     size_t off = 0;
     struct flb_time tms;
     msgpack_object *obj;
     msgpack_unpacked result;
-    msgpack_sbuffer mp_sbuf;
-    msgpack_packer mp_pck;
-    char *json_buf;
-    size_t json_size;
+    flb_sds_t json;
+    flb_sds_t tmp;
 
-    /* Count number of records */
-    msgpack_unpacked_init(&result);
-    while (msgpack_unpack_next(&result, data, bytes, &off) == MSGPACK_UNPACK_SUCCESS) {
-        array_size++;
+    json = flb_sds_create_size(bytes * 1.5 + 64);
+    if (!json) {
+        flb_errno();
+        return -1;
     }
-    msgpack_unpacked_destroy(&result);
-    msgpack_unpacked_init(&result);
-
-    /* Create temporal msgpack buffer */
-    msgpack_sbuffer_init(&mp_sbuf);
-    msgpack_packer_init(&mp_pck, &mp_sbuf, msgpack_sbuffer_write);
 
     /*
-     * Pack root map (kind & rows):
+     * Root map (kind & rows):
      *
      * {"kind": "bigquery#tableDataInsertAllRequest"
      *  "rows": []
      */
-    msgpack_pack_map(&mp_pck, 2);
-
-    msgpack_pack_str(&mp_pck, 4);
-    msgpack_pack_str_body(&mp_pck, "kind", 4);
-
-    msgpack_pack_str(&mp_pck, 34);
-    msgpack_pack_str_body(&mp_pck, "bigquery#tableDataInsertAllRequest", 34);
-
-    msgpack_pack_str(&mp_pck, 4);
-    msgpack_pack_str_body(&mp_pck, "rows", 4);
-
-    /* Append entries */
-    msgpack_pack_array(&mp_pck, array_size);
+    tmp = flb_sds_cat(json, "{\"kind\":\"bigquery#tableDataInsertAllRequest\", "
+                      "\"rows\":[", 54);
+    if (!tmp) {
+        goto error;
+    }
+    json = tmp;
 
-    off = 0;
+    msgpack_unpacked_init(&result);
     while (msgpack_unpack_next(&result, data, bytes, &off) == MSGPACK_UNPACK_SUCCESS) {
         /* Get timestamp */
         flb_time_pop_from_msgpack(&tms, &result, &obj);
 
         /*
-         * Pack entry
+         * Entry
          *
          * {
          *  "json": {...}
@@ -372,29 +373,45 @@ static int bigquery_format(void *data, size_t bytes,
          *
          * For now, we don't support the insertId that's required for duplicate detection.
          */
-        msgpack_pack_map(&mp_pck, 1);
+        tmp = flb_sds_cat(json, rows > 0 ? ", {\"json\":" : "{\"json\":",
+                          rows > 0 ? 10 : 8);
+        if (!tmp) {
+            goto error_unpack;
+        }
+        json = tmp;
 
-        /* json */
-        msgpack_pack_str(&mp_pck, 4);
-        msgpack_pack_str_body(&mp_pck, "json", 4);
-        msgpack_pack_object(&mp_pck, *obj);
-    }
+        ret = flb_pack_json_enc_object(&json, obj);
+        if (ret == -1) {
+            goto error_unpack;
+        }
 
-    /* Convert from msgpack to JSON */
-    ret = flb_msgpack_raw_to_json_str(mp_sbuf.data, mp_sbuf.size,
-                                      &json_buf, &json_size);
-    msgpack_sbuffer_destroy(&mp_sbuf);
+        tmp = flb_sds_cat(json, "}", 1);
+        if (!tmp) {
+            goto error_unpack;
+        }
+        json = tmp;
+        rows++;
+    }
+    msgpack_unpacked_destroy(&result);
 
-    if (ret != 0) {
-        flb_error("[out_bigquery] error formatting JSON payload");
-        msgpack_unpacked_destroy(&result);
-        return -1;
+    tmp = flb_sds_cat(json, "]}", 2);
+    if (!tmp) {
+        goto error;
     }
+    json = tmp;
 
-    *out_data = json_buf;
-    *out_size = json_size;
+    *out_data = json;
+    *out_size = flb_sds_len(json);
 
     return 0;
+
+ error_unpack:
+    msgpack_unpacked_destroy(&result);
+ error:
+    flb_errno();
+    flb_error("[out_bigquery] error formatting JSON payload");
+    flb_sds_destroy(json);
+    return -1;
 }
 
 static void set_authorization_header(struct flb_http_client *c,
@@ -419,7 +436,7 @@ static void cb_bigquery_flush(void *data, size_t bytes,
     int ret;
     int ret_code = FLB_RETRY;
     size_t b_sent;
-    char *token;
+    flb_sds_t token;
     char *payload_buf;
     size_t payload_size;
     struct flb_bigquery *ctx = out_context;
@@ -441,12 +458,12 @@ static void cb_bigquery_flush(void *data, size_t bytes,
         FLB_OUTPUT_RETURN(FLB_RETRY);
     }
 
-    /* Get or renew Token */
-    token = get_google_token(ctx);
+    /* Get the cached token */
+    token = flb_oauth2_shared_token(ctx->oauth2);
     if (!token) {
         flb_error("[out_bigquery] cannot retrieve oauth2 token");
         flb_upstream_conn_release(u_conn);
-        flb_free(payload_buf);
+        flb_sds_destroy(payload_buf);
         FLB_OUTPUT_RETURN(FLB_RETRY);
     }
 
@@ -461,6 +478,7 @@ static void cb_bigquery_flush(void *data, size_t bytes,
 
     /* Compose and append Authorization header */
     set_authorization_header(c, token);
+    flb_sds_destroy(token);
 
     /* Send HTTP request */
     ret = flb_http_do(c, &b_sent);
@@ -491,7 +509,7 @@ static void cb_bigquery_flush(void *data, size_t bytes,
     }
 
     /* Cleanup */
-    flb_free(payload_buf);
+    flb_sds_destroy(payload_buf);
     flb_http_client_destroy(c);
     flb_upstream_conn_release(u_conn);
 
@@ -64,8 +64,8 @@ struct flb_bigquery {
 
     flb_sds_t uri;
 
-    /* oauth2 context */
-    struct flb_oauth2 *o;
+    /* oauth2 token, shared by instances with the same credentials */
+    struct flb_oauth2_shared *oauth2;
 
     /* Upstream connection to the backend server */
     struct flb_upstream *u;
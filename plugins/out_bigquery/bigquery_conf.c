@@ -342,6 +342,10 @@ int flb_bigquery_conf_destroy(struct flb_bigquery *ctx)
         return -1;
     }
 
+    if (ctx->oauth2) {
+        flb_oauth2_shared_release(ctx->oauth2, ctx);
+    }
+
     flb_sds_destroy(ctx->credentials_file);
 
     flb_bigquery_oauth_credentials_destroy(ctx->oauth_credentials);
@@ -351,10 +355,6 @@ int flb_bigquery_conf_destroy(struct flb_bigquery *ctx)
     flb_sds_destroy(ctx->table_id);
     flb_sds_destroy(ctx->uri);
 
-    if (ctx->o) {
-        flb_oauth2_destroy(ctx->o);
-    }
-
     flb_free(ctx);
     return 0;
 }
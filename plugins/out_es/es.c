@@ -138,6 +138,7 @@ static char *elasticsearch_format(void *data, size_t bytes,
     int index_len;
     size_t s;
     size_t off = 0;
+    size_t rec_off;
     char *p;
     char *buf;
     char *es_index;
@@ -149,8 +150,8 @@ static char *elasticsearch_format(void *data, size_t bytes,
     msgpack_object root;
     msgpack_object map;
     msgpack_object *obj;
-    char *json_buf;
-    size_t json_size;
+    msgpack_unpacked rec;
+    flb_sds_t json;
     char j_index[ES_BULK_HEADER];
     struct es_bulk *bulk;
     struct tm tm;
@@ -195,6 +196,21 @@ static char *elasticsearch_format(void *data, size_t bytes,
         return NULL;
     }
 
+    /*
+     * The record buffers are reused across the chunk: the msgpack one keeps
+     * the sanitized record (hashed when generating the ID) and the JSON one
+     * its encoded form before it goes into the bulk.
+     */
+    json = flb_sds_create_size(1024);
+    if (!json) {
+        flb_errno();
+        es_bulk_destroy(bulk);
+        return NULL;
+    }
+    msgpack_sbuffer_init(&tmp_sbuf);
+    msgpack_packer_init(&tmp_pck, &tmp_sbuf, msgpack_sbuffer_write);
+    msgpack_unpacked_init(&rec);
+
     off = 0;
 
     msgpack_unpacked_destroy(&result);
@@ -291,9 +307,8 @@ static char *elasticsearch_format(void *data, size_t bytes,
             }
         }
 
-        /* Create temporal msgpack buffer */
-        msgpack_sbuffer_init(&tmp_sbuf);
-        msgpack_packer_init(&tmp_pck, &tmp_sbuf, msgpack_sbuffer_write);
+        /* Reset the record buffer */
+        msgpack_sbuffer_clear(&tmp_sbuf);
 
         if (ctx->include_tag_key == FLB_TRUE) {
             map_size++;
@@ -364,10 +379,7 @@ static char *elasticsearch_format(void *data, size_t bytes,
          */
         ret = es_pack_map_content(&tmp_pck, map, ctx);
         if (ret == -1) {
-            msgpack_unpacked_destroy(&result);
-            msgpack_sbuffer_destroy(&tmp_sbuf);
-            es_bulk_destroy(bulk);
-            return NULL;
+            goto error;
         }
 
         if (ctx->generate_id == FLB_TRUE) {
@@ -383,26 +395,29 @@ static char *elasticsearch_format(void *data, size_t bytes,
         }
 
         /* Convert msgpack to JSON */
-        ret = flb_msgpack_raw_to_json_str(tmp_sbuf.data, tmp_sbuf.size,
-                                          &json_buf, &json_size);
-        msgpack_sbuffer_destroy(&tmp_sbuf);
-        if (ret != 0) {
-            msgpack_unpacked_destroy(&result);
-            es_bulk_destroy(bulk);
-            return NULL;
+        rec_off = 0;
+        ret = msgpack_unpack_next(&rec, tmp_sbuf.data, tmp_sbuf.size,
+                                  &rec_off);
+        if (ret != MSGPACK_UNPACK_SUCCESS) {
+            goto error;
+        }
+        flb_sds_len_set(json, 0);
+        ret = flb_pack_json_enc_object(&json, &rec.data);
+        if (ret == -1) {
+            goto error;
         }
 
-        ret = es_bulk_append(bulk, j_index, index_len, json_buf, json_size);
-        flb_free(json_buf);
+        ret = es_bulk_append(bulk, j_index, index_len,
+                             json, flb_sds_len(json));
         if (ret == -1) {
             /* We likely ran out of memory, abort here */
-            msgpack_unpacked_destroy(&result);
-            *out_size = 0;
-            es_bulk_destroy(bulk);
-            return NULL;
+            goto error;
         }
     }
+    msgpack_unpacked_destroy(&rec);
     msgpack_unpacked_destroy(&result);
+    msgpack_sbuffer_destroy(&tmp_sbuf);
+    flb_sds_destroy(json);
 
     *out_size = bulk->len;
     buf = bulk->ptr;
@@ -418,6 +433,15 @@ static char *elasticsearch_format(void *data, size_t bytes,
         fflush(stdout);
     }
     return buf;
+
+ error:
+    msgpack_unpacked_destroy(&rec);
+    msgpack_unpacked_destroy(&result);
+    msgpack_sbuffer_destroy(&tmp_sbuf);
+    flb_sds_destroy(json);
+    *out_size = 0;
+    es_bulk_destroy(bulk);
+    return NULL;
 }
 
 int cb_es_init(struct flb_output_instance *ins,
@@ -26,11 +26,14 @@
 #include <msgpack.h>
 
 #include <stdio.h>
+#include <ctype.h>
+#include <inttypes.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
 
 #include "file.h"
+#include "file_io.h"
 
 #ifdef FLB_SYSTEM_WINDOWS
 #define NEWLINE "\r\n"
@@ -38,13 +41,6 @@
 #define NEWLINE "\n"
 #endif
 
-struct flb_file_conf {
-    char *out_file;
-    char *delimiter;
-    char *label_delimiter;
-    int  format;
-};
-
 static char* check_delimiter(char *str)
 {
     if (str == NULL) {
@@ -69,9 +65,9 @@ static int cb_file_init(struct flb_output_instance *ins,
                         struct flb_config *config,
                         void *data)
 {
+    ssize_t ret;
     char *tmp;
     char *ret_str;
-    (void) config;
     (void) data;
     struct flb_file_conf *conf;
 
@@ -127,14 +123,241 @@ static int cb_file_init(struct flb_output_instance *ins,
         conf->label_delimiter = ret_str;
     }
 
+    /* Optional rotation by size and/or time */
+    tmp = flb_output_get_property("rotate_size", ins);
+    if (tmp) {
+        ret = flb_utils_size_to_bytes(tmp);
+        if (ret < 0) {
+            flb_error("[out_file] invalid rotate_size '%s'", tmp);
+            flb_free(conf);
+            return -1;
+        }
+        conf->rotate_size = ret;
+    }
+
+    tmp = flb_output_get_property("rotate_interval", ins);
+    if (tmp) {
+        conf->rotate_interval = flb_utils_time_to_seconds(tmp);
+        if (conf->rotate_interval <= 0) {
+            flb_error("[out_file] invalid rotate_interval '%s'", tmp);
+            flb_free(conf);
+            return -1;
+        }
+    }
+
+    /* Rotated files can be compressed with gzip */
+    tmp = flb_output_get_property("rotate_compress", ins);
+    if (tmp && (strcasecmp(tmp, "gzip") == 0 ||
+                flb_utils_bool(tmp) == FLB_TRUE)) {
+#ifdef FLB_OUT_FILE_GZIP
+        conf->rotate_gzip = FLB_TRUE;
+#else
+        flb_warn("[out_file] built without zlib, rotate_compress ignored");
+#endif
+    }
+
+    /* Write from a dedicated thread */
+    tmp = flb_output_get_property("io_thread", ins);
+    if (tmp) {
+        conf->io_thread = flb_utils_bool(tmp);
+    }
+
+    /* Compressing a rotated file would block the engine thread */
+    if (conf->rotate_gzip == FLB_TRUE && conf->io_thread == FLB_FALSE) {
+        flb_error("[out_file] rotate_compress requires io_thread on");
+        flb_free(conf);
+        return -1;
+    }
+
+    mk_list_init(&conf->files);
+
+    conf->buf = flb_sds_create_size(FLB_OUT_FILE_BUF_SIZE);
+    if (!conf->buf) {
+        flb_errno();
+        flb_free(conf);
+        return -1;
+    }
+
+    if (conf->io_thread == FLB_TRUE) {
+        ret = file_io_thread_start(conf, config);
+        if (ret == -1) {
+            flb_sds_destroy(conf->buf);
+            flb_free(conf);
+            return -1;
+        }
+    }
+
     /* Set the context */
     flb_output_set_context(ins, conf);
 
     return 0;
 }
 
-static int csv_output(FILE *fp, struct flb_time *tm, msgpack_object *obj,
-                      struct flb_file_conf *ctx)
+/* Append 'len' bytes to the buffer */
+static int buf_cat(flb_sds_t *buf, char *str, int len)
+{
+    flb_sds_t tmp;
+
+    tmp = flb_sds_cat(*buf, str, len);
+    if (!tmp) {
+        flb_errno();
+        return -1;
+    }
+    *buf = tmp;
+    return 0;
+}
+
+/* Make sure the buffer has room for at least 'size' more bytes */
+static int buf_reserve(flb_sds_t *buf, size_t size)
+{
+    flb_sds_t tmp;
+
+    if (flb_sds_avail(*buf) >= size) {
+        return 0;
+    }
+
+    tmp = flb_sds_increase(*buf, size);
+    if (!tmp) {
+        flb_errno();
+        return -1;
+    }
+    *buf = tmp;
+    return 0;
+}
+
+/* Same representation of binary data than msgpack_object_print() */
+static int buf_bin(flb_sds_t *buf, const char *ptr, size_t size)
+{
+    size_t i;
+    int len;
+
+    /* worst case every byte is printed as \xNN */
+    if (buf_reserve(buf, size * 4 + 2) == -1) {
+        return -1;
+    }
+
+    len = flb_sds_len(*buf);
+    (*buf)[len++] = '"';
+    for (i = 0; i < size; i++) {
+        if (ptr[i] == '"') {
+            (*buf)[len++] = '\\';
+            (*buf)[len++] = '"';
+        }
+        else if (isprint((unsigned char) ptr[i])) {
+            (*buf)[len++] = ptr[i];
+        }
+        else {
+            snprintf(*buf + len, 5, "\\x%02x", (unsigned char) ptr[i]);
+            len += 4;
+        }
+    }
+    (*buf)[len++] = '"';
+    flb_sds_len_set(*buf, len);
+
+    return 0;
+}
+
+/*
+ * Print a msgpack object in the buffer, the output is the same than the
+ * one of msgpack_object_print() used by the CSV and LTSV formats.
+ */
+static int buf_object(flb_sds_t *buf, msgpack_object *o)
+{
+    int ret = 0;
+    uint32_t i;
+
+    switch (o->type) {
+    case MSGPACK_OBJECT_NIL:
+        return buf_cat(buf, "nil", 3);
+    case MSGPACK_OBJECT_BOOLEAN:
+        if (o->via.boolean) {
+            return buf_cat(buf, "true", 4);
+        }
+        return buf_cat(buf, "false", 5);
+    case MSGPACK_OBJECT_POSITIVE_INTEGER:
+        return flb_sds_printf(buf, "%" PRIu64, o->via.u64) ? 0 : -1;
+    case MSGPACK_OBJECT_NEGATIVE_INTEGER:
+        return flb_sds_printf(buf, "%" PRIi64, o->via.i64) ? 0 : -1;
+    case MSGPACK_OBJECT_FLOAT32:
+    case MSGPACK_OBJECT_FLOAT64:
+        return flb_sds_printf(buf, "%f", o->via.f64) ? 0 : -1;
+    case MSGPACK_OBJECT_STR:
+        if (buf_cat(buf, "\"", 1) == -1 ||
+            buf_cat(buf, (char *) o->via.str.ptr, o->via.str.size) == -1) {
+            return -1;
+        }
+        return buf_cat(buf, "\"", 1);
+    case MSGPACK_OBJECT_BIN:
+        return buf_bin(buf, o->via.bin.ptr, o->via.bin.size);
+    case MSGPACK_OBJECT_EXT:
+        if (!flb_sds_printf(buf, "(ext: %" PRIi8 ")", o->via.ext.type)) {
+            return -1;
+        }
+        return buf_bin(buf, o->via.ext.ptr, o->via.ext.size);
+    case MSGPACK_OBJECT_ARRAY:
+        ret = buf_cat(buf, "[", 1);
+        for (i = 0; i < o->via.array.size && ret == 0; i++) {
+            if (i > 0) {
+                ret = buf_cat(buf, ", ", 2);
+            }
+            if (ret == 0) {
+                ret = buf_object(buf, &o->via.array.ptr[i]);
+            }
+        }
+        if (ret == 0) {
+            ret = buf_cat(buf, "]", 1);
+        }
+        return ret;
+    case MSGPACK_OBJECT_MAP:
+        ret = buf_cat(buf, "{", 1);
+        for (i = 0; i < o->via.map.size && ret == 0; i++) {
+            if (i > 0) {
+                ret = buf_cat(buf, ", ", 2);
+            }
+            if (ret == 0) {
+                ret = buf_object(buf, &o->via.map.ptr[i].key);
+            }
+            if (ret == 0) {
+                ret = buf_cat(buf, "=>", 2);
+            }
+            if (ret == 0) {
+                ret = buf_object(buf, &o->via.map.ptr[i].val);
+            }
+        }
+        if (ret == 0) {
+            ret = buf_cat(buf, "}", 1);
+        }
+        return ret;
+    default:
+        return flb_sds_printf(buf, "#<UNKNOWN %i %" PRIu64 ">",
+                              o->type, o->via.u64) ? 0 : -1;
+    }
+}
+
+/* Append the JSON representation of the object */
+static int buf_json(flb_sds_t *buf, msgpack_object *obj, size_t size)
+{
+    int ret;
+
+    while (1) {
+        if (buf_reserve(buf, size) == -1) {
+            return -1;
+        }
+
+        ret = flb_msgpack_to_json(*buf + flb_sds_len(*buf),
+                                  flb_sds_avail(*buf), obj);
+        if (ret > 0) {
+            flb_sds_len_set(*buf, flb_sds_len(*buf) + ret);
+            return 0;
+        }
+
+        /* buffer is small, retry */
+        size += flb_sds_avail(*buf) + 128;
+    }
+}
+
+static int csv_output(flb_sds_t *buf, struct flb_time *tm,
+                      msgpack_object *obj, struct flb_file_conf *ctx)
 {
     int i;
     int map_size;
@@ -143,21 +366,28 @@ static int csv_output(FILE *fp, struct flb_time *tm, msgpack_object *obj,
     if (obj->type == MSGPACK_OBJECT_MAP && obj->via.map.size > 0) {
         kv = obj->via.map.ptr;
         map_size = obj->via.map.size;
-        fprintf(fp, "%f%s", flb_time_to_double(tm), ctx->delimiter);
+        if (!flb_sds_printf(buf, "%f%s",
+                            flb_time_to_double(tm), ctx->delimiter)) {
+            return -1;
+        }
 
-        for (i = 0; i < map_size - 1; i++) {
-            msgpack_object_print(fp, (kv+i)->val);
-            fprintf(fp, "%s", ctx->delimiter);
+        for (i = 0; i < map_size; i++) {
+            if (i > 0 &&
+                buf_cat(buf, ctx->delimiter, strlen(ctx->delimiter)) == -1) {
+                return -1;
+            }
+            if (buf_object(buf, &(kv+i)->val) == -1) {
+                return -1;
+            }
         }
 
-        msgpack_object_print(fp, (kv+(map_size-1))->val);
-        fprintf(fp, NEWLINE);
+        return buf_cat(buf, NEWLINE, sizeof(NEWLINE) - 1);
     }
     return 0;
 }
 
-static int ltsv_output(FILE *fp, struct flb_time *tm, msgpack_object *obj,
-                       struct flb_file_conf *ctx)
+static int ltsv_output(flb_sds_t *buf, struct flb_time *tm,
+                       msgpack_object *obj, struct flb_file_conf *ctx)
 {
     msgpack_object_kv *kv = NULL;
     int i;
@@ -166,107 +396,75 @@ static int ltsv_output(FILE *fp, struct flb_time *tm, msgpack_object *obj,
     if (obj->type == MSGPACK_OBJECT_MAP && obj->via.map.size > 0) {
         kv = obj->via.map.ptr;
         map_size = obj->via.map.size;
-        fprintf(fp, "\"time\"%s%f%s",
-                ctx->label_delimiter,
-                flb_time_to_double(tm),
-                ctx->delimiter);
-
-        for (i = 0; i < map_size - 1; i++) {
-            msgpack_object_print(fp, (kv+i)->key);
-            fprintf(fp, "%s", ctx->label_delimiter);
-            msgpack_object_print(fp, (kv+i)->val);
-            fprintf(fp, "%s", ctx->delimiter);
+        if (!flb_sds_printf(buf, "\"time\"%s%f%s",
+                            ctx->label_delimiter,
+                            flb_time_to_double(tm),
+                            ctx->delimiter)) {
+            return -1;
+        }
+
+        for (i = 0; i < map_size; i++) {
+            if (i > 0 &&
+                buf_cat(buf, ctx->delimiter, strlen(ctx->delimiter)) == -1) {
+                return -1;
+            }
+            if (buf_object(buf, &(kv+i)->key) == -1 ||
+                buf_cat(buf, ctx->label_delimiter,
+                        strlen(ctx->label_delimiter)) == -1 ||
+                buf_object(buf, &(kv+i)->val) == -1) {
+                return -1;
+            }
         }
 
-        msgpack_object_print(fp, (kv+(map_size-1))->key);
-        fprintf(fp, "%s", ctx->label_delimiter);
-        msgpack_object_print(fp, (kv+(map_size-1))->val);
-        fprintf(fp, NEWLINE);
+        return buf_cat(buf, NEWLINE, sizeof(NEWLINE) - 1);
     }
     return 0;
 }
 
-static int plain_output(FILE *fp, msgpack_object *obj, size_t alloc_size)
+static int plain_output(flb_sds_t *buf, msgpack_object *obj,
+                        size_t alloc_size)
 {
-    char *buf;
+    if (buf_json(buf, obj, alloc_size) == -1) {
+        return -1;
+    }
+    return buf_cat(buf, NEWLINE, sizeof(NEWLINE) - 1);
+}
 
-    buf = flb_msgpack_to_json_str(alloc_size, obj);
-    if (buf) {
-        fprintf(fp, "%s" NEWLINE,
-                buf);
-        flb_free(buf);
+static int json_output(flb_sds_t *buf, char *tag, int tag_len,
+                       struct flb_time *tm, msgpack_object *obj,
+                       size_t alloc_size)
+{
+    if (!flb_sds_printf(buf, "%.*s: [%f, ",
+                        tag_len, tag, flb_time_to_double(tm))) {
+        return -1;
     }
-    return 0;
+    if (buf_json(buf, obj, alloc_size) == -1) {
+        return -1;
+    }
+    return buf_cat(buf, "]" NEWLINE, sizeof("]" NEWLINE) - 1);
 }
 
-static void cb_file_flush(void *data, size_t bytes,
-                          char *tag, int tag_len,
-                          struct flb_input_instance *i_ins,
-                          void *out_context,
-                          struct flb_config *config)
+/*
+ * Format all the records of the chunk in the buffer, so the file is
+ * written with a single call.
+ */
+static int file_format(struct flb_file_conf *ctx, flb_sds_t *buf,
+                       char *tag, int tag_len, void *data, size_t bytes)
 {
-    int ret;
-    FILE * fp;
-    msgpack_unpacked result;
+    int ret = 0;
     size_t off = 0;
     size_t last_off = 0;
     size_t alloc_size = 0;
-    size_t total;
-    char *out_file;
-    char *buf;
-    char *tag_buf;
+    msgpack_unpacked result;
     msgpack_object *obj;
-    struct flb_file_conf *ctx = out_context;
     struct flb_time tm;
-    (void) i_ins;
-    (void) config;
-
-    /* Set the right output */
-    if (!ctx->out_file) {
-        out_file = tag;
-    }
-    else {
-        out_file = ctx->out_file;
-    }
-
-    /* Open output file with default name as the Tag */
-    fp = fopen(out_file, "ab+");
-    if (fp == NULL) {
-        flb_errno();
-        FLB_OUTPUT_RETURN(FLB_ERROR);
-    }
-
-    tag_buf = flb_malloc(tag_len + 1);
-    if (!tag_buf) {
-        flb_errno();
-        fclose(fp);
-        FLB_OUTPUT_RETURN(FLB_RETRY);
-    }
-    memcpy(tag_buf, tag, tag_len);
-    tag_buf[tag_len] = '\0';
 
     /*
      * Msgpack output format used to create unit tests files, useful for
      * Fluent Bit developers.
      */
     if (ctx->format == FLB_OUT_FILE_FMT_MSGPACK) {
-        off = 0;
-        total = 0;
-
-        do {
-            ret = fwrite((char *)data + off, 1, bytes - off, fp);
-            if (ret < 0) {
-                flb_errno();
-                fclose(fp);
-                flb_free(tag_buf);
-                FLB_OUTPUT_RETURN(FLB_RETRY);
-            }
-            total += ret;
-        } while (total < bytes);
-
-        fclose(fp);
-        flb_free(tag_buf);
-        FLB_OUTPUT_RETURN(FLB_OK);
+        return buf_cat(buf, data, bytes);
     }
 
     /*
@@ -282,36 +480,113 @@ static void cb_file_flush(void *data, size_t bytes,
 
         switch (ctx->format){
         case FLB_OUT_FILE_FMT_JSON:
-            buf = flb_msgpack_to_json_str(alloc_size, obj);
-            if (buf) {
-                fprintf(fp, "%s: [%f, %s]" NEWLINE,
-                        tag_buf,
-                        flb_time_to_double(&tm),
-                        buf);
-                flb_free(buf);
-            }
-            else {
-                msgpack_unpacked_destroy(&result);
-                fclose(fp);
-                flb_free(tag_buf);
-                FLB_OUTPUT_RETURN(FLB_RETRY);
-            }
+            ret = json_output(buf, tag, tag_len, &tm, obj, alloc_size);
             break;
         case FLB_OUT_FILE_FMT_CSV:
-            csv_output(fp, &tm, obj, ctx);
+            ret = csv_output(buf, &tm, obj, ctx);
             break;
         case FLB_OUT_FILE_FMT_LTSV:
-            ltsv_output(fp, &tm, obj, ctx);
+            ret = ltsv_output(buf, &tm, obj, ctx);
             break;
         case FLB_OUT_FILE_FMT_PLAIN:
-            plain_output(fp, obj, alloc_size);
+            ret = plain_output(buf, obj, alloc_size);
             break;
         }
-    }
 
-    flb_free(tag_buf);
+        if (ret == -1) {
+            break;
+        }
+    }
     msgpack_unpacked_destroy(&result);
-    fclose(fp);
+
+    return ret;
+}
+
+static void cb_file_flush(void *data, size_t bytes,
+                          char *tag, int tag_len,
+                          struct flb_input_instance *i_ins,
+                          void *out_context,
+                          struct flb_config *config)
+{
+    int ret;
+    char *out_file;
+    flb_sds_t buf;
+    flb_sds_t tag_buf = NULL;
+    struct flb_file_conf *ctx = out_context;
+    (void) i_ins;
+    (void) config;
+
+    /* Set the right output */
+    if (!ctx->out_file) {
+        tag_buf = flb_sds_create_len(tag, tag_len);
+        if (!tag_buf) {
+            flb_errno();
+            FLB_OUTPUT_RETURN(FLB_RETRY);
+        }
+        out_file = tag_buf;
+    }
+    else {
+        out_file = ctx->out_file;
+    }
+
+    /* The I/O thread is behind, don't format the chunk for nothing */
+    if (ctx->io_thread == FLB_TRUE && file_io_queue_full(ctx) == FLB_TRUE) {
+        flb_sds_destroy(tag_buf);
+        FLB_OUTPUT_RETURN(FLB_RETRY);
+    }
+
+    /*
+     * Buffers queued to the I/O thread are owned by it until written,
+     * otherwise the context buffer is reused on every flush.
+     */
+    if (ctx->io_thread == FLB_TRUE) {
+        buf = file_io_buf_get(ctx, bytes * 2);
+    }
+    else {
+        buf = ctx->buf;
+        flb_sds_len_set(buf, 0);
+    }
+    if (!buf) {
+        flb_errno();
+        flb_sds_destroy(tag_buf);
+        FLB_OUTPUT_RETURN(FLB_RETRY);
+    }
+
+    ret = file_format(ctx, &buf, tag, tag_len, data, bytes);
+    if (ctx->io_thread == FLB_FALSE) {
+        ctx->buf = buf;
+    }
+    if (ret == -1) {
+        if (ctx->io_thread == FLB_TRUE) {
+            flb_sds_destroy(buf);
+        }
+        flb_sds_destroy(tag_buf);
+        FLB_OUTPUT_RETURN(FLB_RETRY);
+    }
+
+    /* Nothing to write, don't create the file */
+    if (flb_sds_len(buf) == 0) {
+        if (ctx->io_thread == FLB_TRUE) {
+            flb_sds_destroy(buf);
+        }
+        flb_sds_destroy(tag_buf);
+        FLB_OUTPUT_RETURN(FLB_OK);
+    }
+
+    if (ctx->io_thread == FLB_TRUE) {
+        ret = file_io_enqueue(ctx, out_file, buf);
+        if (ret == -1) {
+            flb_sds_destroy(buf);
+        }
+    }
+    else {
+        ret = file_io_write(ctx, out_file, buf, flb_sds_len(buf));
+    }
+    flb_sds_destroy(tag_buf);
+
+    if (ret == -1) {
+        FLB_OUTPUT_RETURN(FLB_RETRY);
+    }
 
     FLB_OUTPUT_RETURN(FLB_OK);
 }
@@ -320,6 +595,11 @@ static int cb_file_exit(void *data, struct flb_config *config)
 {
     struct flb_file_conf *ctx = data;
 
+    if (ctx->io_thread == FLB_TRUE) {
+        file_io_thread_stop(ctx);
+    }
+    file_io_close_all(ctx);
+    flb_sds_destroy(ctx->buf);
     flb_free(ctx);
 
     return 0;
@@ -21,6 +21,12 @@
 #ifndef FLB_OUT_FILE
 #define FLB_OUT_FILE
 
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_sds.h>
+#include <monkey/mk_core.h>
+
+#include <pthread.h>
+
 enum {
     FLB_OUT_FILE_FMT_JSON,
     FLB_OUT_FILE_FMT_CSV,
@@ -29,4 +35,51 @@ enum {
     FLB_OUT_FILE_FMT_MSGPACK,
 };
 
+/* Initial size of the format buffer */
+#define FLB_OUT_FILE_BUF_SIZE   65536
+
+/* Files kept open, when exceeded the least recently used one is closed */
+#define FLB_OUT_FILE_MAX_OPEN   64
+
+/* Format buffers kept for reuse when writing through the I/O thread */
+#define FLB_OUT_FILE_MAX_BUFS   4
+
+/* Buffers waiting for the I/O thread, when exceeded the flushes retry */
+#define FLB_OUT_FILE_MAX_QUEUE  64
+
+struct flb_file_conf {
+    char *out_file;
+    char *delimiter;
+    char *label_delimiter;
+    int  format;
+
+    /* Rotation: Rotate_Size, Rotate_Interval and Rotate_Compress */
+    size_t rotate_size;
+    int rotate_interval;
+    int rotate_gzip;
+
+    /* Open files (struct file_entry), least recently used first */
+    struct mk_list files;
+    int n_files;
+
+    /* Format buffer reused by the flushes when writing inline */
+    flb_sds_t buf;
+
+    /*
+     * I/O thread: when enabled, flushes queue the formatted buffers and
+     * the thread owns the open files, so the engine never blocks on disk.
+     * A flush succeeds once its buffer is queued, a write failing later is
+     * only logged: the delivery is at-most-once in this mode.
+     */
+    int io_thread;
+    int io_exit;
+    pthread_t io_tid;
+    pthread_mutex_t io_lock;
+    pthread_cond_t io_cond;
+    struct mk_list io_queue;
+    int io_queue_len;
+    flb_sds_t io_bufs[FLB_OUT_FILE_MAX_BUFS];
+    int io_n_bufs;
+};
+
 #endif
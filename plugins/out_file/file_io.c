@@ -0,0 +1,512 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2019      The Fluent Bit Authors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_mem.h>
+#include <fluent-bit/flb_log.h>
+#include <fluent-bit/flb_worker.h>
+
+#include <stdio.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef FLB_OUT_FILE_GZIP
+#include <zlib.h>
+#endif
+
+#include "file.h"
+#include "file_io.h"
+
+/* Size of the blocks read when compressing a rotated file */
+#define FILE_GZIP_BLOCK   65536
+
+static void handle_destroy(struct flb_file_conf *ctx, struct file_entry *h)
+{
+    if (h->fd >= 0) {
+        close(h->fd);
+    }
+    flb_sds_destroy(h->path);
+    mk_list_del(&h->_head);
+    ctx->n_files--;
+    flb_free(h);
+}
+
+/*
+ * Check, at most once per second, that 'path' still refers to the open
+ * file: it could have been removed or rotated by an external tool.
+ */
+static int handle_valid(struct file_entry *h, time_t now)
+{
+    struct stat st;
+
+    if (h->checked == now) {
+        return FLB_TRUE;
+    }
+    h->checked = now;
+
+    if (stat(h->path, &st) == -1) {
+        return FLB_FALSE;
+    }
+
+    if (st.st_dev != h->dev || st.st_ino != h->ino) {
+        return FLB_FALSE;
+    }
+
+    return FLB_TRUE;
+}
+
+/* Get the open handle of 'path', the file is opened if required */
+static struct file_entry *handle_get(struct flb_file_conf *ctx, char *path)
+{
+    time_t now;
+    struct stat st;
+    struct mk_list *head;
+    struct file_entry *h;
+
+    now = time(NULL);
+    mk_list_foreach(head, &ctx->files) {
+        h = mk_list_entry(head, struct file_entry, _head);
+        if (strcmp(h->path, path) == 0) {
+            if (handle_valid(h, now) == FLB_FALSE) {
+                flb_debug("[out_file] %s was moved or removed, reopening",
+                          path);
+                handle_destroy(ctx, h);
+                break;
+            }
+
+            /* keep the list sorted by last usage */
+            mk_list_del(&h->_head);
+            mk_list_add(&h->_head, &ctx->files);
+            return h;
+        }
+    }
+
+    /* Close the least recently used file */
+    if (ctx->n_files >= FLB_OUT_FILE_MAX_OPEN) {
+        h = mk_list_entry_first(&ctx->files, struct file_entry, _head);
+        handle_destroy(ctx, h);
+    }
+
+    h = flb_calloc(1, sizeof(struct file_entry));
+    if (!h) {
+        flb_errno();
+        return NULL;
+    }
+
+    h->fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0666);
+    if (h->fd == -1) {
+        flb_errno();
+        flb_error("[out_file] cannot open %s", path);
+        flb_free(h);
+        return NULL;
+    }
+
+    h->path = flb_sds_create(path);
+    if (!h->path) {
+        flb_errno();
+        close(h->fd);
+        flb_free(h);
+        return NULL;
+    }
+
+    if (fstat(h->fd, &st) == 0) {
+        h->size = st.st_size;
+        h->dev = st.st_dev;
+        h->ino = st.st_ino;
+    }
+    h->opened = now;
+    h->checked = now;
+
+    mk_list_add(&h->_head, &ctx->files);
+    ctx->n_files++;
+
+    return h;
+}
+
+#ifdef FLB_OUT_FILE_GZIP
+/* Compress 'path' into 'path.gz' and remove the original, I/O thread only */
+static int file_gzip(char *path)
+{
+    int fd;
+    int ret = 0;
+    ssize_t bytes;
+    char *buf;
+    gzFile gz;
+    flb_sds_t gz_path;
+
+    gz_path = flb_sds_create_size(strlen(path) + 4);
+    if (!gz_path) {
+        flb_errno();
+        return -1;
+    }
+    flb_sds_printf(&gz_path, "%s.gz", path);
+
+    buf = flb_malloc(FILE_GZIP_BLOCK);
+    if (!buf) {
+        flb_errno();
+        flb_sds_destroy(gz_path);
+        return -1;
+    }
+
+    fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        flb_errno();
+        flb_free(buf);
+        flb_sds_destroy(gz_path);
+        return -1;
+    }
+
+    gz = gzopen(gz_path, "wb");
+    if (!gz) {
+        flb_error("[out_file] cannot create %s", gz_path);
+        close(fd);
+        flb_free(buf);
+        flb_sds_destroy(gz_path);
+        return -1;
+    }
+
+    while ((bytes = read(fd, buf, FILE_GZIP_BLOCK)) > 0) {
+        if (gzwrite(gz, buf, bytes) != bytes) {
+            ret = -1;
+            break;
+        }
+    }
+    if (bytes == -1) {
+        flb_errno();
+        ret = -1;
+    }
+
+    if (gzclose(gz) != Z_OK) {
+        ret = -1;
+    }
+    close(fd);
+    flb_free(buf);
+
+    /* keep the uncompressed file if something failed */
+    if (ret == 0) {
+        unlink(path);
+    }
+    else {
+        flb_error("[out_file] cannot compress %s", path);
+        unlink(gz_path);
+    }
+    flb_sds_destroy(gz_path);
+
+    return ret;
+}
+#endif
+
+/*
+ * Rotate the file: it's renamed as 'path.YYYYmmdd-HHMMSS' (plus a counter
+ * if the name is taken) and optionally compressed. The next write creates
+ * a new file.
+ */
+static int file_rotate(struct flb_file_conf *ctx, struct file_entry *h)
+{
+    int i;
+    int ret;
+    char ts[32];
+    time_t now;
+    struct tm tm;
+    flb_sds_t name;
+    flb_sds_t gz_name;
+    flb_sds_t path;
+
+    now = time(NULL);
+    localtime_r(&now, &tm);
+    strftime(ts, sizeof(ts) - 1, "%Y%m%d-%H%M%S", &tm);
+
+    name = flb_sds_create_size(flb_sds_len(h->path) + 48);
+    gz_name = flb_sds_create_size(flb_sds_len(h->path) + 52);
+    if (!name || !gz_name) {
+        flb_errno();
+        flb_sds_destroy(name);
+        flb_sds_destroy(gz_name);
+        return -1;
+    }
+
+    for (i = 0; ; i++) {
+        flb_sds_len_set(name, 0);
+        flb_sds_len_set(gz_name, 0);
+        if (i == 0) {
+            flb_sds_printf(&name, "%s.%s", h->path, ts);
+        }
+        else {
+            flb_sds_printf(&name, "%s.%s.%i", h->path, ts, i);
+        }
+        flb_sds_printf(&gz_name, "%s.gz", name);
+
+        if (access(name, F_OK) != 0 && access(gz_name, F_OK) != 0) {
+            break;
+        }
+    }
+    flb_sds_destroy(gz_name);
+
+    /* The handle is released, the path is needed for the rename */
+    path = h->path;
+    h->path = NULL;
+    handle_destroy(ctx, h);
+
+    ret = rename(path, name);
+    if (ret == -1) {
+        flb_errno();
+        flb_error("[out_file] cannot rotate %s", path);
+    }
+    else {
+        flb_info("[out_file] rotated %s to %s", path, name);
+#ifdef FLB_OUT_FILE_GZIP
+        if (ctx->rotate_gzip == FLB_TRUE) {
+            file_gzip(name);
+        }
+#endif
+    }
+
+    flb_sds_destroy(path);
+    flb_sds_destroy(name);
+
+    return ret;
+}
+
+static int rotate_needed(struct flb_file_conf *ctx, struct file_entry *h)
+{
+    if (h->size == 0) {
+        return FLB_FALSE;
+    }
+
+    if (ctx->rotate_size > 0 && h->size >= ctx->rotate_size) {
+        return FLB_TRUE;
+    }
+
+    if (ctx->rotate_interval > 0 &&
+        time(NULL) - h->opened >= ctx->rotate_interval) {
+        return FLB_TRUE;
+    }
+
+    return FLB_FALSE;
+}
+
+/* Append 'data' to the file, rotating it first if required */
+int file_io_write(struct flb_file_conf *ctx, char *path,
+                  char *data, size_t size)
+{
+    ssize_t ret;
+    size_t total = 0;
+    struct file_entry *h;
+
+    h = handle_get(ctx, path);
+    if (!h) {
+        return -1;
+    }
+
+    if (rotate_needed(ctx, h) == FLB_TRUE) {
+        file_rotate(ctx, h);
+        h = handle_get(ctx, path);
+        if (!h) {
+            return -1;
+        }
+    }
+
+    while (total < size) {
+        ret = write(h->fd, data + total, size - total);
+        if (ret == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            flb_errno();
+            /* reopen the file on the next write */
+            handle_destroy(ctx, h);
+            return -1;
+        }
+        total += ret;
+    }
+    h->size += total;
+
+    return 0;
+}
+
+void file_io_close_all(struct flb_file_conf *ctx)
+{
+    struct mk_list *tmp;
+    struct mk_list *head;
+    struct file_entry *h;
+
+    mk_list_foreach_safe(head, tmp, &ctx->files) {
+        h = mk_list_entry(head, struct file_entry, _head);
+        handle_destroy(ctx, h);
+    }
+}
+
+/* Give back a buffer written by the I/O thread, io_lock must be held */
+static void buf_put(struct flb_file_conf *ctx, flb_sds_t buf)
+{
+    if (ctx->io_n_bufs < FLB_OUT_FILE_MAX_BUFS) {
+        flb_sds_len_set(buf, 0);
+        ctx->io_bufs[ctx->io_n_bufs++] = buf;
+        return;
+    }
+
+    flb_sds_destroy(buf);
+}
+
+static void io_worker(void *data)
+{
+    int ret;
+    struct file_write *w;
+    struct flb_file_conf *ctx = data;
+
+    pthread_mutex_lock(&ctx->io_lock);
+    while (1) {
+        while (mk_list_is_empty(&ctx->io_queue) == 0 &&
+               ctx->io_exit == FLB_FALSE) {
+            pthread_cond_wait(&ctx->io_cond, &ctx->io_lock);
+        }
+
+        /* pending writes are completed before exiting */
+        if (mk_list_is_empty(&ctx->io_queue) == 0) {
+            break;
+        }
+
+        w = mk_list_entry_first(&ctx->io_queue, struct file_write, _head);
+        mk_list_del(&w->_head);
+        ctx->io_queue_len--;
+        pthread_mutex_unlock(&ctx->io_lock);
+
+        /* The flush was already acknowledged, the records are lost */
+        ret = file_io_write(ctx, w->path, w->data, flb_sds_len(w->data));
+        if (ret == -1) {
+            flb_error("[out_file] could not write %lu bytes to %s, "
+                      "records dropped", flb_sds_len(w->data), w->path);
+        }
+
+        pthread_mutex_lock(&ctx->io_lock);
+        buf_put(ctx, w->data);
+        flb_sds_destroy(w->path);
+        flb_free(w);
+    }
+    pthread_mutex_unlock(&ctx->io_lock);
+}
+
+int file_io_thread_start(struct flb_file_conf *ctx, struct flb_config *config)
+{
+    int ret;
+
+    mk_list_init(&ctx->io_queue);
+    ctx->io_queue_len = 0;
+    pthread_mutex_init(&ctx->io_lock, NULL);
+    pthread_cond_init(&ctx->io_cond, NULL);
+    ctx->io_exit = FLB_FALSE;
+
+    ret = flb_worker_create(io_worker, ctx, &ctx->io_tid, config);
+    if (ret == -1) {
+        flb_error("[out_file] could not start I/O thread");
+        pthread_cond_destroy(&ctx->io_cond);
+        pthread_mutex_destroy(&ctx->io_lock);
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Complete the pending writes and stop the I/O thread */
+void file_io_thread_stop(struct flb_file_conf *ctx)
+{
+    int i;
+
+    pthread_mutex_lock(&ctx->io_lock);
+    ctx->io_exit = FLB_TRUE;
+    pthread_cond_signal(&ctx->io_cond);
+    pthread_mutex_unlock(&ctx->io_lock);
+    pthread_join(ctx->io_tid, NULL);
+
+    for (i = 0; i < ctx->io_n_bufs; i++) {
+        flb_sds_destroy(ctx->io_bufs[i]);
+    }
+    ctx->io_n_bufs = 0;
+
+    pthread_cond_destroy(&ctx->io_cond);
+    pthread_mutex_destroy(&ctx->io_lock);
+}
+
+/* Get an empty buffer to format a chunk that will be queued */
+flb_sds_t file_io_buf_get(struct flb_file_conf *ctx, size_t size)
+{
+    flb_sds_t buf = NULL;
+
+    pthread_mutex_lock(&ctx->io_lock);
+    if (ctx->io_n_bufs > 0) {
+        buf = ctx->io_bufs[--ctx->io_n_bufs];
+    }
+    pthread_mutex_unlock(&ctx->io_lock);
+
+    if (!buf) {
+        buf = flb_sds_create_size(size);
+    }
+
+    return buf;
+}
+
+/* Returns true if the I/O thread can't take more buffers */
+int file_io_queue_full(struct flb_file_conf *ctx)
+{
+    int full;
+
+    pthread_mutex_lock(&ctx->io_lock);
+    full = (ctx->io_queue_len >= FLB_OUT_FILE_MAX_QUEUE);
+    pthread_mutex_unlock(&ctx->io_lock);
+
+    return full;
+}
+
+/*
+ * Queue 'data' to be written to 'path', the buffer is owned by the thread.
+ * Returns -1 if the queue is full, the caller keeps the buffer.
+ */
+int file_io_enqueue(struct flb_file_conf *ctx, char *path, flb_sds_t data)
+{
+    struct file_write *w;
+
+    if (file_io_queue_full(ctx) == FLB_TRUE) {
+        return -1;
+    }
+
+    w = flb_malloc(sizeof(struct file_write));
+    if (!w) {
+        flb_errno();
+        return -1;
+    }
+
+    w->path = flb_sds_create(path);
+    if (!w->path) {
+        flb_errno();
+        flb_free(w);
+        return -1;
+    }
+    w->data = data;
+
+    pthread_mutex_lock(&ctx->io_lock);
+    mk_list_add(&w->_head, &ctx->io_queue);
+    ctx->io_queue_len++;
+    pthread_cond_signal(&ctx->io_cond);
+    pthread_mutex_unlock(&ctx->io_lock);
+
+    return 0;
+}
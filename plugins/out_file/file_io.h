@@ -0,0 +1,62 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2019      The Fluent Bit Authors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef FLB_OUT_FILE_IO_H
+#define FLB_OUT_FILE_IO_H
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_sds.h>
+#include <fluent-bit/flb_config.h>
+#include <monkey/mk_core.h>
+
+#include <time.h>
+#include <sys/types.h>
+
+#include "file.h"
+
+/* An open output file */
+struct file_entry {
+    flb_sds_t path;
+    int fd;
+    size_t size;                /* current file size      */
+    time_t opened;              /* rotation interval base */
+    time_t checked;             /* last path check        */
+    dev_t dev;                  /* identity of the file   */
+    ino_t ino;
+    struct mk_list _head;
+};
+
+/* A buffer waiting to be written by the I/O thread */
+struct file_write {
+    flb_sds_t path;
+    flb_sds_t data;
+    struct mk_list _head;
+};
+
+int file_io_write(struct flb_file_conf *ctx, char *path,
+                  char *data, size_t size);
+void file_io_close_all(struct flb_file_conf *ctx);
+
+int file_io_thread_start(struct flb_file_conf *ctx, struct flb_config *config);
+void file_io_thread_stop(struct flb_file_conf *ctx);
+flb_sds_t file_io_buf_get(struct flb_file_conf *ctx, size_t size);
+int file_io_queue_full(struct flb_file_conf *ctx);
+int file_io_enqueue(struct flb_file_conf *ctx, char *path, flb_sds_t data);
+
+#endif
@@ -17,6 +17,8 @@
  *  limitations under the License.
  */
 
+#define _GNU_SOURCE
+
 #include <fluent-bit/flb_info.h>
 #include <fluent-bit/flb_output.h>
 #include <fluent-bit/flb_pack.h>
@@ -32,6 +34,7 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <sys/socket.h>
 #include <zlib.h>
 
 #include "gelf.h"
@@ -107,22 +110,41 @@ static int gelf_zlib_init (z_stream *stream)
     return 0;
 }
 
-static int gelf_zlib_compress(z_stream *stream,
-    void *msg, size_t msg_size, void *data, size_t data_size)
+/*
+ * Compress a message into the context buffer, the deflate stream is reset
+ * and reused for every message.
+ */
+static int gelf_zlib_compress(struct flb_out_gelf_config *ctx,
+                              void *msg, size_t msg_size)
 {
     int status;
+    size_t size;
+    char *tmp;
+    z_stream *stream = &ctx->stream;
 
     status = deflateReset(stream);
-    if(status != Z_OK)
+    if (status != Z_OK) {
         return -1;
+    }
+
+    size = deflateBound(stream, msg_size);
+    if (ctx->zbuf_size < size) {
+        tmp = flb_realloc(ctx->zbuf, size);
+        if (!tmp) {
+            flb_errno();
+            return -1;
+        }
+        ctx->zbuf = tmp;
+        ctx->zbuf_size = size;
+    }
 
     stream->avail_in = msg_size;
     stream->next_in = msg;
 
-    stream->avail_out = data_size;
-    stream->next_out = data;
+    stream->avail_out = ctx->zbuf_size;
+    stream->next_out = (Bytef *) ctx->zbuf;
 
-    if (deflate(stream, Z_FINISH) == Z_STREAM_ERROR) {
+    if (deflate(stream, Z_FINISH) != Z_STREAM_END) {
         flb_error("[out_gelf] error compressing with zlib deflate");
         return -1;
     }
@@ -138,21 +160,26 @@ static void gelf_zlib_end(z_stream *stream)
 static int gelf_send_udp_chunked (struct flb_out_gelf_config *ctx, void *msg,
                                   size_t msg_size)
 {
+    int i;
     int ret;
-    uint8_t header[12];
     uint8_t n;
     size_t chunks;
     size_t offset;
     struct flb_time tm;
     uint64_t messageid;
+    uint8_t header[FLB_GELF_MAX_CHUNKS][12];
+    struct iovec iov[FLB_GELF_MAX_CHUNKS][2];
+#ifdef FLB_HAVE_SENDMMSG
+    struct mmsghdr msgs[FLB_GELF_MAX_CHUNKS];
+#else
     struct msghdr msghdr;
-    struct iovec iov[2];
+#endif
 
     chunks = msg_size / ctx->pckt_size;
     if ((msg_size % ctx->pckt_size) != 0)
         chunks++;
 
-    if (chunks > 128) {
+    if (chunks > FLB_GELF_MAX_CHUNKS) {
         flb_error("[out_gelf] message too big: %zd bytes, too many chunks",
                   msg_size);
         return -1;
@@ -163,36 +190,58 @@ static int gelf_send_udp_chunked (struct flb_out_gelf_config *ctx, void *msg,
     messageid = ((uint64_t)(tm.tm.tv_nsec*1000000 + tm.tm.tv_nsec) << 32) |
                 (uint64_t)rand_r(&(ctx->seed));
 
-    header[0] = 0x1e;
-    header[1] = 0x0f;
-    memcpy (header+2, &messageid, 8);
-    header[10] = chunks;
-
-    iov[0].iov_base = header;
-    iov[0].iov_len = 12;
-
-    memset(&msghdr, 0, sizeof(struct msghdr));
-    msghdr.msg_iov = iov;
-    msghdr.msg_iovlen = 2;
-
+    /* Compose every chunk: header plus a slice of the message */
     offset = 0;
     for (n = 0; n < chunks; n++) {
-        header[11] = n;
+        header[n][0] = 0x1e;
+        header[n][1] = 0x0f;
+        memcpy(header[n] + 2, &messageid, 8);
+        header[n][10] = chunks;
+        header[n][11] = n;
 
-        iov[1].iov_base = msg + offset;
+        iov[n][0].iov_base = header[n];
+        iov[n][0].iov_len = 12;
+
+        iov[n][1].iov_base = (char *) msg + offset;
         if ((msg_size - offset) < ctx->pckt_size) {
-            iov[1].iov_len = msg_size - offset;
+            iov[n][1].iov_len = msg_size - offset;
         }
         else {
-            iov[1].iov_len = ctx->pckt_size;
+            iov[n][1].iov_len = ctx->pckt_size;
+        }
+        offset += ctx->pckt_size;
+    }
+
+#ifdef FLB_HAVE_SENDMMSG
+    /* Send all the chunks with the minimum number of system calls */
+    memset(msgs, 0, sizeof(struct mmsghdr) * chunks);
+    for (i = 0; i < chunks; i++) {
+        msgs[i].msg_hdr.msg_iov = iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 2;
+    }
+
+    i = 0;
+    while (i < chunks) {
+        ret = sendmmsg(ctx->fd, msgs + i, chunks - i,
+                       MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (ret == -1) {
+            flb_errno();
+            return -1;
         }
+        i += ret;
+    }
+#else
+    memset(&msghdr, 0, sizeof(struct msghdr));
+    msghdr.msg_iovlen = 2;
 
+    for (i = 0; i < chunks; i++) {
+        msghdr.msg_iov = iov[i];
         ret = sendmsg(ctx->fd, &msghdr, MSG_DONTWAIT | MSG_NOSIGNAL);
         if (ret == -1) {
             flb_errno();
         }
-        offset += ctx->pckt_size;
     }
+#endif
 
     return 0;
 }
@@ -223,26 +272,15 @@ static int gelf_send_udp(struct flb_out_gelf_config *ctx, char *msg,
 
     if (ctx->compress == FLB_TRUE || (msg_size > ctx->pckt_size)) {
         int size;
-        size_t zdata_size = msg_size * 1.001 + 12;
-        void *zdata;
-
-        zdata = flb_malloc(zdata_size);
-        if (zdata == NULL) {
 
-          return -1;
-        }
-
-        size = gelf_zlib_compress(&(ctx->stream), msg, msg_size, zdata, zdata_size);
+        size = gelf_zlib_compress(ctx, msg, msg_size);
         if (size < 0) {
-          flb_free(zdata);
           return size;
         }
-        status = gelf_send_udp_pckt (ctx, zdata, size);
+        status = gelf_send_udp_pckt (ctx, ctx->zbuf, size);
         if (status < 0) {
-           flb_free(zdata);
            return status;
         }
-        flb_free(zdata);
     }
     else {
       status = send(ctx->fd, msg, msg_size, MSG_DONTWAIT | MSG_NOSIGNAL);
@@ -263,8 +301,7 @@ void cb_gelf_flush(void *data, size_t bytes,
     flb_sds_t tmp;
     msgpack_unpacked result;
     size_t off = 0;
-    size_t prev_off = 0;
-    size_t size = 0;
+    size_t prev_len;
     size_t bytes_sent;
     msgpack_object root;
     msgpack_object map;
@@ -273,19 +310,25 @@ void cb_gelf_flush(void *data, size_t bytes,
     struct flb_upstream_conn *u_conn;
     int ret;
 
-    if (ctx->mode != FLB_GELF_UDP) {
-        u_conn = flb_upstream_conn_get(ctx->u);
-        if (!u_conn) {
-            flb_error("[out_gelf] no upstream connections available");
-            FLB_OUTPUT_RETURN(FLB_RETRY);
-        }
+    /*
+     * UDP messages are composed and sent one by one reusing the same
+     * buffer; on TCP/TLS the whole chunk is composed as a batch of null
+     * byte delimited messages and written at once.
+     */
+    if (ctx->mode == FLB_GELF_UDP) {
+        s = flb_sds_create_size(1024);
+    }
+    else {
+        s = flb_sds_create_size(bytes * 1.4);
+    }
+    if (!s) {
+        flb_errno();
+        FLB_OUTPUT_RETURN(FLB_RETRY);
     }
 
     msgpack_unpacked_init(&result);
 
     while (msgpack_unpack_next(&result, data, bytes, &off) == MSGPACK_UNPACK_SUCCESS) {
-        size = off - prev_off;
-        prev_off = off;
         if (result.data.type != MSGPACK_OBJECT_ARRAY) {
             continue;
         }
@@ -298,48 +341,62 @@ void cb_gelf_flush(void *data, size_t bytes,
         flb_time_pop_from_msgpack(&tm, &result, &obj);
         map = root.via.array.ptr[1];
 
-        size = (size * 1.4);
-        s = flb_sds_create_size(size);
-        if (s == NULL) {
-            msgpack_unpacked_destroy(&result);
-            FLB_OUTPUT_RETURN(FLB_ERROR);
+        if (ctx->mode == FLB_GELF_UDP) {
+            flb_sds_len_set(s, 0);
         }
+        prev_len = flb_sds_len(s);
 
         tmp = flb_msgpack_to_gelf(&s, &map, &tm, &(ctx->fields));
-        if (tmp != NULL) {
-            s = tmp;
-            if (ctx->mode == FLB_GELF_UDP) {
-                ret = gelf_send_udp(ctx, s, flb_sds_len(s));
-                if (ret == -1) {
-                    msgpack_unpacked_destroy(&result);
-                    flb_sds_destroy(s);
-                    FLB_OUTPUT_RETURN(FLB_RETRY);
-                }
-            }
-            else {
-                /* write gelf json plus \0 */
-                ret = flb_io_net_write(u_conn,
-                                       s, flb_sds_len(s) + 1, &bytes_sent);
-                if (ret == -1) {
-                    flb_errno();
-                    flb_upstream_conn_release(u_conn);
-                    msgpack_unpacked_destroy(&result);
-                    flb_sds_destroy(s);
-                    FLB_OUTPUT_RETURN(FLB_RETRY);
-                }
+        if (tmp == NULL) {
+            flb_error("[out_gelf] error encoding to GELF");
+            /* discard partial output of the failed record */
+            flb_sds_len_set(s, prev_len);
+            continue;
+        }
+        s = tmp;
+
+        if (ctx->mode == FLB_GELF_UDP) {
+            ret = gelf_send_udp(ctx, s, flb_sds_len(s));
+            if (ret == -1) {
+                msgpack_unpacked_destroy(&result);
+                flb_sds_destroy(s);
+                FLB_OUTPUT_RETURN(FLB_RETRY);
             }
         }
         else {
-            flb_error("[out_gelf] error encoding to GELF");
+            /* messages are delimited by a null byte */
+            tmp = flb_sds_cat(s, "\0", 1);
+            if (!tmp) {
+                msgpack_unpacked_destroy(&result);
+                flb_sds_destroy(s);
+                FLB_OUTPUT_RETURN(FLB_RETRY);
+            }
+            s = tmp;
         }
+    }
 
+    msgpack_unpacked_destroy(&result);
+
+    if (ctx->mode == FLB_GELF_UDP || flb_sds_len(s) == 0) {
         flb_sds_destroy(s);
+        FLB_OUTPUT_RETURN(FLB_OK);
     }
 
-    msgpack_unpacked_destroy(&result);
+    /* The connection is kept open by the upstream between flushes */
+    u_conn = flb_upstream_conn_get(ctx->u);
+    if (!u_conn) {
+        flb_error("[out_gelf] no upstream connections available");
+        flb_sds_destroy(s);
+        FLB_OUTPUT_RETURN(FLB_RETRY);
+    }
+
+    ret = flb_io_net_write(u_conn, s, flb_sds_len(s), &bytes_sent);
+    flb_upstream_conn_release(u_conn);
+    flb_sds_destroy(s);
 
-    if (ctx->mode != FLB_GELF_UDP) {
-        flb_upstream_conn_release(u_conn);
+    if (ret == -1) {
+        flb_errno();
+        FLB_OUTPUT_RETURN(FLB_RETRY);
     }
 
     FLB_OUTPUT_RETURN(FLB_OK);
@@ -474,10 +531,10 @@ int cb_gelf_init(struct flb_output_instance *ins, struct flb_config *config,
             return -1;
         }
     } else {
-        int io_flags = FLB_IO_TCP;
+        int io_flags = FLB_IO_TCP | FLB_IO_TCP_KA;
 
         if (ctx->mode == FLB_GELF_TLS) {
-            io_flags = FLB_IO_TLS;
+            io_flags = FLB_IO_TLS | FLB_IO_TCP_KA;
         }
 
         if (ins->host.ipv6 == FLB_TRUE) {
@@ -515,6 +572,7 @@ int cb_gelf_exit(void *data, struct flb_config *config)
     flb_sds_destroy(ctx->fields.level_key);
 
     gelf_zlib_end(&(ctx->stream));
+    flb_free(ctx->zbuf);
 
     flb_free(ctx);
 
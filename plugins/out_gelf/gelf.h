@@ -24,6 +24,9 @@
 #define FLB_GELF_TCP 1
 #define FLB_GELF_TLS 2
 
+/* A chunked GELF message can't have more than 128 chunks */
+#define FLB_GELF_MAX_CHUNKS 128
+
 struct flb_out_gelf_config {
 
     struct flb_gelf_fields fields;
@@ -33,6 +36,8 @@ struct flb_out_gelf_config {
     flb_sockfd_t fd;
 
     z_stream stream;
+    char *zbuf;          /* compressed message, reused by UDP sends */
+    size_t zbuf_size;
     int pckt_size;
     int compress;
     unsigned int seed;
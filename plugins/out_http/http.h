@@ -27,10 +27,7 @@
 #define FLB_HTTP_OUT_JSON_LINES     3
 #define FLB_HTTP_OUT_GELF           4
 
-#define FLB_JSON_DATE_DOUBLE      0
-#define FLB_JSON_DATE_ISO8601     1
-#define FLB_JSON_DATE_EPOCH       2
-#define FLB_JSON_DATE_ISO8601_FMT "%Y-%m-%dT%H:%M:%S"
+#include <fluent-bit/flb_pack.h>
 
 #define FLB_HTTP_CONTENT_TYPE   "Content-Type"
 #define FLB_HTTP_MIME_MSGPACK   "application/msgpack"
@@ -49,9 +46,8 @@ struct flb_out_http {
     /* Output format */
     int out_format;
 
-    int json_date_format;
-    char *json_date_key;
-    size_t json_date_key_len;
+    /* JSON encoder: date format and key */
+    struct flb_pack_json_enc json_enc;
 
     /* HTTP URI */
     char *uri;
@@ -30,9 +30,12 @@
 struct flb_out_http *flb_http_conf_create(struct flb_output_instance *ins,
                                           struct flb_config *config)
 {
+    int ret;
     int ulen;
     int len;
     int io_flags = 0;
+    int date_format;
+    int json_format;
     char *uri = NULL;
     char *tmp;
     struct flb_upstream *upstream;
@@ -211,21 +214,39 @@ struct flb_out_http *flb_http_conf_create(struct flb_output_instance *ins,
     }
 
     /* Date format for JSON output */
-    ctx->json_date_format = FLB_JSON_DATE_DOUBLE;
+    date_format = FLB_PACK_JSON_DATE_DOUBLE;
     tmp = flb_output_get_property("json_date_format", ins);
     if (tmp) {
-        if (strcasecmp(tmp, "iso8601") == 0) {
-            ctx->json_date_format = FLB_JSON_DATE_ISO8601;
+        ret = flb_pack_to_json_date_type(tmp);
+        if (ret == -1) {
+            flb_warn("[out_http] unrecognized 'json_date_format' option. "
+                     "Using 'double'");
         }
-        if (strcasecmp(tmp, "epoch") == 0) {
-            ctx->json_date_format = FLB_JSON_DATE_EPOCH;
+        else {
+            date_format = ret;
         }
     }
 
     /* Date key for JSON output */
     tmp = flb_output_get_property("json_date_key", ins);
-    ctx->json_date_key = flb_strdup(tmp ? tmp : "date");
-    ctx->json_date_key_len = strlen(ctx->json_date_key);
+
+    /* JSON layout */
+    if (ctx->out_format == FLB_HTTP_OUT_JSON_STREAM) {
+        json_format = FLB_PACK_JSON_FORMAT_STREAM;
+    }
+    else if (ctx->out_format == FLB_HTTP_OUT_JSON_LINES) {
+        json_format = FLB_PACK_JSON_FORMAT_LINES;
+    }
+    else {
+        json_format = FLB_PACK_JSON_FORMAT_JSON;
+    }
+
+    ret = flb_pack_json_enc_init(&ctx->json_enc, json_format,
+                                 date_format, tmp ? tmp : "date");
+    if (ret == -1) {
+        flb_http_conf_destroy(ctx);
+        return NULL;
+    }
 
     /* Config Gelf_Timestamp_Key */
     tmp = flb_output_get_property("gelf_timestamp_key", ins);
@@ -335,7 +356,7 @@ void flb_http_conf_destroy(struct flb_out_http *ctx)
     flb_free(ctx->http_passwd);
     flb_free(ctx->proxy_host);
     flb_free(ctx->uri);
-    flb_free(ctx->json_date_key);
+    flb_pack_json_enc_destroy(&ctx->json_enc);
     flb_free(ctx->header_tag);
 
     mk_list_foreach_safe(head, tmp, &ctx->headers) {
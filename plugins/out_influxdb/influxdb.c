@@ -28,7 +28,6 @@
 #include <stdio.h>
 
 #include "influxdb.h"
-#include "influxdb_bulk.h"
 
 /*
  * Returns FLB_TRUE if the specified value is true, otherwise FLB_FALSE
@@ -42,6 +41,8 @@ static int bool_value(char *v);
 static int is_tagged_key(struct flb_influxdb_config *ctx,
                          char *key, int kl, int type);
 
+int cb_influxdb_exit(void *data, struct flb_config *config);
+
 /*
  * Increments the timestamp when it is duplicated
  */
@@ -58,20 +59,118 @@ static void influxdb_tsmod(struct flb_time *ts, struct flb_time *dupe,
     }
 }
 
+/*
+ * Escape the tag as a measurement name, the result is kept in the context
+ * so consecutive chunks with the same tag reuse it.
+ */
+static int influxdb_measurement(struct flb_influxdb_config *ctx,
+                                char *tag, int tag_len)
+{
+    flb_sds_t tmp;
+
+    if (ctx->tag && flb_sds_len(ctx->tag) == tag_len &&
+        memcmp(ctx->tag, tag, tag_len) == 0) {
+        return 0;
+    }
+
+    flb_sds_len_set(ctx->tag, 0);
+    flb_sds_len_set(ctx->tag_escaped, 0);
+
+    tmp = flb_sds_cat(ctx->tag, tag, tag_len);
+    if (!tmp) {
+        return -1;
+    }
+    ctx->tag = tmp;
+
+    if (flb_sds_alloc(ctx->tag_escaped) < tag_len * 2 + 1) {
+        tmp = flb_sds_increase(ctx->tag_escaped, tag_len * 2 + 1);
+        if (!tmp) {
+            flb_sds_len_set(ctx->tag, 0);
+            return -1;
+        }
+        ctx->tag_escaped = tmp;
+    }
+    flb_sds_len_set(ctx->tag_escaped,
+                    influxdb_escape_measurement(ctx->tag_escaped,
+                                                tag, tag_len));
+    ctx->tag_escaped[flb_sds_len(ctx->tag_escaped)] = '\0';
+
+    return 0;
+}
+
+/* Escape a string value into the context scratch buffer */
+static int influxdb_str(struct flb_influxdb_config *ctx,
+                        char *str, size_t str_len,
+                        char **out, size_t *out_size)
+{
+    int off = 0;
+    int ret;
+    size_t size;
+    char *tmp;
+
+    /* Worst case: every byte escaped as \uXXXX */
+    size = str_len * 6 + 1;
+    if (ctx->str_size < size) {
+        tmp = flb_realloc(ctx->str_buf, size);
+        if (!tmp) {
+            flb_errno();
+            return -1;
+        }
+        ctx->str_buf = tmp;
+        ctx->str_size = size;
+    }
+
+    ret = flb_utils_write_str(ctx->str_buf, &off, ctx->str_size,
+                              str, str_len);
+    if (ret == FLB_FALSE) {
+        return -1;
+    }
+
+    *out = ctx->str_buf;
+    *out_size = off;
+    return 0;
+}
+
+/* Take the cached output bulk or create a new one */
+static struct influxdb_bulk *influxdb_bulk_get(struct flb_influxdb_config *ctx)
+{
+    struct influxdb_bulk *bulk;
+
+    if (ctx->bulk) {
+        bulk = ctx->bulk;
+        ctx->bulk = NULL;
+        influxdb_bulk_reset(bulk);
+        return bulk;
+    }
+
+    return influxdb_bulk_create();
+}
+
+/* Give back an output bulk, the buffer is kept for the next flush */
+static void influxdb_bulk_put(struct flb_influxdb_config *ctx,
+                              struct influxdb_bulk *bulk)
+{
+    if (!ctx->bulk) {
+        ctx->bulk = bulk;
+        return;
+    }
+
+    influxdb_bulk_destroy(bulk);
+}
+
 /*
  * Convert the internal Fluent Bit data representation to the required one
  * by InfluxDB.
  */
-static char *influxdb_format(char *tag, int tag_len,
-                             void *data, size_t bytes, int *out_size,
-                             struct flb_influxdb_config *ctx)
+static struct influxdb_bulk *influxdb_format(char *tag, int tag_len,
+                                             void *data, size_t bytes,
+                                             struct flb_influxdb_config *ctx)
 {
     int i;
     int ret;
     int n_size;
     uint64_t seq = 0;
     size_t off = 0;
-    char *buf;
     char *str = NULL;
     size_t str_size;
     char tmp[128];
@@ -81,51 +180,24 @@ static char *influxdb_format(char *tag, int tag_len,
     msgpack_object *obj;
     struct flb_time tm;
     struct influxdb_bulk *bulk = NULL;
-    struct influxdb_bulk *bulk_head = NULL;
-    struct influxdb_bulk *bulk_body = NULL;
-
-
-    /* Iterate the original buffer and perform adjustments */
-    msgpack_unpacked_init(&result);
-
-    /* Perform some format validation */
-    ret = msgpack_unpack_next(&result, data, bytes, &off);
-    if (!ret) {
-        return NULL;
-    }
-
-    /* We 'should' get an array */
-    if (result.data.type != MSGPACK_OBJECT_ARRAY) {
-        /*
-         * If we got a different format, we assume the caller knows what he is
-         * doing, we just duplicate the content in a new buffer and cleanup.
-         */
-        return NULL;
-    }
+    struct influxdb_bulk *bulk_head = ctx->bulk_head;
+    struct influxdb_bulk *bulk_body = ctx->bulk_body;
 
-    root = result.data;
-    if (root.via.array.size == 0) {
+    /* Measurement name is escaped once per chunk */
+    ret = influxdb_measurement(ctx, tag, tag_len);
+    if (ret == -1) {
+        flb_errno();
         return NULL;
     }
 
     /* Create the bulk composer */
-    bulk = influxdb_bulk_create();
+    bulk = influxdb_bulk_get(ctx);
     if (!bulk) {
-        goto error;
-    }
-
-    bulk_head = influxdb_bulk_create();
-    if (!bulk_head) {
-        goto error;
-    }
-
-    bulk_body = influxdb_bulk_create();
-    if (!bulk_body) {
-        goto error;
+        return NULL;
     }
+    influxdb_bulk_reset(bulk_head);
+    influxdb_bulk_reset(bulk_body);
 
-    off = 0;
-    msgpack_unpacked_destroy(&result);
     msgpack_unpacked_init(&result);
     while (msgpack_unpack_next(&result, data, bytes, &off) == MSGPACK_UNPACK_SUCCESS) {
         if (result.data.type != MSGPACK_OBJECT_ARRAY) {
@@ -138,9 +210,11 @@ static char *influxdb_format(char *tag, int tag_len,
             continue;
         }
 
-
         flb_time_pop_from_msgpack(&tm, &result, &obj);
         map    = root.via.array.ptr[1];
+        if (map.type != MSGPACK_OBJECT_MAP) {
+            continue;
+        }
         n_size = map.via.map.size + 1;
 
         seq = ctx->seq;
@@ -152,7 +226,8 @@ static char *influxdb_format(char *tag, int tag_len,
         }
 
         ret = influxdb_bulk_append_header(bulk_head,
-                                          tag, tag_len,
+                                          ctx->tag_escaped,
+                                          flb_sds_len(ctx->tag_escaped),
                                           seq,
                                           ctx->seq_name, ctx->seq_len);
         if (ret == -1) {
@@ -203,15 +278,15 @@ static char *influxdb_format(char *tag, int tag_len,
             }
             else if (v->type == MSGPACK_OBJECT_POSITIVE_INTEGER) {
                 val = tmp;
-                val_len = snprintf(tmp, sizeof(tmp) - 1, "%" PRIu64, v->via.u64);
+                val_len = influxdb_fmt_u64(tmp, v->via.u64);
             }
             else if (v->type == MSGPACK_OBJECT_NEGATIVE_INTEGER) {
                 val = tmp;
-                val_len = snprintf(tmp, sizeof(tmp) - 1, "%" PRId64, v->via.i64);
+                val_len = influxdb_fmt_i64(tmp, v->via.i64);
             }
             else if (v->type == MSGPACK_OBJECT_FLOAT) {
                 val = tmp;
-                val_len = snprintf(tmp, sizeof(tmp) - 1, "%f", v->via.f64);
+                val_len = influxdb_fmt_double(tmp, v->via.f64);
             }
             else if (v->type == MSGPACK_OBJECT_STR) {
                 /* String value */
@@ -232,10 +307,8 @@ static char *influxdb_format(char *tag, int tag_len,
 
             /* is this a string ? */
             if (quote == FLB_TRUE) {
-                ret = flb_utils_write_str_buf(val, val_len,
-                                              &str, &str_size);
+                ret = influxdb_str(ctx, val, val_len, &str, &str_size);
                 if (ret == -1) {
-                    flb_errno();
                     goto error;
                 }
 
@@ -258,11 +331,6 @@ static char *influxdb_format(char *tag, int tag_len,
                                               quote);
             }
 
-            if (quote == FLB_TRUE) {
-                flb_free(str);
-                str_size = 0;
-            }
-
             if (ret == -1) {
                 flb_error("[out_influxdb] cannot append key/value");
                 goto error;
@@ -298,30 +366,15 @@ static char *influxdb_format(char *tag, int tag_len,
 
     msgpack_unpacked_destroy(&result);
 
-    *out_size = bulk->len;
-    buf = bulk->ptr;
-
-    /*
-     * Note: we don't destroy the bulk as we need to keep the allocated
-     * buffer with the data. Instead we just release the bulk context and
-     * return the bulk->ptr buffer
-     */
-    flb_free(bulk);
-    influxdb_bulk_destroy(bulk_head);
-    influxdb_bulk_destroy(bulk_body);
+    if (bulk->len == 0) {
+        influxdb_bulk_put(ctx, bulk);
+        return NULL;
+    }
 
-    return buf;
+    return bulk;
 
 error:
-    if (bulk != NULL) {
-        influxdb_bulk_destroy(bulk);
-    }
-    if (bulk_head != NULL) {
-        influxdb_bulk_destroy(bulk_head);
-    }
-    if (bulk_body != NULL) {
-        influxdb_bulk_destroy(bulk_body);
-    }
+    influxdb_bulk_put(ctx, bulk);
     msgpack_unpacked_destroy(&result);
     return NULL;
 }
@@ -431,6 +484,19 @@ int cb_influxdb_init(struct flb_output_instance *ins, struct flb_config *config,
     ctx->u   = upstream;
     ctx->seq = 0;
 
+    /* Measurement cache and buffers reused by flushes */
+    ctx->tag = flb_sds_create_size(64);
+    ctx->tag_escaped = flb_sds_create_size(128);
+    ctx->bulk = influxdb_bulk_create();
+    ctx->bulk_head = influxdb_bulk_create();
+    ctx->bulk_body = influxdb_bulk_create();
+    if (!ctx->tag || !ctx->tag_escaped || !ctx->bulk ||
+        !ctx->bulk_head || !ctx->bulk_body) {
+        flb_errno();
+        cb_influxdb_exit(ctx, config);
+        return -1;
+    }
+
     flb_time_zero(&ctx->ts_dupe);
     flb_time_zero(&ctx->ts_last);
 
@@ -447,29 +513,28 @@ void cb_influxdb_flush(void *data, size_t bytes,
                        struct flb_config *config)
 {
     int ret;
-    int bytes_out;
     size_t b_sent;
-    char *pack;
+    struct influxdb_bulk *bulk;
     struct flb_upstream_conn *u_conn;
     struct flb_http_client *c;
     struct flb_influxdb_config *ctx = out_context;
 
     /* Convert format */
-    pack = influxdb_format(tag, tag_len, data, bytes, &bytes_out, ctx);
-    if (!pack) {
+    bulk = influxdb_format(tag, tag_len, data, bytes, ctx);
+    if (!bulk) {
         FLB_OUTPUT_RETURN(FLB_ERROR);
     }
 
     /* Get upstream connection */
     u_conn = flb_upstream_conn_get(ctx->u);
     if (!u_conn) {
-        flb_free(pack);
+        influxdb_bulk_put(ctx, bulk);
         FLB_OUTPUT_RETURN(FLB_RETRY);
     }
 
     /* Compose HTTP Client request */
     c = flb_http_client(u_conn, FLB_HTTP_POST, ctx->uri,
-                        pack, bytes_out, NULL, 0, NULL, 0);
+                        bulk->ptr, bulk->len, NULL, 0, NULL, 0);
     flb_http_add_header(c, "User-Agent", 10, "Fluent-Bit", 10);
 
     if (ctx->http_user && ctx->http_passwd) {
@@ -496,7 +561,7 @@ void cb_influxdb_flush(void *data, size_t bytes,
 
     flb_http_client_destroy(c);
 
-    flb_free(pack);
+    influxdb_bulk_put(ctx, bulk);
 
     /* Release the connection */
     flb_upstream_conn_release(u_conn);
@@ -518,6 +583,19 @@ int cb_influxdb_exit(void *data, struct flb_config *config)
         flb_utils_split_free(ctx->tag_keys);
     }
 
+    if (ctx->bulk) {
+        influxdb_bulk_destroy(ctx->bulk);
+    }
+    if (ctx->bulk_head) {
+        influxdb_bulk_destroy(ctx->bulk_head);
+    }
+    if (ctx->bulk_body) {
+        influxdb_bulk_destroy(ctx->bulk_body);
+    }
+    flb_free(ctx->str_buf);
+    flb_sds_destroy(ctx->tag);
+    flb_sds_destroy(ctx->tag_escaped);
+
     flb_upstream_destroy(ctx->u);
     flb_free(ctx->db_name);
     flb_free(ctx->seq_name);
@@ -23,6 +23,9 @@
 
 #include <fluent-bit/flb_output.h>
 #include <fluent-bit/flb_time.h>
+#include <fluent-bit/flb_sds.h>
+
+#include "influxdb_bulk.h"
 
 #define FLB_INFLUXDB_HOST "127.0.0.1"
 #define FLB_INFLUXDB_PORT 8086
@@ -53,6 +56,21 @@ struct flb_influxdb_config {
     /* Upstream connection to the backend server */
     struct flb_upstream *u;
 
+    /* measurement: last seen tag and its escaped version */
+    flb_sds_t tag;
+    flb_sds_t tag_escaped;
+
+    /*
+     * Buffers reused across flushes. The output bulk is taken by a flush
+     * while it is being sent (NULL meanwhile), the others are only used
+     * while formatting the chunk.
+     */
+    struct influxdb_bulk *bulk;
+    struct influxdb_bulk *bulk_head;
+    struct influxdb_bulk *bulk_body;
+    char *str_buf;
+    size_t str_size;
+
     /* used for incrementing identical timestamps */
     struct flb_time ts_dupe;
     struct flb_time ts_last;
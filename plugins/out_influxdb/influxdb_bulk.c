@@ -22,6 +22,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <math.h>
 
 #include <fluent-bit.h>
 #include "influxdb.h"
@@ -42,6 +43,88 @@ static int influxdb_escape(char *out, const char *str, int size, bool quote) {
     return out_size;
 }
 
+/*
+ * Escape a measurement name, commas and spaces must be escaped, the
+ * output buffer must have room for twice the input size.
+ */
+int influxdb_escape_measurement(char *out, const char *str, int size)
+{
+    int i;
+    int out_size = 0;
+
+    for (i = 0; i < size; i++) {
+        if (str[i] == ',' || str[i] == ' ') {
+            out[out_size++] = '\\';
+        }
+        out[out_size++] = str[i];
+    }
+    return out_size;
+}
+
+/*
+ * Number formatters: they write the value in 'out' (without NULL byte) and
+ * return the number of bytes written. The output buffer must have room
+ * for at least 32 bytes (128 for doubles).
+ */
+int influxdb_fmt_u64(char *out, uint64_t val)
+{
+    int i;
+    int len = 0;
+    char tmp[20];
+
+    do {
+        tmp[len++] = '0' + (val % 10);
+        val /= 10;
+    } while (val > 0);
+
+    for (i = 0; i < len; i++) {
+        out[i] = tmp[len - i - 1];
+    }
+    return len;
+}
+
+int influxdb_fmt_i64(char *out, int64_t val)
+{
+    if (val < 0) {
+        out[0] = '-';
+        /* do not negate INT64_MIN as signed */
+        return influxdb_fmt_u64(out + 1, (uint64_t) 0 - (uint64_t) val) + 1;
+    }
+    return influxdb_fmt_u64(out, (uint64_t) val);
+}
+
+/* Same output than printf("%f") for the usual range of values */
+int influxdb_fmt_double(char *out, double val)
+{
+    int i;
+    int len = 0;
+    uint64_t scaled;
+    uint64_t frac;
+
+    if (!isfinite(val) || fabs(val) >= 1e12) {
+        return snprintf(out, 127, "%f", val);
+    }
+
+    if (val < 0) {
+        out[len++] = '-';
+        val = -val;
+    }
+
+    /* six decimal digits */
+    scaled = (uint64_t) llround(val * 1000000.0);
+    len += influxdb_fmt_u64(out + len, scaled / 1000000);
+    out[len++] = '.';
+
+    frac = scaled % 1000000;
+    for (i = 5; i >= 0; i--) {
+        out[len + i] = '0' + (frac % 10);
+        frac /= 10;
+    }
+    len += 6;
+
+    return len;
+}
+
 static int influxdb_bulk_buffer(struct influxdb_bulk *bulk, int required)
 {
     int new_size;
@@ -86,6 +169,12 @@ struct influxdb_bulk *influxdb_bulk_create()
     return b;
 }
 
+void influxdb_bulk_reset(struct influxdb_bulk *bulk)
+{
+    bulk->len = 0;
+    bulk->ptr[0] = '\0';
+}
+
 void influxdb_bulk_destroy(struct influxdb_bulk *bulk)
 {
     if (bulk->size > 0) {
@@ -124,8 +213,7 @@ int influxdb_bulk_append_header(struct influxdb_bulk *bulk,
         bulk->ptr[bulk->len] = '=';
         bulk->len++;
 
-        ret = snprintf(bulk->ptr + bulk->len, 32, "%" PRIu64, seq_n);
-        bulk->len += ret;
+        bulk->len += influxdb_fmt_u64(bulk->ptr + bulk->len, seq_n);
     }
 
     /* Add a NULL byte for debugging purposes */
@@ -187,7 +275,6 @@ int influxdb_bulk_append_timestamp(struct influxdb_bulk *bulk,
                                    struct flb_time *t)
 {
     int ret;
-    int len;
     uint64_t timestamp;
 
     /* Make sure we have enough space */
@@ -198,11 +285,8 @@ int influxdb_bulk_append_timestamp(struct influxdb_bulk *bulk,
 
     /* Timestamp is in Nanoseconds */
     timestamp = (t->tm.tv_sec * ONE_BILLION) + t->tm.tv_nsec;
-    len = snprintf(bulk->ptr + bulk->len, 127, " %" PRIu64, timestamp);
-    if (len == -1) {
-        return -1;
-    }
-    bulk->len += len;
+    bulk->ptr[bulk->len++] = ' ';
+    bulk->len += influxdb_fmt_u64(bulk->ptr + bulk->len, timestamp);
     bulk->ptr[bulk->len] = '\0';
 
     return 0;
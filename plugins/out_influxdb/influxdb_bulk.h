@@ -34,6 +34,7 @@ struct influxdb_bulk {
 };
 
 struct influxdb_bulk *influxdb_bulk_create();
+void influxdb_bulk_reset(struct influxdb_bulk *bulk);
 
 int influxdb_bulk_append_header(struct influxdb_bulk *bulk,
                                 char *tag, int tag_len,
@@ -52,4 +53,9 @@ void influxdb_bulk_destroy(struct influxdb_bulk *bulk);
 int influxdb_bulk_append_timestamp(struct influxdb_bulk *bulk,
                                    struct flb_time *t);
 
+int influxdb_escape_measurement(char *out, const char *str, int size);
+int influxdb_fmt_u64(char *out, uint64_t val);
+int influxdb_fmt_i64(char *out, int64_t val);
+int influxdb_fmt_double(char *out, double val);
+
 #endif
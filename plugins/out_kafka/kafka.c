@@ -22,6 +22,9 @@
 #include <fluent-bit/flb_output.h>
 #include <fluent-bit/flb_time.h>
 #include <fluent-bit/flb_pack.h>
+#include <fluent-bit/flb_mem.h>
+#include <fluent-bit/flb_sds.h>
+#include <fluent-bit/flb_time_utils.h>
 
 #include "kafka_config.h"
 #include "kafka_topic.h"
@@ -29,15 +32,24 @@
 void cb_kafka_msg(rd_kafka_t *rk, const rd_kafka_message_t *rkmessage,
                   void *opaque)
 {
+    struct flb_kafka_task *task = rkmessage->_private;
+
     if (rkmessage->err) {
         flb_warn("[out_kafka] message delivery failed: %s",
                  rd_kafka_err2str(rkmessage->err));
+        if (task) {
+            task->failed++;
+        }
     }
     else {
         flb_debug("[out_kafka] message delivered (%zd bytes, "
                   "partition %"PRId32")",
                   rkmessage->len, rkmessage->partition);
     }
+
+    if (task) {
+        task->pending--;
+    }
 }
 
 void cb_kafka_logger(const rd_kafka_t *rk, int level,
@@ -66,27 +78,103 @@ static int cb_kafka_init(struct flb_output_instance *ins,
     return 0;
 }
 
-int produce_message(struct flb_time *tm, msgpack_object *map,
-                    struct flb_kafka *ctx, struct flb_config *config)
+static struct flb_kafka_task *task_create(size_t bytes)
+{
+    struct flb_kafka_task *task;
+
+    task = flb_calloc(1, sizeof(struct flb_kafka_task));
+    if (!task) {
+        flb_errno();
+        return NULL;
+    }
+
+    /* Encoded records are usually bigger than their msgpack version */
+    task->buf = flb_sds_create_size(bytes * 1.5);
+    if (!task->buf) {
+        flb_free(task);
+        return NULL;
+    }
+
+    return task;
+}
+
+static void task_destroy(struct flb_kafka_task *task)
+{
+    flb_sds_destroy(task->buf);
+    flb_free(task->msgs);
+    flb_free(task->topics);
+    flb_free(task);
+}
+
+/* Register a message of 'size' bytes ending at the tail of the buffer */
+static int task_add_message(struct flb_kafka_task *task, size_t size,
+                            struct flb_kafka_topic *topic,
+                            struct flb_kafka *ctx)
+{
+    int new_size;
+    rd_kafka_message_t *msgs;
+    struct flb_kafka_topic **topics;
+    rd_kafka_message_t *msg;
+
+    if (task->msgs_count == task->msgs_size) {
+        new_size = task->msgs_size ? task->msgs_size * 2 : 64;
+        msgs = flb_realloc(task->msgs, sizeof(rd_kafka_message_t) * new_size);
+        if (!msgs) {
+            flb_errno();
+            return -1;
+        }
+        task->msgs = msgs;
+
+        topics = flb_realloc(task->topics,
+                             sizeof(struct flb_kafka_topic *) * new_size);
+        if (!topics) {
+            flb_errno();
+            return -1;
+        }
+        task->topics = topics;
+        task->msgs_size = new_size;
+    }
+
+    /*
+     * The buffer might be reallocated by the next records, keep the offset
+     * of the payload until all of them are encoded.
+     */
+    msg = &task->msgs[task->msgs_count];
+    memset(msg, '\0', sizeof(rd_kafka_message_t));
+    msg->payload = (void *) (flb_sds_len(task->buf) - size);
+    msg->len = size;
+    msg->key = ctx->message_key;
+    msg->key_len = ctx->message_key_len;
+    msg->_private = task;
+
+    task->topics[task->msgs_count] = topic;
+    task->msgs_count++;
+
+    return 0;
+}
+
+/* Encode a record in the task buffer according to the configured format */
+static int encode_message(struct flb_time *tm, msgpack_object *map,
+                          struct flb_kafka *ctx,
+                          struct flb_kafka_task *task,
+                          msgpack_sbuffer *mp_sbuf)
 {
     int i;
     int ret;
     int size;
-    int queue_full_retries = 0;
-    char *out_buf;
     size_t out_size;
+    size_t before;
     struct flb_kafka_topic *topic = NULL;
-    msgpack_sbuffer mp_sbuf;
     msgpack_packer mp_pck;
     msgpack_object key;
     msgpack_object val;
     flb_sds_t s;
 
-    /* Init temporal buffers */
-    msgpack_sbuffer_init(&mp_sbuf);
-    msgpack_packer_init(&mp_pck, &mp_sbuf, msgpack_sbuffer_write);
+    /* Reuse the temporal buffer of the flush */
+    mp_sbuf->size = 0;
+    msgpack_packer_init(&mp_pck, mp_sbuf, msgpack_sbuffer_write);
 
-    if (ctx->format == FLB_KAFKA_FMT_JSON || ctx->format == FLB_KAFKA_FMT_MSGP) {
+    if (ctx->format == FLB_KAFKA_FMT_MSGP) {
         /* Make room for the timestamp */
         size = map->via.map.size + 1;
         msgpack_pack_map(&mp_pck, size);
@@ -96,11 +184,11 @@ int produce_message(struct flb_time *tm, msgpack_object *map,
         msgpack_pack_str_body(&mp_pck,
                               ctx->timestamp_key, ctx->timestamp_key_len);
         switch (ctx->timestamp_format) {
-            case FLB_JSON_DATE_DOUBLE:
+            case FLB_PACK_JSON_DATE_DOUBLE:
                 msgpack_pack_double(&mp_pck, flb_time_to_double(tm));
                 break;
 
-            case FLB_JSON_DATE_ISO8601:
+            case FLB_PACK_JSON_DATE_ISO8601:
                 {
                 size_t date_len;
                 int len;
@@ -109,7 +197,7 @@ int produce_message(struct flb_time *tm, msgpack_object *map,
                 /* Format the time; use microsecond precision (not nanoseconds). */
                 gmtime_r(&tm->tm.tv_sec, &_tm);
                 date_len = strftime(time_formatted, sizeof(time_formatted) - 1,
-                             FLB_JSON_DATE_ISO8601_FMT, &_tm);
+                             FLB_PACK_JSON_DATE_ISO8601_FMT, &_tm);
 
                 len = snprintf(time_formatted + date_len, sizeof(time_formatted) - 1 - date_len,
                                ".%06" PRIu64 "Z", (uint64_t) tm->tm.tv_nsec / 1000);
@@ -121,17 +209,15 @@ int produce_message(struct flb_time *tm, msgpack_object *map,
                 break;
         }
     }
-    else {
-        size = map->via.map.size;
-        msgpack_pack_map(&mp_pck, size);
-    }
 
     for (i = 0; i < map->via.map.size; i++) {
         key = map->via.map.ptr[i].key;
         val = map->via.map.ptr[i].val;
 
-        msgpack_pack_object(&mp_pck, key);
-        msgpack_pack_object(&mp_pck, val);
+        if (ctx->format == FLB_KAFKA_FMT_MSGP) {
+            msgpack_pack_object(&mp_pck, key);
+            msgpack_pack_object(&mp_pck, val);
+        }
 
         /* Lookup key/topic */
         if (ctx->topic_key && !topic && val.type == MSGPACK_OBJECT_STR) {
@@ -144,104 +230,139 @@ int produce_message(struct flb_time *tm, msgpack_object *map,
         }
     }
 
+    if (!topic) {
+        topic = flb_kafka_topic_default(ctx);
+    }
+    if (!topic) {
+        flb_error("[out_kafka] no default topic found");
+        return FLB_ERROR;
+    }
+
     if (ctx->format == FLB_KAFKA_FMT_JSON) {
-        ret = flb_msgpack_raw_to_json_str(mp_sbuf.data, mp_sbuf.size,
-                                          &out_buf, &out_size);
-        if (ret != 0) {
+        /* JSON is encoded straight from the original record */
+        before = flb_sds_len(task->buf);
+        ret = flb_pack_json_enc_record(&ctx->json_enc, &task->buf, tm, map);
+        if (ret == -1) {
             flb_error("[out_kafka] error encoding to JSON");
-            msgpack_sbuffer_destroy(&mp_sbuf);
             return FLB_ERROR;
         }
+        out_size = flb_sds_len(task->buf) - before;
     }
     else if (ctx->format == FLB_KAFKA_FMT_MSGP) {
-        out_buf = mp_sbuf.data;
-        out_size = mp_sbuf.size;
+        s = flb_sds_cat(task->buf, mp_sbuf->data, mp_sbuf->size);
+        if (!s) {
+            flb_errno();
+            return FLB_ERROR;
+        }
+        task->buf = s;
+        out_size = mp_sbuf->size;
     }
-    else if (ctx->format == FLB_KAFKA_FMT_GELF) {
-        s = flb_msgpack_raw_to_gelf(mp_sbuf.data, mp_sbuf.size,
-                                    tm, &(ctx->gelf_fields));
+    else {
+        /* GELF is encoded straight from the original record */
+        before = flb_sds_len(task->buf);
+        s = flb_msgpack_to_gelf(&task->buf, map, tm, &(ctx->gelf_fields));
         if (s == NULL) {
             flb_error("[out_kafka] error encoding to GELF");
-            msgpack_sbuffer_destroy(&mp_sbuf);
             return FLB_ERROR;
         }
-        out_buf = s;
-        out_size = flb_sds_len(s);
+        out_size = flb_sds_len(task->buf) - before;
     }
 
-    if (!topic) {
-        topic = flb_kafka_topic_default(ctx);
-    }
-    if (!topic) {
-        flb_error("[out_kafka] no default topic found");
-        msgpack_sbuffer_destroy(&mp_sbuf);
+    ret = task_add_message(task, out_size, topic, ctx);
+    if (ret == -1) {
         return FLB_ERROR;
     }
 
- retry:
-    if (queue_full_retries >= 10) {
-        if (ctx->format == FLB_KAFKA_FMT_JSON) {
-            flb_free(out_buf);
-        }
-        if (ctx->format == FLB_KAFKA_FMT_GELF) {
-            flb_sds_destroy(s);
-        }
-        msgpack_sbuffer_destroy(&mp_sbuf);
-        return FLB_RETRY;
+    return FLB_OK;
+}
+
+/*
+ * Enqueue the messages of the task without copying the payloads. Messages
+ * are grouped in runs of the same topic for rd_kafka_produce_batch(). Only
+ * the messages rejected because the rdkafka queue is full are produced
+ * again, after giving some time to rdkafka to deliver the queued ones.
+ */
+static int task_produce(struct flb_kafka_task *task, struct flb_kafka *ctx,
+                        struct flb_config *config)
+{
+    int i;
+    int j;
+    int n;
+    int ret;
+    int start;
+    int count;
+    int retries = 0;
+    struct flb_kafka_topic *topic;
+    rd_kafka_message_t *msg;
+
+    /* Payload offsets are now final */
+    for (i = 0; i < task->msgs_count; i++) {
+        msg = &task->msgs[i];
+        msg->payload = task->buf + (size_t) msg->payload;
     }
 
-    ret = rd_kafka_produce(topic->tp,
-                           RD_KAFKA_PARTITION_UA,
-                           RD_KAFKA_MSG_F_COPY,
-                           out_buf, out_size,
-                           ctx->message_key, ctx->message_key_len,
-                           NULL);
-    if (ret == -1) {
-        fprintf(stderr,
-                "%% Failed to produce to topic %s: %s\n",
-                rd_kafka_topic_name(topic->tp),
-                rd_kafka_err2str(rd_kafka_last_error()));
-
-        /*
-         * rdkafka queue is full, keep trying 'locally' for a few seconds,
-         * otherwise let the caller to issue a main retry againt the engine.
-         */
-        if (rd_kafka_last_error() == RD_KAFKA_RESP_ERR__QUEUE_FULL) {
-            flb_warn("[out_kafka] internal queue is full, "
-                     "retrying in one second");
+    start = 0;
+    while (start < task->msgs_count) {
+        topic = task->topics[start];
+        for (count = 1; start + count < task->msgs_count; count++) {
+            if (task->topics[start + count] != topic) {
+                break;
+            }
+        }
+
+        n = count;
+        while (n > 0) {
+            ret = rd_kafka_produce_batch(topic->tp, RD_KAFKA_PARTITION_UA, 0,
+                                         task->msgs + start, n);
+            task->pending += ret;
+            if (ret == n) {
+                break;
+            }
+
+            /* Compact the rejected messages at the beginning of the run */
+            for (i = 0, j = 0; i < n; i++) {
+                msg = &task->msgs[start + i];
+                if (msg->err == RD_KAFKA_RESP_ERR_NO_ERROR) {
+                    continue;
+                }
+                if (msg->err != RD_KAFKA_RESP_ERR__QUEUE_FULL) {
+                    flb_error("[out_kafka] failed to produce to topic %s: %s",
+                              rd_kafka_topic_name(topic->tp),
+                              rd_kafka_err2str(msg->err));
+                    task->failed++;
+                    continue;
+                }
+                msg->err = RD_KAFKA_RESP_ERR_NO_ERROR;
+                task->msgs[start + j++] = *msg;
+            }
+            n = j;
+            if (n == 0) {
+                break;
+            }
 
             /*
-             * Next step is to give it some time to the background rdkafka
-             * library to do it own work. By default rdkafka wait 1 second
-             * or up to 10000 messages to be enqueued before delivery.
-             *
-             * If the kafka broker is down we should try a couple of times
-             * to enqueue this message, if we exceed 10 times, we just
-             * issue a full retry of the data chunk.
+             * If the kafka broker is down we try a few times to enqueue the
+             * messages, then the chunk is retried by the engine once the
+             * reports of the enqueued messages arrive.
              */
-            flb_time_sleep(1000, config);
-            rd_kafka_poll(ctx->producer, 0);
+            if (retries >= FLB_KAFKA_QUEUE_RETRIES) {
+                task->failed += n;
+                return -1;
+            }
 
-            /* Issue a re-try */
-            queue_full_retries++;
-            goto retry;
+            flb_warn("[out_kafka] internal queue is full, "
+                     "retrying in one second");
+            rd_kafka_poll(ctx->producer, 0);
+            flb_time_sleep(1000, config);
+            retries++;
         }
-    }
-    else {
-        flb_debug("[out_kafka] enqueued message (%zd bytes) for topic '%s'",
-                  out_size, rd_kafka_topic_name(topic->tp));
-    }
 
-    rd_kafka_poll(ctx->producer, 0);
-    if (ctx->format == FLB_KAFKA_FMT_JSON) {
-        flb_free(out_buf);
-    }
-    if (ctx->format == FLB_KAFKA_FMT_GELF) {
-        flb_sds_destroy(s);
+        flb_debug("[out_kafka] enqueued %i messages for topic '%s'",
+                  count, rd_kafka_topic_name(topic->tp));
+        start += count;
     }
 
-    msgpack_sbuffer_destroy(&mp_sbuf);
-    return FLB_OK;
+    return 0;
 }
 
 static void cb_kafka_flush(void *data, size_t bytes,
@@ -254,27 +375,54 @@ static void cb_kafka_flush(void *data, size_t bytes,
     int ret;
     size_t off = 0;
     struct flb_kafka *ctx = out_context;
+    struct flb_kafka_task *task;
     struct flb_time tms;
     msgpack_object *obj;
     msgpack_unpacked result;
+    msgpack_sbuffer mp_sbuf;
+
+    task = task_create(bytes);
+    if (!task) {
+        FLB_OUTPUT_RETURN(FLB_RETRY);
+    }
 
-    /* Iterate the original buffer and perform adjustments */
+    /* Encode all the records in the task buffer */
+    msgpack_sbuffer_init(&mp_sbuf);
     msgpack_unpacked_init(&result);
     while (msgpack_unpack_next(&result, data, bytes, &off) == MSGPACK_UNPACK_SUCCESS) {
         flb_time_pop_from_msgpack(&tms, &result, &obj);
 
-        ret = produce_message(&tms, obj, ctx, config);
+        ret = encode_message(&tms, obj, ctx, task, &mp_sbuf);
         if (ret == FLB_ERROR) {
             msgpack_unpacked_destroy(&result);
+            msgpack_sbuffer_destroy(&mp_sbuf);
+            task_destroy(task);
             FLB_OUTPUT_RETURN(FLB_ERROR);
         }
-        else if (ret == FLB_RETRY) {
-            msgpack_unpacked_destroy(&result);
-            FLB_OUTPUT_RETURN(FLB_RETRY);
-        }
     }
-
     msgpack_unpacked_destroy(&result);
+    msgpack_sbuffer_destroy(&mp_sbuf);
+
+    task_produce(task, ctx, config);
+
+    /*
+     * Wait for the delivery reports: the records are confirmed (or the
+     * chunk retried) only once rdkafka is done with all the messages.
+     */
+    rd_kafka_poll(ctx->producer, 0);
+    while (task->pending > 0) {
+        flb_time_sleep(FLB_KAFKA_DR_POLL_MS, config);
+        rd_kafka_poll(ctx->producer, 0);
+    }
+
+    if (task->failed > 0) {
+        flb_warn("[out_kafka] %i/%i messages were not delivered",
+                 task->failed, task->msgs_count);
+        task_destroy(task);
+        FLB_OUTPUT_RETURN(FLB_RETRY);
+    }
+
+    task_destroy(task);
     FLB_OUTPUT_RETURN(FLB_OK);
 }
 
@@ -152,11 +152,11 @@ struct flb_kafka *flb_kafka_conf_create(struct flb_output_instance *ins,
     }
 
     /* Config: Timestamp_Format */
-    ctx->timestamp_format = FLB_JSON_DATE_DOUBLE;
+    ctx->timestamp_format = FLB_PACK_JSON_DATE_DOUBLE;
     tmp = flb_output_get_property("timestamp_format", ins);
     if (tmp) {
         if (strcasecmp(tmp, "iso8601") == 0) {
-            ctx->timestamp_format = FLB_JSON_DATE_ISO8601;
+            ctx->timestamp_format = FLB_PACK_JSON_DATE_ISO8601;
         }
     }
 
@@ -225,6 +225,14 @@ struct flb_kafka *flb_kafka_conf_create(struct flb_output_instance *ins,
         }
     }
 
+    /* JSON encoder, the timestamp key goes first */
+    ret = flb_pack_json_enc_init(&ctx->json_enc, FLB_PACK_JSON_FORMAT_JSON,
+                                 ctx->timestamp_format, ctx->timestamp_key);
+    if (ret == -1) {
+        flb_kafka_conf_destroy(ctx);
+        return NULL;
+    }
+
     flb_info("[out_kafka] brokers='%s' topics='%s'", ctx->brokers, tmp);
     return ctx;
 }
@@ -242,6 +250,8 @@ int flb_kafka_conf_destroy(struct flb_kafka *ctx)
     flb_kafka_topic_destroy_all(ctx);
 
     if (ctx->producer) {
+        /* Wait for the delivery reports of the in-flight messages */
+        rd_kafka_flush(ctx->producer, 5000);
         rd_kafka_destroy(ctx->producer);
     }
 
@@ -253,6 +263,8 @@ int flb_kafka_conf_destroy(struct flb_kafka *ctx)
         flb_free(ctx->message_key);
     }
 
+    flb_pack_json_enc_destroy(&ctx->json_enc);
+
     flb_sds_destroy(ctx->gelf_fields.timestamp_key);
     flb_sds_destroy(ctx->gelf_fields.host_key);
     flb_sds_destroy(ctx->gelf_fields.short_message_key);
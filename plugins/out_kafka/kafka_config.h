@@ -34,9 +34,11 @@
 #define FLB_KAFKA_TOPIC     "fluent-bit"
 #define FLB_KAFKA_TS_KEY    "@timestamp"
 
-#define FLB_JSON_DATE_DOUBLE      0
-#define FLB_JSON_DATE_ISO8601     1
-#define FLB_JSON_DATE_ISO8601_FMT "%Y-%m-%dT%H:%M:%S"
+/* Interval to poll for delivery reports while a flush waits for them */
+#define FLB_KAFKA_DR_POLL_MS      50
+
+/* Attempts to enqueue messages while the rdkafka queue is full */
+#define FLB_KAFKA_QUEUE_RETRIES   10
 
 struct flb_kafka_topic {
     int name_len;
@@ -45,6 +47,21 @@ struct flb_kafka_topic {
     struct mk_list _head;
 };
 
+/*
+ * Messages produced by a flush task. The payloads point into 'buf' (no copy
+ * is made by rdkafka), so the task is released only when the delivery
+ * reports of all the enqueued messages arrived.
+ */
+struct flb_kafka_task {
+    int pending;                     /* enqueued, waiting for a report */
+    int failed;                      /* not enqueued or not delivered  */
+    flb_sds_t buf;                   /* encoded messages               */
+    int msgs_count;
+    int msgs_size;
+    rd_kafka_message_t *msgs;        /* payload offsets before produce */
+    struct flb_kafka_topic **topics; /* destination of each message    */
+};
+
 struct flb_kafka {
     /* Config Parameters */
     int format;
@@ -58,6 +75,9 @@ struct flb_kafka {
     char *timestamp_key;
     int timestamp_format;
 
+    /* JSON encoder, the timestamp key goes first */
+    struct flb_pack_json_enc json_enc;
+
     int message_key_len;
     char *message_key;
 
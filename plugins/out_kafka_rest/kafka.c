@@ -29,143 +29,137 @@
 #include "kafka.h"
 #include "kafka_conf.h"
 
+/* JSON encoder hook: append the pre-encoded tag key pair */
+static int kafka_rest_tag_field(flb_sds_t *buf, struct flb_time *tm,
+                                msgpack_object *map, void *data)
+{
+    flb_sds_t field = data;
+    flb_sds_t tmp;
+    (void) tm;
+    (void) map;
+
+    tmp = flb_sds_cat(*buf, field, flb_sds_len(field));
+    if (!tmp) {
+        flb_errno();
+        return -1;
+    }
+    *buf = tmp;
+    return 1;
+}
+
 /*
  * Convert the internal Fluent Bit data representation to the required
- * one by Kafka REST Proxy.
+ * one by Kafka REST Proxy:
+ *
+ *   {"records":[{"partition":N, "key":"...", "value":{...}}, ...]}
  */
-static char *kafka_rest_format(void *data, size_t bytes,
-                               char *tag, int tag_len, size_t *out_size,
-                               struct flb_kafka_rest *ctx)
+static flb_sds_t kafka_rest_format(void *data, size_t bytes,
+                                   char *tag, int tag_len,
+                                   struct flb_kafka_rest *ctx)
 {
-    int i;
     int ret;
-    int len;
-    int arr_size = 0;
-    int map_size;
-    size_t s;
+    int records = 0;
     size_t off = 0;
-    char time_formatted[256];
+    struct flb_time tms;
     msgpack_unpacked result;
-    msgpack_object root;
-    msgpack_object map;
     msgpack_object *obj;
-    msgpack_object key;
-    msgpack_object val;
-    char *json_buf;
-    size_t json_size;
-    struct tm tm;
-    struct flb_time tms;
-    msgpack_sbuffer mp_sbuf;
-    msgpack_packer mp_pck;
+    flb_sds_t tag_field = NULL;
+    flb_sds_t buf;
+    flb_sds_t tmp;
 
-    /* Init temporal buffers */
-    msgpack_sbuffer_init(&mp_sbuf);
-    msgpack_packer_init(&mp_pck, &mp_sbuf, msgpack_sbuffer_write);
+    buf = flb_sds_create_size(bytes * 1.5 + 64);
+    if (!buf) {
+        flb_errno();
+        return NULL;
+    }
 
-    /* Iterate the original buffer and perform adjustments */
-    msgpack_unpacked_init(&result);
+    /* The tag is the same for the whole chunk, encode it once */
+    if (ctx->include_tag_key == FLB_TRUE) {
+        tag_field = flb_sds_create_size(ctx->tag_key_len + tag_len + 8);
+        if (!tag_field) {
+            goto error;
+        }
+        ret = flb_pack_json_enc_str(&tag_field, ctx->tag_key,
+                                    ctx->tag_key_len);
+        if (ret == 0) {
+            tmp = flb_sds_cat(tag_field, ":", 1);
+            if (!tmp) {
+                goto error;
+            }
+            tag_field = tmp;
+            ret = flb_pack_json_enc_str(&tag_field, tag, tag_len);
+        }
+        if (ret == -1) {
+            goto error;
+        }
 
-    /* Count number of entries */
-    while (msgpack_unpack_next(&result, data, bytes, &off) == MSGPACK_UNPACK_SUCCESS) {
-        arr_size++;
+        /* formatting does not yield, the hook data is set for this chunk */
+        ctx->json_enc.cb_fields = kafka_rest_tag_field;
+        ctx->json_enc.cb_data = tag_field;
     }
-    msgpack_unpacked_destroy(&result);
-    off = 0;
 
-    /* Root map */
-    msgpack_pack_map(&mp_pck, 1);
-    msgpack_pack_str(&mp_pck, 7);
-    msgpack_pack_str_body(&mp_pck, "records", 7);
-
-    msgpack_pack_array(&mp_pck, arr_size);
+    tmp = flb_sds_cat(buf, "{\"records\":[", 12);
+    if (!tmp) {
+        goto error;
+    }
+    buf = tmp;
 
-    /* Iterate and compose array content */
     msgpack_unpacked_init(&result);
     while (msgpack_unpack_next(&result, data, bytes, &off) == MSGPACK_UNPACK_SUCCESS) {
-        root = result.data;
-
-        map = root.via.array.ptr[1];
-        map_size = 1;
-
-        flb_time_pop_from_msgpack(&tms, &result, &obj);
-
-        if (ctx->partition >= 0) {
-            map_size++;
-        }
-
-        if (ctx->message_key != NULL) {
-            map_size++;
-        }
-
-        msgpack_pack_map(&mp_pck, map_size);
-        if (ctx->partition >= 0) {
-            msgpack_pack_str(&mp_pck, 9);
-            msgpack_pack_str_body(&mp_pck, "partition", 9);
-            msgpack_pack_int64(&mp_pck, ctx->partition);
+        if (result.data.type != MSGPACK_OBJECT_ARRAY ||
+            result.data.via.array.size != 2) {
+            continue;
         }
+        flb_time_pop_from_msgpack(&tms, &result, &obj);
 
-
-        if (ctx->message_key != NULL) {
-            msgpack_pack_str(&mp_pck, 3);
-            msgpack_pack_str_body(&mp_pck, "key", 3);
-            msgpack_pack_str(&mp_pck, ctx->message_key_len);
-            msgpack_pack_str_body(&mp_pck, ctx->message_key, ctx->message_key_len);
+        if (records > 0) {
+            tmp = flb_sds_cat(buf, ", ", 2);
+            if (!tmp) {
+                goto error_unpack;
+            }
+            buf = tmp;
         }
-
-        /* Value Map Size */
-        map_size = map.via.map.size;
-        map_size++;
-        if (ctx->include_tag_key == FLB_TRUE) {
-            map_size++;
+        tmp = flb_sds_cat(buf, ctx->record_head,
+                          flb_sds_len(ctx->record_head));
+        if (!tmp) {
+            goto error_unpack;
         }
+        buf = tmp;
 
-        msgpack_pack_str(&mp_pck, 5);
-        msgpack_pack_str_body(&mp_pck, "value", 5);
-
-        msgpack_pack_map(&mp_pck, map_size);
-
-        /* Time key and time formatted */
-        msgpack_pack_str(&mp_pck, ctx->time_key_len);
-        msgpack_pack_str_body(&mp_pck, ctx->time_key, ctx->time_key_len);
-
-        /* Format the time */
-        gmtime_r(&tms.tm.tv_sec, &tm);
-        s = strftime(time_formatted, sizeof(time_formatted) - 1,
-                     ctx->time_key_format, &tm);
-        len = snprintf(time_formatted + s, sizeof(time_formatted) - 1 - s,
-                       ".%09" PRIu64 "Z", (uint64_t) tms.tm.tv_nsec);
-        s += len;
-        msgpack_pack_str(&mp_pck, s);
-        msgpack_pack_str_body(&mp_pck, time_formatted, s);
-
-        /* Tag Key */
-        if (ctx->include_tag_key == FLB_TRUE) {
-            msgpack_pack_str(&mp_pck, ctx->tag_key_len);
-            msgpack_pack_str_body(&mp_pck, ctx->tag_key, ctx->tag_key_len);
-            msgpack_pack_str(&mp_pck, tag_len);
-            msgpack_pack_str_body(&mp_pck, tag, tag_len);
+        ret = flb_pack_json_enc_record(&ctx->json_enc, &buf, &tms, obj);
+        if (ret == -1) {
+            goto error_unpack;
         }
 
-        for (i = 0; i < map.via.map.size; i++) {
-            key = map.via.map.ptr[i].key;
-            val = map.via.map.ptr[i].val;
-
-            msgpack_pack_object(&mp_pck, key);
-            msgpack_pack_object(&mp_pck, val);
+        tmp = flb_sds_cat(buf, "}", 1);
+        if (!tmp) {
+            goto error_unpack;
         }
+        buf = tmp;
+        records++;
     }
     msgpack_unpacked_destroy(&result);
 
-    /* Convert to JSON */
-    ret = flb_msgpack_raw_to_json_str(mp_sbuf.data, mp_sbuf.size,
-                                      &json_buf, &json_size);
-    msgpack_sbuffer_destroy(&mp_sbuf);
-    if (ret != 0) {
-        return NULL;
+    tmp = flb_sds_cat(buf, "]}", 2);
+    if (!tmp) {
+        goto error;
     }
+    buf = tmp;
 
-    *out_size = json_size;
-    return json_buf;
+    if (tag_field) {
+        flb_sds_destroy(tag_field);
+    }
+    return buf;
+
+ error_unpack:
+    msgpack_unpacked_destroy(&result);
+ error:
+    flb_errno();
+    if (tag_field) {
+        flb_sds_destroy(tag_field);
+    }
+    flb_sds_destroy(buf);
+    return NULL;
 }
 
 static int cb_kafka_init(struct flb_output_instance *ins,
@@ -197,8 +191,7 @@ static void cb_kafka_flush(void *data, size_t bytes,
                            struct flb_config *config)
 {
     int ret;
-    char *js;
-    size_t js_size;
+    flb_sds_t js;
     size_t b_sent;
     struct flb_http_client *c;
     struct flb_upstream_conn *u_conn;
@@ -214,7 +207,7 @@ static void cb_kafka_flush(void *data, size_t bytes,
     }
 
     /* Convert format */
-    js = kafka_rest_format(data, bytes, tag, tag_len, &js_size, ctx);
+    js = kafka_rest_format(data, bytes, tag, tag_len, ctx);
     if (!js) {
         flb_upstream_conn_release(u_conn);
         FLB_OUTPUT_RETURN(FLB_ERROR);
@@ -222,7 +215,7 @@ static void cb_kafka_flush(void *data, size_t bytes,
 
     /* Compose HTTP Client request */
     c = flb_http_client(u_conn, FLB_HTTP_POST, ctx->uri,
-                        js, js_size, NULL, 0, NULL, 0);
+                        js, flb_sds_len(js), NULL, 0, NULL, 0);
     flb_http_add_header(c, "User-Agent", 10, "Fluent-Bit", 10);
     flb_http_add_header(c,
                         "Content-Type", 12,
@@ -259,14 +252,14 @@ static void cb_kafka_flush(void *data, size_t bytes,
 
     /* Cleanup */
     flb_http_client_destroy(c);
-    flb_free(js);
+    flb_sds_destroy(js);
     flb_upstream_conn_release(u_conn);
     FLB_OUTPUT_RETURN(FLB_OK);
 
     /* Issue a retry */
  retry:
     flb_http_client_destroy(c);
-    flb_free(js);
+    flb_sds_destroy(js);
     flb_upstream_conn_release(u_conn);
     FLB_OUTPUT_RETURN(FLB_RETRY);
 }
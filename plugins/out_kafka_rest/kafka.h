@@ -25,6 +25,9 @@
 #define FLB_KAFKA_TIME_KEYF  "%Y-%m-%dT%H:%M:%S"
 #define FLB_KAFKA_TAG_KEY    "_flb-key"
 
+#include <fluent-bit/flb_sds.h>
+#include <fluent-bit/flb_pack.h>
+
 struct flb_kafka_rest {
     /* Kafka specifics */
     long partition;
@@ -52,6 +55,13 @@ struct flb_kafka_rest {
     /* HTTP URI */
     char uri[256];
 
+    /*
+     * JSON: every record starts with the constant partition and key
+     * fields, the encoder writes the value with the time key first.
+     */
+    flb_sds_t record_head;
+    struct flb_pack_json_enc json_enc;
+
     /* Upstream connection to the backend server */
     struct flb_upstream *u;
 };
@@ -26,9 +26,23 @@
 #include "kafka.h"
 #include "kafka_conf.h"
 
+static int json_head_cat(flb_sds_t *buf, char *str, int len)
+{
+    flb_sds_t tmp;
+
+    tmp = flb_sds_cat(*buf, str, len);
+    if (!tmp) {
+        flb_errno();
+        return -1;
+    }
+    *buf = tmp;
+    return 0;
+}
+
 struct flb_kafka_rest *flb_kr_conf_create(struct flb_output_instance *ins,
                                           struct flb_config *config)
 {
+    int ret;
     long part;
     int io_flags = 0;
     char *tmp;
@@ -181,6 +195,48 @@ struct flb_kafka_rest *flb_kr_conf_create(struct flb_output_instance *ins,
         ctx->message_key_len = 0;
     }
 
+    /* Record head: {"partition":N, "key":"...", "value": */
+    ctx->record_head = flb_sds_create_size(64 + ctx->message_key_len);
+    if (!ctx->record_head) {
+        flb_errno();
+        flb_kr_conf_destroy(ctx);
+        return NULL;
+    }
+    ret = json_head_cat(&ctx->record_head, "{", 1);
+    if (ret == 0 && ctx->partition >= 0) {
+        if (!flb_sds_printf(&ctx->record_head, "\"partition\":%ld, ",
+                            ctx->partition)) {
+            ret = -1;
+        }
+    }
+    if (ret == 0 && ctx->message_key) {
+        ret = json_head_cat(&ctx->record_head, "\"key\":", 6);
+        if (ret == 0) {
+            ret = flb_pack_json_enc_str(&ctx->record_head, ctx->message_key,
+                                        ctx->message_key_len);
+        }
+        if (ret == 0) {
+            ret = json_head_cat(&ctx->record_head, ", ", 2);
+        }
+    }
+    if (ret == 0) {
+        ret = json_head_cat(&ctx->record_head, "\"value\":", 8);
+    }
+    if (ret == -1) {
+        flb_kr_conf_destroy(ctx);
+        return NULL;
+    }
+
+    /* Value: time key in RFC3339 with nanoseconds, then the tag key */
+    ret = flb_pack_json_enc_init(&ctx->json_enc, FLB_PACK_JSON_FORMAT_JSON,
+                                 FLB_PACK_JSON_DATE_ISO8601, ctx->time_key);
+    if (ret == -1) {
+        flb_kr_conf_destroy(ctx);
+        return NULL;
+    }
+    ctx->json_enc.date_strftime = ctx->time_key_format;
+    ctx->json_enc.date_frac = 9;
+
     return ctx;
 }
 
@@ -201,6 +257,11 @@ int flb_kr_conf_destroy(struct flb_kafka_rest *ctx)
         flb_free(ctx->message_key);
     }
 
+    if (ctx->record_head) {
+        flb_sds_destroy(ctx->record_head);
+    }
+    flb_pack_json_enc_destroy(&ctx->json_enc);
+
     flb_upstream_destroy(ctx->u);
     flb_free(ctx);
 
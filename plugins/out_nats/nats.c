@@ -25,6 +25,7 @@
 #include <fluent-bit/flb_time.h>
 
 #include <stdio.h>
+#include <string.h>
 #include <msgpack.h>
 
 #include "nats.h"
@@ -51,7 +52,8 @@ int cb_nats_init(struct flb_output_instance *ins, struct flb_config *config,
         return -1;
     }
 
-    io_flags = FLB_IO_TCP;
+    /* The connection is kept open across flushes */
+    io_flags = FLB_IO_TCP | FLB_IO_TCP_KA;
     if (ins->host.ipv6 == FLB_TRUE) {
         io_flags |= FLB_IO_IPV6;
     }
@@ -60,7 +62,7 @@ int cb_nats_init(struct flb_output_instance *ins, struct flb_config *config,
     upstream = flb_upstream_create(config,
                                    ins->host.name,
                                    ins->host.port,
-                                   FLB_IO_TCP,
+                                   io_flags,
                                    NULL);
     if (!upstream) {
         flb_free(ctx);
@@ -73,82 +75,171 @@ int cb_nats_init(struct flb_output_instance *ins, struct flb_config *config,
     return 0;
 }
 
-static int msgpack_to_json(void *data, size_t bytes,
-                           char *tag, int tag_len,
-                           char **out_json, size_t *out_size)
+/*
+ * Compose a record message: [time, {"tag": "...", k/v...}]. The 'head'
+ * contains the constant part between the time and the record fields.
+ */
+static int nats_record(flb_sds_t *rec, flb_sds_t head,
+                       struct flb_time *tm, msgpack_object *map)
 {
-    int i;
-    int ret;
-    int map_size;
-    size_t off = 0;
-    size_t array_size = 0;
-    msgpack_object map;
-    msgpack_object root;
-    msgpack_object m_key;
-    msgpack_object m_val;
-    msgpack_packer   mp_pck;
-    msgpack_sbuffer  mp_sbuf;
-    msgpack_unpacked result;
-    msgpack_object *obj;
-    struct flb_time tm;
-    char *json_buf;
-    size_t json_size;
+    uint32_t i;
+    msgpack_object_kv *kv;
+    flb_sds_t tmp;
 
-    /* Iterate the original buffer and perform adjustments */
-    msgpack_unpacked_init(&result);
-    while (msgpack_unpack_next(&result, data, bytes, &off) == MSGPACK_UNPACK_SUCCESS) {
-        array_size++;
+    flb_sds_len_set(*rec, 0);
+    tmp = flb_sds_printf(rec, "[%f%s", flb_time_to_double(tm), head);
+    if (!tmp) {
+        return -1;
     }
-    msgpack_unpacked_destroy(&result);
-    msgpack_unpacked_init(&result);
-    off = 0;
 
-    /* Convert MsgPack to JSON */
-    msgpack_sbuffer_init(&mp_sbuf);
-    msgpack_packer_init(&mp_pck, &mp_sbuf, msgpack_sbuffer_write);
-    msgpack_pack_array(&mp_pck, array_size);
+    /* the record fields continue the object started by the tag key */
+    if (map->type == MSGPACK_OBJECT_MAP) {
+        for (i = 0; i < map->via.map.size; i++) {
+            kv = map->via.map.ptr + i;
+            tmp = flb_sds_cat(*rec, ", ", 2);
+            if (!tmp) {
+                return -1;
+            }
+            *rec = tmp;
+            if (flb_pack_json_enc_object(rec, &kv->key) == -1) {
+                return -1;
+            }
+            tmp = flb_sds_cat(*rec, ":", 1);
+            if (!tmp) {
+                return -1;
+            }
+            *rec = tmp;
+            if (flb_pack_json_enc_object(rec, &kv->val) == -1) {
+                return -1;
+            }
+        }
+    }
 
-    while (msgpack_unpack_next(&result, data, bytes, &off) == MSGPACK_UNPACK_SUCCESS) {
+    tmp = flb_sds_cat(*rec, "}]", 2);
+    if (!tmp) {
+        return -1;
+    }
+    *rec = tmp;
+    return 0;
+}
+
+/* Append the PUB of every record to the write buffer until it's full */
+static int nats_publish_batch(void *data, size_t bytes, size_t *off,
+                              char *tag, int tag_len,
+                              flb_sds_t head, flb_sds_t *rec,
+                              flb_sds_t *buf)
+{
+    int ret;
+    int records = 0;
+    struct flb_time tm;
+    msgpack_object *obj;
+    msgpack_unpacked result;
+    flb_sds_t tmp;
+
+    msgpack_unpacked_init(&result);
+    while (flb_sds_len(*buf) < NATS_BUF_SIZE &&
+           msgpack_unpack_next(&result, data, bytes, off) == MSGPACK_UNPACK_SUCCESS) {
         if (result.data.type != MSGPACK_OBJECT_ARRAY) {
             continue;
         }
-        root = result.data;
 
         flb_time_pop_from_msgpack(&tm, &result, &obj);
-        map    = root.via.array.ptr[1];
-        map_size = map.via.map.size;
-
-        msgpack_pack_array(&mp_pck, 2);
-        msgpack_pack_double(&mp_pck, flb_time_to_double(&tm));
-
-        msgpack_pack_map(&mp_pck, map_size + 1);
-        msgpack_pack_str(&mp_pck, 3);
-        msgpack_pack_str_body(&mp_pck, "tag", 3);
-        msgpack_pack_str(&mp_pck, tag_len);
-        msgpack_pack_str_body(&mp_pck, tag, tag_len);
-
-        for (i = 0; i < map_size; i++) {
-            m_key = map.via.map.ptr[i].key;
-            m_val = map.via.map.ptr[i].val;
+        ret = nats_record(rec, head, &tm, obj);
+        if (ret == -1) {
+            msgpack_unpacked_destroy(&result);
+            return -1;
+        }
 
-            msgpack_pack_object(&mp_pck, m_key);
-            msgpack_pack_object(&mp_pck, m_val);
+        /* PUB <subject> <size>\r\n<payload>\r\n */
+        tmp = flb_sds_printf(buf, "PUB %.*s %zu\r\n",
+                             tag_len, tag, flb_sds_len(*rec));
+        if (tmp) {
+            tmp = flb_sds_cat(*buf, *rec, flb_sds_len(*rec));
         }
+        if (tmp) {
+            *buf = tmp;
+            tmp = flb_sds_cat(*buf, "\r\n", 2);
+        }
+        if (!tmp) {
+            msgpack_unpacked_destroy(&result);
+            return -1;
+        }
+        *buf = tmp;
+        records++;
     }
     msgpack_unpacked_destroy(&result);
 
-    ret = flb_msgpack_raw_to_json_str(mp_sbuf.data, mp_sbuf.size,
-                                      &json_buf, &json_size);
-    msgpack_sbuffer_destroy(&mp_sbuf);
+    return records;
+}
 
-    if (ret != 0) {
-        return -1;
-    }
+/*
+ * Read the server replies until the PONG for our PING arrives. The server
+ * may also send INFO, its own PINGs or an -ERR before closing.
+ */
+static int nats_wait_pong(struct flb_upstream_conn *u_conn)
+{
+    int ret;
+    int skip = FLB_FALSE;
+    size_t len = 0;
+    size_t bytes_sent;
+    char buf[1024];
+    char *p;
+    char *line;
+    char *eol;
+
+    while (1) {
+        ret = flb_io_net_read(u_conn, buf + len, sizeof(buf) - len - 1);
+        if (ret <= 0) {
+            flb_error("[out_nats] connection lost waiting for PONG");
+            return -1;
+        }
+        len += ret;
+
+        p = buf;
+        while ((eol = memchr(p, '\n', len - (p - buf)))) {
+            line = p;
+            p = eol + 1;
+
+            if (skip == FLB_TRUE) {
+                skip = FLB_FALSE;
+                continue;
+            }
+
+            if (strncmp(line, "PONG", 4) == 0) {
+                return 0;
+            }
+            else if (strncmp(line, "PING", 4) == 0) {
+                ret = flb_io_net_write(u_conn, NATS_PONG,
+                                       sizeof(NATS_PONG) - 1, &bytes_sent);
+                if (ret == -1) {
+                    return -1;
+                }
+            }
+            else if (strncmp(line, "-ERR", 4) == 0) {
+                flb_error("[out_nats] server error: %.*s",
+                          (int) (eol - line), line);
+                return -1;
+            }
+        }
 
-    *out_json = json_buf;
-    *out_size = json_size;
+        len -= (p - buf);
+        memmove(buf, p, len);
 
-    return 0;
+        /* a line longer than the buffer (e.g: INFO), drop it */
+        if (len == sizeof(buf) - 1) {
+            skip = FLB_TRUE;
+            len = 0;
+        }
+    }
+}
+
+/* Drop the connection so it's not reused after a protocol error */
+static void nats_conn_close(struct flb_upstream_conn *u_conn)
+{
+    if (u_conn->fd > 0) {
+        flb_socket_close(u_conn->fd);
+        u_conn->fd = -1;
+    }
 }
 
 void cb_nats_flush(void *data, size_t bytes,
@@ -158,60 +249,95 @@ void cb_nats_flush(void *data, size_t bytes,
                    struct flb_config *config)
 {
     int ret;
+    int ret_code = FLB_OK;
+    size_t off = 0;
     size_t bytes_sent;
-    size_t json_len;
-    char *json_msg;
-    char *request;
-    int req_len;
+    flb_sds_t head = NULL;
+    flb_sds_t rec = NULL;
+    flb_sds_t buf = NULL;
+    flb_sds_t tmp;
     struct flb_out_nats_config *ctx = out_context;
     struct flb_upstream_conn *u_conn;
 
     u_conn = flb_upstream_conn_get(ctx->u);
     if (!u_conn) {
         flb_error("[out_nats] no upstream connections available");
-        FLB_OUTPUT_RETURN(FLB_ERROR);
+        FLB_OUTPUT_RETURN(FLB_RETRY);
     }
 
-    /* Before to flush the content check if we need to start the handshake */
-    ret = flb_io_net_write(u_conn,
-                           NATS_CONNECT,
-                           sizeof(NATS_CONNECT) - 1,
-                           &bytes_sent);
-    if (ret == -1) {
-        flb_upstream_conn_release(u_conn);
-        FLB_OUTPUT_RETURN(FLB_RETRY);
+    /* Record JSON part shared by the whole chunk: , {"tag":"..." */
+    head = flb_sds_create_size(tag_len + 16);
+    rec = flb_sds_create_size(1024);
+    buf = flb_sds_create_size(bytes * 1.5 < NATS_BUF_SIZE ?
+                              bytes * 1.5 + 64 : NATS_BUF_SIZE + 4096);
+    if (!head || !rec || !buf) {
+        flb_errno();
+        ret_code = FLB_RETRY;
+        goto exit;
     }
 
-    /* Convert original Fluent Bit MsgPack format to JSON */
-    ret = msgpack_to_json(data, bytes, tag, tag_len, &json_msg, &json_len);
+    tmp = flb_sds_cat(head, ", {\"tag\":", 9);
+    if (!tmp) {
+        ret_code = FLB_RETRY;
+        goto exit;
+    }
+    head = tmp;
+    ret = flb_pack_json_enc_str(&head, tag, tag_len);
     if (ret == -1) {
-        flb_upstream_conn_release(u_conn);
-        FLB_OUTPUT_RETURN(FLB_ERROR);
+        ret_code = FLB_RETRY;
+        goto exit;
     }
 
-    /* Compose the NATS Publish request */
-    request = flb_malloc(json_len + tag_len + 32);
-    req_len = snprintf(request, tag_len + 32, "PUB %s %zu\r\n",
-                       tag, json_len);
+    /* A new connection starts with the handshake */
+    if (u_conn->ka_count == 0) {
+        tmp = flb_sds_cat(buf, NATS_CONNECT, sizeof(NATS_CONNECT) - 1);
+        if (!tmp) {
+            ret_code = FLB_RETRY;
+            goto exit;
+        }
+        buf = tmp;
+    }
 
-    /* Append JSON message and ending CRLF */
-    memcpy(request + req_len, json_msg, json_len);
-    req_len += json_len;
-    request[req_len++] = '\r';
-    request[req_len++] = '\n';
-    flb_free(json_msg);
+    while (off < bytes) {
+        ret = nats_publish_batch(data, bytes, &off, tag, tag_len,
+                                 head, &rec, &buf);
+        if (ret == -1) {
+            flb_error("[out_nats] error formatting records");
+            ret_code = FLB_ERROR;
+            goto exit;
+        }
+        if (ret == 0) {
+            break;
+        }
 
-    ret = flb_io_net_write(u_conn, request, req_len, &bytes_sent);
-    if (ret == -1) {
-        perror("write");
-        flb_free(request);
-        flb_upstream_conn_release(u_conn);
-        FLB_OUTPUT_RETURN(FLB_RETRY);
+        /* Flow control: the server answers the PING once it's done */
+        tmp = flb_sds_cat(buf, NATS_PING, sizeof(NATS_PING) - 1);
+        if (!tmp) {
+            ret_code = FLB_RETRY;
+            goto exit;
+        }
+        buf = tmp;
+        ret = flb_io_net_write(u_conn, buf, flb_sds_len(buf), &bytes_sent);
+        if (ret == -1) {
+            ret_code = FLB_RETRY;
+            goto exit;
+        }
+
+        ret = nats_wait_pong(u_conn);
+        if (ret == -1) {
+            nats_conn_close(u_conn);
+            ret_code = FLB_RETRY;
+            goto exit;
+        }
+        flb_sds_len_set(buf, 0);
     }
 
-    flb_free(request);
+ exit:
+    flb_sds_destroy(head);
+    flb_sds_destroy(rec);
+    flb_sds_destroy(buf);
     flb_upstream_conn_release(u_conn);
-    FLB_OUTPUT_RETURN(FLB_OK);
+    FLB_OUTPUT_RETURN(ret_code);
 }
 
 int cb_nats_exit(void *data, struct flb_config *config)
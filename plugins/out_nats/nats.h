@@ -25,6 +25,15 @@
 
 #define NATS_CONNECT "CONNECT {\"verbose\":false,\"pedantic\":false,\"ssl_required\":false,\"name\":\"fluent-bit\",\"lang\":\"c\",\"version\":\"" FLB_VERSION_STR "\"}\r\n"
 
+/*
+ * Publishes are pipelined in a write buffer, once it reaches this size a
+ * PING is appended and the flush waits for the server PONG before going on.
+ */
+#define NATS_BUF_SIZE  (1024 * 1024)
+
+#define NATS_PING      "PING\r\n"
+#define NATS_PONG      "PONG\r\n"
+
 struct flb_out_nats_config {
     struct flb_output_instance *ins;
     struct flb_upstream *u;
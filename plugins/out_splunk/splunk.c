@@ -24,7 +24,12 @@
 #include <fluent-bit/flb_pack.h>
 #include <fluent-bit/flb_utils.h>
 #include <fluent-bit/flb_time.h>
+#include <fluent-bit/flb_time_utils.h>
 #include <msgpack.h>
+#include <jsmn/jsmn.h>
+
+#include <errno.h>
+#include <inttypes.h>
 
 #include "splunk.h"
 #include "splunk_conf.h"
@@ -44,25 +49,23 @@ static int cb_splunk_init(struct flb_output_instance *ins,
     return 0;
 }
 
+/*
+ * Encode the chunk as a batch of HEC events in a single pass: every record
+ * is written straight into the request body, no intermediate msgpack or
+ * JSON buffers are created.
+ */
 int splunk_format(void *in_buf, size_t in_bytes,
                   char **out_buf, size_t *out_size,
                   struct flb_splunk *ctx)
 {
-    int i;
-    int map_size;
+    int ret;
     size_t off = 0;
-    double t;
     struct flb_time tm;
     msgpack_unpacked result;
     msgpack_object root;
     msgpack_object *obj;
     msgpack_object map;
-    msgpack_object k;
-    msgpack_object v;
-    msgpack_sbuffer mp_sbuf;
-    msgpack_packer mp_pck;
     flb_sds_t tmp;
-    flb_sds_t record;
     flb_sds_t json_out;
 
     json_out = flb_sds_create_size(in_bytes * 1.5);
@@ -71,81 +74,251 @@ int splunk_format(void *in_buf, size_t in_bytes,
         return -1;
     }
 
-    /* Iterate the original buffer and perform adjustments */
     msgpack_unpacked_init(&result);
-
     while (msgpack_unpack_next(&result, in_buf, in_bytes, &off) == MSGPACK_UNPACK_SUCCESS) {
         root = result.data;
+        if (root.type != MSGPACK_OBJECT_ARRAY || root.via.array.size != 2) {
+            continue;
+        }
 
         /* Get timestamp */
         flb_time_pop_from_msgpack(&tm, &result, &obj);
-        t = flb_time_to_double(&tm);
-
-        /* Create temporal msgpack buffer */
-        msgpack_sbuffer_init(&mp_sbuf);
-        msgpack_packer_init(&mp_pck, &mp_sbuf, msgpack_sbuffer_write);
-
         map = root.via.array.ptr[1];
-        map_size = map.via.map.size;
 
         if (ctx->splunk_send_raw == FLB_TRUE) {
-            msgpack_pack_map(&mp_pck, 1 + map_size /* time + all k/v */);
-        } else {
-            msgpack_pack_map(&mp_pck, 2 /* time + event */);
+            /* The record fields go to the top level object */
+            ret = flb_pack_json_enc_record(&ctx->json_enc, &json_out,
+                                           &tm, &map);
+            if (ret == -1) {
+                goto error;
+            }
         }
+        else {
+            tmp = flb_sds_printf(&json_out, "{\"%s\":%f, \"%s\":",
+                                 FLB_SPLUNK_DEFAULT_TIME,
+                                 flb_time_to_double(&tm),
+                                 FLB_SPLUNK_DEFAULT_EVENT);
+            if (!tmp) {
+                goto error;
+            }
+
+            ret = flb_pack_json_enc_object(&json_out, &map);
+            if (ret == -1) {
+                goto error;
+            }
 
-        /* Append the time key */
-        msgpack_pack_str(&mp_pck, sizeof(FLB_SPLUNK_DEFAULT_TIME) -1);
-        msgpack_pack_str_body(&mp_pck,
-                              FLB_SPLUNK_DEFAULT_TIME,
-                              sizeof(FLB_SPLUNK_DEFAULT_TIME) - 1);
-        msgpack_pack_double(&mp_pck, t);
-
-        if (ctx->splunk_send_raw == FLB_FALSE) {
-            /* Add k/v pairs under the key 'event' instead of to the top level object */
-            msgpack_pack_str(&mp_pck, sizeof(FLB_SPLUNK_DEFAULT_EVENT) -1);
-            msgpack_pack_str_body(&mp_pck,
-                                  FLB_SPLUNK_DEFAULT_EVENT,
-                                  sizeof(FLB_SPLUNK_DEFAULT_EVENT) - 1);
-            msgpack_pack_map(&mp_pck, map_size);
+            tmp = flb_sds_cat(json_out, "}", 1);
+            if (!tmp) {
+                goto error;
+            }
+            json_out = tmp;
         }
+    }
+    msgpack_unpacked_destroy(&result);
+
+    *out_buf = json_out;
+    *out_size = flb_sds_len(json_out);
+
+    return 0;
+
+ error:
+    flb_errno();
+    msgpack_unpacked_destroy(&result);
+    flb_sds_destroy(json_out);
+    return -1;
+}
+
+#ifdef FLB_OUT_SPLUNK_GZIP
+/* Compress the payload as a gzip stream */
+static int splunk_gzip(struct flb_splunk *ctx, char *in, size_t in_size,
+                       char **out, size_t *out_size)
+{
+    int ret;
+    size_t size;
+    char *buf;
+    z_stream *strm = &ctx->stream;
+
+    ret = deflateReset(strm);
+    if (ret != Z_OK) {
+        return -1;
+    }
+
+    size = deflateBound(strm, in_size);
+    buf = flb_malloc(size);
+    if (!buf) {
+        flb_errno();
+        return -1;
+    }
+
+    strm->next_in = (Bytef *) in;
+    strm->avail_in = in_size;
+    strm->next_out = (Bytef *) buf;
+    strm->avail_out = size;
+
+    ret = deflate(strm, Z_FINISH);
+    if (ret != Z_STREAM_END) {
+        flb_error("[out_splunk] gzip compression failed (%i)", ret);
+        flb_free(buf);
+        return -1;
+    }
+
+    *out = buf;
+    *out_size = strm->total_out;
+    return 0;
+}
+#endif
+
+/* Compare a JSON string token against a NULL terminated string */
+static int splunk_json_token_eq(char *json, jsmntok_t *t, char *str)
+{
+    int len = strlen(str);
+
+    if (t->type != JSMN_STRING || t->end - t->start != len) {
+        return FLB_FALSE;
+    }
+    return strncmp(json + t->start, str, len) == 0;
+}
+
+/*
+ * Look up the key in a flat HEC response and return its value token, e.g:
+ * {"text":"Success","code":0,"ackId":7} or {"acks":{"7":true}}.
+ */
+static jsmntok_t *splunk_json_get(char *json, size_t size,
+                                  jsmntok_t *tokens, int n_tokens,
+                                  char *key)
+{
+    int i;
+    int ret;
+    jsmn_parser parser;
+
+    jsmn_init(&parser);
+    ret = jsmn_parse(&parser, json, size, tokens, n_tokens);
+    if (ret <= 0) {
+        return NULL;
+    }
+
+    for (i = 1; i < ret - 1; i++) {
+        if (splunk_json_token_eq(json, &tokens[i], key) == FLB_TRUE) {
+            return &tokens[i + 1];
+        }
+    }
+    return NULL;
+}
+
+/* Get the ackId returned by Splunk when the events were accepted */
+static int splunk_ack_id(struct flb_http_client *c, uint64_t *ack_id)
+{
+    char *end;
+    jsmntok_t tokens[16];
+    jsmntok_t *t;
+
+    if (c->resp.payload_size == 0) {
+        return -1;
+    }
+
+    t = splunk_json_get(c->resp.payload, c->resp.payload_size,
+                        tokens, 16, "ackId");
+    if (!t || t->type != JSMN_PRIMITIVE) {
+        return -1;
+    }
+
+    errno = 0;
+    *ack_id = strtoull(c->resp.payload + t->start, &end, 10);
+    if (errno != 0 || end == c->resp.payload + t->start) {
+        return -1;
+    }
+    return 0;
+}
+
+static struct flb_http_client *splunk_http_client(struct flb_splunk *ctx,
+                                                  struct flb_upstream_conn *u_conn,
+                                                  char *uri,
+                                                  char *body, size_t size)
+{
+    struct flb_http_client *c;
+
+    c = flb_http_client(u_conn, FLB_HTTP_POST, uri,
+                        body, size, NULL, 0, NULL, 0);
+    if (!c) {
+        return NULL;
+    }
+
+    flb_http_buffer_size(c, FLB_HTTP_DATA_SIZE_MAX);
+    flb_http_add_header(c, "User-Agent", 10, "Fluent-Bit", 10);
+    flb_http_add_header(c, "Authorization", 13,
+                        ctx->auth_header, flb_sds_len(ctx->auth_header));
+    if (ctx->channel) {
+        flb_http_add_header(c, "X-Splunk-Request-Channel", 24,
+                            ctx->channel, flb_sds_len(ctx->channel));
+    }
+    return c;
+}
+
+/*
+ * Poll the acknowledgement endpoint until Splunk confirms the events were
+ * indexed. The coroutine sleeps between polls so the engine keeps running.
+ */
+static int splunk_ack_wait(struct flb_splunk *ctx, uint64_t ack_id,
+                           struct flb_config *config)
+{
+    int ret;
+    int len;
+    int acked = FLB_FALSE;
+    char body[64];
+    char id[32];
+    size_t b_sent;
+    time_t deadline;
+    jsmntok_t tokens[16];
+    jsmntok_t *t;
+    struct flb_upstream_conn *u_conn;
+    struct flb_http_client *c;
+
+    snprintf(id, sizeof(id), "%" PRIu64, ack_id);
+    len = snprintf(body, sizeof(body), "{\"acks\":[%s]}", id);
 
-        /* Append k/v */
-        for (i = 0; i < map_size; i++) {
-            k = map.via.map.ptr[i].key;
-            v = map.via.map.ptr[i].val;
+    deadline = time(NULL) + ctx->ack_timeout;
+    while (acked == FLB_FALSE && time(NULL) < deadline) {
+        flb_time_sleep(FLB_SPLUNK_ACK_INTERVAL, config);
 
-            msgpack_pack_object(&mp_pck, k);
-            msgpack_pack_object(&mp_pck, v);
+        u_conn = flb_upstream_conn_get(ctx->u);
+        if (!u_conn) {
+            continue;
         }
 
-        record = flb_msgpack_raw_to_json_sds(mp_sbuf.data, mp_sbuf.size);
-        if (!record) {
-            flb_errno();
-            msgpack_sbuffer_destroy(&mp_sbuf);
-            msgpack_unpacked_destroy(&result);
-            flb_sds_destroy(json_out);
-            return -1;
+        c = splunk_http_client(ctx, u_conn, ctx->ack_uri, body, len);
+        if (!c) {
+            flb_upstream_conn_release(u_conn);
+            continue;
         }
 
-        tmp = flb_sds_cat(json_out, record, flb_sds_len(record));
-        flb_sds_destroy(record);
-        if (tmp) {
-            json_out = tmp;
+        ret = flb_http_do(c, &b_sent);
+        if (ret != 0) {
+            flb_warn("[out_splunk] ack http_do=%i", ret);
         }
-        else {
-            flb_errno();
-            msgpack_sbuffer_destroy(&mp_sbuf);
-            msgpack_unpacked_destroy(&result);
-            flb_sds_destroy(json_out);
-            return -1;
+        else if (c->resp.status != 200) {
+            flb_warn("[out_splunk] ack http_status=%i", c->resp.status);
+        }
+        else if (c->resp.payload_size > 0) {
+            /* {"acks":{"<id>":true}}, the id is the last key found */
+            t = splunk_json_get(c->resp.payload, c->resp.payload_size,
+                                tokens, 16, id);
+            if (t && t->type == JSMN_PRIMITIVE &&
+                c->resp.payload[t->start] == 't') {
+                acked = FLB_TRUE;
+            }
         }
-        msgpack_sbuffer_destroy(&mp_sbuf);
+
+        flb_http_client_destroy(c);
+        flb_upstream_conn_release(u_conn);
     }
 
-    *out_buf = json_out;
-    *out_size = flb_sds_len(json_out);
+    if (acked == FLB_FALSE) {
+        flb_warn("[out_splunk] no indexer acknowledgement for ackId=%s "
+                 "after %i seconds", id, ctx->ack_timeout);
+        return -1;
+    }
 
+    flb_debug("[out_splunk] ackId=%s indexed", id);
     return 0;
 }
 
@@ -156,68 +329,102 @@ static void cb_splunk_flush(void *data, size_t bytes,
                             struct flb_config *config)
 {
     int ret;
+    int out_ret = FLB_OK;
     size_t b_sent;
     char *buf_data;
     size_t buf_size;
+    char *body;
+    size_t body_size;
+    uint64_t ack_id = 0;
     struct flb_splunk *ctx = out_context;
     struct flb_upstream_conn *u_conn;
     struct flb_http_client *c;
     flb_sds_t payload;
     (void) i_ins;
-    (void) config;
-
-    /* Get upstream connection */
-    u_conn = flb_upstream_conn_get(ctx->u);
-    if (!u_conn) {
-        FLB_OUTPUT_RETURN(FLB_RETRY);
-    }
 
     /* Convert binary logs into a JSON payload */
     ret = splunk_format(data, bytes, &buf_data, &buf_size, ctx);
     if (ret == -1) {
-        flb_upstream_conn_release(u_conn);
         FLB_OUTPUT_RETURN(FLB_ERROR);
     }
     payload = (flb_sds_t) buf_data;
+    body = buf_data;
+    body_size = buf_size;
+
+#ifdef FLB_OUT_SPLUNK_GZIP
+    if (ctx->compress_gzip == FLB_TRUE) {
+        ret = splunk_gzip(ctx, buf_data, buf_size, &body, &body_size);
+        if (ret == -1) {
+            flb_sds_destroy(payload);
+            FLB_OUTPUT_RETURN(FLB_ERROR);
+        }
+        flb_sds_destroy(payload);
+        payload = NULL;
+    }
+#endif
+
+    /* Get upstream connection */
+    u_conn = flb_upstream_conn_get(ctx->u);
+    if (!u_conn) {
+        out_ret = FLB_RETRY;
+        goto cleanup;
+    }
 
     /* Compose HTTP Client request */
-    c = flb_http_client(u_conn, FLB_HTTP_POST, FLB_SPLUNK_DEFAULT_URI,
-                        buf_data, buf_size, NULL, 0, NULL, 0);
-    flb_http_buffer_size(c, FLB_HTTP_DATA_SIZE_MAX);
-    flb_http_add_header(c, "User-Agent", 10, "Fluent-Bit", 10);
+    c = splunk_http_client(ctx, u_conn, FLB_SPLUNK_DEFAULT_URI,
+                           body, body_size);
+    if (!c) {
+        flb_upstream_conn_release(u_conn);
+        out_ret = FLB_RETRY;
+        goto cleanup;
+    }
+    if (ctx->compress_gzip == FLB_TRUE) {
+        flb_http_add_header(c, "Content-Encoding", 16, "gzip", 4);
+    }
 
-    flb_http_add_header(c, "Authorization", 13,
-                        ctx->auth_header, flb_sds_len(ctx->auth_header));
     ret = flb_http_do(c, &b_sent);
     if (ret != 0) {
         flb_warn("[out_splunk] http_do=%i", ret);
-        goto retry;
+        out_ret = FLB_RETRY;
     }
-    else {
-        if (c->resp.status != 200) {
-            if (c->resp.payload_size > 0) {
-                flb_warn("[out_splunk] http_status=%i:\n%s",
-                         c->resp.status, c->resp.payload);
-            }
-            else {
-                flb_warn("[out_splunk] http_status=%i", c->resp.status);
-            }
-            goto retry;
+    else if (c->resp.status != 200) {
+        if (c->resp.payload_size > 0) {
+            flb_warn("[out_splunk] http_status=%i:\n%s",
+                     c->resp.status, c->resp.payload);
+        }
+        else {
+            flb_warn("[out_splunk] http_status=%i", c->resp.status);
+        }
+        out_ret = FLB_RETRY;
+    }
+    else if (ctx->ack == FLB_TRUE) {
+        ret = splunk_ack_id(c, &ack_id);
+        if (ret == -1) {
+            flb_warn("[out_splunk] no ackId in response, is indexer "
+                     "acknowledgement enabled for the token?");
+            out_ret = FLB_RETRY;
         }
     }
 
-    /* Cleanup */
     flb_http_client_destroy(c);
-    flb_sds_destroy(payload);
     flb_upstream_conn_release(u_conn);
-    FLB_OUTPUT_RETURN(FLB_OK);
 
-    /* Issue a retry */
- retry:
-    flb_http_client_destroy(c);
-    flb_sds_destroy(payload);
-    flb_upstream_conn_release(u_conn);
-    FLB_OUTPUT_RETURN(FLB_RETRY);
+    /* Complete the task only once Splunk confirms the events are indexed */
+    if (out_ret == FLB_OK && ctx->ack == FLB_TRUE) {
+        ret = splunk_ack_wait(ctx, ack_id, config);
+        if (ret == -1) {
+            out_ret = FLB_RETRY;
+        }
+    }
+
+ cleanup:
+    if (payload) {
+        flb_sds_destroy(payload);
+    }
+    else {
+        flb_free(body);
+    }
+    FLB_OUTPUT_RETURN(out_ret);
 }
 
 static int cb_splunk_exit(void *data, struct flb_config *config)
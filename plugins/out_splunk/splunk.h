@@ -26,10 +26,20 @@
 #define FLB_SPLUNK_DEFAULT_URI        "/services/collector/event"
 #define FLB_SPLUNK_DEFAULT_TIME       "time"
 #define FLB_SPLUNK_DEFAULT_EVENT      "event"
+#define FLB_SPLUNK_ACK_URI            "/services/collector/ack"
+
+/* Indexer acknowledgement: poll interval (ms) and default timeout (sec) */
+#define FLB_SPLUNK_ACK_INTERVAL       1000
+#define FLB_SPLUNK_ACK_TIMEOUT        60
 
 #include <fluent-bit/flb_info.h>
 #include <fluent-bit/flb_output.h>
 #include <fluent-bit/flb_sds.h>
+#include <fluent-bit/flb_pack.h>
+
+#ifdef FLB_OUT_SPLUNK_GZIP
+#include <zlib.h>
+#endif
 
 struct flb_splunk {
     /* HTTP Auth */
@@ -42,6 +52,24 @@ struct flb_splunk {
     /* Send fields directly or pack data into "event" object */
     int splunk_send_raw;
 
+    /* JSON encoder, the record time goes in the 'time' key */
+    struct flb_pack_json_enc json_enc;
+
+    /* gzip compression of the request body */
+    int compress_gzip;
+#ifdef FLB_OUT_SPLUNK_GZIP
+    z_stream stream;
+#endif
+
+    /*
+     * Indexer acknowledgement: requests carry the channel header and the
+     * flush waits until Splunk confirms the events were indexed.
+     */
+    int ack;
+    int ack_timeout;
+    flb_sds_t channel;
+    flb_sds_t ack_uri;
+
     /* Upstream connection to the backend server */
     struct flb_upstream *u;
 };
@@ -21,12 +21,55 @@
 #include <fluent-bit/flb_info.h>
 #include <fluent-bit/flb_utils.h>
 
+#include <fcntl.h>
+#include <unistd.h>
+
 #include "splunk.h"
 #include "splunk_conf.h"
 
+/* Generate a random UUID (version 4) to be used as the request channel */
+static flb_sds_t channel_create()
+{
+    int fd;
+    ssize_t bytes;
+    unsigned char r[16];
+    flb_sds_t ch;
+    flb_sds_t tmp;
+
+    fd = open("/dev/urandom", O_RDONLY);
+    if (fd == -1) {
+        flb_errno();
+        return NULL;
+    }
+    bytes = read(fd, r, sizeof(r));
+    close(fd);
+    if (bytes != sizeof(r)) {
+        return NULL;
+    }
+
+    r[6] = (r[6] & 0x0f) | 0x40;
+    r[8] = (r[8] & 0x3f) | 0x80;
+
+    ch = flb_sds_create_size(37);
+    if (!ch) {
+        return NULL;
+    }
+    tmp = flb_sds_printf(&ch,
+                         "%02x%02x%02x%02x-%02x%02x-%02x%02x-%02x%02x-"
+                         "%02x%02x%02x%02x%02x%02x",
+                         r[0], r[1], r[2], r[3], r[4], r[5], r[6], r[7],
+                         r[8], r[9], r[10], r[11], r[12], r[13], r[14], r[15]);
+    if (!tmp) {
+        flb_sds_destroy(ch);
+        return NULL;
+    }
+    return ch;
+}
+
 struct flb_splunk *flb_splunk_conf_create(struct flb_output_instance *ins,
                                           struct flb_config *config)
 {
+    int ret;
     int io_flags = 0;
     char *tmp;
     flb_sds_t t;
@@ -123,6 +166,82 @@ struct flb_splunk *flb_splunk_conf_create(struct flb_output_instance *ins,
         ctx->splunk_send_raw = FLB_FALSE;
     }
 
+    /* Compress the payload: 'compress gzip' */
+    tmp = flb_output_get_property("compress", ins);
+    if (tmp) {
+        if (strcasecmp(tmp, "gzip") != 0) {
+            flb_error("[out_splunk] invalid compress value '%s'", tmp);
+            flb_splunk_conf_destroy(ctx);
+            return NULL;
+        }
+#ifdef FLB_OUT_SPLUNK_GZIP
+        ret = deflateInit2(&ctx->stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+                           31 /* gzip */, 8, Z_DEFAULT_STRATEGY);
+        if (ret != Z_OK) {
+            flb_error("[out_splunk] cannot initialize gzip compression");
+            flb_splunk_conf_destroy(ctx);
+            return NULL;
+        }
+        ctx->compress_gzip = FLB_TRUE;
+#else
+        flb_error("[out_splunk] gzip compression is not available, "
+                  "built without zlib");
+        flb_splunk_conf_destroy(ctx);
+        return NULL;
+#endif
+    }
+
+    /* Request channel, required by indexer acknowledgement */
+    tmp = flb_output_get_property("channel", ins);
+    if (tmp) {
+        ctx->channel = flb_sds_create(tmp);
+    }
+
+    /* Indexer acknowledgement */
+    tmp = flb_output_get_property("splunk_ack", ins);
+    if (tmp) {
+        ctx->ack = flb_utils_bool(tmp);
+    }
+    else {
+        ctx->ack = FLB_FALSE;
+    }
+
+    tmp = flb_output_get_property("ack_timeout", ins);
+    if (tmp) {
+        ctx->ack_timeout = atoi(tmp);
+    }
+    if (ctx->ack_timeout <= 0) {
+        ctx->ack_timeout = FLB_SPLUNK_ACK_TIMEOUT;
+    }
+
+    if (ctx->ack == FLB_TRUE) {
+        if (!ctx->channel) {
+            ctx->channel = channel_create();
+            if (!ctx->channel) {
+                flb_error("[out_splunk] cannot create request channel");
+                flb_splunk_conf_destroy(ctx);
+                return NULL;
+            }
+        }
+        ctx->ack_uri = flb_sds_create_size(64);
+        if (!ctx->ack_uri ||
+            !flb_sds_printf(&ctx->ack_uri, "%s?channel=%s",
+                            FLB_SPLUNK_ACK_URI, ctx->channel)) {
+            flb_splunk_conf_destroy(ctx);
+            return NULL;
+        }
+        flb_info("[out_splunk] indexer acknowledgement on channel %s",
+                 ctx->channel);
+    }
+
+    ret = flb_pack_json_enc_init(&ctx->json_enc, FLB_PACK_JSON_FORMAT_STREAM,
+                                 FLB_PACK_JSON_DATE_DOUBLE,
+                                 FLB_SPLUNK_DEFAULT_TIME);
+    if (ret == -1) {
+        flb_splunk_conf_destroy(ctx);
+        return NULL;
+    }
+
     return ctx;
 }
 
@@ -133,6 +252,7 @@ int flb_splunk_conf_destroy(struct flb_splunk *ctx)
         return -1;
     }
 
+    flb_pack_json_enc_destroy(&ctx->json_enc);
     if (ctx->auth_header) {
         flb_sds_destroy(ctx->auth_header);
     }
@@ -142,7 +262,20 @@ int flb_splunk_conf_destroy(struct flb_splunk *ctx)
     if (ctx->http_passwd) {
         flb_free(ctx->http_passwd);
     }
-    flb_upstream_destroy(ctx->u);
+    if (ctx->channel) {
+        flb_sds_destroy(ctx->channel);
+    }
+    if (ctx->ack_uri) {
+        flb_sds_destroy(ctx->ack_uri);
+    }
+#ifdef FLB_OUT_SPLUNK_GZIP
+    if (ctx->compress_gzip == FLB_TRUE) {
+        deflateEnd(&ctx->stream);
+    }
+#endif
+    if (ctx->u) {
+        flb_upstream_destroy(ctx->u);
+    }
     flb_free(ctx);
 
     return 0;
@@ -92,7 +92,7 @@ static int fetch_metadata(struct flb_upstream *ctx, char *uri,
     return ret_code;
 }
 
-int gce_metadata_read_token(struct flb_stackdriver *ctx)
+int gce_metadata_read_token(struct flb_stackdriver *ctx, struct flb_oauth2 *o)
 {
     int ret;
     flb_sds_t uri = flb_sds_create(FLB_STD_METADATA_SERVICE_ACCOUNT_URI);
@@ -108,7 +108,7 @@ int gce_metadata_read_token(struct flb_stackdriver *ctx)
         return -1;
     }
 
-    ret = flb_oauth2_parse_json_response(payload, flb_sds_len(payload), ctx->o);
+    ret = flb_oauth2_parse_json_response(payload, flb_sds_len(payload), o);
     flb_sds_destroy(payload);
     flb_sds_destroy(uri);
 
@@ -116,7 +116,7 @@ int gce_metadata_read_token(struct flb_stackdriver *ctx)
         flb_error("[out_stackdriver] unable to parse token body");
         return -1;
     }
-    ctx->o->expires = time(NULL) + ctx->o->expires_in;
+    o->expires = time(NULL) + o->expires_in;
     return 0;
 }
 
@@ -34,7 +34,7 @@
 /* Service account metadata URI */
 #define FLB_STD_METADATA_SERVICE_ACCOUNT_URI "/computeMetadata/v1/instance/service-accounts/"
 
-int gce_metadata_read_token(struct flb_stackdriver *ctx);
+int gce_metadata_read_token(struct flb_stackdriver *ctx, struct flb_oauth2 *o);
 int gce_metadata_read_zone(struct flb_stackdriver *ctx);
 int gce_metadata_read_project_id(struct flb_stackdriver *ctx);
 int gce_metadata_read_instance_id(struct flb_stackdriver *ctx);
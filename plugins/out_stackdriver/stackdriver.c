@@ -186,8 +186,11 @@ static int jwt_encode(char *payload, char *secret,
     return 0;
 }
 
-/* Create a new oauth2 context and get a oauth2 token */
-static int get_oauth2_token(struct flb_stackdriver *ctx)
+/*
+ * Create a new oauth2 context and get a oauth2 token. This callback runs in
+ * the background thread that refreshes the shared token.
+ */
+static struct flb_oauth2 *oauth2_token_create(void *data)
 {
     int ret;
     char *token;
@@ -196,17 +199,24 @@ static int get_oauth2_token(struct flb_stackdriver *ctx)
     time_t issued;
     time_t expires;
     char payload[1024];
+    struct flb_oauth2 *o;
+    struct flb_stackdriver *ctx = data;
 
     /* Create oauth2 context */
-    ctx->o = flb_oauth2_create(ctx->config, FLB_STD_AUTH_URL, 3000);
-    if (!ctx->o) {
+    o = flb_oauth2_create(ctx->config, FLB_STD_AUTH_URL, 3000);
+    if (!o) {
       flb_error("[out_stackdriver] cannot create oauth2 context");
-      return -1;
+      return NULL;
     }
 
     /* In case of using metadata server, fetch token from there */
     if (ctx->metadata_server_auth) {
-        return gce_metadata_read_token(ctx);
+        ret = gce_metadata_read_token(ctx, o);
+        if (ret != 0) {
+            flb_oauth2_destroy(o);
+            return NULL;
+        }
+        return o;
     }
 
     /* JWT encode for oauth2 */
@@ -224,63 +234,159 @@ static int get_oauth2_token(struct flb_stackdriver *ctx)
     ret = jwt_encode(payload, ctx->private_key, &sig_data, &sig_size);
     if (ret != 0) {
         flb_error("[out_stackdriver] JWT signature generation failed");
-        return -1;
+        flb_oauth2_destroy(o);
+        return NULL;
     }
     flb_debug("[out_stackdriver] JWT signature:\n%s", sig_data);
 
-    ret = flb_oauth2_payload_append(ctx->o,
+    ret = flb_oauth2_payload_append(o,
                                     "grant_type", -1,
                                     "urn:ietf:params:oauth:"
                                     "grant-type:jwt-bearer", -1);
     if (ret == -1) {
         flb_error("[out_stackdriver] error appending oauth2 params");
         flb_sds_destroy(sig_data);
-        return -1;
+        flb_oauth2_destroy(o);
+        return NULL;
     }
 
-    ret = flb_oauth2_payload_append(ctx->o,
+    ret = flb_oauth2_payload_append(o,
                                     "assertion", -1,
                                     sig_data, sig_size);
     if (ret == -1) {
         flb_error("[out_stackdriver] error appending oauth2 params");
         flb_sds_destroy(sig_data);
-        return -1;
+        flb_oauth2_destroy(o);
+        return NULL;
     }
     flb_sds_destroy(sig_data);
 
     /* Retrieve access token */
-    token = flb_oauth2_token_get(ctx->o);
+    token = flb_oauth2_token_get(o);
     if (!token) {
         flb_error("[out_stackdriver] error retrieving oauth2 access token");
+        flb_oauth2_destroy(o);
+        return NULL;
+    }
+
+    return o;
+}
+
+/*
+ * Register the instance as user of the token shared by the instances with
+ * the same credentials, it's refreshed in background before it expires.
+ */
+static int oauth2_token_register(struct flb_stackdriver *ctx)
+{
+    flb_sds_t key;
+
+    key = flb_sds_create_size(256);
+    if (!key) {
+        flb_errno();
+        return -1;
+    }
+    flb_sds_printf(&key, "%s %s %s",
+                   ctx->metadata_server_auth ? "metadata" : "jwt",
+                   FLB_STD_SCOPE,
+                   ctx->client_email ? ctx->client_email : "");
+
+    ctx->oauth2 = flb_oauth2_shared_get(ctx->config, key,
+                                        oauth2_token_create, ctx);
+    flb_sds_destroy(key);
+    if (!ctx->oauth2) {
         return -1;
     }
 
     return 0;
 }
 
-static char *get_google_token(struct flb_stackdriver *ctx)
+static int json_cat(flb_sds_t *buf, char *str, int len)
 {
-    int ret = 0;
+    flb_sds_t tmp;
 
-    if (!ctx->o) {
-        ret = get_oauth2_token(ctx);
+    tmp = flb_sds_cat(*buf, str, len);
+    if (!tmp) {
+        flb_errno();
+        return -1;
     }
-    else if (flb_oauth2_token_expired(ctx->o) == FLB_TRUE) {
-        flb_oauth2_destroy(ctx->o);
-        ret = get_oauth2_token(ctx);
+    *buf = tmp;
+    return 0;
+}
+
+/* Append a "key":"value" pair, 'value' can be NULL */
+static int json_kv_append(flb_sds_t *buf, char *key, flb_sds_t val)
+{
+    int ret;
+
+    ret = flb_pack_json_enc_str(buf, key, strlen(key));
+    if (ret == 0) {
+        ret = json_cat(buf, ":", 1);
+    }
+    if (ret == 0) {
+        ret = flb_pack_json_enc_str(buf, val ? val : "",
+                                    val ? flb_sds_len(val) : 0);
     }
+    return ret;
+}
 
-    if (ret != 0) {
+/*
+ * Compose the constant head of every request, the resource does not change
+ * across records and chunks:
+ *
+ * {"resource": {"type": "...", "labels": {...}}, "entries": [
+ */
+static flb_sds_t stackdriver_request_head(struct flb_stackdriver *ctx)
+{
+    int ret;
+    flb_sds_t buf;
+
+    buf = flb_sds_create_size(256);
+    if (!buf) {
+        flb_errno();
         return NULL;
     }
 
-    return ctx->o->access_token;
+    ret = json_cat(&buf, "{\"resource\":{", 13);
+    if (ret == 0) {
+        ret = json_kv_append(&buf, "type", ctx->resource);
+    }
+    if (ret == 0) {
+        ret = json_cat(&buf, ",\"labels\":{", 11);
+    }
+    if (ret == 0 && (strcmp(ctx->resource, "global") == 0 ||
+                     strcmp(ctx->resource, "gce_instance") == 0)) {
+        /* both resources have the field project_id */
+        ret = json_kv_append(&buf, "project_id", ctx->project_id);
+    }
+    if (ret == 0 && strcmp(ctx->resource, "gce_instance") == 0) {
+        /* gce_instance resource has fields project_id, zone, instance_id */
+        ret = json_cat(&buf, ",", 1);
+        if (ret == 0) {
+            ret = json_kv_append(&buf, "zone", ctx->zone);
+        }
+        if (ret == 0) {
+            ret = json_cat(&buf, ",", 1);
+        }
+        if (ret == 0) {
+            ret = json_kv_append(&buf, "instance_id", ctx->instance_id);
+        }
+    }
+    if (ret == 0) {
+        ret = json_cat(&buf, "}},\"entries\":[", 14);
+    }
+
+    if (ret == -1) {
+        flb_sds_destroy(buf);
+        return NULL;
+    }
+    return buf;
 }
 
 static int cb_stackdriver_init(struct flb_output_instance *ins,
                           struct flb_config *config, void *data)
 {
-    char *token;
+    int ret;
+    flb_sds_t token;
     struct flb_stackdriver *ctx;
 
     /* Create config context */
@@ -311,173 +417,134 @@ static int cb_stackdriver_init(struct flb_output_instance *ins,
     ctx->u->flags &= ~FLB_IO_ASYNC;
     ctx->metadata_u->flags &= ~FLB_IO_ASYNC;
 
-    /* Retrieve oauth2 token */
-    token = get_google_token(ctx);
+    /* Retrieve oauth2 token and start the background refresh */
+    ret = oauth2_token_register(ctx);
+    if (ret == -1) {
+        flb_error("[out_stackdriver] cannot register oauth2 token");
+        return -1;
+    }
+
+    token = flb_oauth2_shared_token(ctx->oauth2);
     if (!token) {
         flb_warn("[out_stackdriver] token retrieval failed");
     }
+    flb_sds_destroy(token);
     if (ctx->metadata_server_auth) {
       gce_metadata_read_project_id(ctx);
       gce_metadata_read_zone(ctx);
       gce_metadata_read_instance_id(ctx);
     }
+
+    /* The resource is constant, compose the head of the requests once */
+    ctx->request_head = stackdriver_request_head(ctx);
+    if (!ctx->request_head) {
+        flb_error("[out_stackdriver] cannot compose request resource");
+        return -1;
+    }
+
+    flb_pack_json_enc_init(&ctx->json_enc, FLB_PACK_JSON_FORMAT_JSON,
+                           FLB_PACK_JSON_DATE_ISO8601, NULL);
+    ctx->json_enc.date_strftime = FLB_STD_TIME_FMT;
+    ctx->json_enc.date_frac = 9;
     return 0;
 }
 
+/*
+ * Write the entries JSON directly into the request body, starting at the
+ * record found at offset 'off'. Records are added until the request would
+ * exceed FLB_STD_MAX_REQUEST_SIZE, in which case 'off' is left pointing to
+ * the first record not included so the caller can send the remaining ones
+ * in another request. Returns the number of entries written or -1.
+ */
 static int stackdriver_format(void *data, size_t bytes,
-                              char *tag, size_t tag_len,
-                              char **out_data, size_t *out_size,
+                              flb_sds_t log_name, size_t *off,
+                              flb_sds_t *body,
                               struct flb_stackdriver *ctx)
 {
     int ret;
-    int len;
-    int array_size = 0;
-    size_t s;
-    size_t off = 0;
-    char path[PATH_MAX];
-    char time_formatted[255];
-    struct tm tm;
+    int entries = 0;
+    size_t prev_off;
+    size_t prev_len;
     struct flb_time tms;
     msgpack_object *obj;
     msgpack_unpacked result;
-    msgpack_sbuffer mp_sbuf;
-    msgpack_packer mp_pck;
-    char *json_buf;
-    size_t json_size;
 
-    /* Count number of records */
-    msgpack_unpacked_init(&result);
-    while (msgpack_unpack_next(&result, data, bytes, &off) == MSGPACK_UNPACK_SUCCESS) {
-        array_size++;
+    flb_sds_len_set(*body, 0);
+    ret = json_cat(body, ctx->request_head, flb_sds_len(ctx->request_head));
+    if (ret == -1) {
+        return -1;
     }
-    msgpack_unpacked_destroy(&result);
-    msgpack_unpacked_init(&result);
 
-    /* Create temporal msgpack buffer */
-    msgpack_sbuffer_init(&mp_sbuf);
-    msgpack_packer_init(&mp_pck, &mp_sbuf, msgpack_sbuffer_write);
+    msgpack_unpacked_init(&result);
+    prev_off = *off;
+    while (msgpack_unpack_next(&result, data, bytes, off) == MSGPACK_UNPACK_SUCCESS) {
+        prev_len = flb_sds_len(*body);
 
-    /*
-     * Pack root map (resource & entries):
-     *
-     * {"resource": {"type": "...", "labels": {...},
-     *  "entries": []
-     */
-    msgpack_pack_map(&mp_pck, 2);
-
-    msgpack_pack_str(&mp_pck, 8);
-    msgpack_pack_str_body(&mp_pck, "resource", 8);
-
-    /* type & labels */
-    msgpack_pack_map(&mp_pck, 2);
-
-    /* type */
-    msgpack_pack_str(&mp_pck, 4);
-    msgpack_pack_str_body(&mp_pck, "type", 4);
-    msgpack_pack_str(&mp_pck, flb_sds_len(ctx->resource));
-    msgpack_pack_str_body(&mp_pck, ctx->resource,
-                          flb_sds_len(ctx->resource));
-
-    msgpack_pack_str(&mp_pck, 6);
-    msgpack_pack_str_body(&mp_pck, "labels", 6);
-
-    if (strcmp(ctx->resource, "global") == 0) {
-      /* global resource has field project_id */
-      msgpack_pack_map(&mp_pck, 1);
-      msgpack_pack_str(&mp_pck, 10);
-      msgpack_pack_str_body(&mp_pck, "project_id", 10);
-      msgpack_pack_str(&mp_pck, flb_sds_len(ctx->project_id));
-      msgpack_pack_str_body(&mp_pck,
-                            ctx->project_id, flb_sds_len(ctx->project_id));
-    } else if (strcmp(ctx->resource, "gce_instance") == 0) {
-      /* gce_instance resource has fields project_id, zone, instance_id */
-      msgpack_pack_map(&mp_pck, 3);
-
-      msgpack_pack_str(&mp_pck, 10);
-      msgpack_pack_str_body(&mp_pck, "project_id", 10);
-      msgpack_pack_str(&mp_pck, flb_sds_len(ctx->project_id));
-      msgpack_pack_str_body(&mp_pck,
-                            ctx->project_id, flb_sds_len(ctx->project_id));
-
-      msgpack_pack_str(&mp_pck, 4);
-      msgpack_pack_str_body(&mp_pck, "zone", 4);
-      msgpack_pack_str(&mp_pck, flb_sds_len(ctx->zone));
-      msgpack_pack_str_body(&mp_pck, ctx->zone, flb_sds_len(ctx->zone));
-
-      msgpack_pack_str(&mp_pck, 11);
-      msgpack_pack_str_body(&mp_pck, "instance_id", 11);
-      msgpack_pack_str(&mp_pck, flb_sds_len(ctx->instance_id));
-      msgpack_pack_str_body(&mp_pck,
-                            ctx->instance_id, flb_sds_len(ctx->instance_id));
-    }
-
-    msgpack_pack_str(&mp_pck, 7);
-    msgpack_pack_str_body(&mp_pck, "entries", 7);
-
-    /* Append entries */
-    msgpack_pack_array(&mp_pck, array_size);
-
-    off = 0;
-    while (msgpack_unpack_next(&result, data, bytes, &off) == MSGPACK_UNPACK_SUCCESS) {
         /* Get timestamp */
         flb_time_pop_from_msgpack(&tms, &result, &obj);
 
         /*
-         * Pack entry
+         * Entry
          *
          * {
-         *  "logName": "...",
          *  "jsonPayload": {...},
+         *  "logName": "...",
          *  "timestamp": "..."
          * }
          */
-        msgpack_pack_map(&mp_pck, 3);
-
-        /* jsonPayload */
-        msgpack_pack_str(&mp_pck, 11);
-        msgpack_pack_str_body(&mp_pck, "jsonPayload", 11);
-        msgpack_pack_object(&mp_pck, *obj);
-
-        /* logName */
-        len = snprintf(path, sizeof(path) - 1,
-                       "projects/%s/logs/%s", ctx->project_id, tag);
-
-        msgpack_pack_str(&mp_pck, 7);
-        msgpack_pack_str_body(&mp_pck, "logName", 7);
-        msgpack_pack_str(&mp_pck, len);
-        msgpack_pack_str_body(&mp_pck, path, len);
-
-        /* timestamp */
-        msgpack_pack_str(&mp_pck, 9);
-        msgpack_pack_str_body(&mp_pck, "timestamp", 9);
+        ret = json_cat(body, entries > 0 ? ",{\"jsonPayload\":" :
+                       "{\"jsonPayload\":", entries > 0 ? 16 : 15);
+        if (ret == 0) {
+            ret = flb_pack_json_enc_object(body, obj);
+        }
+        if (ret == 0) {
+            ret = json_cat(body, ",\"logName\":", 11);
+        }
+        if (ret == 0) {
+            ret = json_cat(body, log_name, flb_sds_len(log_name));
+        }
+        if (ret == 0) {
+            ret = json_cat(body, ",\"timestamp\":", 13);
+        }
+        if (ret == 0) {
+            ret = flb_pack_json_enc_date(&ctx->json_enc, body, &tms);
+        }
+        if (ret == 0) {
+            ret = json_cat(body, "}", 1);
+        }
+        if (ret == -1) {
+            msgpack_unpacked_destroy(&result);
+            return -1;
+        }
 
-        /* Format the time */
-        gmtime_r(&tms.tm.tv_sec, &tm);
-        s = strftime(time_formatted, sizeof(time_formatted) - 1,
-                     FLB_STD_TIME_FMT, &tm);
-        len = snprintf(time_formatted + s, sizeof(time_formatted) - 1 - s,
-                       ".%09" PRIu64 "Z", (uint64_t) tms.tm.tv_nsec);
-        s += len;
+        /* Keep the request under the API size limit */
+        if (flb_sds_len(*body) + 2 > FLB_STD_MAX_REQUEST_SIZE) {
+            if (entries > 0) {
+                /* leave this record for the next request */
+                flb_sds_len_set(*body, prev_len);
+                *off = prev_off;
+                break;
+            }
+            /* a single entry above the limit is rejected by the API */
+            flb_error("[out_stackdriver] record of %lu bytes exceeds the "
+                      "request size limit, dropping it",
+                      flb_sds_len(*body) - prev_len);
+            flb_sds_len_set(*body, prev_len);
+            prev_off = *off;
+            continue;
+        }
 
-        msgpack_pack_str(&mp_pck, s);
-        msgpack_pack_str_body(&mp_pck, time_formatted, s);
+        entries++;
+        prev_off = *off;
     }
+    msgpack_unpacked_destroy(&result);
 
-    /* Convert from msgpack to JSON */
-    ret = flb_msgpack_raw_to_json_str(mp_sbuf.data, mp_sbuf.size,
-                                      &json_buf, &json_size);
-    msgpack_sbuffer_destroy(&mp_sbuf);
-
-    if (ret != 0) {
-        flb_error("[out_stackdriver] error formatting JSON payload");
-        msgpack_unpacked_destroy(&result);
+    ret = json_cat(body, "]}", 2);
+    if (ret == -1) {
         return -1;
     }
 
-    *out_data = json_buf;
-    *out_size = json_size;
-
-    return 0;
+    return entries;
 }
 
 static void set_authorization_header(struct flb_http_client *c,
@@ -491,50 +558,33 @@ static void set_authorization_header(struct flb_http_client *c,
     flb_http_add_header(c, "Authorization", 13, header, len);
 }
 
-static void cb_stackdriver_flush(void *data, size_t bytes,
-                            char *tag, int tag_len,
-                            struct flb_input_instance *i_ins,
-                            void *out_context,
-                            struct flb_config *config)
+/* Send one request, returns FLB_OK or FLB_RETRY */
+static int stackdriver_send(struct flb_stackdriver *ctx, flb_sds_t body)
 {
-    (void) i_ins;
-    (void) config;
     int ret;
     int ret_code = FLB_RETRY;
     size_t b_sent;
-    char *token;
-    char *payload_buf;
-    size_t payload_size;
-    struct flb_stackdriver *ctx = out_context;
+    flb_sds_t token;
     struct flb_upstream_conn *u_conn;
     struct flb_http_client *c;
 
     /* Get upstream connection */
     u_conn = flb_upstream_conn_get(ctx->u);
     if (!u_conn) {
-        FLB_OUTPUT_RETURN(FLB_RETRY);
+        return FLB_RETRY;
     }
 
-    /* Reformat msgpack to stackdriver JSON payload */
-    ret = stackdriver_format(data, bytes, tag, tag_len,
-                             &payload_buf, &payload_size, ctx);
-    if (ret != 0) {
-        flb_upstream_conn_release(u_conn);
-        FLB_OUTPUT_RETURN(FLB_RETRY);
-    }
-
-    /* Get or renew Token */
-    token = get_google_token(ctx);
+    /* Get the current token, it's renewed in background */
+    token = flb_oauth2_shared_token(ctx->oauth2);
     if (!token) {
         flb_error("[out_stackdriver] cannot retrieve oauth2 token");
         flb_upstream_conn_release(u_conn);
-        flb_free(payload_buf);
-        FLB_OUTPUT_RETURN(FLB_RETRY);
+        return FLB_RETRY;
     }
 
     /* Compose HTTP Client request */
     c = flb_http_client(u_conn, FLB_HTTP_POST, FLB_STD_WRITE_URI,
-                        payload_buf, payload_size, NULL, 0, NULL, 0);
+                        body, flb_sds_len(body), NULL, 0, NULL, 0);
 
     flb_http_buffer_size(c, 4192);
 
@@ -543,6 +593,7 @@ static void cb_stackdriver_flush(void *data, size_t bytes,
 
     /* Compose and append Authorization header */
     set_authorization_header(c, token);
+    flb_sds_destroy(token);
 
     /* Send HTTP request */
     ret = flb_http_do(c, &b_sent);
@@ -572,11 +623,86 @@ static void cb_stackdriver_flush(void *data, size_t bytes,
         }
     }
 
-    /* Cleanup */
-    flb_free(payload_buf);
     flb_http_client_destroy(c);
     flb_upstream_conn_release(u_conn);
 
+    return ret_code;
+}
+
+static void cb_stackdriver_flush(void *data, size_t bytes,
+                            char *tag, int tag_len,
+                            struct flb_input_instance *i_ins,
+                            void *out_context,
+                            struct flb_config *config)
+{
+    (void) i_ins;
+    (void) config;
+    int ret;
+    int ret_code = FLB_OK;
+    size_t off = 0;
+    size_t prev_off;
+    size_t size;
+    char path[PATH_MAX];
+    flb_sds_t log_name;
+    flb_sds_t body;
+    struct flb_stackdriver *ctx = out_context;
+
+    /* logName is the same for every entry of the chunk */
+    ret = snprintf(path, sizeof(path) - 1,
+                   "projects/%s/logs/%.*s", ctx->project_id, tag_len, tag);
+    log_name = flb_sds_create_size(ret + 16);
+    if (!log_name) {
+        flb_errno();
+        FLB_OUTPUT_RETURN(FLB_RETRY);
+    }
+    ret = flb_pack_json_enc_str(&log_name, path, ret);
+    if (ret == -1) {
+        flb_sds_destroy(log_name);
+        FLB_OUTPUT_RETURN(FLB_RETRY);
+    }
+
+    size = bytes * 1.5;
+    if (size > FLB_STD_MAX_REQUEST_SIZE) {
+        size = FLB_STD_MAX_REQUEST_SIZE;
+    }
+    body = flb_sds_create_size(size);
+    if (!body) {
+        flb_errno();
+        flb_sds_destroy(log_name);
+        FLB_OUTPUT_RETURN(FLB_RETRY);
+    }
+
+    /*
+     * Large chunks are split in several requests. If one of them fails the
+     * whole chunk is retried, the entries already sent are delivered again.
+     */
+    while (off < bytes) {
+        prev_off = off;
+
+        /* Reformat msgpack to stackdriver JSON payload */
+        ret = stackdriver_format(data, bytes, log_name, &off, &body, ctx);
+        if (ret == -1) {
+            flb_error("[out_stackdriver] error formatting JSON payload");
+            ret_code = FLB_RETRY;
+            break;
+        }
+        if (ret == 0) {
+            if (off == prev_off) {
+                /* nothing left that can be unpacked */
+                break;
+            }
+            continue;
+        }
+
+        ret_code = stackdriver_send(ctx, body);
+        if (ret_code != FLB_OK) {
+            break;
+        }
+    }
+
+    flb_sds_destroy(body);
+    flb_sds_destroy(log_name);
+
     /* Done */
     FLB_OUTPUT_RETURN(ret_code);
 }
@@ -25,6 +25,7 @@
 #include <fluent-bit/flb_output.h>
 #include <fluent-bit/flb_oauth2.h>
 #include <fluent-bit/flb_sds.h>
+#include <fluent-bit/flb_pack.h>
 
 /* refresh token every 50 minutes */
 #define FLB_STD_TOKEN_REFRESH 3000
@@ -40,6 +41,9 @@
 #define FLB_STD_WRITE_URL \
     "https://logging.googleapis.com" FLB_STD_WRITE_URI
 
+/* Maximum size of an entries.write request */
+#define FLB_STD_MAX_REQUEST_SIZE  (10 * 1024 * 1024)
+
 /* Timestamp format */
 #define FLB_STD_TIME_FMT  "%Y-%m-%dT%H:%M:%S"
 
@@ -69,8 +73,14 @@ struct flb_stackdriver {
     /* other */
     flb_sds_t resource;
 
-    /* oauth2 context */
-    struct flb_oauth2 *o;
+    /* JSON head of every request: the resource and the entries key */
+    flb_sds_t request_head;
+
+    /* JSON encoder, formats the entries timestamp (RFC3339, nanoseconds) */
+    struct flb_pack_json_enc json_enc;
+
+    /* oauth2 token shared with the instances using the same credentials */
+    struct flb_oauth2_shared *oauth2;
 
     /* upstream context for stackdriver write end-point */
     struct flb_upstream *u;
@@ -288,6 +288,11 @@ int flb_stackdriver_conf_destroy(struct flb_stackdriver *ctx)
         return -1;
     }
 
+    /* Stop using the shared token before releasing the credentials */
+    if (ctx->oauth2) {
+        flb_oauth2_shared_release(ctx->oauth2, ctx);
+    }
+
     flb_sds_destroy(ctx->credentials_file);
     flb_sds_destroy(ctx->type);
     flb_sds_destroy(ctx->project_id);
@@ -298,10 +303,9 @@ int flb_stackdriver_conf_destroy(struct flb_stackdriver *ctx)
     flb_sds_destroy(ctx->auth_uri);
     flb_sds_destroy(ctx->token_uri);
     flb_sds_destroy(ctx->resource);
+    flb_sds_destroy(ctx->request_head);
+    flb_pack_json_enc_destroy(&ctx->json_enc);
 
-    if (ctx->o) {
-        flb_oauth2_destroy(ctx->o);
-    }
     if (ctx->metadata_server_auth) {
       flb_sds_destroy(ctx->zone);
       flb_sds_destroy(ctx->instance_id);
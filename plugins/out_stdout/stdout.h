@@ -24,16 +24,13 @@
 #define FLB_STDOUT_OUT_MSGPACK      0
 #define FLB_STDOUT_OUT_JSON_LINES   1
 
-#define FLB_STDOUT_JSON_DATE_DOUBLE      0
-#define FLB_STDOUT_JSON_DATE_ISO8601     1
-#define FLB_STDOUT_JSON_DATE_ISO8601_FMT "%Y-%m-%dT%H:%M:%S"
+#include <fluent-bit/flb_pack.h>
 
 struct flb_out_stdout_config {
     int out_format;
 
-    int json_date_format;
-    char *json_date_key;
-    size_t json_date_key_len;
+    /* JSON encoder: date format and key */
+    struct flb_pack_json_enc json_enc;
 };
 
 #endif
@@ -0,0 +1,137 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2019      The Fluent Bit Authors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_output.h>
+#include <fluent-bit/flb_pack.h>
+#include <msgpack.h>
+
+#include "tcp.h"
+#include "tcp_conf.h"
+
+static int cb_tcp_init(struct flb_output_instance *ins,
+                       struct flb_config *config, void *data)
+{
+    struct flb_out_tcp *ctx;
+
+    ctx = flb_tcp_conf_create(ins, config);
+    if (!ctx) {
+        flb_error("[out_tcp] configuration failed");
+        return -1;
+    }
+
+    flb_output_set_context(ins, ctx);
+    return 0;
+}
+
+/*
+ * Convert the chunk to JSON lines, one object per record with the date key
+ * first followed by the record fields: {"date":1234.5, "key":"value"}
+ */
+static flb_sds_t tcp_format_json_lines(struct flb_out_tcp *ctx,
+                                       void *data, size_t bytes)
+{
+    int ret;
+    flb_sds_t buf;
+
+    buf = flb_sds_create_size(bytes * 1.5);
+    if (!buf) {
+        flb_errno();
+        return NULL;
+    }
+
+    ret = flb_pack_json_enc_chunk(&ctx->json_enc, &buf, data, bytes);
+    if (ret == -1) {
+        flb_sds_destroy(buf);
+        return NULL;
+    }
+
+    return buf;
+}
+
+static void cb_tcp_flush(void *data, size_t bytes,
+                         char *tag, int tag_len,
+                         struct flb_input_instance *i_ins,
+                         void *out_context,
+                         struct flb_config *config)
+{
+    int ret;
+    size_t bytes_sent;
+    flb_sds_t json = NULL;
+    struct flb_out_tcp *ctx = out_context;
+    struct flb_upstream_conn *u_conn;
+    (void) i_ins;
+    (void) config;
+
+    if (ctx->out_format == FLB_TCP_FMT_JSON_LINES) {
+        json = tcp_format_json_lines(ctx, data, bytes);
+        if (!json) {
+            FLB_OUTPUT_RETURN(FLB_ERROR);
+        }
+    }
+
+    /* Get upstream connection */
+    u_conn = flb_upstream_conn_get(ctx->u);
+    if (!u_conn) {
+        flb_error("[out_tcp] no upstream connections available to %s:%i",
+                  ctx->u->tcp_host, ctx->u->tcp_port);
+        if (json) {
+            flb_sds_destroy(json);
+        }
+        FLB_OUTPUT_RETURN(FLB_RETRY);
+    }
+
+    /* The msgpack chunk is streamed as it is, no copies */
+    if (json) {
+        ret = flb_io_net_write(u_conn, json, flb_sds_len(json), &bytes_sent);
+        flb_sds_destroy(json);
+    }
+    else {
+        ret = flb_io_net_write(u_conn, data, bytes, &bytes_sent);
+    }
+
+    /* on error the socket is closed and the connection not reused */
+    flb_upstream_conn_release(u_conn);
+    if (ret == -1) {
+        flb_warn("[out_tcp] error writing to %s:%i",
+                 ctx->u->tcp_host, ctx->u->tcp_port);
+        FLB_OUTPUT_RETURN(FLB_RETRY);
+    }
+
+    FLB_OUTPUT_RETURN(FLB_OK);
+}
+
+static int cb_tcp_exit(void *data, struct flb_config *config)
+{
+    struct flb_out_tcp *ctx = data;
+
+    flb_tcp_conf_destroy(ctx);
+    return 0;
+}
+
+struct flb_output_plugin out_tcp_plugin = {
+    .name         = "tcp",
+    .description  = "TCP Output",
+    .cb_init      = cb_tcp_init,
+    .cb_flush     = cb_tcp_flush,
+    .cb_exit      = cb_tcp_exit,
+
+    /* Plugin flags */
+    .flags          = FLB_OUTPUT_NET | FLB_IO_OPT_TLS,
+};
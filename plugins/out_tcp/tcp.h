@@ -0,0 +1,46 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2019      The Fluent Bit Authors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef FLB_OUT_TCP_H
+#define FLB_OUT_TCP_H
+
+#include <fluent-bit/flb_output.h>
+#include <fluent-bit/flb_sds.h>
+#include <fluent-bit/flb_pack.h>
+
+#define FLB_TCP_DEFAULT_HOST     "127.0.0.1"
+#define FLB_TCP_DEFAULT_PORT     5170
+#define FLB_TCP_DEFAULT_DATE_KEY "date"
+
+/* Output formats */
+#define FLB_TCP_FMT_MSGPACK      0
+#define FLB_TCP_FMT_JSON_LINES   1
+
+struct flb_out_tcp {
+    int out_format;
+
+    /* JSON lines encoder: date format and key */
+    struct flb_pack_json_enc json_enc;
+
+    /* Upstream connection to the backend server, kept open */
+    struct flb_upstream *u;
+    struct flb_output_instance *ins;
+};
+
+#endif
@@ -0,0 +1,132 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2019      The Fluent Bit Authors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_utils.h>
+
+#include "tcp.h"
+#include "tcp_conf.h"
+
+struct flb_out_tcp *flb_tcp_conf_create(struct flb_output_instance *ins,
+                                        struct flb_config *config)
+{
+    int ret;
+    int io_flags = 0;
+    int date_format;
+    char *tmp;
+    struct flb_upstream *upstream;
+    struct flb_out_tcp *ctx;
+
+    ctx = flb_calloc(1, sizeof(struct flb_out_tcp));
+    if (!ctx) {
+        flb_errno();
+        return NULL;
+    }
+    ctx->ins = ins;
+
+    /* Get network configuration */
+    if (!ins->host.name) {
+        ins->host.name = flb_strdup(FLB_TCP_DEFAULT_HOST);
+    }
+
+    if (ins->host.port == 0) {
+        ins->host.port = FLB_TCP_DEFAULT_PORT;
+    }
+
+    /* use TLS ? */
+    if (ins->use_tls == FLB_TRUE) {
+        io_flags = FLB_IO_TLS;
+    }
+    else {
+        io_flags = FLB_IO_TCP;
+    }
+
+    if (ins->host.ipv6 == FLB_TRUE) {
+        io_flags |= FLB_IO_IPV6;
+    }
+
+    /* The connection is kept open across flushes */
+    io_flags |= FLB_IO_TCP_KA;
+
+    /* Prepare an upstream handler */
+    upstream = flb_upstream_create(config,
+                                   ins->host.name,
+                                   ins->host.port,
+                                   io_flags,
+                                   &ins->tls);
+    if (!upstream) {
+        flb_error("[out_tcp] cannot create Upstream context");
+        flb_tcp_conf_destroy(ctx);
+        return NULL;
+    }
+    ctx->u = upstream;
+
+    /* Output format */
+    ctx->out_format = FLB_TCP_FMT_MSGPACK;
+    tmp = flb_output_get_property("format", ins);
+    if (tmp) {
+        if (strcasecmp(tmp, "json_lines") == 0) {
+            ctx->out_format = FLB_TCP_FMT_JSON_LINES;
+        }
+        else if (strcasecmp(tmp, "msgpack") != 0) {
+            flb_error("[out_tcp] unrecognized 'format' option '%s'", tmp);
+            flb_tcp_conf_destroy(ctx);
+            return NULL;
+        }
+    }
+
+    /* Date format and key for JSON lines */
+    date_format = FLB_PACK_JSON_DATE_DOUBLE;
+    tmp = flb_output_get_property("json_date_format", ins);
+    if (tmp) {
+        date_format = flb_pack_to_json_date_type(tmp);
+        if (date_format == -1) {
+            flb_error("[out_tcp] unrecognized 'json_date_format' option '%s'",
+                      tmp);
+            flb_tcp_conf_destroy(ctx);
+            return NULL;
+        }
+    }
+
+    tmp = flb_output_get_property("json_date_key", ins);
+    ret = flb_pack_json_enc_init(&ctx->json_enc, FLB_PACK_JSON_FORMAT_LINES,
+                                 date_format,
+                                 tmp ? tmp : FLB_TCP_DEFAULT_DATE_KEY);
+    if (ret == -1) {
+        flb_tcp_conf_destroy(ctx);
+        return NULL;
+    }
+
+    return ctx;
+}
+
+int flb_tcp_conf_destroy(struct flb_out_tcp *ctx)
+{
+    if (!ctx) {
+        return -1;
+    }
+
+    flb_pack_json_enc_destroy(&ctx->json_enc);
+    if (ctx->u) {
+        flb_upstream_destroy(ctx->u);
+    }
+    flb_free(ctx);
+
+    return 0;
+}
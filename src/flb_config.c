@@ -35,6 +35,7 @@
 #include <fluent-bit/flb_slist.h>
 #include <fluent-bit/flb_io_tls.h>
 #include <fluent-bit/flb_kernel.h>
+#include <fluent-bit/flb_net_dns.h>
 #include <fluent-bit/flb_worker.h>
 #include <fluent-bit/flb_scheduler.h>
 #include <fluent-bit/flb_http_server.h>
@@ -153,6 +154,10 @@ struct flb_config *flb_config_init()
     mk_list_init(&config->sqldb_list);
 #endif
 
+#ifdef FLB_HAVE_TLS
+    mk_list_init(&config->oauth2_tokens);
+#endif
+
 #ifdef FLB_HAVE_LUAJIT
     mk_list_init(&config->luajit_list);
 #endif
@@ -182,6 +187,10 @@ struct flb_config *flb_config_init()
     /* Environment */
     config->env = flb_env_create();
 
+    /* DNS resolver */
+    config->dns = flb_net_dns_create(FLB_NET_DNS_RESOLV_CONF,
+                                     FLB_NET_DNS_HOSTS);
+
     /* Register plugins */
     flb_register_plugins(config);
 
@@ -318,6 +327,8 @@ void flb_config_exit(struct flb_config *config)
     flb_slist_destroy(&config->stream_processor_tasks);
 #endif
 
+    flb_net_dns_destroy(config->dns);
+
     if (config->evl) {
         mk_event_loop_destroy(config->evl);
     }
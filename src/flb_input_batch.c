@@ -0,0 +1,164 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2019      The Fluent Bit Authors
+ *  Copyright (C) 2015-2018 Treasure Data Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_mem.h>
+#include <fluent-bit/flb_sds.h>
+#include <fluent-bit/flb_input.h>
+#include <fluent-bit/flb_input_chunk.h>
+#include <fluent-bit/flb_input_batch.h>
+
+int flb_input_batch_init(struct flb_input_batch *batch,
+                         struct flb_input_instance *in, size_t flush_size)
+{
+    if (flush_size == 0) {
+        flush_size = FLB_INPUT_BATCH_SIZE;
+    }
+
+    batch->records = 0;
+    batch->flush_size = flush_size;
+    batch->tag = NULL;
+    batch->in = in;
+    batch->cb_flush = NULL;
+    batch->cb_data = NULL;
+
+    msgpack_sbuffer_init(&batch->mp_sbuf);
+    msgpack_packer_init(&batch->mp_pck, &batch->mp_sbuf,
+                        msgpack_sbuffer_write);
+    return 0;
+}
+
+/*
+ * Set the tag used for the next records. If the batch contains records for
+ * a different tag, they are flushed first. A NULL tag means the records will
+ * inherit the instance tag.
+ */
+int flb_input_batch_set_tag(struct flb_input_batch *batch,
+                            char *tag, int tag_len)
+{
+    flb_sds_t tmp;
+
+    if (!tag && !batch->tag) {
+        return 0;
+    }
+
+    if (tag && batch->tag && flb_sds_len(batch->tag) == tag_len &&
+        strncmp(batch->tag, tag, tag_len) == 0) {
+        return 0;
+    }
+
+    flb_input_batch_flush(batch);
+
+    if (!tag) {
+        flb_sds_destroy(batch->tag);
+        batch->tag = NULL;
+        return 0;
+    }
+
+    if (!batch->tag) {
+        batch->tag = flb_sds_create_len(tag, tag_len);
+        if (!batch->tag) {
+            return -1;
+        }
+        return 0;
+    }
+
+    tmp = flb_sds_copy(batch->tag, tag, tag_len);
+    if (!tmp) {
+        return -1;
+    }
+    batch->tag = tmp;
+
+    return 0;
+}
+
+/*
+ * Notify that 'records' new records were packed through batch->mp_pck, the
+ * buffer is flushed if the size threshold was reached.
+ */
+int flb_input_batch_commit(struct flb_input_batch *batch, int records)
+{
+    batch->records += records;
+
+    if (batch->mp_sbuf.size >= batch->flush_size) {
+        return flb_input_batch_flush(batch);
+    }
+
+    return 0;
+}
+
+/* Copy an already packed set of records into the batch */
+int flb_input_batch_append_raw(struct flb_input_batch *batch, int records,
+                               char *buf, size_t size)
+{
+    int ret;
+
+    ret = msgpack_sbuffer_write(&batch->mp_sbuf, buf, size);
+    if (ret != 0) {
+        return -1;
+    }
+
+    return flb_input_batch_commit(batch, records);
+}
+
+/* Append the pending records into the input chunks */
+int flb_input_batch_flush(struct flb_input_batch *batch)
+{
+    int ret;
+    char *tag = NULL;
+    size_t tag_len = 0;
+
+    if (batch->mp_sbuf.size == 0) {
+        return 0;
+    }
+
+    if (batch->cb_flush) {
+        ret = batch->cb_flush(batch, batch->cb_data);
+        batch->mp_sbuf.size = 0;
+        batch->records = 0;
+        return ret;
+    }
+
+    if (batch->tag) {
+        tag = batch->tag;
+        tag_len = flb_sds_len(batch->tag);
+    }
+
+    ret = flb_input_chunk_append_records(batch->in, batch->records,
+                                         tag, tag_len,
+                                         batch->mp_sbuf.data,
+                                         batch->mp_sbuf.size);
+
+    /* Keep the allocated memory for the next round */
+    batch->mp_sbuf.size = 0;
+    batch->records = 0;
+
+    return ret;
+}
+
+void flb_input_batch_destroy(struct flb_input_batch *batch)
+{
+    msgpack_sbuffer_destroy(&batch->mp_sbuf);
+    if (batch->tag) {
+        flb_sds_destroy(batch->tag);
+        batch->tag = NULL;
+    }
+    batch->records = 0;
+}
@@ -352,11 +352,15 @@ int flb_input_chunk_set_up(struct flb_input_chunk *ic)
     return 0;
 }
 
-
-/* Append a RAW MessagPack buffer to the input instance */
-int flb_input_chunk_append_raw(struct flb_input_instance *in,
-                               char *tag, size_t tag_len,
-                               void *buf, size_t buf_size)
+/*
+ * Append a msgpack buffer into a chunk, 'records' is the number of records
+ * contained in the buffer, if it's unknown (-1) and metrics are enabled,
+ * the records are counted.
+ */
+static int input_chunk_append_raw(struct flb_input_instance *in,
+                                  int records,
+                                  char *tag, size_t tag_len,
+                                  void *buf, size_t buf_size)
 {
     int ret;
     size_t size;
@@ -364,8 +368,11 @@ int flb_input_chunk_append_raw(struct flb_input_instance *in,
     struct flb_storage_input *si;
 
 #ifdef FLB_HAVE_METRICS
-    int records;
-    records = flb_mp_count(buf, buf_size);
+    if (records < 0) {
+        records = flb_mp_count(buf, buf_size);
+    }
+#else
+    (void) records;
 #endif
 
     /* Check if the input plugin has been paused */
@@ -483,6 +490,25 @@ int flb_input_chunk_append_raw(struct flb_input_instance *in,
     return 0;
 }
 
+int flb_input_chunk_append_raw(struct flb_input_instance *in,
+                               char *tag, size_t tag_len,
+                               void *buf, size_t buf_size)
+{
+    return input_chunk_append_raw(in, -1, tag, tag_len, buf, buf_size);
+}
+
+/*
+ * Same as flb_input_chunk_append_raw() but the caller already knows how many
+ * records are in the buffer, so there is no need to count them again.
+ */
+int flb_input_chunk_append_records(struct flb_input_instance *in,
+                                   int records,
+                                   char *tag, size_t tag_len,
+                                   void *buf, size_t buf_size)
+{
+    return input_chunk_append_raw(in, records, tag, tag_len, buf, buf_size);
+}
+
 /* Retrieve a raw buffer from a dyntag node */
 void *flb_input_chunk_flush(struct flb_input_chunk *ic, size_t *size)
 {
@@ -64,6 +64,7 @@
 #include <fluent-bit/flb_utils.h>
 #include <fluent-bit/flb_macros.h>
 #include <fluent-bit/flb_network.h>
+#include <fluent-bit/flb_net_dns.h>
 #include <fluent-bit/flb_engine.h>
 #include <fluent-bit/flb_thread.h>
 
@@ -73,23 +74,44 @@ FLB_INLINE int flb_io_net_connect(struct flb_upstream_conn *u_conn,
     int ret;
     int err;
     int error = 0;
+    int family;
     uint32_t mask;
     char so_error_buf[256];
     flb_sockfd_t fd;
     socklen_t len = sizeof(error);
+    socklen_t addr_len;
+    struct sockaddr_storage addr;
     struct flb_upstream *u = u_conn->u;
 
     if (u_conn->fd > 0) {
         flb_socket_close(u_conn->fd);
+        u_conn->fd = -1;
     }
 
-    /* Create the socket */
     if (u_conn->u->flags & FLB_IO_IPV6) {
-        fd = flb_net_socket_create(AF_INET6, FLB_FALSE);
+        family = AF_INET6;
     }
     else {
-        fd = flb_net_socket_create(AF_INET, FLB_FALSE);
+        family = AF_INET;
+    }
+
+    /*
+     * Resolve the host before creating the socket, in async mode the
+     * co-routine yields while the DNS query is in flight.
+     */
+    if (u->dns) {
+        ret = flb_net_dns_lookup(u->dns, u->tcp_host, u->tcp_port, family,
+                                 u->evl,
+                                 (u->flags & FLB_IO_ASYNC) ? th : NULL,
+                                 &addr, &addr_len);
+        if (ret == -1) {
+            flb_error("[io] could not resolve %s", u->tcp_host);
+            return -1;
+        }
     }
+
+    /* Create the socket */
+    fd = flb_net_socket_create(family, FLB_FALSE);
     if (fd == -1) {
         flb_error("[io] could not create socket");
         return -1;
@@ -107,7 +129,12 @@ FLB_INLINE int flb_io_net_connect(struct flb_upstream_conn *u_conn,
     flb_net_socket_tcp_nodelay(fd);
 
     /* Start the connection */
-    ret = flb_net_tcp_fd_connect(fd, u->tcp_host, u->tcp_port);
+    if (u->dns) {
+        ret = connect(fd, (struct sockaddr *) &addr, addr_len);
+    }
+    else {
+        ret = flb_net_tcp_fd_connect(fd, u->tcp_host, u->tcp_port);
+    }
     if (ret == -1) {
         /* In blocking mode connect() fails right away */
         if ((u->flags & FLB_IO_ASYNC) == 0) {
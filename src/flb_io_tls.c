@@ -37,6 +37,7 @@
 #include <fluent-bit/flb_network.h>
 #include <fluent-bit/flb_engine.h>
 #include <fluent-bit/flb_thread.h>
+#include <fluent-bit/flb_time.h>
 
 #define FLB_TLS_CLIENT   "Fluent Bit"
 
@@ -117,6 +118,78 @@ static int flb_tls_load_system_cert(struct flb_tls_context *ctx)
 }
 #endif
 
+static void flb_tls_debug(void *ctx, int level,
+                          const char *file, int line,
+                          const char *str)
+{
+    int len;
+    char *p;
+    ((void) level);
+
+    len = strlen(str);
+    p = (char *) str;
+    p[len - 1] = '\0';
+
+    flb_debug("[io_tls] %s %04d: %s", file + sizeof(FLB_SOURCE_DIR) - 1,
+              line, str);
+}
+
+/* Prepare the SSL configuration shared by the sessions of a context */
+static int tls_context_conf(struct flb_tls_context *ctx)
+{
+    int ret;
+
+    mbedtls_ssl_config_init(&ctx->conf);
+    ctx->conf_set = FLB_TRUE;
+
+    ret = mbedtls_ssl_config_defaults(&ctx->conf,
+                                      MBEDTLS_SSL_IS_CLIENT,
+                                      MBEDTLS_SSL_TRANSPORT_STREAM,
+                                      MBEDTLS_SSL_PRESET_DEFAULT);
+    if (ret != 0) {
+        io_tls_error(ret);
+        return -1;
+    }
+
+    mbedtls_ssl_conf_rng(&ctx->conf,
+                         mbedtls_ctr_drbg_random,
+                         &ctx->ctr_drbg);
+
+    if (ctx->debug >= 0) {
+        mbedtls_ssl_conf_dbg(&ctx->conf, flb_tls_debug, NULL);
+        mbedtls_debug_set_threshold(ctx->debug);
+    }
+
+    if (ctx->verify == FLB_TRUE) {
+        mbedtls_ssl_conf_authmode(&ctx->conf, MBEDTLS_SSL_VERIFY_REQUIRED);
+    }
+    else {
+        mbedtls_ssl_conf_authmode(&ctx->conf, MBEDTLS_SSL_VERIFY_NONE);
+    }
+
+    /* Ask for a session ticket, so reconnections can skip the full handshake */
+    mbedtls_ssl_conf_session_tickets(&ctx->conf,
+                                     MBEDTLS_SSL_SESSION_TICKETS_ENABLED);
+
+    /* CA Root */
+    if (ctx->certs_set & FLB_TLS_CA_ROOT) {
+        mbedtls_ssl_conf_ca_chain(&ctx->conf, &ctx->ca_cert, NULL);
+    }
+
+    /* Specific Cert */
+    if (ctx->certs_set & FLB_TLS_CERT) {
+        ret = mbedtls_ssl_conf_own_cert(&ctx->conf,
+                                        &ctx->cert,
+                                        &ctx->priv_key);
+        if (ret != 0) {
+            flb_error("[TLS] Error loading certificate with private key");
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
 struct flb_tls_context *flb_tls_context_new(int verify,
                                             int debug,
                                             char *ca_path,
@@ -197,6 +270,11 @@ struct flb_tls_context *flb_tls_context_new(int verify,
         ctx->certs_set |= FLB_TLS_PRIV_KEY;
     }
 
+    ret = tls_context_conf(ctx);
+    if (ret == -1) {
+        goto error;
+    }
+
     return ctx;
 
  error:
@@ -206,6 +284,10 @@ struct flb_tls_context *flb_tls_context_new(int verify,
 
 void flb_tls_context_destroy(struct flb_tls_context *ctx)
 {
+    if (ctx->conf_set == FLB_TRUE) {
+        mbedtls_ssl_config_free(&ctx->conf);
+    }
+
     if (ctx->certs_set & FLB_TLS_CA_ROOT) {
         mbedtls_x509_crt_free(&ctx->ca_cert);
     }
@@ -221,22 +303,6 @@ void flb_tls_context_destroy(struct flb_tls_context *ctx)
     flb_free(ctx);
 }
 
-static void flb_tls_debug(void *ctx, int level,
-                          const char *file, int line,
-                          const char *str)
-{
-    int len;
-    char *p;
-    ((void) level);
-
-    len = strlen(str);
-    p = (char *) str;
-    p[len - 1] = '\0';
-
-    flb_debug("[io_tls] %s %04d: %s", file + sizeof(FLB_SOURCE_DIR) - 1,
-              line, str);
-}
-
 struct flb_tls_session *flb_tls_session_new(struct flb_tls_context *ctx)
 {
     int ret;
@@ -251,86 +317,72 @@ struct flb_tls_session *flb_tls_session_new(struct flb_tls_context *ctx)
         return NULL;
     }
 
+    /* The configuration is shared, a session only needs its SSL context */
     mbedtls_ssl_init(&session->ssl);
-
-    mbedtls_ssl_config_init(&session->conf);
-    ret = mbedtls_ssl_config_defaults(&session->conf,
-                                      MBEDTLS_SSL_IS_CLIENT,
-                                      MBEDTLS_SSL_TRANSPORT_STREAM,
-                                      MBEDTLS_SSL_PRESET_DEFAULT);
+    ret = mbedtls_ssl_setup(&session->ssl, &ctx->conf);
     if (ret != 0) {
         io_tls_error(ret);
-    }
-
-    mbedtls_ssl_conf_rng(&session->conf,
-                         mbedtls_ctr_drbg_random,
-                         &ctx->ctr_drbg);
-
-    if (ctx->debug >= 0) {
-        mbedtls_ssl_conf_dbg(&session->conf, flb_tls_debug, NULL);
-        mbedtls_debug_set_threshold(ctx->debug);
-    }
-
-    if (ctx->verify == FLB_TRUE) {
-        mbedtls_ssl_conf_authmode(&session->conf, MBEDTLS_SSL_VERIFY_REQUIRED);
-    }
-    else {
-        mbedtls_ssl_conf_authmode(&session->conf, MBEDTLS_SSL_VERIFY_NONE);
-    }
-
-
-    /* CA Root */
-    if (ctx->certs_set & FLB_TLS_CA_ROOT) {
-        mbedtls_ssl_conf_ca_chain(&session->conf, &ctx->ca_cert, NULL);
-    }
-
-    /* Specific Cert */
-    if (ctx->certs_set & FLB_TLS_CERT) {
-        ret = mbedtls_ssl_conf_own_cert(&session->conf,
-                                        &ctx->cert,
-                                        &ctx->priv_key);
-        if (ret != 0) {
-            flb_error("[TLS] Error loading certificate with private key");
-            goto error;
-        }
-    }
-
-
-    ret = mbedtls_ssl_setup(&session->ssl, &session->conf);
-    if (ret == -1) {
         flb_error("[tls] ssl_setup");
-        goto error;
+        mbedtls_ssl_free(&session->ssl);
+        flb_free(session);
+        return NULL;
     }
 
     return session;
-
- error:
-    flb_free(session);
-    return NULL;
 }
 
 int flb_tls_session_destroy(struct flb_tls_session *session)
 {
     if (session) {
         mbedtls_ssl_free(&session->ssl);
-        mbedtls_ssl_config_free(&session->conf);
         flb_free(session);
     }
 
     return 0;
 }
 
+/* Account a completed handshake in the metrics of the output instance */
+static void tls_handshake_metrics(struct flb_tls *tls, int resumed,
+                                  struct flb_time *start)
+{
+#ifdef FLB_HAVE_METRICS
+    struct flb_time now;
+    struct flb_time diff;
+
+    if (!tls->metrics) {
+        return;
+    }
+
+    flb_time_get(&now);
+    flb_time_diff(&now, start, &diff);
+
+    flb_metrics_sum(FLB_METRIC_OUT_TLS_HANDSHAKES, 1, tls->metrics);
+    if (resumed == FLB_TRUE) {
+        flb_metrics_sum(FLB_METRIC_OUT_TLS_RESUMED, 1, tls->metrics);
+    }
+    flb_metrics_sum(FLB_METRIC_OUT_TLS_HS_USEC,
+                    diff.tm.tv_sec * 1000000 + diff.tm.tv_nsec / 1000,
+                    tls->metrics);
+#endif
+}
+
 /* Perform a TLS handshake */
 int net_io_tls_handshake(void *_u_conn, void *_th)
 {
     int ret;
     int flag;
+    int offered = FLB_FALSE;
+    int resumed = FLB_FALSE;
+    struct flb_time start;
+    mbedtls_ssl_session last;
     struct flb_tls_session *session;
     struct flb_upstream_conn *u_conn = _u_conn;
     struct flb_upstream *u = u_conn->u;
 
     struct flb_thread *th = _th;
 
+    flb_time_get(&start);
+
     session = flb_tls_session_new(u->tls->context);
     if (!session) {
         flb_error("[io_tls] could not create tls session");
@@ -338,6 +390,17 @@ int net_io_tls_handshake(void *_u_conn, void *_th)
     }
     mbedtls_ssl_set_hostname(&session->ssl,u->tcp_host);
 
+    /* Offer the last session negotiated with this host */
+    if (u->tls_resume_set == FLB_TRUE) {
+        ret = mbedtls_ssl_set_session(&session->ssl, &u->tls_resume);
+        if (ret != 0) {
+            io_tls_error(ret);
+        }
+        else {
+            offered = FLB_TRUE;
+        }
+    }
+
     /* Store session and mbedtls net context fd */
     u_conn->tls_session = session;
     u_conn->tls_net_context.fd = u_conn->fd;
@@ -380,10 +443,34 @@ int net_io_tls_handshake(void *_u_conn, void *_th)
         flb_thread_yield(th, FLB_FALSE);
         goto retry_handshake;
     }
+
+    /*
+     * Keep the session (or its new ticket) for the next connection. A
+     * resumed session keeps the master secret of the one we offered, a
+     * full handshake negotiates a new one. The session ID can't tell: on
+     * a ticket based resumption the client sends a new random ID.
+     */
+    mbedtls_ssl_session_init(&last);
+    ret = mbedtls_ssl_get_session(&session->ssl, &last);
+    if (ret == 0) {
+        if (offered == FLB_TRUE &&
+            memcmp(last.master, u->tls_resume.master,
+                   sizeof(last.master)) == 0) {
+            resumed = FLB_TRUE;
+        }
+        mbedtls_ssl_session_free(&u->tls_resume);
+        u->tls_resume = last;
+        u->tls_resume_set = FLB_TRUE;
+    }
     else {
-        flb_trace("[io_tls] Handshake OK");
+        mbedtls_ssl_session_free(&last);
+        u->tls_resume_set = FLB_FALSE;
     }
 
+    flb_trace("[io_tls] Handshake OK%s",
+              resumed == FLB_TRUE ? " (resumed)" : "");
+    tls_handshake_metrics(u->tls, resumed, &start);
+
     if (u_conn->event.status & MK_EVENT_REGISTERED) {
         mk_event_del(u->evl, &u_conn->event);
     }
@@ -394,6 +481,14 @@ int net_io_tls_handshake(void *_u_conn, void *_th)
     if (u_conn->event.status & MK_EVENT_REGISTERED) {
         mk_event_del(u->evl, &u_conn->event);
     }
+
+    /* The host might not accept the cached session anymore */
+    if (u->tls_resume_set == FLB_TRUE) {
+        mbedtls_ssl_session_free(&u->tls_resume);
+        mbedtls_ssl_session_init(&u->tls_resume);
+        u->tls_resume_set = FLB_FALSE;
+    }
+
     flb_tls_session_destroy(u_conn->tls_session);
     u_conn->tls_session = NULL;
 
@@ -67,3 +67,222 @@ int flb_mp_count_zone(void *data, size_t bytes, msgpack_zone *zone)
 {
     return mp_count(data, bytes, zone);
 }
+
+/* Generic types reported by mp_header() */
+#define MP_INT     0
+#define MP_FLOAT   1
+#define MP_EXT     2
+#define MP_ARRAY   3
+#define MP_MAP     4
+#define MP_OTHER   5
+
+#define MP_BE16(p)  (((size_t) (p)[0] << 8) | (p)[1])
+#define MP_BE32(p)  (((size_t) (p)[0] << 24) | ((size_t) (p)[1] << 16) | \
+                     ((size_t) (p)[2] << 8) | (p)[3])
+
+/*
+ * Read the header of the msgpack object at '*p' and move the pointer to the
+ * next object: scalar payloads are skipped, for arrays and maps 'children'
+ * is set to the number of nested objects that follows. Returns -1 if the
+ * data is incomplete or invalid.
+ */
+static inline int mp_header(const unsigned char **p, const unsigned char *end,
+                            int *type, size_t *children)
+{
+    size_t len = 0;
+    size_t skip = 0;
+    unsigned char c;
+    const unsigned char *b = *p;
+
+    if (b >= end) {
+        return -1;
+    }
+
+    c = *b++;
+    *children = 0;
+    *type = MP_OTHER;
+
+    if (c <= 0x7f || c >= 0xe0) {
+        *type = MP_INT;
+    }
+    else if (c <= 0x8f) {
+        *type = MP_MAP;
+        *children = (c & 0x0f) * 2;
+    }
+    else if (c <= 0x9f) {
+        *type = MP_ARRAY;
+        *children = c & 0x0f;
+    }
+    else if (c <= 0xbf) {
+        skip = c & 0x1f;
+    }
+    else {
+        switch (c) {
+        case 0xc0:   /* nil   */
+        case 0xc2:   /* false */
+        case 0xc3:   /* true  */
+            break;
+        case 0xc4:   /* bin 8  */
+        case 0xd9:   /* str 8  */
+            len = 1;
+            break;
+        case 0xc5:   /* bin 16 */
+        case 0xda:   /* str 16 */
+            len = 2;
+            break;
+        case 0xc6:   /* bin 32 */
+        case 0xdb:   /* str 32 */
+            len = 4;
+            break;
+        case 0xc7:   /* ext 8  */
+            *type = MP_EXT;
+            len = 1;
+            skip = 1;
+            break;
+        case 0xc8:   /* ext 16 */
+            *type = MP_EXT;
+            len = 2;
+            skip = 1;
+            break;
+        case 0xc9:   /* ext 32 */
+            *type = MP_EXT;
+            len = 4;
+            skip = 1;
+            break;
+        case 0xca:
+            *type = MP_FLOAT;
+            skip = 4;
+            break;
+        case 0xcb:
+            *type = MP_FLOAT;
+            skip = 8;
+            break;
+        case 0xcc:
+        case 0xd0:
+            *type = MP_INT;
+            skip = 1;
+            break;
+        case 0xcd:
+        case 0xd1:
+            *type = MP_INT;
+            skip = 2;
+            break;
+        case 0xce:
+        case 0xd2:
+            *type = MP_INT;
+            skip = 4;
+            break;
+        case 0xcf:
+        case 0xd3:
+            *type = MP_INT;
+            skip = 8;
+            break;
+        case 0xd4:   /* fixext 1, 2, 4, 8 and 16 */
+        case 0xd5:
+        case 0xd6:
+        case 0xd7:
+        case 0xd8:
+            *type = MP_EXT;
+            skip = 1 + (1 << (c - 0xd4));
+            break;
+        case 0xdc:   /* array 16 */
+        case 0xde:   /* map 16   */
+            if (end - b < 2) {
+                return -1;
+            }
+            *children = MP_BE16(b);
+            b += 2;
+            break;
+        case 0xdd:   /* array 32 */
+        case 0xdf:   /* map 32   */
+            if (end - b < 4) {
+                return -1;
+            }
+            *children = MP_BE32(b);
+            b += 4;
+            break;
+        default:     /* 0xc1: never used */
+            return -1;
+        }
+
+        if (c == 0xdc || c == 0xdd) {
+            *type = MP_ARRAY;
+        }
+        else if (c == 0xde || c == 0xdf) {
+            *type = MP_MAP;
+            *children *= 2;
+        }
+    }
+
+    /* Length prefixed payload: str, bin and ext */
+    if (len > 0) {
+        if ((size_t) (end - b) < len) {
+            return -1;
+        }
+        if (len == 1) {
+            skip += b[0];
+        }
+        else if (len == 2) {
+            skip += MP_BE16(b);
+        }
+        else {
+            skip += MP_BE32(b);
+        }
+        b += len;
+    }
+
+    if ((size_t) (end - b) < skip) {
+        return -1;
+    }
+
+    *p = b + skip;
+    return 0;
+}
+
+/*
+ * Validate a buffer of serialized records, every entry must be an array of
+ * [timestamp, map], and count them. This is a lightweight scan of the
+ * msgpack format: no objects are unpacked and no zone memory is allocated.
+ *
+ * Returns the number of records or -1 if the buffer is not valid.
+ */
+int flb_mp_validate_records(const char *data, size_t bytes)
+{
+    int type;
+    int count = 0;
+    size_t n;
+    size_t pending;
+    const unsigned char *p = (const unsigned char *) data;
+    const unsigned char *end = p + bytes;
+
+    while (p < end) {
+        /* [ */
+        if (mp_header(&p, end, &type, &n) == -1 ||
+            type != MP_ARRAY || n != 2) {
+            return -1;
+        }
+
+        /* timestamp */
+        if (mp_header(&p, end, &type, &n) == -1 ||
+            (type != MP_INT && type != MP_FLOAT && type != MP_EXT)) {
+            return -1;
+        }
+
+        /* map */
+        if (mp_header(&p, end, &type, &n) == -1 || type != MP_MAP) {
+            return -1;
+        }
+
+        /* skip the map content */
+        pending = n;
+        while (pending > 0) {
+            if (mp_header(&p, end, &type, &n) == -1) {
+                return -1;
+            }
+            pending = pending - 1 + n;
+        }
+        count++;
+    }
+
+    return count;
+}
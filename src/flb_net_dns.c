@@ -0,0 +1,977 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2019      The Fluent Bit Authors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+/*
+ * FLB_NET_DNS
+ * ===========
+ * Name resolution for the upstream connections. getaddrinfo() blocks the
+ * caller until the resolver answers, which in the engine thread means every
+ * flush stalls while a DNS server is slow or unreachable. Here the queries
+ * are sent over a non-blocking UDP socket to the servers of resolv.conf
+ * and, when running inside a co-routine, the co-routine yields until the
+ * answer arrives or the timeout expires.
+ *
+ * Answers are cached honoring their TTL and shared by all the upstreams,
+ * when a name resolves to many addresses every lookup returns the next
+ * one (round-robin).
+ *
+ * Names listed in /etc/hosts, or any name when no nameserver is set, are
+ * still resolved through getaddrinfo() so the system configuration rules.
+ */
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_mem.h>
+#include <fluent-bit/flb_log.h>
+#include <fluent-bit/flb_slist.h>
+#include <fluent-bit/flb_utils.h>
+#include <fluent-bit/flb_network.h>
+#include <fluent-bit/flb_engine.h>
+#include <fluent-bit/flb_net_dns.h>
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stddef.h>
+#include <errno.h>
+#include <unistd.h>
+
+#ifndef _WIN32
+#include <poll.h>
+#include <netdb.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#endif
+
+#define DNS_HEADER_SIZE     12
+#define DNS_BUF_SIZE        1500
+#define DNS_CLASS_IN        1
+#define DNS_TYPE_A          1
+#define DNS_TYPE_AAAA       28
+
+#define DNS_RCODE_NXDOMAIN  3
+
+/* return values of the query functions */
+#define DNS_OK              0
+#define DNS_ERROR          -1     /* server failure or timeout: next server */
+#define DNS_NOT_FOUND      -2     /* no such name or no addresses           */
+#define DNS_IGNORE         -3     /* not an answer to our query             */
+
+/* A query waiting for an answer */
+struct dns_query {
+    struct mk_event event;       /* socket event, must be the first field */
+    flb_sockfd_t fd;
+    uint16_t id;
+    time_t deadline;
+    int done;                    /* finished, released by the timer */
+    struct flb_thread *th;
+    struct mk_list _head;
+};
+
+/* Addresses of an answer before they land in the cache */
+struct dns_result {
+    int n_addrs;
+    uint32_t ttl;
+    struct sockaddr_storage addrs[FLB_NET_DNS_MAX_ADDRS];
+};
+
+static int net_dns_sockaddr(const char *addr, int port, int family,
+                            struct sockaddr_storage *ss, socklen_t *len)
+{
+    struct sockaddr_in *sin;
+    struct sockaddr_in6 *sin6;
+
+    memset(ss, '\0', sizeof(struct sockaddr_storage));
+
+    if (family == AF_INET || family == AF_UNSPEC) {
+        sin = (struct sockaddr_in *) ss;
+        if (inet_pton(AF_INET, addr, &sin->sin_addr) == 1) {
+            sin->sin_family = AF_INET;
+            sin->sin_port = htons(port);
+            *len = sizeof(struct sockaddr_in);
+            return 0;
+        }
+    }
+
+    if (family == AF_INET6 || family == AF_UNSPEC) {
+        sin6 = (struct sockaddr_in6 *) ss;
+        if (inet_pton(AF_INET6, addr, &sin6->sin6_addr) == 1) {
+            sin6->sin6_family = AF_INET6;
+            sin6->sin6_port = htons(port);
+            *len = sizeof(struct sockaddr_in6);
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+static void net_dns_set_port(struct sockaddr_storage *ss, int port,
+                             socklen_t *len)
+{
+    if (ss->ss_family == AF_INET6) {
+        ((struct sockaddr_in6 *) ss)->sin6_port = htons(port);
+        *len = sizeof(struct sockaddr_in6);
+    }
+    else {
+        ((struct sockaddr_in *) ss)->sin_port = htons(port);
+        *len = sizeof(struct sockaddr_in);
+    }
+}
+
+int flb_net_dns_server_add(struct flb_net_dns *dns, const char *addr, int port)
+{
+    int ret;
+    int n;
+
+    n = dns->n_servers;
+    if (n >= FLB_NET_DNS_MAX_SERVERS) {
+        flb_debug("[dns] nameserver %s ignored, max %i", addr,
+                  FLB_NET_DNS_MAX_SERVERS);
+        return -1;
+    }
+
+    ret = net_dns_sockaddr(addr, port, AF_UNSPEC,
+                           &dns->servers[n], &dns->servers_len[n]);
+    if (ret == -1) {
+        flb_debug("[dns] invalid nameserver address '%s'", addr);
+        return -1;
+    }
+
+    dns->n_servers++;
+    return 0;
+}
+
+static void net_dns_search_reset(struct flb_net_dns *dns)
+{
+    int i;
+
+    for (i = 0; i < dns->n_search; i++) {
+        flb_sds_destroy(dns->search[i]);
+    }
+    dns->n_search = 0;
+}
+
+static int net_dns_option(const char *opt, const char *name, int min, int max,
+                          int *val)
+{
+    int n;
+    size_t len;
+
+    len = strlen(name);
+    if (strncmp(opt, name, len) != 0 || opt[len] != ':') {
+        return -1;
+    }
+
+    n = atoi(opt + len + 1);
+    if (n < min) {
+        n = min;
+    }
+    else if (n > max) {
+        n = max;
+    }
+    *val = n;
+
+    return 0;
+}
+
+/* Strip comments and the end of line */
+static void net_dns_line_clean(char *line)
+{
+    char *p;
+
+    p = strpbrk(line, "#;\r\n");
+    if (p) {
+        *p = '\0';
+    }
+}
+
+static void net_dns_resolv_conf(struct flb_net_dns *dns, const char *path)
+{
+    char *key;
+    char *val;
+    char *saveptr;
+    char line[1024];
+    FILE *fp;
+
+    fp = fopen(path, "r");
+    if (!fp) {
+        flb_debug("[dns] cannot open %s, using the system resolver", path);
+        return;
+    }
+
+    while (fgets(line, sizeof(line), fp)) {
+        net_dns_line_clean(line);
+
+        key = strtok_r(line, " \t", &saveptr);
+        if (!key) {
+            continue;
+        }
+
+        if (strcmp(key, "nameserver") == 0) {
+            val = strtok_r(NULL, " \t", &saveptr);
+            if (val) {
+                flb_net_dns_server_add(dns, val, FLB_NET_DNS_PORT);
+            }
+        }
+        else if (strcmp(key, "search") == 0 || strcmp(key, "domain") == 0) {
+            /* the last search or domain line wins */
+            net_dns_search_reset(dns);
+            while ((val = strtok_r(NULL, " \t", &saveptr)) &&
+                   dns->n_search < FLB_NET_DNS_MAX_SEARCH) {
+                dns->search[dns->n_search] = flb_sds_create(val);
+                if (dns->search[dns->n_search]) {
+                    dns->n_search++;
+                }
+            }
+        }
+        else if (strcmp(key, "options") == 0) {
+            while ((val = strtok_r(NULL, " \t", &saveptr))) {
+                if (net_dns_option(val, "timeout", 1, 30,
+                                   &dns->timeout) == 0) {
+                    continue;
+                }
+                if (net_dns_option(val, "attempts", 1, 5,
+                                   &dns->attempts) == 0) {
+                    continue;
+                }
+                net_dns_option(val, "ndots", 0, 15, &dns->ndots);
+            }
+        }
+    }
+
+    fclose(fp);
+}
+
+static void net_dns_hosts(struct flb_net_dns *dns, const char *path)
+{
+    char *val;
+    char *saveptr;
+    char line[1024];
+    FILE *fp;
+
+    fp = fopen(path, "r");
+    if (!fp) {
+        return;
+    }
+
+    while (fgets(line, sizeof(line), fp)) {
+        net_dns_line_clean(line);
+
+        /* skip the address, the rest of the line are names */
+        val = strtok_r(line, " \t", &saveptr);
+        if (!val) {
+            continue;
+        }
+
+        while ((val = strtok_r(NULL, " \t", &saveptr))) {
+            flb_slist_add(&dns->hosts, val);
+        }
+    }
+
+    fclose(fp);
+}
+
+struct flb_net_dns *flb_net_dns_create(const char *resolv_conf,
+                                       const char *hosts)
+{
+    struct flb_net_dns *dns;
+
+    dns = flb_calloc(1, sizeof(struct flb_net_dns));
+    if (!dns) {
+        flb_errno();
+        return NULL;
+    }
+
+    dns->timeout  = FLB_NET_DNS_TIMEOUT;
+    dns->attempts = FLB_NET_DNS_ATTEMPTS;
+    dns->ndots    = FLB_NET_DNS_NDOTS;
+    dns->timer_fd = -1;
+    dns->query_id = (uint16_t) (time(NULL) ^ getpid());
+
+    pthread_mutex_init(&dns->lock, NULL);
+    mk_list_init(&dns->entries);
+    mk_list_init(&dns->queries);
+    flb_slist_create(&dns->hosts);
+
+    if (resolv_conf) {
+        net_dns_resolv_conf(dns, resolv_conf);
+    }
+    if (hosts) {
+        net_dns_hosts(dns, hosts);
+    }
+
+    return dns;
+}
+
+static void net_dns_query_close(struct flb_net_dns *dns, struct dns_query *q)
+{
+    if (q->fd == -1) {
+        return;
+    }
+
+    if (q->th) {
+        mk_event_del(dns->evl, &q->event);
+    }
+    flb_socket_close(q->fd);
+    q->fd = -1;
+}
+
+void flb_net_dns_destroy(struct flb_net_dns *dns)
+{
+    struct mk_list *tmp;
+    struct mk_list *head;
+    struct dns_query *q;
+    struct flb_net_dns_entry *entry;
+
+    if (!dns) {
+        return;
+    }
+
+    mk_list_foreach_safe(head, tmp, &dns->queries) {
+        q = mk_list_entry(head, struct dns_query, _head);
+        net_dns_query_close(dns, q);
+        mk_list_del(&q->_head);
+        flb_free(q);
+    }
+
+    if (dns->timer_fd != -1) {
+        mk_event_timeout_destroy(dns->evl, &dns->timer);
+        mk_event_closesocket(dns->timer_fd);
+    }
+
+    mk_list_foreach_safe(head, tmp, &dns->entries) {
+        entry = mk_list_entry(head, struct flb_net_dns_entry, _head);
+        mk_list_del(&entry->_head);
+        flb_sds_destroy(entry->host);
+        flb_free(entry);
+    }
+
+    net_dns_search_reset(dns);
+    flb_slist_destroy(&dns->hosts);
+    pthread_mutex_destroy(&dns->lock);
+    flb_free(dns);
+}
+
+/* Take the next address of a cached name, the caller holds the lock */
+static void net_dns_entry_pick(struct flb_net_dns_entry *entry, int port,
+                               struct sockaddr_storage *addr,
+                               socklen_t *addr_len)
+{
+    memcpy(addr, &entry->addrs[entry->next], sizeof(struct sockaddr_storage));
+    net_dns_set_port(addr, port, addr_len);
+    entry->next = (entry->next + 1) % entry->n_addrs;
+}
+
+static struct flb_net_dns_entry *net_dns_entry_get(struct flb_net_dns *dns,
+                                                   const char *host,
+                                                   int family)
+{
+    struct mk_list *head;
+    struct flb_net_dns_entry *entry;
+
+    mk_list_foreach(head, &dns->entries) {
+        entry = mk_list_entry(head, struct flb_net_dns_entry, _head);
+        if (entry->family == family && strcasecmp(entry->host, host) == 0) {
+            return entry;
+        }
+    }
+
+    return NULL;
+}
+
+static int net_dns_cache_get(struct flb_net_dns *dns, const char *host,
+                             int port, int family,
+                             struct sockaddr_storage *addr,
+                             socklen_t *addr_len)
+{
+    int ret = -1;
+    struct flb_net_dns_entry *entry;
+
+    pthread_mutex_lock(&dns->lock);
+    entry = net_dns_entry_get(dns, host, family);
+    if (entry && entry->expire > time(NULL)) {
+        net_dns_entry_pick(entry, port, addr, addr_len);
+        ret = 0;
+    }
+    pthread_mutex_unlock(&dns->lock);
+
+    return ret;
+}
+
+/*
+ * Store an answer and take its first address. Entries are refreshed in
+ * place, so the rotation goes on across the TTL expirations.
+ */
+static int net_dns_cache_set(struct flb_net_dns *dns, const char *host,
+                             int port, int family, struct dns_result *res,
+                             struct sockaddr_storage *addr,
+                             socklen_t *addr_len)
+{
+    struct flb_net_dns_entry *entry;
+
+    pthread_mutex_lock(&dns->lock);
+    entry = net_dns_entry_get(dns, host, family);
+    if (!entry) {
+        entry = flb_calloc(1, sizeof(struct flb_net_dns_entry));
+        if (!entry) {
+            flb_errno();
+            pthread_mutex_unlock(&dns->lock);
+            return -1;
+        }
+        entry->host = flb_sds_create((char *) host);
+        if (!entry->host) {
+            flb_free(entry);
+            pthread_mutex_unlock(&dns->lock);
+            return -1;
+        }
+        entry->family = family;
+        mk_list_add(&entry->_head, &dns->entries);
+    }
+
+    memcpy(entry->addrs, res->addrs,
+           sizeof(struct sockaddr_storage) * res->n_addrs);
+    entry->n_addrs = res->n_addrs;
+    entry->next %= entry->n_addrs;
+    entry->expire = time(NULL) + res->ttl;
+
+    net_dns_entry_pick(entry, port, addr, addr_len);
+    pthread_mutex_unlock(&dns->lock);
+
+    return 0;
+}
+
+static int net_dns_is_local(struct flb_net_dns *dns, const char *host)
+{
+    struct mk_list *head;
+    struct flb_slist_entry *e;
+
+    if (strcasecmp(host, "localhost") == 0) {
+        return FLB_TRUE;
+    }
+
+    mk_list_foreach(head, &dns->hosts) {
+        e = mk_list_entry(head, struct flb_slist_entry, _head);
+        if (strcasecmp(e->str, host) == 0) {
+            return FLB_TRUE;
+        }
+    }
+
+    return FLB_FALSE;
+}
+
+/* Resolve through the system resolver, it might block */
+static int net_dns_system(const char *host, int family,
+                          struct dns_result *res)
+{
+    int ret;
+    struct addrinfo hints;
+    struct addrinfo *ai;
+    struct addrinfo *rp;
+
+    memset(&hints, '\0', sizeof(hints));
+    hints.ai_family = family;
+    hints.ai_socktype = SOCK_STREAM;
+
+    ret = getaddrinfo(host, NULL, &hints, &ai);
+    if (ret != 0) {
+        flb_warn("[dns] getaddrinfo(host='%s'): %s", host, gai_strerror(ret));
+        return DNS_NOT_FOUND;
+    }
+
+    res->n_addrs = 0;
+    for (rp = ai; rp && res->n_addrs < FLB_NET_DNS_MAX_ADDRS;
+         rp = rp->ai_next) {
+        if (rp->ai_addrlen > sizeof(struct sockaddr_storage)) {
+            continue;
+        }
+        memset(&res->addrs[res->n_addrs], '\0',
+               sizeof(struct sockaddr_storage));
+        memcpy(&res->addrs[res->n_addrs], rp->ai_addr, rp->ai_addrlen);
+        res->n_addrs++;
+    }
+    freeaddrinfo(ai);
+
+    if (res->n_addrs == 0) {
+        return DNS_NOT_FOUND;
+    }
+
+    res->ttl = FLB_NET_DNS_SYSTEM_TTL;
+    return DNS_OK;
+}
+
+/* Compose a query for 'name', returns the packet length */
+static int net_dns_packet(const char *name, uint16_t id, int qtype,
+                          unsigned char *buf, size_t size)
+{
+    int len;
+    size_t off;
+    const char *p;
+    const char *dot;
+
+    if (strlen(name) > 253 || strlen(name) + DNS_HEADER_SIZE + 6 > size) {
+        return -1;
+    }
+
+    memset(buf, '\0', DNS_HEADER_SIZE);
+    buf[0] = id >> 8;
+    buf[1] = id & 0xff;
+    buf[2] = 0x01;              /* recursion desired */
+    buf[5] = 1;                 /* one question      */
+    off = DNS_HEADER_SIZE;
+
+    p = name;
+    while (*p) {
+        dot = strchr(p, '.');
+        len = dot ? dot - p : strlen(p);
+        if (len == 0 || len > 63) {
+            return -1;
+        }
+        buf[off++] = len;
+        memcpy(buf + off, p, len);
+        off += len;
+        p += len;
+        if (*p == '.') {
+            p++;
+        }
+    }
+    buf[off++] = 0;
+
+    buf[off++] = 0;
+    buf[off++] = qtype;
+    buf[off++] = 0;
+    buf[off++] = DNS_CLASS_IN;
+
+    return off;
+}
+
+/* Skip an encoded name, returns the offset after it or -1 */
+static int net_dns_skip_name(unsigned char *buf, int size, int off)
+{
+    while (off < size) {
+        if (buf[off] == 0) {
+            return off + 1;
+        }
+        if ((buf[off] & 0xc0) == 0xc0) {
+            return (off + 2 <= size) ? off + 2 : -1;
+        }
+        off += buf[off] + 1;
+    }
+
+    return -1;
+}
+
+static int net_dns_answer(unsigned char *buf, int size,
+                          unsigned char *query, int query_len,
+                          int qtype, struct dns_result *res)
+{
+    int i;
+    int off;
+    int ancount;
+    int type;
+    int class;
+    int rdlen;
+    uint32_t ttl;
+    struct sockaddr_in *sin;
+    struct sockaddr_in6 *sin6;
+
+    if (size < query_len || buf[0] != query[0] || buf[1] != query[1]) {
+        return DNS_IGNORE;
+    }
+
+    /* it must be a response echoing our question */
+    if ((buf[2] & 0x80) == 0 || buf[4] != 0 || buf[5] != 1 ||
+        strncasecmp((char *) buf + DNS_HEADER_SIZE,
+                    (char *) query + DNS_HEADER_SIZE,
+                    query_len - DNS_HEADER_SIZE) != 0) {
+        return DNS_IGNORE;
+    }
+
+    if ((buf[3] & 0x0f) == DNS_RCODE_NXDOMAIN) {
+        return DNS_NOT_FOUND;
+    }
+    else if ((buf[3] & 0x0f) != 0) {
+        return DNS_ERROR;
+    }
+
+    ancount = (buf[6] << 8) | buf[7];
+    off = query_len;
+    res->n_addrs = 0;
+    res->ttl = UINT32_MAX;
+
+    for (i = 0; i < ancount && res->n_addrs < FLB_NET_DNS_MAX_ADDRS; i++) {
+        off = net_dns_skip_name(buf, size, off);
+        if (off == -1 || off + 10 > size) {
+            break;
+        }
+
+        type  = (buf[off] << 8) | buf[off + 1];
+        class = (buf[off + 2] << 8) | buf[off + 3];
+        ttl   = ((uint32_t) buf[off + 4] << 24) | (buf[off + 5] << 16) |
+                (buf[off + 6] << 8) | buf[off + 7];
+        rdlen = (buf[off + 8] << 8) | buf[off + 9];
+        off += 10;
+        if (off + rdlen > size) {
+            break;
+        }
+
+        /* CNAME records of the chain are skipped, only the addresses count */
+        if (type == qtype && class == DNS_CLASS_IN) {
+            memset(&res->addrs[res->n_addrs], '\0',
+                   sizeof(struct sockaddr_storage));
+            if (type == DNS_TYPE_A && rdlen == 4) {
+                sin = (struct sockaddr_in *) &res->addrs[res->n_addrs];
+                sin->sin_family = AF_INET;
+                memcpy(&sin->sin_addr, buf + off, 4);
+                res->n_addrs++;
+            }
+            else if (type == DNS_TYPE_AAAA && rdlen == 16) {
+                sin6 = (struct sockaddr_in6 *) &res->addrs[res->n_addrs];
+                sin6->sin6_family = AF_INET6;
+                memcpy(&sin6->sin6_addr, buf + off, 16);
+                res->n_addrs++;
+            }
+            if (ttl < res->ttl) {
+                res->ttl = ttl;
+            }
+        }
+        off += rdlen;
+    }
+
+    if (res->n_addrs == 0) {
+        return DNS_NOT_FOUND;
+    }
+
+    /* the sign bit is not valid in a TTL (RFC 2181) */
+    if (res->ttl > INT32_MAX) {
+        res->ttl = 0;
+    }
+
+    return DNS_OK;
+}
+
+/* Resumes the co-routine waiting for the answer */
+static int net_dns_event_handler(void *data)
+{
+    struct dns_query *q = data;
+
+    /* a stale event of a query that already finished */
+    if (q->done) {
+        return 0;
+    }
+
+    flb_thread_resume(q->th);
+    return 0;
+}
+
+/*
+ * Runs every second: resumes the queries past their deadline and
+ * releases the finished ones. A finished query is kept until the next
+ * round, its event can still be pending in the batch the event loop is
+ * dispatching.
+ */
+static int net_dns_timer_handler(void *data)
+{
+    time_t now;
+    struct mk_list *tmp;
+    struct mk_list *head;
+    struct dns_query *q;
+    struct flb_net_dns *dns;
+
+    dns = (struct flb_net_dns *) ((char *) data -
+                                  offsetof(struct flb_net_dns, timer));
+    flb_utils_timer_consume(dns->timer_fd);
+
+    now = time(NULL);
+    mk_list_foreach_safe(head, tmp, &dns->queries) {
+        q = mk_list_entry(head, struct dns_query, _head);
+        if (q->done) {
+            if (++q->done > 2) {
+                mk_list_del(&q->_head);
+                flb_free(q);
+            }
+        }
+        else if (now >= q->deadline) {
+            flb_thread_resume(q->th);
+        }
+    }
+
+    return 0;
+}
+
+static int net_dns_timer_start(struct flb_net_dns *dns,
+                               struct mk_event_loop *evl)
+{
+    int fd;
+
+    if (dns->timer_fd != -1) {
+        return (dns->evl == evl) ? 0 : -1;
+    }
+
+    MK_EVENT_NEW(&dns->timer);
+    fd = mk_event_timeout_create(evl, 1, 0, &dns->timer);
+    if (fd == -1) {
+        flb_error("[dns] could not create the queries timer");
+        return -1;
+    }
+
+    dns->timer.type = FLB_ENGINE_EV_CUSTOM;
+    dns->timer.handler = net_dns_timer_handler;
+    dns->timer_fd = fd;
+    dns->evl = evl;
+
+    return 0;
+}
+
+/*
+ * Send the query to a server and wait for the answer: a co-routine yields
+ * until the socket is readable or the timer resumes it at the deadline,
+ * otherwise the caller blocks on poll().
+ */
+static int net_dns_send(struct flb_net_dns *dns, struct dns_query *q,
+                        int server, unsigned char *query, int query_len,
+                        int qtype, struct dns_result *res)
+{
+    int ret;
+    ssize_t n;
+    time_t now;
+    unsigned char buf[DNS_BUF_SIZE];
+#ifndef _WIN32
+    struct pollfd pfd;
+#endif
+
+    q->fd = flb_net_socket_create_udp(dns->servers[server].ss_family,
+                                      FLB_TRUE);
+    if (q->fd == -1) {
+        return DNS_ERROR;
+    }
+
+    ret = connect(q->fd, (struct sockaddr *) &dns->servers[server],
+                  dns->servers_len[server]);
+    if (ret == -1) {
+        net_dns_query_close(dns, q);
+        return DNS_ERROR;
+    }
+
+    if (q->th) {
+        MK_EVENT_NEW(&q->event);
+        ret = mk_event_add(dns->evl, q->fd, FLB_ENGINE_EV_CUSTOM,
+                           MK_EVENT_READ, &q->event);
+        if (ret == -1) {
+            net_dns_query_close(dns, q);
+            return DNS_ERROR;
+        }
+        q->event.handler = net_dns_event_handler;
+    }
+
+    if (send(q->fd, query, query_len, 0) != query_len) {
+        net_dns_query_close(dns, q);
+        return DNS_ERROR;
+    }
+
+    q->deadline = time(NULL) + dns->timeout;
+    while (1) {
+        n = recv(q->fd, buf, sizeof(buf), 0);
+        if (n > 0) {
+            ret = net_dns_answer(buf, n, query, query_len, qtype, res);
+            if (ret != DNS_IGNORE) {
+                break;
+            }
+            continue;
+        }
+        else if (n == -1 && !FLB_WOULDBLOCK()) {
+            /* e.g: ICMP port unreachable */
+            ret = DNS_ERROR;
+            break;
+        }
+
+        now = time(NULL);
+        if (now >= q->deadline) {
+            ret = DNS_ERROR;
+            break;
+        }
+
+        if (q->th) {
+            flb_thread_yield(q->th, FLB_FALSE);
+        }
+        else {
+#ifndef _WIN32
+            pfd.fd = q->fd;
+            pfd.events = POLLIN;
+            poll(&pfd, 1, (q->deadline - now) * 1000);
+#endif
+        }
+    }
+
+    net_dns_query_close(dns, q);
+    return ret;
+}
+
+/* Ask the servers about 'name', trying each one 'attempts' times */
+static int net_dns_query(struct flb_net_dns *dns, struct dns_query *q,
+                         const char *name, int family,
+                         struct dns_result *res)
+{
+    int i;
+    int ret;
+    int len;
+    int qtype;
+    int attempt;
+    unsigned char query[DNS_HEADER_SIZE + 260];
+
+    qtype = (family == AF_INET6) ? DNS_TYPE_AAAA : DNS_TYPE_A;
+
+    for (attempt = 0; attempt < dns->attempts; attempt++) {
+        for (i = 0; i < dns->n_servers; i++) {
+            pthread_mutex_lock(&dns->lock);
+            q->id = ++dns->query_id;
+            pthread_mutex_unlock(&dns->lock);
+
+            len = net_dns_packet(name, q->id, qtype, query, sizeof(query));
+            if (len == -1) {
+                return DNS_NOT_FOUND;
+            }
+
+            ret = net_dns_send(dns, q, i, query, len, qtype, res);
+            if (ret != DNS_ERROR) {
+                return ret;
+            }
+        }
+    }
+
+    flb_warn("[dns] no answer from the nameservers for '%s'", name);
+    return DNS_ERROR;
+}
+
+/* Try the name and its search domains in the order resolv.conf(5) says */
+static int net_dns_resolve(struct flb_net_dns *dns, struct dns_query *q,
+                           const char *host, int family,
+                           struct dns_result *res)
+{
+    int i;
+    int ret;
+    int dots = 0;
+    size_t len;
+    const char *p;
+    flb_sds_t name;
+
+    len = strlen(host);
+    if (len > 0 && host[len - 1] == '.') {
+        name = flb_sds_create_len((char *) host, len - 1);
+        if (!name) {
+            return DNS_ERROR;
+        }
+        ret = net_dns_query(dns, q, name, family, res);
+        flb_sds_destroy(name);
+        return ret;
+    }
+
+    for (p = host; *p; p++) {
+        if (*p == '.') {
+            dots++;
+        }
+    }
+
+    if (dots >= dns->ndots || dns->n_search == 0) {
+        ret = net_dns_query(dns, q, host, family, res);
+        if (ret != DNS_NOT_FOUND) {
+            return ret;
+        }
+    }
+
+    for (i = 0; i < dns->n_search; i++) {
+        name = flb_sds_create_size(len + flb_sds_len(dns->search[i]) + 2);
+        if (!name) {
+            return DNS_ERROR;
+        }
+        name = flb_sds_printf(&name, "%s.%s", host, dns->search[i]);
+        ret = net_dns_query(dns, q, name, family, res);
+        flb_sds_destroy(name);
+        if (ret != DNS_NOT_FOUND) {
+            return ret;
+        }
+    }
+
+    if (dots < dns->ndots && dns->n_search > 0) {
+        return net_dns_query(dns, q, host, family, res);
+    }
+
+    return DNS_NOT_FOUND;
+}
+
+/*
+ * Resolve 'host' for a socket of the given family (AF_INET or AF_INET6)
+ * and store the next address in 'addr' with 'port' set. When 'th' is set
+ * the queries yield the co-routine on the event loop 'evl' while waiting.
+ */
+int flb_net_dns_lookup(struct flb_net_dns *dns, const char *host, int port,
+                       int family, struct mk_event_loop *evl,
+                       struct flb_thread *th,
+                       struct sockaddr_storage *addr, socklen_t *addr_len)
+{
+    int ret;
+    struct dns_query sq;
+    struct dns_query *q;
+    struct dns_result res;
+
+    /* an address needs no lookup */
+    ret = net_dns_sockaddr(host, port, family, addr, addr_len);
+    if (ret == 0) {
+        return 0;
+    }
+
+    ret = net_dns_cache_get(dns, host, port, family, addr, addr_len);
+    if (ret == 0) {
+        return 0;
+    }
+
+    if (dns->n_servers == 0 || net_dns_is_local(dns, host) == FLB_TRUE) {
+        ret = net_dns_system(host, family, &res);
+    }
+    else {
+        if (th && evl && net_dns_timer_start(dns, evl) == 0) {
+            /* it lives in the list until the timer releases it */
+            q = flb_calloc(1, sizeof(struct dns_query));
+            if (!q) {
+                flb_errno();
+                return -1;
+            }
+            q->th = th;
+            mk_list_add(&q->_head, &dns->queries);
+        }
+        else {
+            memset(&sq, '\0', sizeof(sq));
+            q = &sq;
+        }
+        q->fd = -1;
+        MK_EVENT_NEW(&q->event);
+
+        ret = net_dns_resolve(dns, q, host, family, &res);
+        q->done = 1;
+
+        if (ret == DNS_NOT_FOUND) {
+            flb_warn("[dns] could not resolve '%s'", host);
+        }
+    }
+
+    if (ret != DNS_OK) {
+        return -1;
+    }
+
+    return net_dns_cache_set(dns, host, port, family, &res, addr, addr_len);
+}
@@ -0,0 +1,593 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2019      The Fluent Bit Authors
+ *  Copyright (C) 2015-2018 Treasure Data Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_mem.h>
+#include <fluent-bit/flb_log.h>
+#include <fluent-bit/flb_sds.h>
+#include <fluent-bit/flb_engine.h>
+#include <fluent-bit/flb_network.h>
+#include <fluent-bit/flb_worker.h>
+#include <fluent-bit/flb_input_chunk.h>
+#include <fluent-bit/flb_net_workers.h>
+
+#include <errno.h>
+
+/* Records decoded by a worker, handed to the engine thread */
+struct net_workers_batch {
+    int records;
+    flb_sds_t tag;
+    char *buf;
+    size_t size;
+    struct mk_list _head;
+};
+
+/*
+ * Worker batch flush callback: the buffer ownership is transferred to the
+ * engine thread through the queue. If the queue is full the worker waits
+ * for the engine to take a batch, so it stops reading its connections.
+ */
+static int worker_batch_dispatch(struct flb_input_batch *batch, void *data)
+{
+    char val = 0;
+    struct net_workers_batch *b;
+    struct flb_net_worker *worker = data;
+    struct flb_net_workers *ws = worker->parent;
+
+    b = flb_malloc(sizeof(struct net_workers_batch));
+    if (!b) {
+        flb_errno();
+        return -1;
+    }
+
+    b->records = batch->records;
+    b->tag = NULL;
+    if (batch->tag) {
+        b->tag = flb_sds_create_len(batch->tag, flb_sds_len(batch->tag));
+        if (!b->tag) {
+            flb_errno();
+            flb_free(b);
+            return -1;
+        }
+    }
+    b->size = batch->mp_sbuf.size;
+    b->buf = msgpack_sbuffer_release(&batch->mp_sbuf);
+
+    pthread_mutex_lock(&ws->lock);
+    while (ws->queue_len >= FLB_NET_WORKERS_QUEUE_MAX &&
+           ws->exit == FLB_FALSE) {
+        pthread_cond_wait(&ws->cond, &ws->lock);
+    }
+    mk_list_add(&b->_head, &ws->queue);
+    ws->queue_len++;
+    pthread_mutex_unlock(&ws->lock);
+
+    /*
+     * Wake up the engine thread. The channel is non-blocking: if it's full
+     * the engine has wake ups pending already.
+     */
+    flb_pipe_w(ws->ch_batches[1], &val, sizeof(val));
+
+    return 0;
+}
+
+/* Read a message from the worker control channel */
+static int worker_control(struct flb_net_worker *worker)
+{
+    int ret;
+    uint64_t val;
+
+    ret = flb_pipe_r(worker->ch_ctl[0], &val, sizeof(val));
+    if (ret != sizeof(val)) {
+        flb_errno();
+        return FLB_NET_WORKER_EXIT;
+    }
+
+    return (int) val;
+}
+
+/*
+ * The input instance was paused: hand the pending records to the engine
+ * and stop reading the connections until it's resumed, the clients are
+ * throttled by the socket buffers meanwhile.
+ */
+static int worker_pause(struct flb_net_worker *worker)
+{
+    int msg;
+
+    flb_debug("[net_workers] %s worker #%i paused",
+              worker->parent->in->name, worker->id);
+
+    flb_input_batch_flush(&worker->batch);
+
+    /* the control channel is blocking */
+    do {
+        msg = worker_control(worker);
+    } while (msg != FLB_NET_WORKER_RESUME && msg != FLB_NET_WORKER_EXIT);
+
+    return msg;
+}
+
+static void worker_accept(struct flb_net_worker *worker)
+{
+    flb_sockfd_t fd;
+    struct flb_net_workers *ws = worker->parent;
+
+    /* The listening socket is non-blocking, accept the whole backlog */
+    while (1) {
+        fd = flb_net_accept(worker->server_fd);
+        if (fd == -1) {
+            break;
+        }
+
+        flb_trace("[net_workers] worker #%i new connection fd=%i",
+                  worker->id, fd);
+        ws->cb_accept(fd, worker, ws->data);
+    }
+}
+
+static void worker_run(void *data)
+{
+    int msg;
+    int stop = FLB_FALSE;
+    struct mk_event *event;
+    struct flb_net_worker *worker = data;
+
+    flb_debug("[net_workers] %s worker #%i started",
+              worker->parent->in->name, worker->id);
+
+    while (stop == FLB_FALSE) {
+        mk_event_wait(worker->evl);
+        mk_event_foreach(event, worker->evl) {
+            if (event == &worker->ch_event) {
+                msg = worker_control(worker);
+                if (msg == FLB_NET_WORKER_PAUSE) {
+                    msg = worker_pause(worker);
+                }
+                if (msg == FLB_NET_WORKER_EXIT) {
+                    stop = FLB_TRUE;
+                }
+            }
+            else if (event == &worker->server_event) {
+                if (worker->parent->type == FLB_NET_WORKERS_UDP) {
+                    worker->parent->cb_read(worker, worker->parent->data);
+                }
+                else {
+                    worker_accept(worker);
+                }
+            }
+            else if (event->type == FLB_ENGINE_EV_CUSTOM) {
+                event->handler(event);
+            }
+        }
+
+        /* Hand the records decoded in this round to the engine */
+        flb_input_batch_flush(&worker->batch);
+    }
+
+    flb_debug("[net_workers] %s worker #%i stopped",
+              worker->parent->in->name, worker->id);
+}
+
+static void worker_destroy(struct flb_net_worker *worker)
+{
+    struct flb_net_workers *ws = worker->parent;
+
+    if (ws->cb_exit) {
+        ws->cb_exit(worker, ws->data);
+    }
+
+    if (worker->evl) {
+        if (worker->server_fd != -1) {
+            mk_event_del(worker->evl, &worker->server_event);
+        }
+        if (worker->ch_ctl[0] > 0) {
+            mk_event_del(worker->evl, &worker->ch_event);
+            flb_pipe_destroy(worker->ch_ctl);
+        }
+        mk_event_loop_destroy(worker->evl);
+    }
+
+    if (worker->server_fd != -1 && worker->server_fd != ws->server_fd) {
+        flb_socket_close(worker->server_fd);
+    }
+
+    flb_input_batch_destroy(&worker->batch);
+    flb_free(worker);
+}
+
+static struct flb_net_worker *worker_create(struct flb_net_workers *ws,
+                                            int id, char *listen, char *port)
+{
+    int ret;
+    struct flb_net_worker *worker;
+
+    worker = flb_calloc(1, sizeof(struct flb_net_worker));
+    if (!worker) {
+        flb_errno();
+        return NULL;
+    }
+    worker->id = id;
+    worker->parent = ws;
+    worker->server_fd = -1;
+    mk_list_init(&worker->connections);
+
+    flb_input_batch_init(&worker->batch, ws->in, 0);
+    worker->batch.cb_flush = worker_batch_dispatch;
+    worker->batch.cb_data = worker;
+
+    worker->evl = mk_event_loop_create(256);
+    if (!worker->evl) {
+        worker_destroy(worker);
+        return NULL;
+    }
+
+    /* Control channel: exit, pause and resume */
+    MK_EVENT_ZERO(&worker->ch_event);
+    ret = mk_event_channel_create(worker->evl,
+                                  &worker->ch_ctl[0], &worker->ch_ctl[1],
+                                  &worker->ch_event);
+    if (ret != 0) {
+        worker->ch_ctl[0] = -1;
+        worker_destroy(worker);
+        return NULL;
+    }
+
+    /* Listening socket */
+    if (ws->server_fd != -1) {
+        worker->server_fd = ws->server_fd;
+    }
+    else {
+        if (ws->type == FLB_NET_WORKERS_UDP) {
+            worker->server_fd = flb_net_server_udp_reuseport(port, listen);
+        }
+        else {
+            worker->server_fd = flb_net_server_reuseport(port, listen);
+        }
+        if (worker->server_fd == -1) {
+            flb_error("[net_workers] could not bind address %s:%s",
+                      listen, port);
+            worker_destroy(worker);
+            return NULL;
+        }
+        flb_net_socket_nonblocking(worker->server_fd);
+    }
+
+    MK_EVENT_NEW(&worker->server_event);
+    worker->server_event.fd = worker->server_fd;
+    ret = mk_event_add(worker->evl, worker->server_fd,
+                       FLB_ENGINE_EV_CORE, MK_EVENT_READ,
+                       &worker->server_event);
+    if (ret == -1) {
+        worker_destroy(worker);
+        return NULL;
+    }
+
+    if (ws->cb_init) {
+        ret = ws->cb_init(worker, ws->data);
+        if (ret == -1) {
+            worker_destroy(worker);
+            return NULL;
+        }
+    }
+
+    return worker;
+}
+
+static struct flb_net_workers *workers_new(struct flb_input_instance *in,
+                                           int type, int count, void *data)
+{
+    int ret;
+    flb_pipefd_t ch[2];
+    struct flb_net_workers *ws;
+
+    ws = flb_calloc(1, sizeof(struct flb_net_workers));
+    if (!ws) {
+        flb_errno();
+        return NULL;
+    }
+    ws->type = type;
+    ws->count = count;
+    ws->server_fd = -1;
+    ws->data = data;
+    ws->in = in;
+    ws->exit = FLB_FALSE;
+    ws->queue_len = 0;
+    mk_list_init(&ws->queue);
+    mk_list_init(&ws->workers);
+    pthread_mutex_init(&ws->lock, NULL);
+    pthread_cond_init(&ws->cond, NULL);
+
+    ret = flb_pipe_create(ch);
+    if (ret == -1) {
+        flb_errno();
+        pthread_mutex_destroy(&ws->lock);
+        pthread_cond_destroy(&ws->cond);
+        flb_free(ws);
+        return NULL;
+    }
+    if (sizeof(ch) > sizeof(ws->ch_batches)) {
+        flb_pipe_destroy(ch);
+        pthread_mutex_destroy(&ws->lock);
+        pthread_cond_destroy(&ws->cond);
+        flb_free(ws);
+        return NULL;
+    }
+    memcpy(ws->ch_batches, ch, sizeof(ch));
+    flb_pipe_set_nonblocking(ws->ch_batches[0]);
+    flb_pipe_set_nonblocking(ws->ch_batches[1]);
+
+    return ws;
+}
+
+/* Bind the sockets and start the threads, 'ws' is released on error */
+static int workers_start(struct flb_net_workers *ws, char *listen, char *port)
+{
+    int i;
+    int ret;
+    struct flb_net_worker *worker;
+
+#ifndef SO_REUSEPORT
+    /* All the workers wait on the same socket */
+    if (ws->type == FLB_NET_WORKERS_UDP) {
+        ws->server_fd = flb_net_server_udp(port, listen);
+    }
+    else {
+        ws->server_fd = flb_net_server(port, listen);
+    }
+    if (ws->server_fd == -1) {
+        flb_error("[net_workers] could not bind address %s:%s",
+                  listen, port);
+        flb_net_workers_destroy(ws);
+        return -1;
+    }
+    flb_net_socket_nonblocking(ws->server_fd);
+#endif
+
+    for (i = 0; i < ws->count; i++) {
+        worker = worker_create(ws, i, listen, port);
+        if (!worker) {
+            flb_net_workers_destroy(ws);
+            return -1;
+        }
+
+        ret = flb_worker_create(worker_run, worker, &worker->tid,
+                                ws->in->config);
+        if (ret == -1) {
+            flb_error("[net_workers] could not start worker thread");
+            worker_destroy(worker);
+            flb_net_workers_destroy(ws);
+            return -1;
+        }
+        mk_list_add(&worker->_head, &ws->workers);
+    }
+
+    flb_info("[net_workers] %s: %i %s workers listening on %s:%s",
+             ws->in->name, ws->count,
+             ws->type == FLB_NET_WORKERS_UDP ? "UDP" : "TCP",
+             listen, port);
+
+    return 0;
+}
+
+/*
+ * Create 'count' workers listening on 'listen:port'. The caller must
+ * register a collector for 'ch_batches[0]' that invokes
+ * flb_net_workers_collect().
+ */
+struct flb_net_workers *flb_net_workers_create(struct flb_input_instance *in,
+                                               char *listen, char *port,
+                                               int count,
+                                               int (*cb_accept) (flb_sockfd_t,
+                                                                 struct flb_net_worker *,
+                                                                 void *),
+                                               void (*cb_exit) (struct flb_net_worker *,
+                                                                void *),
+                                               void *data)
+{
+    int ret;
+    struct flb_net_workers *ws;
+
+    ws = workers_new(in, FLB_NET_WORKERS_TCP, count, data);
+    if (!ws) {
+        return NULL;
+    }
+    ws->cb_accept = cb_accept;
+    ws->cb_exit = cb_exit;
+
+    ret = workers_start(ws, listen, port);
+    if (ret == -1) {
+        return NULL;
+    }
+
+    return ws;
+}
+
+/*
+ * Same as flb_net_workers_create() for an UDP input: every worker reads
+ * the datagrams of its socket in cb_read(). cb_init() can attach the
+ * per worker data, like the receive buffers, and set the socket options.
+ */
+struct flb_net_workers *flb_net_workers_create_udp(struct flb_input_instance *in,
+                                                   char *listen, char *port,
+                                                   int count,
+                                                   int (*cb_init) (struct flb_net_worker *,
+                                                                   void *),
+                                                   void (*cb_read) (struct flb_net_worker *,
+                                                                    void *),
+                                                   void (*cb_exit) (struct flb_net_worker *,
+                                                                    void *),
+                                                   void *data)
+{
+    int ret;
+    struct flb_net_workers *ws;
+
+    ws = workers_new(in, FLB_NET_WORKERS_UDP, count, data);
+    if (!ws) {
+        return NULL;
+    }
+    ws->cb_init = cb_init;
+    ws->cb_read = cb_read;
+    ws->cb_exit = cb_exit;
+
+    ret = workers_start(ws, listen, port);
+    if (ret == -1) {
+        return NULL;
+    }
+
+    return ws;
+}
+
+/*
+ * Take the queued batches, 'append' is false when releasing them. Appending
+ * stops if the instance gets paused, the remaining batches are kept.
+ */
+static int batches_read(struct flb_net_workers *ws, int append)
+{
+    int tag_len;
+    struct net_workers_batch *b;
+
+    while (1) {
+        if (append == FLB_TRUE && flb_input_buf_paused(ws->in) == FLB_TRUE) {
+            break;
+        }
+
+        pthread_mutex_lock(&ws->lock);
+        if (ws->queue_len == 0) {
+            pthread_mutex_unlock(&ws->lock);
+            break;
+        }
+        b = mk_list_entry_first(&ws->queue, struct net_workers_batch, _head);
+        mk_list_del(&b->_head);
+        ws->queue_len--;
+        pthread_cond_broadcast(&ws->cond);
+        pthread_mutex_unlock(&ws->lock);
+
+        if (append == FLB_TRUE) {
+            tag_len = b->tag ? flb_sds_len(b->tag) : 0;
+            flb_input_chunk_append_records(ws->in, b->records,
+                                           b->tag, tag_len,
+                                           b->buf, b->size);
+        }
+
+        flb_sds_destroy(b->tag);
+        flb_free(b->buf);
+        flb_free(b);
+    }
+
+    return 0;
+}
+
+/* Engine thread: append the records decoded by the workers */
+int flb_net_workers_collect(struct flb_net_workers *ws)
+{
+    char buf[64];
+
+    /* Consume the wake ups */
+    while (flb_pipe_r(ws->ch_batches[0], buf, sizeof(buf)) > 0);
+
+    /* A paused instance can't take records, keep them until it's resumed */
+    if (flb_input_buf_paused(ws->in) == FLB_TRUE) {
+        return 0;
+    }
+
+    return batches_read(ws, FLB_TRUE);
+}
+
+static void workers_control(struct flb_net_workers *ws, uint64_t msg)
+{
+    struct mk_list *head;
+    struct flb_net_worker *worker;
+
+    mk_list_foreach(head, &ws->workers) {
+        worker = mk_list_entry(head, struct flb_net_worker, _head);
+        flb_pipe_w(worker->ch_ctl[1], &msg, sizeof(msg));
+    }
+}
+
+/* Input instance cb_pause: the workers stop reading their connections */
+void flb_net_workers_pause(struct flb_net_workers *ws)
+{
+    workers_control(ws, FLB_NET_WORKER_PAUSE);
+}
+
+/* Input instance cb_resume */
+void flb_net_workers_resume(struct flb_net_workers *ws)
+{
+    char val = 0;
+
+    workers_control(ws, FLB_NET_WORKER_RESUME);
+
+    /* Collect the batches queued while paused */
+    flb_pipe_w(ws->ch_batches[1], &val, sizeof(val));
+}
+
+/*
+ * Append the batches not collected by the engine: their records were read
+ * from the clients already. At shutdown the instance is paused before the
+ * plugins exit, the status is lifted for this last append; with filesystem
+ * storage the chunks are processed on the next start.
+ */
+static void batches_flush_all(struct flb_net_workers *ws)
+{
+    int status;
+
+    status = ws->in->mem_buf_status;
+    ws->in->mem_buf_status = FLB_INPUT_RUNNING;
+    batches_read(ws, FLB_TRUE);
+    if (status == FLB_INPUT_PAUSED) {
+        ws->in->mem_buf_status = FLB_INPUT_PAUSED;
+    }
+}
+
+void flb_net_workers_destroy(struct flb_net_workers *ws)
+{
+    struct mk_list *tmp;
+    struct mk_list *head;
+    struct flb_net_worker *worker;
+
+    /* Workers waiting for room in the queue must not block anymore */
+    pthread_mutex_lock(&ws->lock);
+    ws->exit = FLB_TRUE;
+    pthread_cond_broadcast(&ws->cond);
+    pthread_mutex_unlock(&ws->lock);
+
+    workers_control(ws, FLB_NET_WORKER_EXIT);
+    batches_flush_all(ws);
+
+    mk_list_foreach_safe(head, tmp, &ws->workers) {
+        worker = mk_list_entry(head, struct flb_net_worker, _head);
+        pthread_join(worker->tid, NULL);
+        mk_list_del(&worker->_head);
+        worker_destroy(worker);
+    }
+
+    /* Batches dispatched by the workers while exiting */
+    batches_flush_all(ws);
+    batches_read(ws, FLB_FALSE);
+    flb_pipe_destroy(ws->ch_batches);
+
+    if (ws->server_fd != -1) {
+        flb_socket_close(ws->server_fd);
+    }
+    pthread_mutex_destroy(&ws->lock);
+    pthread_cond_destroy(&ws->cond);
+    flb_free(ws);
+}
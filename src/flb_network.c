@@ -121,6 +121,43 @@ int flb_net_socket_reset(flb_sockfd_t fd)
     return 0;
 }
 
+/*
+ * Allow multiple sockets to bind the same address and port, the Kernel
+ * distribute the incoming traffic across them (Linux >= 3.9).
+ */
+int flb_net_socket_reuseport(flb_sockfd_t fd)
+{
+#ifdef SO_REUSEPORT
+    int on = 1;
+    int ret;
+
+    ret = setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on));
+    if (ret == -1) {
+        flb_errno();
+        return -1;
+    }
+
+    return 0;
+#else
+    flb_warn("[network] SO_REUSEPORT is not supported on this system");
+    return -1;
+#endif
+}
+
+/* Set the size of the Kernel receive buffer (SO_RCVBUF) for the socket */
+int flb_net_socket_rcvbuf(flb_sockfd_t fd, int size)
+{
+    int ret;
+
+    ret = setsockopt(fd, SOL_SOCKET, SO_RCVBUF, (void *) &size, sizeof(size));
+    if (ret == -1) {
+        flb_errno();
+        return -1;
+    }
+
+    return 0;
+}
+
 int flb_net_socket_tcp_nodelay(flb_sockfd_t fd)
 {
     int on = 1;
@@ -314,7 +351,7 @@ int flb_net_tcp_fd_connect(flb_sockfd_t fd, char *host, unsigned long port)
     return ret;
 }
 
-flb_sockfd_t flb_net_server(char *port, char *listen_addr)
+static flb_sockfd_t net_server(char *port, char *listen_addr, int reuseport)
 {
     flb_sockfd_t fd = -1;
     int ret;
@@ -343,6 +380,11 @@ flb_sockfd_t flb_net_server(char *port, char *listen_addr)
         flb_net_socket_tcp_nodelay(fd);
         flb_net_socket_reset(fd);
 
+        if (reuseport == FLB_TRUE && flb_net_socket_reuseport(fd) == -1) {
+            flb_socket_close(fd);
+            continue;
+        }
+
         ret = flb_net_bind(fd, rp->ai_addr, rp->ai_addrlen, 128);
         if(ret == -1) {
             flb_warn("Cannot listen on %s port %s", listen_addr, port);
@@ -360,7 +402,23 @@ flb_sockfd_t flb_net_server(char *port, char *listen_addr)
     return fd;
 }
 
-flb_sockfd_t flb_net_server_udp(char *port, char *listen_addr)
+flb_sockfd_t flb_net_server(char *port, char *listen_addr)
+{
+    return net_server(port, listen_addr, FLB_FALSE);
+}
+
+/*
+ * Same as flb_net_server() but the socket is created with SO_REUSEPORT, so
+ * many listeners can be bound to the same address and the Kernel balance
+ * the incoming connections across them.
+ */
+flb_sockfd_t flb_net_server_reuseport(char *port, char *listen_addr)
+{
+    return net_server(port, listen_addr, FLB_TRUE);
+}
+
+static flb_sockfd_t net_server_udp(char *port, char *listen_addr,
+                                   int reuseport)
 {
     flb_sockfd_t fd = -1;
     int ret;
@@ -386,6 +444,11 @@ flb_sockfd_t flb_net_server_udp(char *port, char *listen_addr)
             continue;
         }
 
+        if (reuseport == FLB_TRUE && flb_net_socket_reuseport(fd) == -1) {
+            flb_socket_close(fd);
+            continue;
+        }
+
         ret = flb_net_bind_udp(fd, rp->ai_addr, rp->ai_addrlen);
         if(ret == -1) {
             flb_warn("Cannot listen on %s port %s", listen_addr, port);
@@ -403,6 +466,20 @@ flb_sockfd_t flb_net_server_udp(char *port, char *listen_addr)
     return fd;
 }
 
+flb_sockfd_t flb_net_server_udp(char *port, char *listen_addr)
+{
+    return net_server_udp(port, listen_addr, FLB_FALSE);
+}
+
+/*
+ * Same as flb_net_server_udp() but the socket is created with SO_REUSEPORT,
+ * so the same address can be bound by many sockets (e.g: one per thread).
+ */
+flb_sockfd_t flb_net_server_udp_reuseport(char *port, char *listen_addr)
+{
+    return net_server_udp(port, listen_addr, FLB_TRUE);
+}
+
 int flb_net_bind(flb_sockfd_t fd, const struct sockaddr *addr,
                  socklen_t addrlen, int backlog)
 {
@@ -451,7 +528,7 @@ flb_sockfd_t flb_net_accept(flb_sockfd_t server_fd)
     flb_net_socket_nonblocking(remote_fd);
 #endif
 
-    if (remote_fd == -1) {
+    if (remote_fd == -1 && errno != EAGAIN && errno != EWOULDBLOCK) {
         perror("accept4");
     }
 
@@ -25,8 +25,11 @@
 #include <fluent-bit/flb_oauth2.h>
 #include <fluent-bit/flb_upstream.h>
 #include <fluent-bit/flb_http_client.h>
+#include <fluent-bit/flb_worker.h>
 
 #include <jsmn/jsmn.h>
+#include <errno.h>
+#include <time.h>
 
 #define free_temporal_buffers()                 \
     if (prot) {                                 \
@@ -123,6 +126,8 @@ int flb_oauth2_parse_json_response(char *json_data, size_t json_size,
     if (!ctx->access_token || !ctx->token_type || ctx->expires_in < 60) {
         flb_sds_destroy(ctx->access_token);
         flb_sds_destroy(ctx->token_type);
+        ctx->access_token = NULL;
+        ctx->token_type = NULL;
         ctx->expires_in = 0;
         return -1;
     }
@@ -400,3 +405,268 @@ int flb_oauth2_token_expired(struct flb_oauth2 *ctx)
 
     return FLB_FALSE;
 }
+
+/*
+ * Request a new token through the first registered user and store it in
+ * the shared context. The users lock is held so the user data is not
+ * released in the middle of the request.
+ */
+static int shared_refresh(struct flb_oauth2_shared *s)
+{
+    time_t expires;
+    flb_sds_t token = NULL;
+    struct flb_oauth2 *o = NULL;
+    struct flb_oauth2_shared_user *user;
+
+    pthread_mutex_lock(&s->users_lock);
+    if (mk_list_is_empty(&s->users) != 0) {
+        user = mk_list_entry_first(&s->users, struct flb_oauth2_shared_user,
+                                   _head);
+        o = user->cb_token(user->data);
+    }
+    pthread_mutex_unlock(&s->users_lock);
+
+    if (!o) {
+        return -1;
+    }
+
+    if (!o->access_token) {
+        flb_oauth2_destroy(o);
+        return -1;
+    }
+
+    token = flb_sds_create(o->access_token);
+    if (!token) {
+        flb_errno();
+        flb_oauth2_destroy(o);
+        return -1;
+    }
+
+    /* Prefer the lifetime reported by the server */
+    if (o->expires_in > 0) {
+        expires = time(NULL) + o->expires_in;
+    }
+    else {
+        expires = o->expires;
+    }
+    flb_oauth2_destroy(o);
+
+    pthread_mutex_lock(&s->lock);
+    flb_sds_destroy(s->access_token);
+    s->access_token = token;
+    s->expires = expires;
+    pthread_mutex_unlock(&s->lock);
+
+    flb_debug("[oauth2] token '%s' refreshed, expires in %lus",
+              s->key, (unsigned long) (expires - time(NULL)));
+    return 0;
+}
+
+/* Time for the next refresh of a token valid until 'expires' */
+static time_t shared_next_refresh(time_t expires)
+{
+    time_t now;
+    time_t lifetime;
+
+    now = time(NULL);
+    lifetime = expires - now;
+    if (lifetime > FLB_OAUTH2_REFRESH_MARGIN * 2) {
+        return expires - FLB_OAUTH2_REFRESH_MARGIN;
+    }
+
+    /* Short lived token, refresh at the half of it life */
+    return now + (lifetime > 0 ? lifetime / 2 : 0);
+}
+
+static void shared_worker(void *data)
+{
+    int ret;
+    int retry = FLB_OAUTH2_REFRESH_RETRY;
+    time_t next;
+    struct timespec ts;
+    struct flb_oauth2_shared *s = data;
+
+    pthread_mutex_lock(&s->lock);
+    if (s->access_token) {
+        next = shared_next_refresh(s->expires);
+    }
+    else {
+        next = time(NULL) + retry;
+    }
+
+    while (s->stop == FLB_FALSE) {
+        ts.tv_sec = next;
+        ts.tv_nsec = 0;
+        ret = pthread_cond_timedwait(&s->cond, &s->lock, &ts);
+        if (s->stop == FLB_TRUE) {
+            break;
+        }
+        if (ret != ETIMEDOUT) {
+            continue;
+        }
+        pthread_mutex_unlock(&s->lock);
+
+        ret = shared_refresh(s);
+        if (ret == 0) {
+            retry = FLB_OAUTH2_REFRESH_RETRY;
+        }
+        else {
+            flb_warn("[oauth2] token '%s' refresh failed, retrying in %is",
+                     s->key, retry);
+        }
+
+        pthread_mutex_lock(&s->lock);
+        if (ret == 0) {
+            next = shared_next_refresh(s->expires);
+        }
+        else {
+            next = time(NULL) + retry;
+            retry = retry * 2;
+            if (retry > FLB_OAUTH2_REFRESH_MARGIN) {
+                retry = FLB_OAUTH2_REFRESH_MARGIN;
+            }
+        }
+    }
+    pthread_mutex_unlock(&s->lock);
+}
+
+static void shared_destroy(struct flb_oauth2_shared *s)
+{
+    pthread_mutex_lock(&s->lock);
+    s->stop = FLB_TRUE;
+    pthread_cond_signal(&s->cond);
+    pthread_mutex_unlock(&s->lock);
+    pthread_join(s->tid, NULL);
+
+    pthread_cond_destroy(&s->cond);
+    pthread_mutex_destroy(&s->users_lock);
+    pthread_mutex_destroy(&s->lock);
+
+    flb_sds_destroy(s->access_token);
+    flb_sds_destroy(s->key);
+    mk_list_del(&s->_head);
+    flb_free(s);
+}
+
+/*
+ * Get the shared token for the credentials identified by 'key'. The first
+ * caller obtains the initial token (blocking) and starts the background
+ * refresh; the next ones are registered as users of the same token.
+ */
+struct flb_oauth2_shared *flb_oauth2_shared_get(struct flb_config *config,
+                                                char *key,
+                                                struct flb_oauth2 *(*cb_token) (void *),
+                                                void *data)
+{
+    int ret;
+    struct mk_list *head;
+    struct flb_oauth2_shared *s = NULL;
+    struct flb_oauth2_shared_user *user;
+    pthread_condattr_t attr;
+
+    user = flb_malloc(sizeof(struct flb_oauth2_shared_user));
+    if (!user) {
+        flb_errno();
+        return NULL;
+    }
+    user->cb_token = cb_token;
+    user->data = data;
+
+    mk_list_foreach(head, &config->oauth2_tokens) {
+        s = mk_list_entry(head, struct flb_oauth2_shared, _head);
+        if (strcmp(s->key, key) == 0) {
+            pthread_mutex_lock(&s->users_lock);
+            mk_list_add(&user->_head, &s->users);
+            pthread_mutex_unlock(&s->users_lock);
+            flb_debug("[oauth2] using shared token '%s'", key);
+            return s;
+        }
+    }
+
+    s = flb_calloc(1, sizeof(struct flb_oauth2_shared));
+    if (!s) {
+        flb_errno();
+        flb_free(user);
+        return NULL;
+    }
+    s->key = flb_sds_create(key);
+    if (!s->key) {
+        flb_errno();
+        flb_free(user);
+        flb_free(s);
+        return NULL;
+    }
+    s->config = config;
+    mk_list_init(&s->users);
+    mk_list_add(&user->_head, &s->users);
+
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_mutex_init(&s->users_lock, NULL);
+
+    /* pthread_cond_timedwait() expects a wall clock deadline */
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_REALTIME);
+    pthread_cond_init(&s->cond, &attr);
+    pthread_condattr_destroy(&attr);
+
+    /* Initial token, the worker retries on failure */
+    shared_refresh(s);
+
+    ret = flb_worker_create(shared_worker, s, &s->tid, config);
+    if (ret == -1) {
+        flb_error("[oauth2] could not start token refresh thread");
+        pthread_cond_destroy(&s->cond);
+        pthread_mutex_destroy(&s->users_lock);
+        pthread_mutex_destroy(&s->lock);
+        flb_sds_destroy(s->access_token);
+        flb_sds_destroy(s->key);
+        flb_free(user);
+        flb_free(s);
+        return NULL;
+    }
+    mk_list_add(&s->_head, &config->oauth2_tokens);
+
+    return s;
+}
+
+/* Unregister the user owning 'data', the last one stops the refresh */
+void flb_oauth2_shared_release(struct flb_oauth2_shared *s, void *data)
+{
+    int empty;
+    struct mk_list *tmp;
+    struct mk_list *head;
+    struct flb_oauth2_shared_user *user;
+
+    pthread_mutex_lock(&s->users_lock);
+    mk_list_foreach_safe(head, tmp, &s->users) {
+        user = mk_list_entry(head, struct flb_oauth2_shared_user, _head);
+        if (user->data == data) {
+            mk_list_del(&user->_head);
+            flb_free(user);
+            break;
+        }
+    }
+    empty = mk_list_is_empty(&s->users) == 0;
+    pthread_mutex_unlock(&s->users_lock);
+
+    if (empty) {
+        shared_destroy(s);
+    }
+}
+
+/*
+ * Copy of the current access token, NULL if no valid token is available.
+ * The caller must release it with flb_sds_destroy().
+ */
+flb_sds_t flb_oauth2_shared_token(struct flb_oauth2_shared *s)
+{
+    flb_sds_t token = NULL;
+
+    pthread_mutex_lock(&s->lock);
+    if (s->access_token && s->expires > time(NULL)) {
+        token = flb_sds_create(s->access_token);
+    }
+    pthread_mutex_unlock(&s->lock);
+
+    return token;
+}
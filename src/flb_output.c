@@ -113,8 +113,83 @@ static void flb_output_free_properties(struct flb_output_instance *ins)
 #endif
 }
 
+/* Max number of co-routines kept by the pool of an output instance */
+#define FLB_OUTPUT_THREAD_POOL_MAX   256
+
+/* Take a co-routine from the pool, NULL if it's empty */
+struct flb_thread *flb_output_thread_pool_get(struct flb_output_instance *ins)
+{
+#if defined FLB_HAVE_FLUSH_LIBCO
+    struct flb_output_thread *out_th;
+
+    if (ins->th_pool_size == 0) {
+        return NULL;
+    }
+
+    out_th = mk_list_entry_first(&ins->th_pool, struct flb_output_thread,
+                                 _head);
+    mk_list_del(&out_th->_head);
+    ins->th_pool_size--;
+
+#ifdef FLB_HAVE_METRICS
+    if (ins->metrics) {
+        flb_metrics_sum(FLB_METRIC_OUT_CORO_REUSED, 1, ins->metrics);
+    }
+#endif
+
+    return out_th->parent;
+#else
+    return NULL;
+#endif
+}
+
+/*
+ * Keep the co-routine of a finished flush for the next one. It must be
+ * parked in FLB_OUTPUT_RETURN(), where the flush callback ends. Returns -1
+ * when the pool is full and the caller must destroy it.
+ */
+int flb_output_thread_pool_put(struct flb_output_instance *ins,
+                               struct flb_thread *th)
+{
+#if defined FLB_HAVE_FLUSH_LIBCO
+    struct flb_output_thread *out_th;
+
+    ins->th_active--;
+    if (ins->th_pool_size >= ins->th_peak ||
+        ins->th_pool_size >= FLB_OUTPUT_THREAD_POOL_MAX) {
+        return -1;
+    }
+
+    out_th = (struct flb_output_thread *) FLB_THREAD_DATA(th);
+    out_th->task = NULL;
+    out_th->buffer = NULL;
+    mk_list_add(&out_th->_head, &ins->th_pool);
+    ins->th_pool_size++;
+
+    return 0;
+#else
+    return -1;
+#endif
+}
+
+static void output_thread_pool_destroy(struct flb_output_instance *ins)
+{
+    struct mk_list *tmp;
+    struct mk_list *head;
+    struct flb_output_thread *out_th;
+
+    mk_list_foreach_safe(head, tmp, &ins->th_pool) {
+        out_th = mk_list_entry(head, struct flb_output_thread, _head);
+        mk_list_del(&out_th->_head);
+        flb_thread_destroy(out_th->parent);
+    }
+    ins->th_pool_size = 0;
+}
+
 int flb_output_instance_destroy(struct flb_output_instance *ins)
 {
+    output_thread_pool_destroy(ins);
+
     if (ins->alias) {
         flb_free(ins->alias);
     }
@@ -295,6 +370,7 @@ struct flb_output_instance *flb_output_new(struct flb_config *config,
 #endif
     instance->retry_limit = 1;
     instance->host.name   = NULL;
+    mk_list_init(&instance->th_pool);
 
     /* Parent plugin flags */
     flags = instance->flags;
@@ -535,6 +611,20 @@ int flb_output_init(struct flb_config *config)
                             "retries", ins->metrics);
             flb_metrics_add(FLB_METRIC_OUT_RETRY_FAILED,
                         "retries_failed", ins->metrics);
+            flb_metrics_add(FLB_METRIC_OUT_CORO_NEW,
+                            "coro_created", ins->metrics);
+            flb_metrics_add(FLB_METRIC_OUT_CORO_REUSED,
+                            "coro_reused", ins->metrics);
+#ifdef FLB_HAVE_TLS
+            if (ins->flags & FLB_IO_TLS) {
+                flb_metrics_add(FLB_METRIC_OUT_TLS_HANDSHAKES,
+                                "tls_handshakes", ins->metrics);
+                flb_metrics_add(FLB_METRIC_OUT_TLS_RESUMED,
+                                "tls_resumed", ins->metrics);
+                flb_metrics_add(FLB_METRIC_OUT_TLS_HS_USEC,
+                                "tls_handshake_usec", ins->metrics);
+            }
+#endif
         }
 #endif
 
@@ -564,6 +654,9 @@ int flb_output_init(struct flb_config *config)
                 flb_output_instance_destroy(ins);
                 return -1;
             }
+#ifdef FLB_HAVE_METRICS
+            ins->tls.metrics = ins->metrics;
+#endif
         }
 #endif
         ret = p->cb_init(ins, config, ins->data);
@@ -20,6 +20,8 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <stdarg.h>
+#include <inttypes.h>
 
 #include <fluent-bit/flb_info.h>
 #include <fluent-bit/flb_mem.h>
@@ -85,26 +87,14 @@ static inline int is_float(char *buf, int len)
     return 0;
 }
 
-/* Receive a tokenized JSON message and convert it to MsgPack */
-static char *tokens_to_msgpack(char *js,
-                               jsmntok_t *tokens, int arr_size, int *out_size,
-                               int *last_byte)
+/* Pack a list of JSON tokens through the given packer */
+static int tokens_pack(char *js, jsmntok_t *tokens, int arr_size,
+                       msgpack_packer *pck, int *last_byte)
 {
     int i;
     int flen;
     char *p;
-    char *buf;
     jsmntok_t *t;
-    msgpack_packer pck;
-    msgpack_sbuffer sbuf;
-
-    if (arr_size == 0) {
-        return NULL;
-    }
-
-    /* initialize buffers */
-    msgpack_sbuffer_init(&sbuf);
-    msgpack_packer_init(&pck, &sbuf, msgpack_sbuffer_write);
 
     for (i = 0; i < arr_size ; i++) {
         t = &tokens[i];
@@ -120,41 +110,67 @@ static char *tokens_to_msgpack(char *js,
         flen = (t->end - t->start);
         switch (t->type) {
         case JSMN_OBJECT:
-            msgpack_pack_map(&pck, t->size);
+            msgpack_pack_map(pck, t->size);
             break;
         case JSMN_ARRAY:
-            msgpack_pack_array(&pck, t->size);
+            msgpack_pack_array(pck, t->size);
             break;
         case JSMN_STRING:
-            msgpack_pack_str(&pck, flen);
-            msgpack_pack_str_body(&pck, js + t->start, flen);
+            msgpack_pack_str(pck, flen);
+            msgpack_pack_str_body(pck, js + t->start, flen);
             break;
         case JSMN_PRIMITIVE:
             p = js + t->start;
             if (*p == 'f') {
-                msgpack_pack_false(&pck);
+                msgpack_pack_false(pck);
             }
             else if (*p == 't') {
-                msgpack_pack_true(&pck);
+                msgpack_pack_true(pck);
             }
             else if (*p == 'n') {
-                msgpack_pack_nil(&pck);
+                msgpack_pack_nil(pck);
             }
             else {
                 if (is_float(p, flen)) {
-                    msgpack_pack_double(&pck, atof(p));
+                    msgpack_pack_double(pck, atof(p));
                 }
                 else {
-                    msgpack_pack_int64(&pck, atol(p));
+                    msgpack_pack_int64(pck, atol(p));
                 }
             }
             break;
         case JSMN_UNDEFINED:
-            msgpack_sbuffer_destroy(&sbuf);
-            return NULL;
+            return -1;
         }
     }
 
+    return 0;
+}
+
+/* Receive a tokenized JSON message and convert it to MsgPack */
+static char *tokens_to_msgpack(char *js,
+                               jsmntok_t *tokens, int arr_size, int *out_size,
+                               int *last_byte)
+{
+    int ret;
+    char *buf;
+    msgpack_packer pck;
+    msgpack_sbuffer sbuf;
+
+    if (arr_size == 0) {
+        return NULL;
+    }
+
+    /* initialize buffers */
+    msgpack_sbuffer_init(&sbuf);
+    msgpack_packer_init(&pck, &sbuf, msgpack_sbuffer_write);
+
+    ret = tokens_pack(js, tokens, arr_size, &pck, last_byte);
+    if (ret == -1) {
+        msgpack_sbuffer_destroy(&sbuf);
+        return NULL;
+    }
+
     /* dump data back to a new buffer */
     *out_size = sbuf.size;
     buf = flb_malloc(sbuf.size);
@@ -321,6 +337,326 @@ int flb_pack_json_state(char *js, size_t len,
     return 0;
 }
 
+/*
+ * JSON stream
+ * ===========
+ * The following interface is used by inputs receiving a stream of JSON
+ * messages (in_tcp, in_lib). Instead of tokenizing the whole accumulated
+ * buffer after every read, the stream keeps its scanning position so every
+ * byte is inspected only once: it just tracks strings and nesting to find
+ * where each top level value ends. Once a value is complete it's tokenized
+ * and packed alone.
+ *
+ * In newline delimited mode (NDJSON) every line is a value, lookup of the
+ * value boundaries is just a memchr(3).
+ */
+int flb_pack_json_stream_init(struct flb_pack_json_stream *s, int ndjson)
+{
+    int ret;
+
+    ret = flb_pack_state_init(&s->state);
+    if (ret != 0) {
+        return -1;
+    }
+
+    s->ndjson = ndjson;
+    flb_pack_json_stream_reset(s);
+
+    return 0;
+}
+
+/* Discard the value being scanned */
+void flb_pack_json_stream_reset(struct flb_pack_json_stream *s)
+{
+    s->depth = 0;
+    s->in_string = FLB_FALSE;
+    s->escape = FLB_FALSE;
+    s->started = FLB_FALSE;
+    s->start = 0;
+    s->offset = 0;
+}
+
+void flb_pack_json_stream_destroy(struct flb_pack_json_stream *s)
+{
+    flb_pack_state_reset(&s->state);
+}
+
+static inline int json_is_space(char c)
+{
+    return (c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\0');
+}
+
+static inline int json_root_type(char c)
+{
+    if (c == '{') {
+        return FLB_PACK_JSON_OBJECT;
+    }
+    else if (c == '[') {
+        return FLB_PACK_JSON_ARRAY;
+    }
+    else if (c == '"') {
+        return FLB_PACK_JSON_STRING;
+    }
+    return FLB_PACK_JSON_PRIMITIVE;
+}
+
+/* NDJSON: every non empty line is a value */
+static int json_stream_next_line(struct flb_pack_json_stream *s,
+                                 char *js, size_t len,
+                                 char **value, size_t *value_len,
+                                 int *root_type)
+{
+    char *p;
+    char *eol;
+    char *end;
+
+    while (s->offset < len) {
+        p = js + s->offset;
+        eol = memchr(p, '\n', len - s->offset);
+        if (!eol) {
+            /* Incomplete line, resume from here on next call */
+            s->offset = len;
+            return FLB_ERR_JSON_PART;
+        }
+
+        p = js + s->start;
+        s->offset = (eol - js) + 1;
+        s->start = s->offset;
+
+        /* Trim spaces and CR */
+        end = eol;
+        while (p < end && json_is_space(*p)) {
+            p++;
+        }
+        while (end > p && json_is_space(*(end - 1))) {
+            end--;
+        }
+
+        if (p == end) {
+            continue;
+        }
+
+        *value = p;
+        *value_len = end - p;
+        *root_type = json_root_type(*p);
+        return 0;
+    }
+
+    return FLB_ERR_JSON_PART;
+}
+
+/*
+ * Lookup the next complete JSON value available in 'js', scanning only the
+ * bytes that were not seen in a previous call. On success the value
+ * boundaries and root type are set and 0 is returned. If the value is not
+ * complete FLB_ERR_JSON_PART is returned and FLB_ERR_JSON_INVAL if the
+ * stream is not valid: the unexpected byte is then counted as processed,
+ * calling again resumes the scan right after it.
+ *
+ * The caller must not modify the bytes before 'len' between calls, except
+ * to remove the ones already processed by calling
+ * flb_pack_json_stream_consume().
+ */
+int flb_pack_json_stream_next(struct flb_pack_json_stream *s,
+                              char *js, size_t len,
+                              char **value, size_t *value_len,
+                              int *root_type)
+{
+    char c;
+    size_t i;
+
+    if (s->ndjson == FLB_TRUE) {
+        return json_stream_next_line(s, js, len, value, value_len, root_type);
+    }
+
+    for (i = s->offset; i < len; i++) {
+        c = js[i];
+
+        /* Lookup the beginning of a value */
+        if (s->started == FLB_FALSE) {
+            if (json_is_space(c)) {
+                continue;
+            }
+            if (c == '}' || c == ']' || c == ',' || c == ':') {
+                /* Skip the unexpected byte, the caller can resync */
+                s->start = i + 1;
+                s->offset = i + 1;
+                return FLB_ERR_JSON_INVAL;
+            }
+            s->started = FLB_TRUE;
+            s->start = i;
+            if (c == '{' || c == '[') {
+                s->depth = 1;
+            }
+            else if (c == '"') {
+                s->in_string = FLB_TRUE;
+            }
+            continue;
+        }
+
+        if (s->in_string == FLB_TRUE) {
+            if (s->escape == FLB_TRUE) {
+                s->escape = FLB_FALSE;
+            }
+            else if (c == '\\') {
+                s->escape = FLB_TRUE;
+            }
+            else if (c == '"') {
+                s->in_string = FLB_FALSE;
+                if (s->depth == 0) {
+                    /* Top level string is complete */
+                    i++;
+                    break;
+                }
+            }
+            continue;
+        }
+
+        if (s->depth == 0) {
+            /* Top level primitive, it ends on a space or a delimiter */
+            if (json_is_space(c) || c == '{' || c == '[' || c == '"' ||
+                c == '}' || c == ']' || c == ',') {
+                break;
+            }
+            continue;
+        }
+
+        if (c == '"') {
+            s->in_string = FLB_TRUE;
+        }
+        else if (c == '{' || c == '[') {
+            s->depth++;
+        }
+        else if (c == '}' || c == ']') {
+            s->depth--;
+            if (s->depth == 0) {
+                i++;
+                break;
+            }
+        }
+    }
+
+    if (i >= len && (s->started == FLB_FALSE ||
+                     s->depth > 0 || s->in_string == FLB_TRUE ||
+                     json_root_type(js[s->start]) == FLB_PACK_JSON_PRIMITIVE)) {
+        /* Need more data (a top level primitive might be truncated) */
+        s->offset = len;
+        if (s->started == FLB_FALSE) {
+            s->start = len;
+        }
+        return FLB_ERR_JSON_PART;
+    }
+
+    *value = js + s->start;
+    *value_len = i - s->start;
+    *root_type = json_root_type(js[s->start]);
+
+    s->started = FLB_FALSE;
+    s->depth = 0;
+    s->start = i;
+    s->offset = i;
+
+    return 0;
+}
+
+/*
+ * Return the number of bytes of the buffer that have been fully processed
+ * and can be released by the caller.
+ */
+size_t flb_pack_json_stream_processed(struct flb_pack_json_stream *s)
+{
+    return s->start;
+}
+
+/* Notify that the first 'bytes' of the buffer were removed by the caller */
+void flb_pack_json_stream_consume(struct flb_pack_json_stream *s,
+                                  size_t bytes)
+{
+    s->start -= bytes;
+    s->offset -= bytes;
+}
+
+/*
+ * Convert a complete JSON value (as returned by flb_pack_json_stream_next())
+ * to MessagePack using the given packer. Nothing is packed on error.
+ */
+int flb_pack_json_stream_pack(struct flb_pack_json_stream *s,
+                              char *value, size_t value_len,
+                              msgpack_packer *pck)
+{
+    int ret;
+    int end;
+    int last;
+    char c;
+    jsmntok_t tok;
+    struct flb_pack_state *state = &s->state;
+
+    /* The tokenizer in strict mode only accepts objects and arrays as root */
+    c = *value;
+    if (c != '{' && c != '[') {
+        tok.start = 0;
+        tok.end = value_len;
+        tok.size = 0;
+        tok.parent = -1;
+        if (c == '"') {
+            if (value_len < 2 || value[value_len - 1] != '"') {
+                return FLB_ERR_JSON_INVAL;
+            }
+            tok.type = JSMN_STRING;
+            tok.start = 1;
+            tok.end = value_len - 1;
+        }
+        else if (c == 't' || c == 'f' || c == 'n' || c == '-' ||
+                 (c >= '0' && c <= '9')) {
+            tok.type = JSMN_PRIMITIVE;
+        }
+        else {
+            return FLB_ERR_JSON_INVAL;
+        }
+        return tokens_pack(value, &tok, 1, pck, &last);
+    }
+
+    jsmn_init(&state->parser);
+    state->tokens_count = 0;
+
+    ret = flb_json_tokenise(value, value_len, state);
+    if (ret != 0) {
+        return ret;
+    }
+
+    /* Expect a single value */
+    if (state->tokens_count == 0) {
+        return FLB_ERR_JSON_INVAL;
+    }
+    end = state->tokens[0].end;
+    if (end != (int) value_len) {
+        return FLB_ERR_JSON_INVAL;
+    }
+
+    return tokens_pack(value, state->tokens, state->tokens_count, pck, &last);
+}
+
+/*
+ * Pack a complete JSON value as a record with the current time. Values that
+ * are not a map are wrapped in a 'msg' key. On error the record is partially
+ * packed, the caller must discard it.
+ */
+int flb_pack_json_stream_record(struct flb_pack_json_stream *s,
+                                char *value, size_t value_len, int type,
+                                msgpack_packer *pck)
+{
+    msgpack_pack_array(pck, 2);
+    flb_pack_time_now(pck);
+
+    if (type != FLB_PACK_JSON_OBJECT) {
+        msgpack_pack_map(pck, 1);
+        msgpack_pack_str(pck, 3);
+        msgpack_pack_str_body(pck, "msg", 3);
+    }
+
+    return flb_pack_json_stream_pack(s, value, value_len, pck);
+}
+
 static int pack_print_fluent_record(size_t cnt, msgpack_unpacked result)
 {
     double unix_time;
@@ -554,49 +890,493 @@ int flb_msgpack_to_json(char *json_str, size_t json_size,
     return ret ? off: ret;
 }
 
-flb_sds_t flb_msgpack_raw_to_json_sds(void *in_buf, size_t in_size)
+/*
+ * JSON encoder
+ * ============
+ * Converts msgpack objects to JSON appending to a sds buffer. The room
+ * needed by every value is reserved before it's written: numbers are
+ * printed in place and strings are first tried with their raw length,
+ * reserving the worst escaping case only when that is not enough. The
+ * buffer grows geometrically so there are no intermediate buffers nor
+ * full conversion retries on large chunks.
+ */
+
+/* Make sure the buffer has room for 'size' more bytes */
+static inline int json_enc_reserve(flb_sds_t *buf, size_t size)
+{
+    size_t inc;
+    flb_sds_t tmp;
+
+    if (flb_sds_avail(*buf) >= size) {
+        return 0;
+    }
+
+    inc = flb_sds_alloc(*buf);
+    if (inc < size) {
+        inc = size;
+    }
+
+    tmp = flb_sds_increase(*buf, inc);
+    if (!tmp) {
+        return -1;
+    }
+    *buf = tmp;
+    return 0;
+}
+
+static inline int json_enc_cat(flb_sds_t *buf, const char *str, size_t len)
+{
+    size_t buf_len;
+
+    if (json_enc_reserve(buf, len) == -1) {
+        return -1;
+    }
+
+    buf_len = flb_sds_len(*buf);
+    memcpy(*buf + buf_len, str, len);
+    buf_len += len;
+    (*buf)[buf_len] = '\0';
+    flb_sds_len_set(*buf, buf_len);
+    return 0;
+}
+
+static int json_enc_printf(flb_sds_t *buf, const char *fmt, ...)
 {
     int ret;
+    size_t avail;
+    va_list ap;
+
+    if (json_enc_reserve(buf, 32) == -1) {
+        return -1;
+    }
+
+    while (1) {
+        avail = flb_sds_avail(*buf);
+        va_start(ap, fmt);
+        ret = vsnprintf(*buf + flb_sds_len(*buf), avail + 1, fmt, ap);
+        va_end(ap);
+        if (ret < 0) {
+            return -1;
+        }
+        if ((size_t) ret <= avail) {
+            break;
+        }
+        if (json_enc_reserve(buf, ret) == -1) {
+            return -1;
+        }
+    }
+
+    flb_sds_len_set(*buf, flb_sds_len(*buf) + ret);
+    return 0;
+}
+
+/* Append 'str' as a quoted and escaped JSON string */
+int flb_pack_json_enc_str(flb_sds_t *buf, char *str, size_t len)
+{
+    int i;
+    int ret;
+    int off;
+    size_t size;
+    char *p;
+
+    /* raw length first, then the worst case: every byte as \u00XX */
+    size = len + 2;
+    for (i = 0; i < 2; i++) {
+        if (json_enc_reserve(buf, size) == -1) {
+            return -1;
+        }
+
+        p = *buf + flb_sds_len(*buf);
+        p[0] = '"';
+        off = 1;
+        ret = FLB_TRUE;
+        if (len > 0) {
+            /* leave room for the closing quote */
+            ret = flb_utils_write_str(p, &off, flb_sds_avail(*buf) - 1,
+                                      str, len);
+        }
+
+        if (ret == FLB_TRUE) {
+            p[off++] = '"';
+            p[off] = '\0';
+            flb_sds_len_set(*buf, flb_sds_len(*buf) + off);
+            return 0;
+        }
+        size = (len * 6) + 2;
+    }
+
+    return -1;
+}
+
+/* Append the JSON representation of 'o', same output as msgpack2json() */
+int flb_pack_json_enc_object(flb_sds_t *buf, msgpack_object *o)
+{
+    int ret;
+    uint32_t i;
+    char *p;
+    msgpack_object_kv *kv;
+
+    switch (o->type) {
+    case MSGPACK_OBJECT_NIL:
+        return json_enc_cat(buf, "null", 4);
+
+    case MSGPACK_OBJECT_BOOLEAN:
+        if (o->via.boolean) {
+            return json_enc_cat(buf, "true", 4);
+        }
+        return json_enc_cat(buf, "false", 5);
+
+    case MSGPACK_OBJECT_POSITIVE_INTEGER:
+        return json_enc_printf(buf, "%" PRIu64, o->via.u64);
+
+    case MSGPACK_OBJECT_NEGATIVE_INTEGER:
+        return json_enc_printf(buf, "%" PRId64, o->via.i64);
+
+    case MSGPACK_OBJECT_FLOAT32:
+    case MSGPACK_OBJECT_FLOAT64:
+        return json_enc_printf(buf, "%f", o->via.f64);
+
+    case MSGPACK_OBJECT_STR:
+        return flb_pack_json_enc_str(buf, (char *) o->via.str.ptr,
+                                     o->via.str.size);
+
+    case MSGPACK_OBJECT_BIN:
+        return flb_pack_json_enc_str(buf, (char *) o->via.bin.ptr,
+                                     o->via.bin.size);
+
+    case MSGPACK_OBJECT_EXT:
+        /* ext body, format is similar to printf(1) */
+        if (json_enc_reserve(buf, (o->via.ext.size * 4) + 2) == -1) {
+            return -1;
+        }
+        p = *buf + flb_sds_len(*buf);
+        *p++ = '"';
+        for (i = 0; i < o->via.ext.size; i++) {
+            p += sprintf(p, "\\x%02x", (unsigned char) o->via.ext.ptr[i]);
+        }
+        *p++ = '"';
+        *p = '\0';
+        flb_sds_len_set(*buf, p - *buf);
+        return 0;
+
+    case MSGPACK_OBJECT_ARRAY:
+        if (json_enc_cat(buf, "[", 1) == -1) {
+            return -1;
+        }
+        for (i = 0; i < o->via.array.size; i++) {
+            if (i > 0 && json_enc_cat(buf, ", ", 2) == -1) {
+                return -1;
+            }
+            ret = flb_pack_json_enc_object(buf, o->via.array.ptr + i);
+            if (ret == -1) {
+                return -1;
+            }
+        }
+        return json_enc_cat(buf, "]", 1);
+
+    case MSGPACK_OBJECT_MAP:
+        if (json_enc_cat(buf, "{", 1) == -1) {
+            return -1;
+        }
+        for (i = 0; i < o->via.map.size; i++) {
+            kv = o->via.map.ptr + i;
+            if (i > 0 && json_enc_cat(buf, ", ", 2) == -1) {
+                return -1;
+            }
+            if (flb_pack_json_enc_object(buf, &kv->key) == -1 ||
+                json_enc_cat(buf, ":", 1) == -1 ||
+                flb_pack_json_enc_object(buf, &kv->val) == -1) {
+                return -1;
+            }
+        }
+        return json_enc_cat(buf, "}", 1);
+
+    default:
+        flb_warn("[%s] unknown msgpack type %i", __FUNCTION__, o->type);
+    }
+
+    return -1;
+}
+
+int flb_pack_json_enc_init(struct flb_pack_json_enc *enc, int format,
+                           int date_format, char *date_key)
+{
+    int ret;
+
+    memset(enc, '\0', sizeof(struct flb_pack_json_enc));
+    enc->format = format;
+    enc->date_format = date_format;
+    enc->date_strftime = FLB_PACK_JSON_DATE_ISO8601_FMT;
+    enc->date_frac = 6;
+    enc->date_sec = -1;
+
+    if (!date_key) {
+        return 0;
+    }
+
+    /* The key is escaped once, it's copied as it is in every record */
+    enc->date_key = flb_sds_create_size(strlen(date_key) + 8);
+    if (!enc->date_key) {
+        flb_errno();
+        return -1;
+    }
+    ret = flb_pack_json_enc_str(&enc->date_key, date_key, strlen(date_key));
+    if (ret == 0) {
+        ret = json_enc_cat(&enc->date_key, ":", 1);
+    }
+    if (ret == -1) {
+        flb_sds_destroy(enc->date_key);
+        enc->date_key = NULL;
+        return -1;
+    }
+
+    return 0;
+}
+
+void flb_pack_json_enc_destroy(struct flb_pack_json_enc *enc)
+{
+    if (enc->date_key) {
+        flb_sds_destroy(enc->date_key);
+        enc->date_key = NULL;
+    }
+}
+
+/* Append the date value (not the key) in the configured format */
+int flb_pack_json_enc_date(struct flb_pack_json_enc *enc, flb_sds_t *buf,
+                           struct flb_time *tm)
+{
+    int len;
+    uint64_t frac;
+    struct tm t;
+    char *p;
+
+    switch (enc->date_format) {
+    case FLB_PACK_JSON_DATE_DOUBLE:
+        return json_enc_printf(buf, "%f", flb_time_to_double(tm));
+
+    case FLB_PACK_JSON_DATE_EPOCH:
+        return json_enc_printf(buf, "%" PRIu64, (uint64_t) tm->tm.tv_sec);
+
+    case FLB_PACK_JSON_DATE_ISO8601:
+        /* records of a chunk usually share the second, format it once */
+        if (enc->date_sec != tm->tm.tv_sec) {
+            gmtime_r(&tm->tm.tv_sec, &t);
+            enc->date_cache_len = strftime(enc->date_cache,
+                                           sizeof(enc->date_cache) - 1,
+                                           enc->date_strftime, &t);
+            enc->date_sec = tm->tm.tv_sec;
+        }
+
+        if (json_enc_reserve(buf, enc->date_cache_len + 16) == -1) {
+            return -1;
+        }
+        p = *buf + flb_sds_len(*buf);
+        *p++ = '"';
+        memcpy(p, enc->date_cache, enc->date_cache_len);
+        p += enc->date_cache_len;
+
+        frac = tm->tm.tv_nsec;
+        if (enc->date_frac == 3) {
+            len = sprintf(p, ".%03" PRIu64 "Z\"", frac / 1000000);
+        }
+        else if (enc->date_frac == 9) {
+            len = sprintf(p, ".%09" PRIu64 "Z\"", frac);
+        }
+        else {
+            len = sprintf(p, ".%06" PRIu64 "Z\"", frac / 1000);
+        }
+        p += len;
+        flb_sds_len_set(*buf, p - *buf);
+        return 0;
+    }
+
+    return -1;
+}
+
+/*
+ * Append a record as a JSON map: the date key first (if set), then the
+ * fields added by the hook and finally the record fields.
+ */
+int flb_pack_json_enc_record(struct flb_pack_json_enc *enc, flb_sds_t *buf,
+                             struct flb_time *tm, msgpack_object *map)
+{
+    int ret;
+    int first = FLB_TRUE;
+    uint32_t i;
+    size_t mark;
+    msgpack_object_kv *kv;
+
+    if (json_enc_cat(buf, "{", 1) == -1) {
+        return -1;
+    }
+
+    if (enc->date_key) {
+        if (json_enc_cat(buf, enc->date_key,
+                         flb_sds_len(enc->date_key)) == -1 ||
+            flb_pack_json_enc_date(enc, buf, tm) == -1) {
+            return -1;
+        }
+        first = FLB_FALSE;
+    }
+
+    if (enc->cb_fields) {
+        mark = flb_sds_len(*buf);
+        if (first == FLB_FALSE && json_enc_cat(buf, ", ", 2) == -1) {
+            return -1;
+        }
+        ret = enc->cb_fields(buf, tm, map, enc->cb_data);
+        if (ret == -1) {
+            return -1;
+        }
+        else if (ret == 0) {
+            flb_sds_len_set(*buf, mark);
+        }
+        else {
+            first = FLB_FALSE;
+        }
+    }
+
+    if (map->type == MSGPACK_OBJECT_MAP) {
+        for (i = 0; i < map->via.map.size; i++) {
+            kv = map->via.map.ptr + i;
+            if (first == FLB_FALSE && json_enc_cat(buf, ", ", 2) == -1) {
+                return -1;
+            }
+            first = FLB_FALSE;
+            if (flb_pack_json_enc_object(buf, &kv->key) == -1 ||
+                json_enc_cat(buf, ":", 1) == -1 ||
+                flb_pack_json_enc_object(buf, &kv->val) == -1) {
+                return -1;
+            }
+        }
+    }
+
+    return json_enc_cat(buf, "}", 1);
+}
+
+/*
+ * Append all the records of a chunk using the configured layout. Returns
+ * the number of records or -1 on error.
+ */
+int flb_pack_json_enc_chunk(struct flb_pack_json_enc *enc, flb_sds_t *buf,
+                            void *data, size_t bytes)
+{
+    int ret;
+    int count = 0;
     size_t off = 0;
-    size_t out_size;
+    struct flb_time tm;
+    msgpack_object *obj;
     msgpack_unpacked result;
-    msgpack_object *root;
-    flb_sds_t out_buf;
-    flb_sds_t tmp_buf;
 
-    out_size = in_size * 1.5;
-    out_buf = flb_sds_create_size(out_size);
-    if (!out_buf) {
-        flb_errno();
-        return NULL;
+    if (enc->format == FLB_PACK_JSON_FORMAT_JSON &&
+        json_enc_cat(buf, "[", 1) == -1) {
+        return -1;
     }
 
     msgpack_unpacked_init(&result);
-    msgpack_unpack_next(&result, in_buf, in_size, &off);
-    root = &result.data;
+    while (msgpack_unpack_next(&result, data, bytes, &off) == MSGPACK_UNPACK_SUCCESS) {
+        if (result.data.type != MSGPACK_OBJECT_ARRAY ||
+            result.data.via.array.size != 2) {
+            continue;
+        }
+        flb_time_pop_from_msgpack(&tm, &result, &obj);
 
-    while (1) {
-        ret = flb_msgpack_to_json(out_buf, out_size, root);
-        if (ret <= 0) {
-            tmp_buf = flb_sds_increase(out_buf, 256);
-            if (tmp_buf) {
-                out_buf = tmp_buf;
-                out_size += 256;
+        if (count > 0) {
+            if (enc->format == FLB_PACK_JSON_FORMAT_JSON) {
+                ret = json_enc_cat(buf, ", ", 2);
+            }
+            else if (enc->format == FLB_PACK_JSON_FORMAT_STREAM) {
+                ret = json_enc_cat(buf, " ", 1);
             }
             else {
-                flb_errno();
-                flb_sds_destroy(out_buf);
+                ret = 0;
+            }
+            if (ret == -1) {
                 msgpack_unpacked_destroy(&result);
-                return NULL;
+                return -1;
             }
         }
-        else {
-            break;
+
+        ret = flb_pack_json_enc_record(enc, buf, &tm, obj);
+        if (ret == 0 && enc->format == FLB_PACK_JSON_FORMAT_LINES) {
+            ret = json_enc_cat(buf, "\n", 1);
+        }
+        if (ret == -1) {
+            msgpack_unpacked_destroy(&result);
+            return -1;
         }
+        count++;
+    }
+    msgpack_unpacked_destroy(&result);
+
+    if (enc->format == FLB_PACK_JSON_FORMAT_JSON &&
+        json_enc_cat(buf, "]", 1) == -1) {
+        return -1;
     }
 
+    return count;
+}
+
+/* Get the layout type from a configuration value */
+int flb_pack_to_json_format_type(char *str)
+{
+    if (strcasecmp(str, "json") == 0) {
+        return FLB_PACK_JSON_FORMAT_JSON;
+    }
+    else if (strcasecmp(str, "json_stream") == 0) {
+        return FLB_PACK_JSON_FORMAT_STREAM;
+    }
+    else if (strcasecmp(str, "json_lines") == 0) {
+        return FLB_PACK_JSON_FORMAT_LINES;
+    }
+
+    return -1;
+}
+
+/* Get the date type from a configuration value */
+int flb_pack_to_json_date_type(char *str)
+{
+    if (strcasecmp(str, "double") == 0) {
+        return FLB_PACK_JSON_DATE_DOUBLE;
+    }
+    else if (strcasecmp(str, "iso8601") == 0) {
+        return FLB_PACK_JSON_DATE_ISO8601;
+    }
+    else if (strcasecmp(str, "epoch") == 0) {
+        return FLB_PACK_JSON_DATE_EPOCH;
+    }
+
+    return -1;
+}
+
+flb_sds_t flb_msgpack_raw_to_json_sds(void *in_buf, size_t in_size)
+{
+    int ret;
+    size_t off = 0;
+    msgpack_unpacked result;
+    flb_sds_t out_buf;
+
+    out_buf = flb_sds_create_size(in_size * 1.5);
+    if (!out_buf) {
+        flb_errno();
+        return NULL;
+    }
+
+    msgpack_unpacked_init(&result);
+    ret = msgpack_unpack_next(&result, in_buf, in_size, &off);
+    if (ret != MSGPACK_UNPACK_SUCCESS) {
+        msgpack_unpacked_destroy(&result);
+        flb_sds_destroy(out_buf);
+        return NULL;
+    }
+
+    ret = flb_pack_json_enc_object(&out_buf, &result.data);
     msgpack_unpacked_destroy(&result);
-    flb_sds_len_set(out_buf, ret);
+    if (ret == -1) {
+        flb_errno();
+        flb_sds_destroy(out_buf);
+        return NULL;
+    }
 
     return out_buf;
 }
@@ -103,6 +103,99 @@ int flb_parser_logfmt_do(struct flb_parser *parser,
                          void **out_buf, size_t *out_size,
                          struct flb_time *out_time);
 
+int flb_parser_syslog_do(struct flb_parser *parser,
+                         char *buf, size_t length,
+                         void **out_buf, size_t *out_size,
+                         struct flb_time *out_time);
+
+int flb_parser_regex_pack(struct flb_parser *parser,
+                          char *buf, size_t length,
+                          msgpack_packer *pck,
+                          struct flb_time *out_time);
+
+static int cb_regex_slot(unsigned char *name, size_t name_len, int group,
+                         void *data)
+{
+    int i;
+    char *time_key;
+    msgpack_sbuffer sbuf;
+    msgpack_packer pck;
+    struct flb_parser *p = data;
+    struct flb_parser_slot *slot;
+
+    slot = &p->slots[p->slots_len];
+    slot->group = group;
+    slot->name = flb_strndup((char *) name, name_len);
+    if (!slot->name) {
+        flb_errno();
+        return -1;
+    }
+    slot->name_len = name_len;
+    p->slots_len++;
+
+    /* Key bytes, copied as they are into every record */
+    msgpack_sbuffer_init(&sbuf);
+    msgpack_packer_init(&pck, &sbuf, msgpack_sbuffer_write);
+    msgpack_pack_str(&pck, name_len);
+    msgpack_pack_str_body(&pck, name, name_len);
+    slot->key = sbuf.data;
+    slot->key_len = sbuf.size;
+
+    /* Time lookup field */
+    if (p->time_fmt) {
+        time_key = p->time_key ? p->time_key : "time";
+        if (strcmp(slot->name, time_key) == 0) {
+            slot->time_key = FLB_TRUE;
+        }
+    }
+
+    /* First type cast matching the name */
+    for (i = 0; i < p->types_len; i++) {
+        if (p->types[i].key != NULL &&
+            p->types[i].key_len == name_len &&
+            strncmp(p->types[i].key, (char *) name, name_len) == 0) {
+            slot->type = p->types[i].type;
+            break;
+        }
+    }
+
+    return 0;
+}
+
+static int cb_regex_count(unsigned char *name, size_t name_len, int group,
+                          void *data)
+{
+    int *count = data;
+
+    (*count)++;
+    return 0;
+}
+
+/* Resolve the regex named groups, see struct flb_parser_slot */
+static int parser_regex_slots(struct flb_parser *p)
+{
+    int ret;
+    int count = 0;
+
+    flb_regex_groups(p->regex, cb_regex_count, &count);
+    if (count == 0) {
+        return 0;
+    }
+
+    p->slots = flb_calloc(count, sizeof(struct flb_parser_slot));
+    if (!p->slots) {
+        flb_errno();
+        return -1;
+    }
+
+    ret = flb_regex_groups(p->regex, cb_regex_slot, p);
+    if (ret != 0) {
+        return -1;
+    }
+
+    return 0;
+}
+
 struct flb_parser *flb_parser_create(char *name, char *format,
                                      char *p_regex,
                                      char *time_fmt, char *time_key,
@@ -153,6 +246,9 @@ struct flb_parser *flb_parser_create(char *name, char *format,
     else if (strcmp(format, "logfmt") == 0) {
         p->type = FLB_PARSER_LOGFMT;
     }
+    else if (strcmp(format, "syslog") == 0) {
+        p->type = FLB_PARSER_SYSLOG;
+    }
     else {
         flb_error("[parser:%s] Invalid format %s", name, format);
         flb_free(p);
@@ -265,18 +361,21 @@ struct flb_parser *flb_parser_create(char *name, char *format,
                 p->time_frac_secs = NULL;
             }
         }
+    }
 
-        /* Optional fixed timezone offset */
-        if (time_offset) {
-            diff = 0;
-            len = strlen(time_offset);
-            ret = flb_parser_tzone_offset(time_offset, len, &diff);
-            if (ret == -1) {
-                flb_free(p);
-                return NULL;
-            }
-            p->time_offset = diff;
+    /*
+     * Optional fixed timezone offset, the syslog format use it without a
+     * time format for RFC3164 timestamps.
+     */
+    if (time_offset && (time_fmt || p->type == FLB_PARSER_SYSLOG)) {
+        diff = 0;
+        len = strlen(time_offset);
+        ret = flb_parser_tzone_offset(time_offset, len, &diff);
+        if (ret == -1) {
+            flb_free(p);
+            return NULL;
         }
+        p->time_offset = diff;
     }
 
     if (time_key) {
@@ -289,6 +388,15 @@ struct flb_parser *flb_parser_create(char *name, char *format,
 
     mk_list_add(&p->_head, &config->parsers);
 
+    if (p->type == FLB_PARSER_REGEX) {
+        ret = parser_regex_slots(p);
+        if (ret == -1) {
+            flb_error("[parser:%s] cannot map regex named groups", name);
+            flb_parser_destroy(p);
+            return NULL;
+        }
+    }
+
     return p;
 }
 
@@ -298,6 +406,12 @@ void flb_parser_destroy(struct flb_parser *parser)
     if (parser->type == FLB_PARSER_REGEX) {
         flb_regex_destroy(parser->regex);
         flb_free(parser->p_regex);
+
+        for (i = 0; i < parser->slots_len; i++) {
+            flb_free(parser->slots[i].name);
+            flb_free(parser->slots[i].key);
+        }
+        flb_free(parser->slots);
     }
 
     flb_free(parser->name);
@@ -605,10 +719,39 @@ int flb_parser_do(struct flb_parser *parser, char *buf, size_t length,
         return flb_parser_logfmt_do(parser, buf, length,
                                   out_buf, out_size, out_time);
     }
+    else if (parser->type == FLB_PARSER_SYSLOG) {
+        return flb_parser_syslog_do(parser, buf, length,
+                                    out_buf, out_size, out_time);
+    }
 
     return -1;
 }
 
+/*
+ * Same as flb_parser_do() but the record map is packed through the caller
+ * packer, so a buffer can be reused across records. Regex parsers pack
+ * directly into it.
+ */
+int flb_parser_do_pack(struct flb_parser *parser, char *buf, size_t length,
+                       msgpack_packer *pck, struct flb_time *out_time)
+{
+    int ret;
+    void *out_buf;
+    size_t out_size;
+
+    if (parser->type == FLB_PARSER_REGEX && !parser->decoders) {
+        return flb_parser_regex_pack(parser, buf, length, pck, out_time);
+    }
+
+    ret = flb_parser_do(parser, buf, length, &out_buf, &out_size, out_time);
+    if (ret >= 0) {
+        pck->callback(pck->data, out_buf, out_size);
+        flb_free(out_buf);
+    }
+
+    return ret;
+}
+
 /* Given a timezone string, return it numeric offset */
 int flb_parser_tzone_offset(char *str, int len, int *tmdiff)
 {
@@ -798,6 +941,78 @@ free_and_return:
     return ret;
 }
 
+/* Pack a value converted to a parser type, a cast error packs the string */
+void flb_parser_typecast_value(char *key, int key_len,
+                               char *val, int val_len, int type,
+                               msgpack_packer *pck)
+{
+    int error = FLB_FALSE;
+    char tmp_char;
+
+    switch (type) {
+    case FLB_PARSER_TYPE_INT:
+        {
+            long long lval;
+
+            /* msgpack char is not null terminated.
+               So backup and fill null char,
+               convert int,
+               rewind char.
+             */
+            tmp_char = val[val_len];
+            val[val_len] = '\0';
+            lval = atoll(val);
+            val[val_len] = tmp_char;
+            msgpack_pack_int64(pck, lval);
+        }
+        break;
+    case FLB_PARSER_TYPE_HEX:
+        {
+            unsigned long long lval;
+            tmp_char = val[val_len];
+            val[val_len] = '\0';
+            lval = strtoull(val, NULL, 16);
+            val[val_len] = tmp_char;
+            msgpack_pack_uint64(pck, lval);
+        }
+        break;
+
+    case FLB_PARSER_TYPE_FLOAT:
+        {
+            double dval;
+            tmp_char = val[val_len];
+            val[val_len] = '\0';
+            dval = atof(val);
+            val[val_len] = tmp_char;
+            msgpack_pack_double(pck, dval);
+        }
+        break;
+    case FLB_PARSER_TYPE_BOOL:
+        if (!strncasecmp(val, "true", 4)) {
+            msgpack_pack_true(pck);
+        }
+        else if(!strncasecmp(val, "false", 5)){
+            msgpack_pack_false(pck);
+        }
+        else {
+            error = FLB_TRUE;
+        }
+        break;
+    case FLB_PARSER_TYPE_STRING:
+        msgpack_pack_str(pck, val_len);
+        msgpack_pack_str_body(pck, val, val_len);
+        break;
+    default:
+        error = FLB_TRUE;
+    }
+    if (error == FLB_TRUE) {
+        flb_warn("[PARSER] key=%.*s cast error. save as string.",
+                 key_len, key);
+        msgpack_pack_str(pck, val_len);
+        msgpack_pack_str_body(pck, val, val_len);
+    }
+}
+
 int flb_parser_typecast(char *key, int key_len,
                         char *val, int val_len,
                         msgpack_packer *pck,
@@ -805,8 +1020,6 @@ int flb_parser_typecast(char *key, int key_len,
                         int types_len)
 {
     int i;
-    int error = FLB_FALSE;
-    char tmp_char;
     int casted = FLB_FALSE;
 
     for(i=0; i<types_len; i++){
@@ -818,68 +1031,8 @@ int flb_parser_typecast(char *key, int key_len,
 
             msgpack_pack_str(pck, key_len);
             msgpack_pack_str_body(pck, key, key_len);
-
-            switch (types[i].type) {
-            case FLB_PARSER_TYPE_INT:
-                {
-                    long long lval;
-
-                    /* msgpack char is not null terminated.
-                       So backup and fill null char,
-                       convert int,
-                       rewind char.
-                     */
-                    tmp_char = val[val_len];
-                    val[val_len] = '\0';
-                    lval = atoll(val);
-                    val[val_len] = tmp_char;
-                    msgpack_pack_int64(pck, lval);
-                }
-                break;
-            case FLB_PARSER_TYPE_HEX:
-                {
-                    unsigned long long lval;
-                    tmp_char = val[val_len];
-                    val[val_len] = '\0';
-                    lval = strtoull(val, NULL, 16);
-                    val[val_len] = tmp_char;
-                    msgpack_pack_uint64(pck, lval);
-                }
-                break;
-
-            case FLB_PARSER_TYPE_FLOAT:
-                {
-                    double dval;
-                    tmp_char = val[val_len];
-                    val[val_len] = '\0';
-                    dval = atof(val);
-                    val[val_len] = tmp_char;
-                    msgpack_pack_double(pck, dval);
-                }
-                break;
-            case FLB_PARSER_TYPE_BOOL:
-                if (!strncasecmp(val, "true", 4)) {
-                    msgpack_pack_true(pck);
-                }
-                else if(!strncasecmp(val, "false", 5)){
-                    msgpack_pack_false(pck);
-                }
-                else {
-                    error = FLB_TRUE;
-                }
-                break;
-            case FLB_PARSER_TYPE_STRING:
-                msgpack_pack_str(pck, val_len);
-                msgpack_pack_str_body(pck, val, val_len);
-                break;
-            default:
-                error = FLB_TRUE;
-            }
-            if (error == FLB_TRUE) {
-                flb_warn("[PARSER] key=%s cast error. save as string.", key);
-                msgpack_pack_str(pck, val_len);
-                msgpack_pack_str_body(pck, val, val_len);
-            }
+            flb_parser_typecast_value(key, key_len, val, val_len,
+                                      types[i].type, pck);
             break;
         }
     }
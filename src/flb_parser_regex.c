@@ -29,87 +29,142 @@
 
 #include <msgpack.h>
 
-/* don't do this at home */
-#define pack_uint16(buf, d) _msgpack_store16(buf, (uint16_t) d)
-#define pack_uint32(buf, d) _msgpack_store32(buf, (uint32_t) d)
-
-struct regex_cb_ctx {
-    int num_skipped;
-    time_t time_lookup;
-    time_t time_now;
-    double time_frac;
-    struct flb_parser *parser;
-    msgpack_packer *pck;
-};
-
-static void cb_results(unsigned char *name, unsigned char *value,
-                       size_t vlen, void *data)
+static int regex_time_lookup(struct flb_parser *parser,
+                             unsigned char *value, size_t vlen,
+                             time_t *time_now, struct flb_time *out_time)
 {
-    int len;
     int ret;
     double frac = 0;
-    char *time_key;
     char tmp[255];
-    struct regex_cb_ctx *pcb = data;
-    struct flb_parser *parser = pcb->parser;
     struct tm tm = {0};
-    (void) data;
 
-    if (vlen == 0) {
-        pcb->num_skipped++;
-        return;
+    if (*time_now == 0) {
+        *time_now = time(NULL);
     }
 
-    len = strlen((char *) name);
+    ret = flb_parser_time_lookup((char *) value, vlen,
+                                 *time_now, parser, &tm, &frac);
+    if (ret == -1) {
+        if (vlen > sizeof(tmp) - 1) {
+            vlen = sizeof(tmp) - 1;
+        }
+        memcpy(tmp, value, vlen);
+        tmp[vlen] = '\0';
+        flb_warn("[parser:%s] Invalid time format %s for '%s'.",
+                 parser->name, parser->time_fmt, tmp);
+        return -1;
+    }
+
+    out_time->tm.tv_sec  = flb_parser_tm2time(&tm);
+    out_time->tm.tv_nsec = (frac * 1000000000);
+
+    return 0;
+}
+
+/*
+ * Parse a record and pack its map through the caller packer. Named groups
+ * were resolved into parser->slots when the parser was created, so every
+ * capture is packed with its pre-packed key and cast type, no names are
+ * compared here.
+ *
+ * The map size must be known before packing the first entry: empty
+ * captures are skipped and the time key may be dropped (invalid time or
+ * Time_Keep off), so a first pass over the slots counts the entries and
+ * resolves the record time.
+ */
+int flb_parser_regex_pack(struct flb_parser *parser,
+                          char *buf, size_t length,
+                          msgpack_packer *pck,
+                          struct flb_time *out_time)
+{
+    int i;
+    int ret;
+    int entries = 0;
+    int time_ok = FLB_FALSE;
+    ssize_t n;
+    ssize_t end;
+    ssize_t last_byte = -1;
+    size_t vlen;
+    time_t time_now = 0;
+    unsigned char *value;
+    struct flb_regex_search result;
+    struct flb_parser_slot *slot;
+
+    n = flb_regex_do(parser->regex, (unsigned char *) buf, length, &result);
+    if (n <= 0) {
+        return -1;
+    }
 
-    /* Check if there is a time lookup field */
-    if (parser->time_fmt) {
-        if (parser->time_key) {
-            time_key = parser->time_key;
+    out_time->tm.tv_sec = 0;
+    out_time->tm.tv_nsec = 0;
+
+    for (i = 0; i < parser->slots_len; i++) {
+        slot = &parser->slots[i];
+
+        end = flb_regex_group_get(&result, slot->group, &value, &vlen);
+        if (end >= 0) {
+            last_byte = end;
         }
-        else {
-            time_key = "time";
+
+        /* keys without associated values are skipped */
+        if (vlen == 0) {
+            continue;
         }
 
-        if (strcmp((char *) name, time_key) == 0) {
-            /* Lookup time */
-            ret = flb_parser_time_lookup((char *) value, vlen,
-                                         pcb->time_now, parser, &tm, &frac);
+        if (slot->time_key == FLB_TRUE) {
+            ret = regex_time_lookup(parser, value, vlen, &time_now, out_time);
             if (ret == -1) {
-                if (vlen > sizeof(tmp) - 1) {
-                    vlen = sizeof(tmp) - 1;
-                }
-                memcpy(tmp, value, vlen);
-                tmp[vlen] = '\0';
-                flb_warn("[parser:%s] Invalid time format %s for '%s'.",
-                         parser->name, parser->time_fmt, tmp);
-                pcb->num_skipped++;
-                return;
+                continue;
             }
-
-            pcb->time_frac = frac;
-            pcb->time_lookup = flb_parser_tm2time(&tm);
-
+            time_ok = FLB_TRUE;
             if (parser->time_keep == FLB_FALSE) {
-                pcb->num_skipped++;
-                return;
+                continue;
             }
         }
+        entries++;
     }
 
-    if (parser->types_len != 0) {
-        flb_parser_typecast((char*)name, len,
-                            (char*)value, vlen,
-                            pcb->pck,
-                            parser->types,
-                            parser->types_len);
+    /*
+     * The return the value >= 0, belongs to the LAST BYTE consumed by the
+     * regex engine. If the last byte is lower than string length, means
+     * there is more data to be processed (maybe it's a stream).
+     */
+    if (last_byte == -1) {
+        flb_regex_search_release(&result);
+        return -1;
     }
-    else {
-        msgpack_pack_str(pcb->pck, len);
-        msgpack_pack_str_body(pcb->pck, (char *) name, len);
-        msgpack_pack_str(pcb->pck, vlen);
-        msgpack_pack_str_body(pcb->pck, (char *) value, vlen);
+
+    msgpack_pack_map(pck, entries);
+
+    for (i = 0; i < parser->slots_len; i++) {
+        slot = &parser->slots[i];
+
+        flb_regex_group_get(&result, slot->group, &value, &vlen);
+        if (vlen == 0) {
+            continue;
+        }
+
+        if (slot->time_key == FLB_TRUE &&
+            (time_ok == FLB_FALSE || parser->time_keep == FLB_FALSE)) {
+            continue;
+        }
+
+        /* pre-packed key, appended as raw bytes */
+        msgpack_pack_str_body(pck, slot->key, slot->key_len);
+
+        if (slot->type != 0) {
+            flb_parser_typecast_value(slot->name, slot->name_len,
+                                      (char *) value, vlen, slot->type, pck);
+        }
+        else {
+            msgpack_pack_str(pck, vlen);
+            msgpack_pack_str_body(pck, (char *) value, vlen);
+        }
     }
+
+    flb_regex_search_release(&result);
+
+    return last_byte;
 }
 
 int flb_parser_regex_do(struct flb_parser *parser,
@@ -118,95 +173,26 @@ int flb_parser_regex_do(struct flb_parser *parser,
                         struct flb_time *out_time)
 {
     int ret;
-    int arr_size;
     int last_byte;
-    ssize_t n;
     size_t dec_out_size;
     char *dec_out_buf;
-    char *tmp;
-    struct flb_regex_search result;
-    struct regex_cb_ctx pcb;
-    struct flb_time *t;
     msgpack_sbuffer tmp_sbuf;
     msgpack_packer tmp_pck;
 
-    n = flb_regex_do(parser->regex, (unsigned char *) buf, length, &result);
-    if (n <= 0) {
-        return -1;
-    }
-
     /* Prepare new outgoing buffer */
     msgpack_sbuffer_init(&tmp_sbuf);
     msgpack_packer_init(&tmp_pck, &tmp_sbuf, msgpack_sbuffer_write);
 
-    /* Set a Map size with the exact number of matches returned by regex */
-    arr_size = n;
-    msgpack_pack_map(&tmp_pck, arr_size);
-
-    /* Callback context */
-    pcb.pck = &tmp_pck;
-    pcb.parser = parser;
-    pcb.num_skipped = 0;
-    pcb.time_lookup = 0;
-    pcb.time_frac = 0;
-    pcb.time_now = time(NULL);
-
-    /* Iterate results and compose new buffer */
-    last_byte = flb_regex_parse(parser->regex, &result, cb_results, &pcb);
+    last_byte = flb_parser_regex_pack(parser, buf, length, &tmp_pck, out_time);
     if (last_byte == -1) {
         msgpack_sbuffer_destroy(&tmp_sbuf);
         return -1;
     }
 
-    /*
-     * There some special cases when the Parser have a 'time' handling
-     * requirement, meaning: lookup for this 'time' key and resolve the
-     * real date of the record. If so, the parser by default will
-     * keep the original 'time' key field found but in other scenarios
-     * it may ask to skip it.
-     *
-     * If a time lookup is specified and the parser ask to skip the record
-     * and the time key is found, we need to adjust the msgpack header
-     * map size, initially we set a size to include all keys found, but
-     * until now we just know we are not going to include it.
-     *
-     * In addition, keys without associated values are skipped too and we
-     * must take this into account in msgpack header map size adjustment.
-     *
-     * In order to avoid to create a new msgpack buffer and repack the
-     * map entries, we just position at the header byte and do the
-     * proper adjustment in our original buffer. Note that for cases
-     * where the map is large enough '<= 65535' or '> 65535' we have
-     * to use internal msgpack api functions since packing the bytes
-     * in Big-Endian is a requirement.
-     */
-     if (pcb.num_skipped > 0) {
-
-        arr_size = (n - pcb.num_skipped);
-
-        tmp = tmp_sbuf.data;
-        uint8_t h = tmp[0];
-        if (h >> 4 == 0x8) { /* 1000xxxx */
-            *tmp = (uint8_t) 0x8 << 4 | ((uint8_t) arr_size);
-        }
-        else if (h == 0xde) {
-            tmp++;
-            pack_uint16(tmp, arr_size);
-        }
-        else if (h == 0xdf) {
-            tmp++;
-            pack_uint32(tmp, arr_size);
-        }
-    }
-
     /* Export results */
     *out_buf = tmp_sbuf.data;
     *out_size = tmp_sbuf.size;
 
-    t = out_time;
-    t->tm.tv_sec  = pcb.time_lookup;
-    t->tm.tv_nsec = (pcb.time_frac * 1000000000);
-
     /* Check if some decoder was specified */
     if (parser->decoders) {
         ret = flb_parser_decoder_do(parser->decoders,
@@ -219,10 +205,5 @@ int flb_parser_regex_do(struct flb_parser *parser,
         }
     }
 
-    /*
-     * The return the value >= 0, belongs to the LAST BYTE consumed by the
-     * regex engine. If the last byte is lower than string length, means
-     * there is more data to be processed (maybe it's a stream).
-     */
     return last_byte;
 }
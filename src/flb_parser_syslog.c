@@ -0,0 +1,555 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2019      The Fluent Bit Authors
+ *  Copyright (C) 2015-2018 Treasure Data Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#define _GNU_SOURCE
+#include <time.h>
+
+#include <fluent-bit/flb_parser.h>
+#include <fluent-bit/flb_parser_decoder.h>
+#include <fluent-bit/flb_mem.h>
+#include <fluent-bit/flb_time.h>
+
+/*
+ * Native Syslog decoder for RFC5424 and RFC3164 messages:
+ *
+ *  RFC5424: <PRI>1 TIMESTAMP HOSTNAME APP-NAME PROCID MSGID SD [MSG]
+ *  RFC3164: <PRI>Mmm dd hh:mm:ss [HOSTNAME] TAG[PID]: MSG
+ *
+ * The message is decoded in one pass without regular expressions nor
+ * memory allocations, the only buffer allocated is the outgoing msgpack
+ * map. The keys generated are the same used by the stock regex parsers
+ * 'syslog-rfc5424' and 'syslog-rfc3164' so they can be replaced.
+ */
+
+struct syslog_field {
+    char *buf;
+    int len;
+};
+
+struct syslog_msg {
+    struct syslog_field pri;
+    struct syslog_field time;
+    struct syslog_field host;
+    struct syslog_field ident;
+    struct syslog_field pid;
+    struct syslog_field msgid;
+    struct syslog_field extradata;
+    struct syslog_field message;
+};
+
+static const char *months[] = {
+    "Jan", "Feb", "Mar", "Apr", "May", "Jun",
+    "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"
+};
+
+static inline int is_digit(char c)
+{
+    return (c >= '0' && c <= '9');
+}
+
+/* Convert 'n' digits to an integer, returns -1 if some byte is not a digit */
+static inline int digits(char *p, int n)
+{
+    int i;
+    int val = 0;
+
+    for (i = 0; i < n; i++) {
+        if (!is_digit(p[i])) {
+            return -1;
+        }
+        val = (val * 10) + (p[i] - '0');
+    }
+
+    return val;
+}
+
+/* Days since the epoch for a civil date (proleptic Gregorian calendar) */
+static inline int64_t days_from_civil(int y, int m, int d)
+{
+    int64_t era;
+    unsigned yoe;
+    unsigned doy;
+    unsigned doe;
+
+    y -= m <= 2;
+    era = (y >= 0 ? y : y - 399) / 400;
+    yoe = (unsigned) (y - era * 400);
+    doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+
+    return era * 146097 + (int64_t) doe - 719468;
+}
+
+static inline time_t civil_to_epoch(int year, int mon, int day,
+                                    int hour, int min, int sec)
+{
+    return (time_t) (days_from_civil(year, mon, day) * 86400 +
+                     hour * 3600 + min * 60 + sec);
+}
+
+/* Returns a pointer to the next space or to the end of the buffer */
+static inline char *token_end(char *p, char *end)
+{
+    while (p < end && *p != ' ') {
+        p++;
+    }
+    return p;
+}
+
+/*
+ * RFC3339 timestamp as used by RFC5424:
+ *
+ *   YYYY-MM-DDTHH:MM:SS[.frac](Z|+HH:MM|-HH:MM)
+ */
+static int time_rfc3339(char *p, int len, struct flb_time *out)
+{
+    int year;
+    int mon;
+    int day;
+    int hour;
+    int min;
+    int sec;
+    int tz;
+    int ndigits = 0;
+    long nsec = 0;
+    char *end = p + len;
+    time_t t;
+
+    if (len < 19 || p[4] != '-' || p[7] != '-' ||
+        (p[10] != 'T' && p[10] != 't' && p[10] != ' ') ||
+        p[13] != ':' || p[16] != ':') {
+        return -1;
+    }
+
+    year = digits(p, 4);
+    mon  = digits(p + 5, 2);
+    day  = digits(p + 8, 2);
+    hour = digits(p + 11, 2);
+    min  = digits(p + 14, 2);
+    sec  = digits(p + 17, 2);
+    if (year < 0 || mon < 1 || mon > 12 || day < 1 || day > 31 ||
+        hour < 0 || hour > 23 || min < 0 || min > 59 || sec < 0 || sec > 60) {
+        return -1;
+    }
+    p += 19;
+
+    /* Fractional seconds, keep up to nanoseconds precision */
+    if (p < end && (*p == '.' || *p == ',')) {
+        p++;
+        while (p < end && is_digit(*p)) {
+            if (ndigits < 9) {
+                nsec = (nsec * 10) + (*p - '0');
+                ndigits++;
+            }
+            p++;
+        }
+        while (ndigits < 9) {
+            nsec *= 10;
+            ndigits++;
+        }
+    }
+
+    t = civil_to_epoch(year, mon, day, hour, min, sec);
+
+    /* Time zone */
+    if (p < end) {
+        if (*p == 'Z' || *p == 'z') {
+            p++;
+        }
+        else if ((*p == '+' || *p == '-') && end - p >= 6 && p[3] == ':') {
+            hour = digits(p + 1, 2);
+            min  = digits(p + 4, 2);
+            if (hour < 0 || min < 0) {
+                return -1;
+            }
+            tz = (hour * 3600) + (min * 60);
+            t += (*p == '+') ? -tz : tz;
+            p += 6;
+        }
+        else {
+            return -1;
+        }
+    }
+
+    if (p != end) {
+        return -1;
+    }
+
+    out->tm.tv_sec = t;
+    out->tm.tv_nsec = nsec;
+    return 0;
+}
+
+/*
+ * RFC3164 timestamp: 'Mmm dd hh:mm:ss', the day can be space padded. The
+ * year is not part of the format, the current year is used.
+ */
+static int time_rfc3164(char *p, int len, int offset, struct flb_time *out)
+{
+    int i;
+    int mon = -1;
+    int day;
+    int hour;
+    int min;
+    int sec;
+    time_t now;
+    struct tm tm;
+
+    if (len != 15 || p[3] != ' ' || p[6] != ' ' ||
+        p[9] != ':' || p[12] != ':') {
+        return -1;
+    }
+
+    for (i = 0; i < 12; i++) {
+        if (strncmp(p, months[i], 3) == 0) {
+            mon = i + 1;
+            break;
+        }
+    }
+    if (mon == -1) {
+        return -1;
+    }
+
+    if (p[4] == ' ') {
+        day = digits(p + 5, 1);
+    }
+    else {
+        day = digits(p + 4, 2);
+    }
+    hour = digits(p + 7, 2);
+    min  = digits(p + 10, 2);
+    sec  = digits(p + 13, 2);
+    if (day < 1 || hour < 0 || min < 0 || sec < 0) {
+        return -1;
+    }
+
+    now = time(NULL);
+    gmtime_r(&now, &tm);
+
+    out->tm.tv_sec = civil_to_epoch(tm.tm_year + 1900, mon, day,
+                                    hour, min, sec) - offset;
+    out->tm.tv_nsec = 0;
+    return 0;
+}
+
+/* <PRI>: returns the position after '>' or NULL */
+static char *decode_pri(char *p, char *end, struct syslog_field *pri)
+{
+    char *start;
+
+    if (p >= end || *p != '<') {
+        return NULL;
+    }
+    p++;
+    start = p;
+    while (p < end && is_digit(*p) && p - start < 3) {
+        p++;
+    }
+    if (p == start || p >= end || *p != '>') {
+        return NULL;
+    }
+    pri->buf = start;
+    pri->len = p - start;
+
+    return p + 1;
+}
+
+/*
+ * Structured data: a NILVALUE or one or many elements like:
+ *
+ *   [id param="value" ...][id2 ...]
+ *
+ * param values can contain escaped '"', '\' and ']'.
+ */
+static char *decode_sd(char *p, char *end)
+{
+    int quoted;
+
+    if (p < end && *p == '-') {
+        return p + 1;
+    }
+
+    while (p < end && *p == '[') {
+        quoted = FLB_FALSE;
+        p++;
+        while (p < end) {
+            if (*p == '\\' && quoted == FLB_TRUE) {
+                p += 2;
+                continue;
+            }
+            if (*p == '"') {
+                quoted = !quoted;
+            }
+            else if (*p == ']' && quoted == FLB_FALSE) {
+                break;
+            }
+            p++;
+        }
+        if (p >= end) {
+            return NULL;
+        }
+        p++;
+    }
+
+    return p;
+}
+
+static int decode_rfc5424(struct flb_parser *parser, char *p, char *end,
+                          struct syslog_msg *msg, struct flb_time *out_time)
+{
+    int i;
+    char *tmp;
+    struct syslog_field *fields[] = {
+        &msg->time, &msg->host, &msg->ident, &msg->pid, &msg->msgid
+    };
+
+    /* Version, only '1' is defined */
+    if (end - p < 2 || p[0] != '1' || p[1] != ' ') {
+        return -1;
+    }
+    p += 2;
+
+    /* TIMESTAMP HOSTNAME APP-NAME PROCID MSGID */
+    for (i = 0; i < 5; i++) {
+        tmp = token_end(p, end);
+        if (tmp == p || tmp >= end) {
+            return -1;
+        }
+        fields[i]->buf = p;
+        fields[i]->len = tmp - p;
+        p = tmp + 1;
+    }
+
+    /* STRUCTURED-DATA */
+    tmp = decode_sd(p, end);
+    if (!tmp) {
+        return -1;
+    }
+    msg->extradata.buf = p;
+    msg->extradata.len = tmp - p;
+    p = tmp;
+
+    /* MSG: optional, it can start with an UTF-8 BOM */
+    if (p < end && *p == ' ') {
+        p++;
+        if (end - p >= 3 && (unsigned char) p[0] == 0xef &&
+            (unsigned char) p[1] == 0xbb && (unsigned char) p[2] == 0xbf) {
+            p += 3;
+        }
+        msg->message.buf = p;
+        msg->message.len = end - p;
+    }
+    else if (p != end) {
+        return -1;
+    }
+
+    if (msg->time.len == 1 && msg->time.buf[0] == '-') {
+        flb_time_get(out_time);
+        return 0;
+    }
+
+    return time_rfc3339(msg->time.buf, msg->time.len, out_time);
+}
+
+static inline int is_tag_byte(char c)
+{
+    return ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+            is_digit(c) || c == '_' || c == '/' || c == '.' || c == '-');
+}
+
+static int decode_rfc3164(struct flb_parser *parser, char *p, char *end,
+                          struct syslog_msg *msg, struct flb_time *out_time)
+{
+    int ret;
+    char *tmp;
+
+    /* Timestamp: 'Mmm dd hh:mm:ss' or a RFC3339 one (e.g: rsyslog) */
+    if (end - p > 0 && is_digit(*p)) {
+        tmp = token_end(p, end);
+        msg->time.buf = p;
+        msg->time.len = tmp - p;
+        ret = time_rfc3339(p, tmp - p, out_time);
+    }
+    else {
+        if (end - p < 15) {
+            return -1;
+        }
+        msg->time.buf = p;
+        msg->time.len = 15;
+        ret = time_rfc3164(p, 15, parser->time_offset, out_time);
+        tmp = p + 15;
+    }
+    if (ret == -1) {
+        return -1;
+    }
+    p = tmp;
+    if (p < end && *p == ' ') {
+        p++;
+    }
+
+    /*
+     * The hostname is optional (e.g: messages sent to a local Unix socket),
+     * if the first word looks like a TAG (it ends with ':' or it contains
+     * the PID '[') it's not an hostname.
+     */
+    tmp = token_end(p, end);
+    if (tmp < end && tmp > p && tmp[-1] != ':' &&
+        memchr(p, '[', tmp - p) == NULL) {
+        msg->host.buf = p;
+        msg->host.len = tmp - p;
+        p = tmp + 1;
+    }
+
+    /* TAG */
+    tmp = p;
+    while (tmp < end && is_tag_byte(*tmp)) {
+        tmp++;
+    }
+    msg->ident.buf = p;
+    msg->ident.len = tmp - p;
+    p = tmp;
+
+    /* [PID] */
+    if (p < end && *p == '[') {
+        tmp = p + 1;
+        while (tmp < end && is_digit(*tmp)) {
+            tmp++;
+        }
+        if (tmp < end && *tmp == ']') {
+            msg->pid.buf = p + 1;
+            msg->pid.len = tmp - (p + 1);
+            p = tmp + 1;
+        }
+    }
+
+    if (p < end && *p == ':') {
+        p++;
+    }
+    while (p < end && *p == ' ') {
+        p++;
+    }
+
+    msg->message.buf = p;
+    msg->message.len = end - p;
+
+    return 0;
+}
+
+static inline void pack_field(struct flb_parser *parser, msgpack_packer *pck,
+                              char *key, int key_len,
+                              struct syslog_field *field)
+{
+    if (parser->types_len > 0) {
+        flb_parser_typecast(key, key_len, field->buf, field->len,
+                            pck, parser->types, parser->types_len);
+        return;
+    }
+
+    msgpack_pack_str(pck, key_len);
+    msgpack_pack_str_body(pck, key, key_len);
+    msgpack_pack_str(pck, field->len);
+    msgpack_pack_str_body(pck, field->buf, field->len);
+}
+
+#define PACK_FIELD(name)                                                \
+    if (msg.name.buf) {                                                 \
+        pack_field(parser, &tmp_pck, #name, sizeof(#name) - 1, &msg.name); \
+    }
+
+int flb_parser_syslog_do(struct flb_parser *parser,
+                         char *in_buf, size_t in_size,
+                         void **out_buf, size_t *out_size,
+                         struct flb_time *out_time)
+{
+    int ret;
+    int map_size;
+    char *p;
+    char *end;
+    char *dec_out_buf;
+    size_t dec_out_size;
+    struct syslog_msg msg;
+    msgpack_sbuffer tmp_sbuf;
+    msgpack_packer tmp_pck;
+
+    memset(&msg, '\0', sizeof(struct syslog_msg));
+
+    /* Remove trailing line breaks */
+    end = in_buf + in_size;
+    while (end > in_buf && (end[-1] == '\n' || end[-1] == '\r')) {
+        end--;
+    }
+
+    p = decode_pri(in_buf, end, &msg.pri);
+    if (!p) {
+        return -1;
+    }
+
+    if (end - p >= 2 && p[0] == '1' && p[1] == ' ') {
+        ret = decode_rfc5424(parser, p, end, &msg, out_time);
+    }
+    else {
+        ret = decode_rfc3164(parser, p, end, &msg, out_time);
+    }
+    if (ret == -1) {
+        return -1;
+    }
+
+    /* Count the fields found */
+    map_size = 1;
+    map_size += (parser->time_keep == FLB_TRUE);
+    map_size += (msg.host.buf != NULL);
+    map_size += (msg.ident.buf != NULL);
+    map_size += (msg.pid.buf != NULL);
+    map_size += (msg.msgid.buf != NULL);
+    map_size += (msg.extradata.buf != NULL);
+    map_size += (msg.message.buf != NULL);
+
+    msgpack_sbuffer_init(&tmp_sbuf);
+    msgpack_packer_init(&tmp_pck, &tmp_sbuf, msgpack_sbuffer_write);
+    msgpack_pack_map(&tmp_pck, map_size);
+
+    PACK_FIELD(pri);
+    if (parser->time_keep == FLB_TRUE) {
+        PACK_FIELD(time);
+    }
+    PACK_FIELD(host);
+    PACK_FIELD(ident);
+    PACK_FIELD(pid);
+    PACK_FIELD(msgid);
+    PACK_FIELD(extradata);
+    PACK_FIELD(message);
+
+    *out_buf = tmp_sbuf.data;
+    *out_size = tmp_sbuf.size;
+
+    /* Check if some decoder was specified */
+    if (parser->decoders) {
+        ret = flb_parser_decoder_do(parser->decoders,
+                                    tmp_sbuf.data, tmp_sbuf.size,
+                                    &dec_out_buf, &dec_out_size);
+        if (ret == 0) {
+            *out_buf = dec_out_buf;
+            *out_size = dec_out_size;
+            msgpack_sbuffer_destroy(&tmp_sbuf);
+        }
+    }
+
+    return in_size;
+}
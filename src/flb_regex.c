@@ -175,6 +175,80 @@ int flb_regex_parse(struct flb_regex *r, struct flb_regex_search *result,
     return -1;
 }
 
+struct regex_groups_ctx {
+    int (*cb_group) (unsigned char *, size_t, int, void *);
+    void *data;
+};
+
+static int cb_onig_groups(const UChar *name, const UChar *name_end,
+                          int ngroup_num, int *group_nums,
+                          regex_t *reg, void *data)
+{
+    int i;
+    int ret;
+    struct regex_groups_ctx *ctx = data;
+
+    for (i = 0; i < ngroup_num; i++) {
+        ret = ctx->cb_group((unsigned char *) name, name_end - name,
+                            group_nums[i], ctx->data);
+        if (ret != 0) {
+            return ret;
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Enumerate the named groups of the pattern in the same order used by
+ * flb_regex_parse(), so callers can resolve names to group numbers once
+ * and read the matches with flb_regex_group_get().
+ */
+int flb_regex_groups(struct flb_regex *r,
+                     int (*cb_group) (unsigned char *, size_t,  /* name  */
+                                      int,                      /* group */
+                                      void *),                  /* caller data */
+                     void *data)
+{
+    struct regex_groups_ctx ctx;
+
+    ctx.cb_group = cb_group;
+    ctx.data = data;
+
+    return onig_foreach_name(r->regex, cb_onig_groups, &ctx);
+}
+
+/*
+ * Get the value captured by a group of a successful flb_regex_do(). It
+ * returns the end offset of the match, or -1 if the group did not
+ * participate in it (value is set to an empty string).
+ */
+ssize_t flb_regex_group_get(struct flb_regex_search *result, int group,
+                            unsigned char **value, size_t *len)
+{
+    OnigRegion *region = result->region;
+
+    if (group >= region->num_regs || region->end[group] < 0) {
+        *value = result->str;
+        *len = 0;
+        return -1;
+    }
+
+    *value = result->str + region->beg[group];
+    *len = region->end[group] - region->beg[group];
+
+    return region->end[group];
+}
+
+/* Release the results of flb_regex_do() when not using flb_regex_parse() */
+void flb_regex_search_release(struct flb_regex_search *result)
+{
+    if (result->region) {
+        onig_region_free(result->region, 1);
+        result->region = NULL;
+    }
+}
+
 int flb_regex_destroy(struct flb_regex *r)
 {
     onig_free(r->regex);
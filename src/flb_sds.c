@@ -28,6 +28,7 @@
 #include <fluent-bit/flb_log.h>
 #include <fluent-bit/flb_sds.h>
 #include <fluent-bit/flb_utf8.h>
+#include <fluent-bit/flb_simd.h>
 #include <stdarg.h>
 
 static flb_sds_t sds_alloc(size_t size)
@@ -164,6 +165,10 @@ flb_sds_t flb_sds_copy(flb_sds_t s, char *str, int len)
     return s;
 }
 
+/*
+ * Append 'str' escaped as the content of a JSON string. Plain ASCII runs
+ * are copied in bulk, escapes and UTF-8 sequences are written one by one.
+ */
 flb_sds_t flb_sds_cat_utf8 (flb_sds_t *sds, char *str, int str_len)
 {
     static const char int2hex[] = "0123456789abcdef";
@@ -171,6 +176,7 @@ flb_sds_t flb_sds_cat_utf8 (flb_sds_t *sds, char *str, int str_len)
     int b;
     int ret;
     int hex_bytes;
+    size_t run;
     uint32_t cp;
     uint32_t state = 0;
     uint32_t c;
@@ -190,14 +196,31 @@ flb_sds_t flb_sds_cat_utf8 (flb_sds_t *sds, char *str, int str_len)
     }
 
     for (i = 0; i < str_len; i++) {
-        if (flb_sds_avail(s) < 6) {
-            tmp = flb_sds_increase(s, 6);
+        /* copy the clean run found at this position */
+        run = flb_simd_json_clean_len(str + i, str_len - i);
+        if (run > 0) {
+            if (flb_sds_avail(s) <= run) {
+                tmp = flb_sds_increase(s, run);
+                if (tmp == NULL) return NULL;
+                *sds = s = tmp;
+                head = FLB_SDS_HEADER(s);
+            }
+            memcpy(s + head->len, str + i, run);
+            head->len += run;
+            i += run;
+            if (i == str_len) {
+                break;
+            }
+        }
+
+        if (flb_sds_avail(s) < 10) {
+            tmp = flb_sds_increase(s, 10);
             if (tmp == NULL) return NULL;
             *sds = s = tmp;
             head = FLB_SDS_HEADER(s);
         }
 
-        c = (uint32_t) str[i];
+        c = (unsigned char) str[i];
         if (c == '\\' || c == '"') {
             s[head->len++] = '\\';
             s[head->len++] = c;
@@ -230,12 +253,6 @@ flb_sds_t flb_sds_cat_utf8 (flb_sds_t *sds, char *str, int str_len)
             }
         }
         else if (c < 32 || c == 0x7f) {
-            if (flb_sds_avail(s) < 6) {
-                tmp = flb_sds_increase(s, 6);
-                if (tmp == NULL) return NULL;
-                *sds = s = tmp;
-                head = FLB_SDS_HEADER(s);
-            }
             s[head->len++] = '\\';
             s[head->len++] = 'u';
             s[head->len++] = '0';
@@ -243,47 +260,13 @@ flb_sds_t flb_sds_cat_utf8 (flb_sds_t *sds, char *str, int str_len)
             s[head->len++] = int2hex[ (unsigned char) ((c & 0xf0) >> 4)];
             s[head->len++] = int2hex[ (unsigned char) (c & 0x0f)];
         }
-        else if (c >= 0x80 && c <= 0xFFFF) {
+        else {
+            /* multibyte UTF-8 sequence, it must be complete and valid */
             hex_bytes = flb_utf8_len(str + i);
-            if (flb_sds_avail(s) < 6) {
-                tmp = flb_sds_increase(s, 2 + 6);
-                if (tmp == NULL) return NULL;
-                *sds = s = tmp;
-                head = FLB_SDS_HEADER(s);
-            }
-
-            state = FLB_UTF8_ACCEPT;
-            cp = 0;
-            for (b = 0; b < hex_bytes; b++) {
-                p = (unsigned char *) str + i + b;
-                ret = flb_utf8_decode(&state, &cp, *p);
-                if (ret == 0) {
-                    break;
-                }
-            }
-
-            if (state != FLB_UTF8_ACCEPT) {
-                /* Invalid UTF-8 hex, just skip utf-8 bytes */
+            if (hex_bytes > str_len - i) {
+                flb_warn("[pack] invalid UTF-8 bytes, skipping");
                 break;
             }
-            else {
-                s[head->len++] = '\\';
-                s[head->len++] = 'u';
-                s[head->len++] = int2hex[ (unsigned char) ((cp & 0xf000) >> 12)];
-                s[head->len++] = int2hex[ (unsigned char) ((cp & 0x0f00) >> 8)];
-                s[head->len++] = int2hex[ (unsigned char) ((cp & 0xf0) >> 4)];
-                s[head->len++] = int2hex[ (unsigned char) (cp & 0x0f)];
-            }
-            i += (hex_bytes - 1);
-        }
-        else if (c > 0xFFFF) {
-            hex_bytes = flb_utf8_len(str + i);
-            if (flb_sds_avail(s) < 10) {
-                tmp = flb_sds_increase(s, 10);
-                if (tmp == NULL) return NULL;
-                *sds = s = tmp;
-                head = FLB_SDS_HEADER(s);
-            }
 
             state = FLB_UTF8_ACCEPT;
             cp = 0;
@@ -300,23 +283,21 @@ flb_sds_t flb_sds_cat_utf8 (flb_sds_t *sds, char *str, int str_len)
                 flb_warn("[pack] invalid UTF-8 bytes, skipping");
                 break;
             }
-            else {
-                s[head->len++] = '\\';
-                s[head->len++] = 'u';
+
+            s[head->len++] = '\\';
+            s[head->len++] = 'u';
+            if (cp > 0xFFFF) {
                 s[head->len++] = '0';
                 s[head->len++] = '0';
                 s[head->len++] = int2hex[ (unsigned char) ((cp & 0xf00000) >> 20)];
                 s[head->len++] = int2hex[ (unsigned char) ((cp & 0x0f0000) >> 16)];
-                s[head->len++] = int2hex[ (unsigned char) ((cp & 0xf000) >> 12)];
-                s[head->len++] = int2hex[ (unsigned char) ((cp & 0x0f00) >> 8)];
-                s[head->len++] = int2hex[ (unsigned char) ((cp & 0xf0) >> 4)];
-                s[head->len++] = int2hex[ (unsigned char) (cp & 0x0f)];
             }
+            s[head->len++] = int2hex[ (unsigned char) ((cp & 0xf000) >> 12)];
+            s[head->len++] = int2hex[ (unsigned char) ((cp & 0x0f00) >> 8)];
+            s[head->len++] = int2hex[ (unsigned char) ((cp & 0xf0) >> 4)];
+            s[head->len++] = int2hex[ (unsigned char) (cp & 0x0f)];
             i += (hex_bytes - 1);
         }
-        else {
-            s[head->len++] = c;
-        }
     }
 
     s[head->len] = '\0';
@@ -345,24 +326,26 @@ flb_sds_t flb_sds_printf(flb_sds_t *sds, const char *fmt, ...)
     }
 
     va_start(ap, fmt);
-
     size = vsnprintf((char *) (s + flb_sds_len(s)), flb_sds_avail(s), fmt, ap);
+    va_end(ap);
     if (size < 0) {
         flb_warn("[%s] buggy vsnprintf return %d", __FUNCTION__, size);
-        va_end(ap);
         return NULL;
     }
-    if (size > flb_sds_avail(s)) {
-        tmp = flb_sds_increase(s, size);
+
+    /* the output was truncated: grow and format again (plus NULL byte) */
+    if (size >= flb_sds_avail(s)) {
+        tmp = flb_sds_increase(s, size - flb_sds_avail(s) + 1);
         if (!tmp) {
-            va_end(ap);
             return NULL;
         }
         *sds = s = tmp;
+
+        va_start(ap, fmt);
         size = vsnprintf((char *) (s + flb_sds_len(s)), flb_sds_avail(s), fmt, ap);
-        if (size > flb_sds_avail(s)) {
+        va_end(ap);
+        if (size >= flb_sds_avail(s)) {
             flb_warn("[%s] vsnprintf is insatiable ", __FUNCTION__);
-            va_end(ap);
             return NULL;
         }
     }
@@ -371,8 +354,6 @@ flb_sds_t flb_sds_printf(flb_sds_t *sds, const char *fmt, ...)
     head->len += size;
     s[head->len] = '\0';
 
-    va_end(ap);
-
     return s;
 }
 
@@ -28,6 +28,8 @@
 #include <fluent-bit/flb_tls.h>
 #include <fluent-bit/flb_utils.h>
 
+#include <errno.h>
+
 /* Creates a new upstream context */
 struct flb_upstream *flb_upstream_create(struct flb_config *config,
                                          char *host, int port, int flags,
@@ -45,6 +47,7 @@ struct flb_upstream *flb_upstream_create(struct flb_config *config,
     u->tcp_port      = port;
     u->flags         = flags;
     u->evl           = config->evl;
+    u->dns           = config->dns;
     u->n_connections = 0;
     u->flags |= FLB_IO_ASYNC;
 
@@ -53,6 +56,8 @@ struct flb_upstream *flb_upstream_create(struct flb_config *config,
 
 #ifdef FLB_HAVE_TLS
     u->tls      = (struct flb_tls *) tls;
+    u->tls_resume_set = FLB_FALSE;
+    mbedtls_ssl_session_init(&u->tls_resume);
 #endif
 
     return u;
@@ -122,22 +127,30 @@ struct flb_upstream *flb_upstream_create_url(struct flb_config *config,
     return u;
 }
 
+static void conn_free(struct flb_upstream_conn *u_conn);
+static int destroy_conn(struct flb_upstream_conn *u_conn);
+
 int flb_upstream_destroy(struct flb_upstream *u)
 {
     struct mk_list *tmp;
     struct mk_list *head;
     struct flb_upstream_conn *u_conn;
 
+    /* idle keepalive connections */
     mk_list_foreach_safe(head, tmp, &u->av_queue) {
         u_conn = mk_list_entry(head, struct flb_upstream_conn, _head);
-        flb_upstream_conn_release(u_conn);
+        conn_free(u_conn);
     }
 
     mk_list_foreach_safe(head, tmp, &u->busy_queue) {
         u_conn = mk_list_entry(head, struct flb_upstream_conn, _head);
-        flb_upstream_conn_release(u_conn);
+        destroy_conn(u_conn);
     }
 
+#ifdef FLB_HAVE_TLS
+    mbedtls_ssl_session_free(&u->tls_resume);
+#endif
+
     flb_free(u->tcp_host);
     flb_free(u);
 
@@ -162,6 +175,7 @@ static struct flb_upstream_conn *create_conn(struct flb_upstream *u)
     conn->u             = u;
     conn->fd            = -1;
     conn->connect_count = 0;
+    conn->ka_count      = 0;
 #ifdef FLB_HAVE_TLS
     conn->tls_session   = NULL;
 #endif
@@ -182,6 +196,30 @@ static struct flb_upstream_conn *create_conn(struct flb_upstream *u)
     return conn;
 }
 
+/*
+ * Check if an idle keepalive connection is still usable: a closed or
+ * failed socket reports EOF or an error without blocking.
+ */
+static int conn_is_alive(struct flb_upstream_conn *conn)
+{
+    int ret;
+    char tmp;
+
+    if (conn->fd <= 0) {
+        return FLB_FALSE;
+    }
+
+    ret = recv(conn->fd, &tmp, 1, MSG_PEEK | MSG_DONTWAIT);
+    if (ret == 0) {
+        return FLB_FALSE;
+    }
+    else if (ret == -1 && errno != EAGAIN && errno != EWOULDBLOCK) {
+        return FLB_FALSE;
+    }
+
+    return FLB_TRUE;
+}
+
 static struct flb_upstream_conn *get_conn(struct flb_upstream *u)
 {
     struct flb_upstream_conn *conn;
@@ -192,6 +230,7 @@ static struct flb_upstream_conn *get_conn(struct flb_upstream *u)
     /* Get the first available connection and increase the counter */
     conn = mk_list_entry_first(&u->av_queue,
                                struct flb_upstream_conn, _head);
+    conn->ka_count++;
     u->n_connections++;
 
     /* Move it to the busy queue */
@@ -210,9 +249,22 @@ struct flb_upstream_conn *flb_upstream_conn_get(struct flb_upstream *u)
     struct flb_upstream_conn *u_conn = NULL;
 
     /*
-     * FIXME: for 0.9 series the keep alive mode will be enabled, useless
-     * check now as the available queue is always empty.
+     * The available queue is only populated by upstreams created with
+     * the FLB_IO_TCP_KA flag, drop the idle connections closed by the
+     * remote end in the meantime.
      */
+    while (mk_list_is_empty(&u->av_queue) != 0) {
+        u_conn = mk_list_entry_first(&u->av_queue,
+                                     struct flb_upstream_conn, _head);
+        if (conn_is_alive(u_conn) == FLB_TRUE) {
+            break;
+        }
+        flb_debug("[upstream] [fd=%i] keepalive connection closed by peer",
+                  u_conn->fd);
+        conn_free(u_conn);
+    }
+    u_conn = NULL;
+
     if (mk_list_is_empty(&u->av_queue) == 0) {
 
         if (u->max_connections <= 0) {
@@ -241,6 +293,34 @@ int flb_upstream_conn_release(struct flb_upstream_conn *u_conn)
 {
     struct flb_upstream *u = u_conn->u;
 
+    /*
+     * Keepalive: a connection with a valid socket goes back to the
+     * available queue (flb_io closes the socket on write errors).
+     */
+    if ((u->flags & FLB_IO_TCP_KA) && u_conn->fd > 0) {
+        flb_trace("[upstream] [fd=%i] keepalive connection %p",
+                  u_conn->fd, u_conn);
+
+        if (u->flags & FLB_IO_ASYNC) {
+            mk_event_del(u->evl, &u_conn->event);
+        }
+        mk_list_del(&u_conn->_head);
+        mk_list_add(&u_conn->_head, &u->av_queue);
+        u->n_connections--;
+        return 0;
+    }
+
+    return destroy_conn(u_conn);
+}
+
+/*
+ * Close and release a connection. Idle keepalive connections (av_queue)
+ * are not counted in n_connections and are released directly.
+ */
+static void conn_free(struct flb_upstream_conn *u_conn)
+{
+    struct flb_upstream *u = u_conn->u;
+
     flb_trace("[upstream] [fd=%i] releasing connection %p",
               u_conn->fd, u_conn);
 
@@ -261,9 +341,14 @@ int flb_upstream_conn_release(struct flb_upstream_conn *u_conn)
 
     /* remove connection from the queue */
     mk_list_del(&u_conn->_head);
-
-    u->n_connections--;
     flb_free(u_conn);
+}
+
+/* Release a busy connection */
+static int destroy_conn(struct flb_upstream_conn *u_conn)
+{
+    u_conn->u->n_connections--;
+    conn_free(u_conn);
 
     return 0;
 }
@@ -36,6 +36,7 @@
 #include <fluent-bit/flb_output.h>
 #include <fluent-bit/flb_utils.h>
 #include <fluent-bit/flb_utf8.h>
+#include <fluent-bit/flb_simd.h>
 
 void flb_utils_error(int err)
 {
@@ -515,17 +516,21 @@ static inline void encoded_to_buf(char *out, char *in, int len)
  * Write string pointed by 'str' to the destination buffer 'buf'. It's make sure
  * to escape sepecial characters and convert utf-8 byte characters to string
  * representation.
+ *
+ * Runs of plain ASCII are found with flb_simd_json_clean_len() and copied in
+ * bulk, only the bytes that need escaping go through the per character path.
  */
 int flb_utils_write_str(char *buf, int *off, size_t size,
                         char *str, size_t str_len)
 {
-    int i;
     int b;
     int ret;
     int written = 0;
     int required;
     int len;
     int hex_bytes;
+    size_t i;
+    size_t run;
     uint32_t codepoint;
     uint32_t state = 0;
     char tmp[16];
@@ -542,11 +547,26 @@ int flb_utils_write_str(char *buf, int *off, size_t size,
 
     p = buf + *off;
     for (i = 0; i < str_len; i++) {
+        /* copy the clean run found at this position */
+        run = flb_simd_json_clean_len(str + i, str_len - i);
+        if (run > 0) {
+            if ((available - written) <= run) {
+                return FLB_FALSE;
+            }
+            memcpy(p, str + i, run);
+            p += run;
+            written += run;
+            i += run;
+            if (i == str_len) {
+                break;
+            }
+        }
+
         if ((available - written) < 2) {
             return FLB_FALSE;
         }
 
-        c = (uint32_t) str[i];
+        c = (unsigned char) str[i];
         if (c == '\\' || c == '"') {
             *p++ = '\\';
             *p++ = c;
@@ -585,38 +605,13 @@ int flb_utils_write_str(char *buf, int *off, size_t size,
             encoded_to_buf(p, tmp, len);
             p += len;
         }
-        else if (c >= 0x80 && c <= 0xFFFF) {
+        else {
+            /* multibyte UTF-8 sequence, it must be complete and valid */
             hex_bytes = flb_utf8_len(str + i);
-            if ((available - written) < (2 + hex_bytes)) {
-                return FLB_FALSE;
-            }
-
-            state = FLB_UTF8_ACCEPT;
-            codepoint = 0;
-            for (b = 0; b < hex_bytes; b++) {
-                s = (unsigned char *) str + i + b;
-                ret = flb_utf8_decode(&state, &codepoint, *s);
-                if (ret == 0) {
-                    break;
-                }
-            }
-
-            if (state != FLB_UTF8_ACCEPT) {
-                /* Invalid UTF-8 hex, just skip utf-8 bytes */
+            if ((size_t) hex_bytes > str_len - i) {
+                flb_warn("[pack] invalid UTF-8 bytes, skipping");
                 break;
             }
-            else {
-                len = snprintf(tmp, sizeof(tmp) - 1, "\\u%.4x", codepoint);
-                encoded_to_buf(p, tmp, len);
-                p += len;
-            }
-            i += (hex_bytes - 1);
-        }
-        else if (c > 0xFFFF) {
-            hex_bytes = flb_utf8_len(str + i);
-            if ((available - written) < (4 + hex_bytes)) {
-                return FLB_FALSE;
-            }
 
             state = FLB_UTF8_ACCEPT;
             codepoint = 0;
@@ -633,16 +628,15 @@ int flb_utils_write_str(char *buf, int *off, size_t size,
                 flb_warn("[pack] invalid UTF-8 bytes, skipping");
                 break;
             }
-            else {
-                len = snprintf(tmp, sizeof(tmp) - 1, "\\u%04x", codepoint);
-                encoded_to_buf(p, tmp, len);
-                p += len;
+
+            len = snprintf(tmp, sizeof(tmp) - 1, "\\u%04x", codepoint);
+            if ((available - written) <= len) {
+                return FLB_FALSE;
             }
+            encoded_to_buf(p, tmp, len);
+            p += len;
             i += (hex_bytes - 1);
         }
-        else {
-            *p++ = c;
-        }
         written = (p - (buf + *off));
     }
 
@@ -650,7 +644,6 @@ int flb_utils_write_str(char *buf, int *off, size_t size,
     return FLB_TRUE;
 }
 
-
 int flb_utils_write_str_buf(char *str, size_t str_len, char **out, size_t *out_size)
 {
     int ret;
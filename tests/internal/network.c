@@ -6,13 +6,19 @@
 #include <fluent-bit/flb_error.h>
 #include <fluent-bit/flb_network.h>
 #include <fluent-bit/flb_socket.h>
+#include <fluent-bit/flb_net_dns.h>
 
 #include <time.h>
+#include <poll.h>
+#include <pthread.h>
+#include <arpa/inet.h>
 #include "flb_tests_internal.h"
 
 #define TEST_HOSTv4           "127.0.0.1"
 #define TEST_HOSTv6           "::1"
 #define TEST_PORT             "41322"
+#define TEST_DNS_PORT         "41323"
+#define TEST_DNS_CONF         "/tmp/flb-test-resolv.conf"
 
 #define TEST_EV_CLIENT        MK_EVENT_NOTIFICATION
 #define TEST_EV_SERVER        MK_EVENT_CUSTOM
@@ -142,8 +148,187 @@ void test_ipv6_client_server()
     test_client_server(FLB_TRUE);
 }
 
+/*
+ * Stub DNS server: 'svc.test' resolves to two addresses with a TTL of one
+ * second, any other name does not exist.
+ */
+struct dns_stub {
+    flb_sockfd_t fd;
+    int queries;
+    int exit;
+};
+
+static void *dns_stub_worker(void *data)
+{
+    int ret;
+    int len;
+    int i;
+    unsigned char buf[512];
+    struct sockaddr_storage peer;
+    socklen_t peer_len;
+    struct pollfd pfd;
+    struct dns_stub *stub = data;
+    /* svc.test in wire format */
+    unsigned char name[] = {3, 's', 'v', 'c', 4, 't', 'e', 's', 't', 0};
+
+    while (!stub->exit) {
+        pfd.fd = stub->fd;
+        pfd.events = POLLIN;
+        if (poll(&pfd, 1, 100) <= 0) {
+            continue;
+        }
+
+        peer_len = sizeof(peer);
+        len = recvfrom(stub->fd, buf, sizeof(buf), 0,
+                       (struct sockaddr *) &peer, &peer_len);
+        if (len < 12) {
+            continue;
+        }
+        stub->queries++;
+
+        buf[2] |= 0x80;
+        buf[3] = 0x80;
+        if (memcmp(buf + 12, name, sizeof(name)) != 0) {
+            buf[3] |= 3;
+        }
+        else {
+            buf[7] = 2;
+            for (i = 0; i < 2; i++) {
+                /* pointer to the question name, A, IN, TTL 1, 4 bytes */
+                unsigned char rr[] = {0xc0, 12, 0, 1, 0, 1, 0, 0, 0, 1,
+                                      0, 4, 10, 0, 0, i + 1};
+                memcpy(buf + len, rr, sizeof(rr));
+                len += sizeof(rr);
+            }
+        }
+
+        ret = sendto(stub->fd, buf, len, 0,
+                     (struct sockaddr *) &peer, peer_len);
+        TEST_CHECK(ret == len);
+    }
+
+    return NULL;
+}
+
+static int dns_lookup_str(struct flb_net_dns *dns, char *host, char *out)
+{
+    int ret;
+    struct sockaddr_storage addr;
+    struct sockaddr_in *sin;
+    socklen_t len;
+
+    ret = flb_net_dns_lookup(dns, host, 80, AF_INET, NULL, NULL,
+                             &addr, &len);
+    if (ret == -1) {
+        return -1;
+    }
+
+    sin = (struct sockaddr_in *) &addr;
+    TEST_CHECK(len == sizeof(struct sockaddr_in));
+    TEST_CHECK(ntohs(sin->sin_port) == 80);
+    inet_ntop(AF_INET, &sin->sin_addr, out, INET_ADDRSTRLEN);
+
+    return 0;
+}
+
+void test_dns_lookup()
+{
+    int ret;
+    char ip[INET_ADDRSTRLEN];
+    pthread_t tid;
+    struct dns_stub stub = {0};
+    struct flb_net_dns *dns;
+
+    stub.fd = flb_net_server_udp(TEST_DNS_PORT, TEST_HOSTv4);
+    TEST_CHECK(stub.fd != -1);
+    if (stub.fd == -1) {
+        return;
+    }
+    pthread_create(&tid, NULL, dns_stub_worker, &stub);
+
+    dns = flb_net_dns_create(NULL, NULL);
+    TEST_CHECK(dns != NULL);
+    ret = flb_net_dns_server_add(dns, TEST_HOSTv4, atoi(TEST_DNS_PORT));
+    TEST_CHECK(ret == 0);
+
+    /* addresses are returned as they are */
+    ret = dns_lookup_str(dns, "192.168.1.1", ip);
+    TEST_CHECK(ret == 0 && strcmp(ip, "192.168.1.1") == 0);
+    TEST_CHECK(stub.queries == 0);
+
+    /* one query, then the cached answer rotates */
+    ret = dns_lookup_str(dns, "svc.test", ip);
+    TEST_CHECK(ret == 0 && strcmp(ip, "10.0.0.1") == 0);
+    ret = dns_lookup_str(dns, "svc.test", ip);
+    TEST_CHECK(ret == 0 && strcmp(ip, "10.0.0.2") == 0);
+    ret = dns_lookup_str(dns, "SVC.test", ip);
+    TEST_CHECK(ret == 0 && strcmp(ip, "10.0.0.1") == 0);
+    TEST_CHECK(stub.queries == 1);
+
+    ret = dns_lookup_str(dns, "none.test", ip);
+    TEST_CHECK(ret == -1);
+    TEST_CHECK(stub.queries == 2);
+
+    /* the TTL expired */
+    sleep(2);
+    ret = dns_lookup_str(dns, "svc.test", ip);
+    TEST_CHECK(ret == 0);
+    TEST_CHECK(stub.queries == 3);
+
+    stub.exit = FLB_TRUE;
+    pthread_join(tid, NULL);
+    flb_socket_close(stub.fd);
+
+    /* nobody listening, the query fails right away */
+    ret = dns_lookup_str(dns, "other.test", ip);
+    TEST_CHECK(ret == -1);
+
+    flb_net_dns_destroy(dns);
+}
+
+void test_dns_resolv_conf()
+{
+    FILE *fp;
+    struct flb_net_dns *dns;
+
+    fp = fopen(TEST_DNS_CONF, "w");
+    TEST_CHECK(fp != NULL);
+    if (!fp) {
+        return;
+    }
+    fprintf(fp,
+            "# comment\n"
+            "nameserver 10.0.0.53\n"
+            "nameserver ::1\n"
+            "nameserver invalid\n"
+            "domain example.org\n"
+            "search a.example.org b.example.org ; comment\n"
+            "options ndots:5 timeout:2 attempts:9\n");
+    fclose(fp);
+
+    dns = flb_net_dns_create(TEST_DNS_CONF, NULL);
+    unlink(TEST_DNS_CONF);
+    TEST_CHECK(dns != NULL);
+    if (!dns) {
+        return;
+    }
+
+    TEST_CHECK(dns->n_servers == 2);
+    TEST_CHECK(dns->servers[0].ss_family == AF_INET);
+    TEST_CHECK(dns->servers[1].ss_family == AF_INET6);
+    TEST_CHECK(dns->n_search == 2);
+    TEST_CHECK(strcmp(dns->search[1], "b.example.org") == 0);
+    TEST_CHECK(dns->ndots == 5);
+    TEST_CHECK(dns->timeout == 2);
+    TEST_CHECK(dns->attempts == 5);
+
+    flb_net_dns_destroy(dns);
+}
+
 TEST_LIST = {
     { "ipv4_client_server", test_ipv4_client_server},
     { "ipv6_client_server", test_ipv6_client_server},
+    { "dns_lookup"        , test_dns_lookup},
+    { "dns_resolv_conf"   , test_dns_resolv_conf},
     { 0 }
 };
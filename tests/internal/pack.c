@@ -5,6 +5,7 @@
 #include <fluent-bit/flb_pack.h>
 #include <fluent-bit/flb_error.h>
 #include <fluent-bit/flb_str.h>
+#include <fluent-bit/flb_mp.h>
 #include <monkey/mk_core.h>
 
 #include <sys/types.h>
@@ -465,6 +466,305 @@ void test_utf8_to_json()
     utf8_tests_destroy(n_tests);
 }
 
+/* Feed a JSON stream byte by byte and pack every complete value */
+static int json_stream_feed(struct flb_pack_json_stream *s, char *data,
+                            int *types, msgpack_sbuffer *sbuf)
+{
+    int ret;
+    int type;
+    int count = 0;
+    int buf_len = 0;
+    size_t len;
+    size_t processed;
+    size_t value_len;
+    char *value;
+    char buf[256];
+    msgpack_packer pck;
+
+    msgpack_packer_init(&pck, sbuf, msgpack_sbuffer_write);
+
+    len = strlen(data);
+    while (len > 0) {
+        buf[buf_len++] = *data++;
+        len--;
+
+        while ((ret = flb_pack_json_stream_next(s, buf, buf_len,
+                                                &value, &value_len,
+                                                &type)) == 0) {
+            ret = flb_pack_json_stream_pack(s, value, value_len, &pck);
+            TEST_CHECK(ret == 0);
+            types[count++] = type;
+        }
+        TEST_CHECK(ret == FLB_ERR_JSON_PART);
+
+        /* Release processed bytes */
+        processed = flb_pack_json_stream_processed(s);
+        consume_bytes(buf, processed, buf_len);
+        buf_len -= processed;
+        flb_pack_json_stream_consume(s, processed);
+    }
+
+    return count;
+}
+
+void test_json_pack_stream()
+{
+    int i;
+    int ret;
+    int count;
+    int types[8];
+    size_t off = 0;
+    char *data;
+    msgpack_sbuffer sbuf;
+    msgpack_unpacked result;
+    struct flb_pack_json_stream s;
+    int type;
+    size_t value_len;
+    char *value;
+    int expected[] = {MSGPACK_OBJECT_MAP, MSGPACK_OBJECT_ARRAY,
+                      MSGPACK_OBJECT_STR, MSGPACK_OBJECT_POSITIVE_INTEGER,
+                      MSGPACK_OBJECT_MAP};
+
+    /* Concatenated values split across reads */
+    data = "{\"a\": \"x}\\\"{\"} [1, {\"b\": [2]}]  \"str\" 123\n"
+           "{\"c\": true}\n";
+
+    ret = flb_pack_json_stream_init(&s, FLB_FALSE);
+    TEST_CHECK(ret == 0);
+
+    msgpack_sbuffer_init(&sbuf);
+    count = json_stream_feed(&s, data, types, &sbuf);
+    TEST_CHECK(count == 5);
+
+    msgpack_unpacked_init(&result);
+    i = 0;
+    while (msgpack_unpack_next(&result, sbuf.data, sbuf.size, &off) ==
+           MSGPACK_UNPACK_SUCCESS) {
+        TEST_CHECK(i < 5 && result.data.type == expected[i]);
+        i++;
+    }
+    TEST_CHECK(i == 5);
+    msgpack_unpacked_destroy(&result);
+    msgpack_sbuffer_destroy(&sbuf);
+    flb_pack_json_stream_destroy(&s);
+
+    /* Newline delimited */
+    data = "{\"a\": 1}\r\n\n  [1, 2]\n{\"b\": \"c\"}\n{\"d\": 1";
+
+    ret = flb_pack_json_stream_init(&s, FLB_TRUE);
+    TEST_CHECK(ret == 0);
+
+    msgpack_sbuffer_init(&sbuf);
+    count = json_stream_feed(&s, data, types, &sbuf);
+    TEST_CHECK(count == 3);
+    TEST_CHECK(types[0] == FLB_PACK_JSON_OBJECT);
+    TEST_CHECK(types[1] == FLB_PACK_JSON_ARRAY);
+    TEST_CHECK(types[2] == FLB_PACK_JSON_OBJECT);
+    msgpack_sbuffer_destroy(&sbuf);
+    flb_pack_json_stream_destroy(&s);
+
+    /* Stray delimiters are skipped, the next value is found */
+    data = "{\"a\": 1} }, {\"b\": 2}";
+
+    ret = flb_pack_json_stream_init(&s, FLB_FALSE);
+    TEST_CHECK(ret == 0);
+
+    count = 0;
+    while ((ret = flb_pack_json_stream_next(&s, data, strlen(data),
+                                            &value, &value_len,
+                                            &type)) != FLB_ERR_JSON_PART) {
+        if (ret == 0) {
+            TEST_CHECK(type == FLB_PACK_JSON_OBJECT);
+            count++;
+        }
+        else {
+            TEST_CHECK(ret == FLB_ERR_JSON_INVAL);
+        }
+    }
+    TEST_CHECK(count == 2);
+    TEST_CHECK(flb_pack_json_stream_processed(&s) == strlen(data));
+    flb_pack_json_stream_destroy(&s);
+}
+
+/* Validate and count serialized records: [time, {map}] */
+void test_mp_validate_records()
+{
+    int i;
+    int ret;
+    msgpack_sbuffer mp_sbuf;
+    msgpack_packer mp_pck;
+
+    msgpack_sbuffer_init(&mp_sbuf);
+    msgpack_packer_init(&mp_pck, &mp_sbuf, msgpack_sbuffer_write);
+
+    for (i = 0; i < 3; i++) {
+        msgpack_pack_array(&mp_pck, 2);
+        msgpack_pack_uint64(&mp_pck, 1556000000 + i);
+        msgpack_pack_map(&mp_pck, 2);
+        msgpack_pack_str(&mp_pck, 3);
+        msgpack_pack_str_body(&mp_pck, "key", 3);
+        msgpack_pack_array(&mp_pck, 2);
+        msgpack_pack_int(&mp_pck, -1);
+        msgpack_pack_double(&mp_pck, 0.5);
+        msgpack_pack_str(&mp_pck, 3);
+        msgpack_pack_str_body(&mp_pck, "map", 3);
+        msgpack_pack_map(&mp_pck, 1);
+        msgpack_pack_nil(&mp_pck);
+        msgpack_pack_true(&mp_pck);
+    }
+
+    ret = flb_mp_validate_records(mp_sbuf.data, mp_sbuf.size);
+    TEST_CHECK(ret == 3);
+
+    /* Truncated record */
+    ret = flb_mp_validate_records(mp_sbuf.data, mp_sbuf.size - 1);
+    TEST_CHECK(ret == -1);
+
+    /* Not a record */
+    msgpack_sbuffer_clear(&mp_sbuf);
+    msgpack_pack_array(&mp_pck, 2);
+    msgpack_pack_str(&mp_pck, 3);
+    msgpack_pack_str_body(&mp_pck, "tag", 3);
+    msgpack_pack_map(&mp_pck, 0);
+    ret = flb_mp_validate_records(mp_sbuf.data, mp_sbuf.size);
+    TEST_CHECK(ret == -1);
+
+    ret = flb_mp_validate_records(mp_sbuf.data, 0);
+    TEST_CHECK(ret == 0);
+
+    msgpack_sbuffer_destroy(&mp_sbuf);
+}
+
+/* Extra field added by the encoder hook */
+static int json_enc_tag(flb_sds_t *buf, struct flb_time *tm,
+                        msgpack_object *map, void *data)
+{
+    flb_sds_t tmp;
+
+    if (flb_pack_json_enc_str(buf, "tag", 3) == -1) {
+        return -1;
+    }
+    tmp = flb_sds_cat(*buf, ":", 1);
+    if (!tmp) {
+        return -1;
+    }
+    *buf = tmp;
+    if (flb_pack_json_enc_str(buf, data, strlen(data)) == -1) {
+        return -1;
+    }
+    return 1;
+}
+
+/* Streaming JSON encoder */
+void test_json_enc()
+{
+    int i;
+    int ret;
+    char big[2048];
+    char json[4096];
+    size_t off = 0;
+    flb_sds_t buf;
+    msgpack_sbuffer mp_sbuf;
+    msgpack_packer mp_pck;
+    msgpack_unpacked result;
+    struct flb_time tm;
+    struct flb_pack_json_enc enc;
+
+    msgpack_sbuffer_init(&mp_sbuf);
+    msgpack_packer_init(&mp_pck, &mp_sbuf, msgpack_sbuffer_write);
+
+    /* Same output than the fixed buffer conversion */
+    memset(big, '\n', sizeof(big));
+    msgpack_pack_map(&mp_pck, 4);
+    msgpack_pack_str(&mp_pck, 3);
+    msgpack_pack_str_body(&mp_pck, "key", 3);
+    msgpack_pack_array(&mp_pck, 4);
+    msgpack_pack_int(&mp_pck, -1);
+    msgpack_pack_double(&mp_pck, 0.5);
+    msgpack_pack_nil(&mp_pck);
+    msgpack_pack_false(&mp_pck);
+    msgpack_pack_str(&mp_pck, 3);
+    msgpack_pack_str_body(&mp_pck, "a\"b", 3);
+    msgpack_pack_uint64(&mp_pck, 18446744073709551615ULL);
+    msgpack_pack_str(&mp_pck, 3);
+    msgpack_pack_str_body(&mp_pck, "big", 3);
+    msgpack_pack_str(&mp_pck, 300);
+    msgpack_pack_str_body(&mp_pck, big, 300);
+    msgpack_pack_str(&mp_pck, 0);
+    msgpack_pack_map(&mp_pck, 0);
+
+    msgpack_unpacked_init(&result);
+    msgpack_unpack_next(&result, mp_sbuf.data, mp_sbuf.size, &off);
+    ret = flb_msgpack_to_json(json, sizeof(json), &result.data);
+    TEST_CHECK(ret > 0);
+
+    /* start small so the buffer has to grow */
+    buf = flb_sds_create_size(1);
+    ret = flb_pack_json_enc_object(&buf, &result.data);
+    TEST_CHECK(ret == 0);
+    TEST_CHECK(strcmp(buf, json) == 0);
+    TEST_CHECK(flb_sds_len(buf) == strlen(json));
+    msgpack_unpacked_destroy(&result);
+    flb_sds_destroy(buf);
+
+    /* Records of a chunk */
+    msgpack_sbuffer_clear(&mp_sbuf);
+    for (i = 0; i < 2; i++) {
+        msgpack_pack_array(&mp_pck, 2);
+        flb_time_set(&tm, 1546300800, 123456789);
+        flb_time_append_to_msgpack(&tm, &mp_pck, 0);
+        msgpack_pack_map(&mp_pck, 1);
+        msgpack_pack_str(&mp_pck, 1);
+        msgpack_pack_str_body(&mp_pck, "k", 1);
+        msgpack_pack_int(&mp_pck, i);
+    }
+
+    ret = flb_pack_json_enc_init(&enc, FLB_PACK_JSON_FORMAT_JSON,
+                                 FLB_PACK_JSON_DATE_EPOCH, "date");
+    TEST_CHECK(ret == 0);
+    buf = flb_sds_create_size(1);
+    ret = flb_pack_json_enc_chunk(&enc, &buf, mp_sbuf.data, mp_sbuf.size);
+    TEST_CHECK(ret == 2);
+    TEST_CHECK(strcmp(buf, "[{\"date\":1546300800, \"k\":0}, "
+                      "{\"date\":1546300800, \"k\":1}]") == 0);
+    flb_pack_json_enc_destroy(&enc);
+    flb_sds_destroy(buf);
+
+    ret = flb_pack_json_enc_init(&enc, FLB_PACK_JSON_FORMAT_LINES,
+                                 FLB_PACK_JSON_DATE_ISO8601, "@t");
+    TEST_CHECK(ret == 0);
+    enc.cb_fields = json_enc_tag;
+    enc.cb_data = "x.y";
+    buf = flb_sds_create_size(1);
+    ret = flb_pack_json_enc_chunk(&enc, &buf, mp_sbuf.data, mp_sbuf.size);
+    TEST_CHECK(ret == 2);
+    TEST_CHECK(strcmp(buf,
+                      "{\"@t\":\"2019-01-01T00:00:00.123456Z\", "
+                      "\"tag\":\"x.y\", \"k\":0}\n"
+                      "{\"@t\":\"2019-01-01T00:00:00.123456Z\", "
+                      "\"tag\":\"x.y\", \"k\":1}\n") == 0);
+    flb_pack_json_enc_destroy(&enc);
+    flb_sds_destroy(buf);
+
+    ret = flb_pack_json_enc_init(&enc, FLB_PACK_JSON_FORMAT_STREAM,
+                                 FLB_PACK_JSON_DATE_DOUBLE, NULL);
+    TEST_CHECK(ret == 0);
+    buf = flb_sds_create_size(1);
+    ret = flb_pack_json_enc_chunk(&enc, &buf, mp_sbuf.data, mp_sbuf.size);
+    TEST_CHECK(ret == 2);
+    TEST_CHECK(strcmp(buf, "{\"k\":0} {\"k\":1}") == 0);
+    flb_pack_json_enc_destroy(&enc);
+    flb_sds_destroy(buf);
+
+    TEST_CHECK(flb_pack_to_json_format_type("json_lines") ==
+               FLB_PACK_JSON_FORMAT_LINES);
+    TEST_CHECK(flb_pack_to_json_date_type("iso8601") ==
+               FLB_PACK_JSON_DATE_ISO8601);
+    TEST_CHECK(flb_pack_to_json_date_type("unknown") == -1);
+
+    msgpack_sbuffer_destroy(&mp_sbuf);
+}
+
 TEST_LIST = {
     /* JSON maps iteration */
     { "json_pack", test_json_pack },
@@ -472,6 +772,13 @@ TEST_LIST = {
     { "json_pack_mult", test_json_pack_mult},
     { "json_pack_mult_iter", test_json_pack_mult_iter},
     { "json_pack_bug342", test_json_pack_bug342},
+    { "json_pack_stream", test_json_pack_stream},
+
+    /* Streaming JSON encoder */
+    { "json_enc", test_json_enc},
+
+    /* Serialized records validation */
+    { "mp_validate_records", test_mp_validate_records},
 
     /* Mixed bytes, check JSON encoding */
     { "utf8_to_json", test_utf8_to_json},
@@ -2,10 +2,12 @@
 
 #include <fluent-bit/flb_info.h>
 #include <fluent-bit/flb_mem.h>
+#include <fluent-bit/flb_str.h>
 #include <fluent-bit/flb_parser.h>
 #include <fluent-bit/flb_error.h>
 
 #include <time.h>
+#include <msgpack.h>
 #include "flb_tests_internal.h"
 
 /* Parsers configuration */
@@ -402,10 +404,213 @@ void test_regex_parser_time_lookup()
     flb_config_exit(config);
 }
 
+/* Lookup a string value in a map */
+static int map_str_cmp(msgpack_object *map, char *key, char *val)
+{
+    int i;
+    int len;
+    msgpack_object *k;
+    msgpack_object *v;
+
+    len = strlen(key);
+    for (i = 0; i < map->via.map.size; i++) {
+        k = &map->via.map.ptr[i].key;
+        v = &map->via.map.ptr[i].val;
+        if (k->via.str.size != len || strncmp(k->via.str.ptr, key, len) != 0) {
+            continue;
+        }
+        if (v->type != MSGPACK_OBJECT_STR ||
+            v->via.str.size != strlen(val)) {
+            return -1;
+        }
+        return strncmp(v->via.str.ptr, val, v->via.str.size);
+    }
+
+    return -1;
+}
+
+/*
+ * Named groups resolved at creation: time key, types and empty captures.
+ * Type casts write a terminator after the value, the input is mutable.
+ */
+void test_regex_parser_slots()
+{
+    int i;
+    int ret;
+    size_t off = 0;
+    void *out_buf;
+    size_t out_size;
+    char msg[128];
+    msgpack_object *map;
+    msgpack_object *val;
+    msgpack_sbuffer sbuf;
+    msgpack_packer pck;
+    msgpack_unpacked result;
+    struct flb_time out_time;
+    struct flb_parser *p;
+    struct flb_parser_types *types;
+    struct flb_config *config;
+
+    config = flb_config_init();
+
+    types = flb_malloc(sizeof(struct flb_parser_types));
+    types[0].key = flb_strdup("code");
+    types[0].key_len = 4;
+    types[0].type = FLB_PARSER_TYPE_INT;
+
+    p = flb_parser_create("access", "regex",
+                          "^(?<host>[^ ]+) (?<code>[^ ]+) (?<size>[^ ]*) "
+                          "(?<time>[^ ]+)$",
+                          "%Y-%m-%dT%H:%M:%S", NULL, NULL, FLB_FALSE,
+                          types, 1, NULL, config);
+    TEST_CHECK(p != NULL);
+    if (!p) {
+        flb_config_exit(config);
+        return;
+    }
+    TEST_CHECK(p->slots_len == 4);
+
+    /* empty 'size' is skipped, 'time' is not kept */
+    strcpy(msg, "example.org 200  2017-07-14T02:40:00");
+    ret = flb_parser_do(p, msg, strlen(msg), &out_buf, &out_size, &out_time);
+    TEST_CHECK(ret == strlen(msg));
+    TEST_CHECK(out_time.tm.tv_sec == 1500000000);
+
+    msgpack_unpacked_init(&result);
+    ret = msgpack_unpack_next(&result, out_buf, out_size, &off);
+    TEST_CHECK(ret == MSGPACK_UNPACK_SUCCESS);
+    map = &result.data;
+    TEST_CHECK(map->type == MSGPACK_OBJECT_MAP && map->via.map.size == 2);
+    TEST_CHECK(map_str_cmp(map, "host", "example.org") == 0);
+    val = NULL;
+    for (i = 0; i < map->via.map.size; i++) {
+        if (map->via.map.ptr[i].key.via.str.size == 4 &&
+            strncmp(map->via.map.ptr[i].key.via.str.ptr, "code", 4) == 0) {
+            val = &map->via.map.ptr[i].val;
+        }
+    }
+    TEST_CHECK(val != NULL && val->type == MSGPACK_OBJECT_POSITIVE_INTEGER &&
+               val->via.u64 == 200);
+    msgpack_unpacked_destroy(&result);
+
+    /* the caller packer gets the same record */
+    msgpack_sbuffer_init(&sbuf);
+    msgpack_packer_init(&pck, &sbuf, msgpack_sbuffer_write);
+    ret = flb_parser_do_pack(p, msg, strlen(msg), &pck, &out_time);
+    TEST_CHECK(ret == strlen(msg));
+    TEST_CHECK(sbuf.size == out_size &&
+               memcmp(sbuf.data, out_buf, out_size) == 0);
+    msgpack_sbuffer_destroy(&sbuf);
+    flb_free(out_buf);
+
+    /* time kept, an invalid time drops the key */
+    p->time_keep = FLB_TRUE;
+    strcpy(msg, "example.org 404 10 yesterday");
+    ret = flb_parser_do(p, msg, strlen(msg), &out_buf, &out_size, &out_time);
+    TEST_CHECK(ret == strlen(msg));
+    TEST_CHECK(out_time.tm.tv_sec == 0);
+
+    msgpack_unpacked_init(&result);
+    off = 0;
+    ret = msgpack_unpack_next(&result, out_buf, out_size, &off);
+    TEST_CHECK(ret == MSGPACK_UNPACK_SUCCESS);
+    map = &result.data;
+    TEST_CHECK(map->type == MSGPACK_OBJECT_MAP && map->via.map.size == 3);
+    TEST_CHECK(map_str_cmp(map, "size", "10") == 0);
+    msgpack_unpacked_destroy(&result);
+    flb_free(out_buf);
+
+    /* no match */
+    strcpy(msg, "example.org");
+    ret = flb_parser_do(p, msg, strlen(msg), &out_buf, &out_size, &out_time);
+    TEST_CHECK(ret == -1);
+
+    flb_parser_exit(config);
+    flb_config_exit(config);
+}
+
+/* Native syslog decoder */
+void test_syslog_parser()
+{
+    int ret;
+    size_t off = 0;
+    void *out_buf;
+    size_t out_size;
+    char *msg;
+    struct flb_time out_time;
+    struct flb_parser *p;
+    struct flb_config *config;
+    msgpack_unpacked result;
+
+    config = flb_config_init();
+    p = flb_parser_create("syslog", "syslog", NULL, NULL, NULL, NULL,
+                          FLB_FALSE, NULL, 0, NULL, config);
+    TEST_CHECK(p != NULL);
+    if (!p) {
+        flb_config_exit(config);
+        return;
+    }
+
+    /* RFC5424 */
+    msg = "<165>1 2003-10-11T22:14:15.003Z mymachine.example.com evntslog "
+        "1234 ID47 [exampleSDID@32473 iut=\"3\" eventID=\"10\"] "
+        "An application event";
+    ret = flb_parser_do(p, msg, strlen(msg), &out_buf, &out_size, &out_time);
+    TEST_CHECK(ret != -1);
+    TEST_CHECK(out_time.tm.tv_sec == 1065910455);
+    TEST_CHECK(out_time.tm.tv_nsec == 3000000);
+
+    msgpack_unpacked_init(&result);
+    off = 0;
+    ret = msgpack_unpack_next(&result, out_buf, out_size, &off);
+    TEST_CHECK(ret == MSGPACK_UNPACK_SUCCESS);
+    TEST_CHECK(map_str_cmp(&result.data, "pri", "165") == 0);
+    TEST_CHECK(map_str_cmp(&result.data, "host",
+                           "mymachine.example.com") == 0);
+    TEST_CHECK(map_str_cmp(&result.data, "ident", "evntslog") == 0);
+    TEST_CHECK(map_str_cmp(&result.data, "pid", "1234") == 0);
+    TEST_CHECK(map_str_cmp(&result.data, "msgid", "ID47") == 0);
+    TEST_CHECK(map_str_cmp(&result.data, "extradata",
+                           "[exampleSDID@32473 iut=\"3\" eventID=\"10\"]")
+               == 0);
+    TEST_CHECK(map_str_cmp(&result.data, "message",
+                           "An application event") == 0);
+    msgpack_unpacked_destroy(&result);
+    flb_free(out_buf);
+
+    /* RFC3164 */
+    msg = "<34>Oct 11 22:14:15 mymachine su[230]: 'su root' failed";
+    ret = flb_parser_do(p, msg, strlen(msg), &out_buf, &out_size, &out_time);
+    TEST_CHECK(ret != -1);
+
+    msgpack_unpacked_init(&result);
+    off = 0;
+    ret = msgpack_unpack_next(&result, out_buf, out_size, &off);
+    TEST_CHECK(ret == MSGPACK_UNPACK_SUCCESS);
+    TEST_CHECK(map_str_cmp(&result.data, "pri", "34") == 0);
+    TEST_CHECK(map_str_cmp(&result.data, "host", "mymachine") == 0);
+    TEST_CHECK(map_str_cmp(&result.data, "ident", "su") == 0);
+    TEST_CHECK(map_str_cmp(&result.data, "pid", "230") == 0);
+    TEST_CHECK(map_str_cmp(&result.data, "message",
+                           "'su root' failed") == 0);
+    msgpack_unpacked_destroy(&result);
+    flb_free(out_buf);
+
+    /* Invalid message */
+    msg = "no priority here";
+    ret = flb_parser_do(p, msg, strlen(msg), &out_buf, &out_size, &out_time);
+    TEST_CHECK(ret == -1);
+
+    flb_parser_exit(config);
+    flb_config_exit(config);
+}
+
 TEST_LIST = {
     { "tzone_offset", test_parser_tzone_offset},
     { "time_lookup", test_parser_time_lookup},
     { "json_time_lookup", test_json_parser_time_lookup},
     { "regex_time_lookup", test_regex_parser_time_lookup},
+    { "regex_slots", test_regex_parser_slots},
+    { "syslog", test_syslog_parser},
     { 0 }
 };
@@ -3,6 +3,7 @@
 #include <fluent-bit/flb_info.h>
 #include <fluent-bit/flb_mem.h>
 #include <fluent-bit/flb_utils.h>
+#include <fluent-bit/flb_sds.h>
 
 #include "flb_tests_internal.h"
 
@@ -110,8 +111,124 @@ void test_url_split()
     }
 }
 
+struct write_str_check {
+    char *str;      /* input string   */
+    char *out;      /* expected JSON  */
+};
+
+struct write_str_check write_str_checks[] = {
+    {"", ""},
+    {"plain ascii", "plain ascii"},
+    {"a\"b\\c", "a\\\"b\\\\c"},
+    {"\n\t\r\b\f", "\\n\\t\\r\\b\\f"},
+    {"\x01\x1f\x7f", "\\u0001\\u001f\\u007f"},
+    {"caf\xc3\xa9", "caf\\u00e9"},
+    {"\xe2\x82\xac 10", "\\u20ac 10"},
+    {"long line of plain text followed by \xc3\xb1 and \"quotes\"",
+     "long line of plain text followed by \\u00f1 and \\\"quotes\\\""},
+
+    /* invalid or truncated UTF-8: the rest of the string is skipped */
+    {"ab\xff cd", "ab"},
+    {"ab\xc3", "ab"},
+};
+
+static void check_write_str(char *str, size_t len, char *expected)
+{
+    int ret;
+    int off;
+    char buf[1024];
+
+    off = 0;
+    ret = flb_utils_write_str(buf, &off, sizeof(buf), str, len);
+    TEST_CHECK(ret == FLB_TRUE);
+    TEST_CHECK(off == strlen(expected));
+    TEST_CHECK(memcmp(buf, expected, off) == 0);
+    if (off != strlen(expected) || memcmp(buf, expected, off) != 0) {
+        TEST_MSG("expected '%s', got '%.*s'", expected, off, buf);
+    }
+}
+
+void test_write_str()
+{
+    int i;
+    int j;
+    int ret;
+    int off;
+    int len;
+    char buf[256];
+    char str[128];
+    char expected[256];
+    struct write_str_check *c;
+
+    for (i = 0; i < sizeof(write_str_checks) / sizeof(struct write_str_check); i++) {
+        c = &write_str_checks[i];
+        check_write_str(c->str, strlen(c->str), c->out);
+    }
+
+    /*
+     * A byte to escape at every position of strings of different lengths,
+     * covers the bulk copy of the vector and the word at a time scans.
+     */
+    for (len = 1; len < sizeof(str); len++) {
+        for (i = 0; i < len; i++) {
+            memset(str, 'x', len);
+            str[i] = '"';
+            memset(expected, 'x', len + 1);
+            expected[i] = '\\';
+            expected[i + 1] = '"';
+            expected[len + 1] = '\0';
+            check_write_str(str, len, expected);
+
+            if (i + 1 < len) {
+                str[i] = (char) 0xc3;
+                str[i + 1] = (char) 0xa9;
+                memset(expected, 'x', len + 4);
+                memcpy(expected + i, "\\u00e9", 6);
+                expected[len + 4] = '\0';
+                check_write_str(str, len, expected);
+            }
+        }
+    }
+
+    /* No room: the caller must get FLB_FALSE to grow the buffer */
+    memset(str, 'x', 64);
+    for (j = 0; j <= 64; j++) {
+        off = 0;
+        ret = flb_utils_write_str(buf, &off, j, str, 64);
+        TEST_CHECK(ret == FLB_FALSE);
+    }
+    off = 0;
+    ret = flb_utils_write_str(buf, &off, 6, "a\"b", 3);
+    TEST_CHECK(ret == FLB_TRUE && off == 4);
+    off = 0;
+    ret = flb_utils_write_str(buf, &off, 4, "a\"b", 3);
+    TEST_CHECK(ret == FLB_FALSE);
+}
+
+void test_sds_cat_utf8()
+{
+    int i;
+    flb_sds_t s;
+    struct write_str_check *c;
+
+    for (i = 0; i < sizeof(write_str_checks) / sizeof(struct write_str_check); i++) {
+        c = &write_str_checks[i];
+
+        s = flb_sds_create_size(4);
+        TEST_CHECK(s != NULL);
+        TEST_CHECK(flb_sds_cat_utf8(&s, c->str, strlen(c->str)) != NULL);
+        TEST_CHECK(strcmp(s, c->out) == 0);
+        if (strcmp(s, c->out) != 0) {
+            TEST_MSG("expected '%s', got '%s'", c->out, s);
+        }
+        flb_sds_destroy(s);
+    }
+}
+
 TEST_LIST = {
     /* JSON maps iteration */
     { "url_split", test_url_split },
+    { "write_str", test_write_str },
+    { "sds_cat_utf8", test_sds_cat_utf8 },
     { 0 }
 };
@@ -0,0 +1,398 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2019      The Fluent Bit Authors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <fluent-bit.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <zlib.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "flb_tests_runtime.h"
+
+#define TEST_PORT      "9881"
+#define TEST_MAX_SIZE  "8k"
+
+/* Test functions */
+void flb_test_in_http_json(void);
+void flb_test_in_http_ndjson(void);
+void flb_test_in_http_chunked(void);
+void flb_test_in_http_gzip(void);
+void flb_test_in_http_oversize(void);
+void flb_test_in_http_malformed(void);
+void flb_test_in_http_keepalive(void);
+
+/* Test list */
+TEST_LIST = {
+    {"json",       flb_test_in_http_json      },
+    {"ndjson",     flb_test_in_http_ndjson    },
+    {"chunked",    flb_test_in_http_chunked   },
+    {"gzip",       flb_test_in_http_gzip      },
+    {"oversize",   flb_test_in_http_oversize  },
+    {"malformed",  flb_test_in_http_malformed },
+    {"keepalive",  flb_test_in_http_keepalive },
+    {NULL, NULL}
+};
+
+/* Number of records received by the lib output */
+int records;
+
+int callback_test(void* data, size_t size, void* cb_data)
+{
+    if (size > 0) {
+        __sync_fetch_and_add(&records, 1);
+        flb_lib_free(data);
+    }
+    return 0;
+}
+
+static int get_records(void)
+{
+    return __sync_fetch_and_add(&records, 0);
+}
+
+static flb_ctx_t *http_start(void)
+{
+    int ret;
+    int in_ffd;
+    int out_ffd;
+    flb_ctx_t *ctx;
+    struct flb_lib_out_cb cb;
+
+    cb.cb   = callback_test;
+    cb.data = NULL;
+    __sync_lock_test_and_set(&records, 0);
+
+    ctx = flb_create();
+    flb_service_set(ctx, "Flush", "1", "Grace", "1", "Log_Level", "error",
+                    NULL);
+
+    in_ffd = flb_input(ctx, (char *) "http", NULL);
+    TEST_CHECK(in_ffd >= 0);
+    flb_input_set(ctx, in_ffd, "tag", "test",
+                  "listen", "127.0.0.1", "port", TEST_PORT,
+                  "buffer_chunk_size", "1k",
+                  "buffer_max_size", TEST_MAX_SIZE, NULL);
+
+    out_ffd = flb_output(ctx, (char *) "lib", &cb);
+    TEST_CHECK(out_ffd >= 0);
+    flb_output_set(ctx, out_ffd, "match", "*", NULL);
+
+    ret = flb_start(ctx);
+    TEST_CHECK(ret == 0);
+
+    return ctx;
+}
+
+static void http_stop(flb_ctx_t *ctx)
+{
+    flb_stop(ctx);
+    flb_destroy(ctx);
+}
+
+static int http_connect(void)
+{
+    int fd;
+    int ret;
+    struct sockaddr_in addr;
+
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    TEST_CHECK(fd != -1);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(atoi(TEST_PORT));
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+
+    ret = connect(fd, (struct sockaddr *) &addr, sizeof(addr));
+    TEST_CHECK(ret == 0);
+
+    return fd;
+}
+
+/* Send the request and return the status code of the response */
+static int http_send(int fd, char *req, size_t len)
+{
+    int status = -1;
+    ssize_t ret;
+    size_t total = 0;
+    char buf[512];
+
+    while (total < len) {
+        ret = write(fd, req + total, len - total);
+        if (ret <= 0) {
+            return -1;
+        }
+        total += ret;
+    }
+
+    /* The responses have no body */
+    total = 0;
+    while (total < sizeof(buf) - 1) {
+        ret = read(fd, buf + total, sizeof(buf) - 1 - total);
+        if (ret <= 0) {
+            break;
+        }
+        total += ret;
+        buf[total] = '\0';
+        if (strstr(buf, "\r\n\r\n")) {
+            break;
+        }
+    }
+
+    if (total > 0) {
+        sscanf(buf, "HTTP/1.1 %i", &status);
+    }
+    return status;
+}
+
+/* Send a request with a Content-Length body on a new connection */
+static int http_post(char *headers, char *body, size_t body_len)
+{
+    int fd;
+    int len;
+    int status;
+    char *req;
+
+    req = malloc(body_len + 512);
+    TEST_CHECK(req != NULL);
+
+    len = snprintf(req, 512,
+                   "POST / HTTP/1.1\r\n"
+                   "Host: localhost\r\n"
+                   "%s"
+                   "Content-Length: %lu\r\n"
+                   "\r\n", headers, (unsigned long) body_len);
+    memcpy(req + len, body, body_len);
+
+    fd = http_connect();
+    status = http_send(fd, req, len + body_len);
+    close(fd);
+    free(req);
+
+    return status;
+}
+
+void flb_test_in_http_json(void)
+{
+    int status;
+    char *body;
+    flb_ctx_t *ctx;
+
+    ctx = http_start();
+
+    body = "{\"key\": \"value\"}";
+    status = http_post("", body, strlen(body));
+    TEST_CHECK(status == 201);
+
+    /* The elements of an array are records */
+    body = "[{\"a\": 1}, {\"b\": 2}, {\"c\": 3}]";
+    status = http_post("Content-Type: application/json\r\n",
+                       body, strlen(body));
+    TEST_CHECK(status == 201);
+
+    sleep(2); /* waiting flush */
+    TEST_CHECK(get_records() == 4);
+
+    http_stop(ctx);
+}
+
+void flb_test_in_http_ndjson(void)
+{
+    int status;
+    char *body;
+    flb_ctx_t *ctx;
+
+    ctx = http_start();
+
+    body = "{\"a\": 1}\n{\"b\": 2}\n{\"c\": 3}";
+    status = http_post("Content-Type: application/x-ndjson\r\n",
+                       body, strlen(body));
+    TEST_CHECK(status == 201);
+
+    sleep(2); /* waiting flush */
+    TEST_CHECK(get_records() == 3);
+
+    http_stop(ctx);
+}
+
+void flb_test_in_http_chunked(void)
+{
+    int fd;
+    int status;
+    char *req;
+    flb_ctx_t *ctx;
+
+    ctx = http_start();
+
+    /* A record split across two chunks, plus a chunk extension */
+    req = "POST / HTTP/1.1\r\n"
+          "Host: localhost\r\n"
+          "Transfer-Encoding: chunked\r\n"
+          "\r\n"
+          "9\r\n{\"key\": \"\r\n"
+          "7;ext=1\r\nvalue\"}\r\n"
+          "0\r\n"
+          "\r\n";
+
+    fd = http_connect();
+    status = http_send(fd, req, strlen(req));
+    TEST_CHECK(status == 201);
+    close(fd);
+
+    sleep(2); /* waiting flush */
+    TEST_CHECK(get_records() == 1);
+
+    http_stop(ctx);
+}
+
+void flb_test_in_http_gzip(void)
+{
+    int ret;
+    int status;
+    char *body;
+    char gz[256];
+    z_stream strm;
+    flb_ctx_t *ctx;
+
+    body = "[{\"a\": 1}, {\"b\": 2}]";
+
+    memset(&strm, 0, sizeof(strm));
+    ret = deflateInit2(&strm, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+                       16 + MAX_WBITS, 8, Z_DEFAULT_STRATEGY);
+    TEST_CHECK(ret == Z_OK);
+    strm.next_in = (Bytef *) body;
+    strm.avail_in = strlen(body);
+    strm.next_out = (Bytef *) gz;
+    strm.avail_out = sizeof(gz);
+    ret = deflate(&strm, Z_FINISH);
+    TEST_CHECK(ret == Z_STREAM_END);
+    deflateEnd(&strm);
+
+    ctx = http_start();
+
+    status = http_post("Content-Encoding: gzip\r\n", gz, strm.total_out);
+    TEST_CHECK(status == 201);
+
+    /* Not a gzip stream */
+    status = http_post("Content-Encoding: gzip\r\n", body, strlen(body));
+    TEST_CHECK(status == 400);
+
+    sleep(2); /* waiting flush */
+    TEST_CHECK(get_records() == 2);
+
+    http_stop(ctx);
+}
+
+void flb_test_in_http_oversize(void)
+{
+    int fd;
+    int status;
+    char *req;
+    flb_ctx_t *ctx;
+
+    ctx = http_start();
+
+    /* The declared length exceeds buffer_max_size */
+    req = "POST / HTTP/1.1\r\n"
+          "Host: localhost\r\n"
+          "Content-Length: 65536\r\n"
+          "\r\n";
+    fd = http_connect();
+    status = http_send(fd, req, strlen(req));
+    TEST_CHECK(status == 413);
+    close(fd);
+
+    /* A chunk size that would wrap the length check */
+    req = "POST / HTTP/1.1\r\n"
+          "Host: localhost\r\n"
+          "Transfer-Encoding: chunked\r\n"
+          "\r\n"
+          "ffffffffffffffff\r\n";
+    fd = http_connect();
+    status = http_send(fd, req, strlen(req));
+    TEST_CHECK(status == 413);
+    close(fd);
+
+    sleep(2); /* waiting flush */
+    TEST_CHECK(get_records() == 0);
+
+    http_stop(ctx);
+}
+
+void flb_test_in_http_malformed(void)
+{
+    int fd;
+    int status;
+    char *req;
+    char *body;
+    flb_ctx_t *ctx;
+
+    ctx = http_start();
+
+    /* Invalid JSON body: no record of the request is ingested */
+    body = "[{\"a\": 1}, {\"b\": ]";
+    status = http_post("", body, strlen(body));
+    TEST_CHECK(status == 400);
+
+    /* Invalid request line */
+    req = "POST /\r\n\r\n";
+    fd = http_connect();
+    status = http_send(fd, req, strlen(req));
+    TEST_CHECK(status == 400);
+    close(fd);
+
+    sleep(2); /* waiting flush */
+    TEST_CHECK(get_records() == 0);
+
+    http_stop(ctx);
+}
+
+void flb_test_in_http_keepalive(void)
+{
+    int i;
+    int fd;
+    int len;
+    int status;
+    char req[256];
+    char *body;
+    flb_ctx_t *ctx;
+
+    ctx = http_start();
+
+    body = "{\"key\": \"value\"}";
+    len = snprintf(req, sizeof(req),
+                   "POST / HTTP/1.1\r\n"
+                   "Host: localhost\r\n"
+                   "Content-Length: %lu\r\n"
+                   "\r\n%s", (unsigned long) strlen(body), body);
+
+    /* Requests on the same connection */
+    fd = http_connect();
+    for (i = 0; i < 3; i++) {
+        status = http_send(fd, req, len);
+        TEST_CHECK(status == 201);
+    }
+    close(fd);
+
+    sleep(2); /* waiting flush */
+    TEST_CHECK(get_records() == 3);
+
+    http_stop(ctx);
+}
@@ -1,6 +1,7 @@
 /* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
 
 #include <fluent-bit.h>
+#include <glob.h>
 #include "flb_tests_runtime.h"
 
 /* Test data */
@@ -15,6 +16,8 @@ void flb_test_file_json_small(void);
 void flb_test_file_format_csv(void);
 void flb_test_file_format_ltsv(void);
 void flb_test_file_format_invalid(void);
+void flb_test_file_io_thread_rotate(void);
+void flb_test_file_reopen_removed(void);
 
 /* Test list */
 TEST_LIST = {
@@ -24,6 +27,8 @@ TEST_LIST = {
     {"format_csv",      flb_test_file_format_csv     },
     {"format_ltsv",     flb_test_file_format_ltsv    },
     {"format_invalid",  flb_test_file_format_invalid },
+    {"io_thread_rotate", flb_test_file_io_thread_rotate },
+    {"reopen_removed",  flb_test_file_reopen_removed },
     {NULL, NULL}
 };
 
@@ -312,3 +317,119 @@ void flb_test_file_format_invalid(void)
         remove(TEST_LOGFILE);
     }
 }
+
+/* Two flushes through the I/O thread, the second one rotates the file */
+void flb_test_file_io_thread_rotate(void)
+{
+    int i;
+    int ret;
+    int bytes;
+    char *p = (char *) JSON_SMALL;
+    flb_ctx_t *ctx;
+    int in_ffd;
+    int out_ffd;
+    FILE *fp;
+    glob_t rotated;
+
+    remove(TEST_LOGFILE);
+
+    ctx = flb_create();
+    flb_service_set(ctx, "Flush", "1", "Grace", "1", "Log_Level", "error", NULL);
+
+    in_ffd = flb_input(ctx, (char *) "lib", NULL);
+    TEST_CHECK(in_ffd >= 0);
+    flb_input_set(ctx, in_ffd, "tag", "test", NULL);
+
+    out_ffd = flb_output(ctx, (char *) "file", NULL);
+    TEST_CHECK(out_ffd >= 0);
+    flb_output_set(ctx, out_ffd, "match", "test", NULL);
+    flb_output_set(ctx, out_ffd, "Path", TEST_LOGFILE, NULL);
+    flb_output_set(ctx, out_ffd, "IO_Thread", "on", NULL);
+    flb_output_set(ctx, out_ffd, "Rotate_Size", "1", NULL);
+
+    ret = flb_start(ctx);
+    TEST_CHECK(ret == 0);
+
+    for (i = 0; i < (int) sizeof(JSON_SMALL) - 1; i++) {
+        bytes = flb_lib_push(ctx, in_ffd, p + i, 1);
+        TEST_CHECK(bytes == 1);
+    }
+
+    sleep(2); /* waiting flush */
+
+    bytes = flb_lib_push(ctx, in_ffd, p, sizeof(JSON_SMALL) - 1);
+    TEST_CHECK(bytes == sizeof(JSON_SMALL) - 1);
+
+    sleep(2); /* waiting flush */
+
+    flb_stop(ctx);
+    flb_destroy(ctx);
+
+    fp = fopen(TEST_LOGFILE, "r");
+    TEST_CHECK(fp != NULL);
+    if (fp != NULL) {
+        fclose(fp);
+        remove(TEST_LOGFILE);
+    }
+
+    ret = glob(TEST_LOGFILE ".*", 0, NULL, &rotated);
+    TEST_CHECK(ret == 0 && rotated.gl_pathc == 1);
+    if (ret == 0) {
+        for (i = 0; i < (int) rotated.gl_pathc; i++) {
+            remove(rotated.gl_pathv[i]);
+        }
+        globfree(&rotated);
+    }
+}
+
+/* The file is removed between two flushes, the second one creates it again */
+void flb_test_file_reopen_removed(void)
+{
+    int ret;
+    int bytes;
+    char *p = (char *) JSON_SMALL;
+    flb_ctx_t *ctx;
+    int in_ffd;
+    int out_ffd;
+    FILE *fp;
+
+    remove(TEST_LOGFILE);
+
+    ctx = flb_create();
+    flb_service_set(ctx, "Flush", "1", "Grace", "1", "Log_Level", "error", NULL);
+
+    in_ffd = flb_input(ctx, (char *) "lib", NULL);
+    TEST_CHECK(in_ffd >= 0);
+    flb_input_set(ctx, in_ffd, "tag", "test", NULL);
+
+    out_ffd = flb_output(ctx, (char *) "file", NULL);
+    TEST_CHECK(out_ffd >= 0);
+    flb_output_set(ctx, out_ffd, "match", "test", NULL);
+    flb_output_set(ctx, out_ffd, "Path", TEST_LOGFILE, NULL);
+
+    ret = flb_start(ctx);
+    TEST_CHECK(ret == 0);
+
+    bytes = flb_lib_push(ctx, in_ffd, p, sizeof(JSON_SMALL) - 1);
+    TEST_CHECK(bytes == sizeof(JSON_SMALL) - 1);
+
+    sleep(2); /* waiting flush */
+
+    ret = remove(TEST_LOGFILE);
+    TEST_CHECK(ret == 0);
+
+    bytes = flb_lib_push(ctx, in_ffd, p, sizeof(JSON_SMALL) - 1);
+    TEST_CHECK(bytes == sizeof(JSON_SMALL) - 1);
+
+    sleep(2); /* waiting flush */
+
+    flb_stop(ctx);
+    flb_destroy(ctx);
+
+    fp = fopen(TEST_LOGFILE, "r");
+    TEST_CHECK(fp != NULL);
+    if (fp != NULL) {
+        fclose(fp);
+        remove(TEST_LOGFILE);
+    }
+}